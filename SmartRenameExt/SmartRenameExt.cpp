@@ -3,6 +3,7 @@
 #include <SmartRenameUI.h>
 #include <SmartRenameItem.h>
 #include <SmartRenameManager.h>
+#include <SmartRenameLinearRegEx.h>
 #include <Helpers.h>
 #include <Settings.h>
 #include "resource.h"
@@ -148,6 +149,23 @@ DWORD WINAPI CSmartRenameMenu::s_SmartRenameUIThreadProc(_In_ void* pData)
         CComPtr<ISmartRenameManager> spsrm;
         if (SUCCEEDED(CSmartRenameManager::s_CreateInstance(&spsrm)))
         {
+            // Use the linear time regular expression engine if it has been turned on
+            if (CSettings::GetUseLinearRegEx())
+            {
+                CComPtr<ISmartRenameRegEx> spsrre;
+                if (SUCCEEDED(CSmartRenameLinearRegEx::s_CreateInstance(&spsrre)))
+                {
+                    spsrm->put_renameRegEx(spsrre);
+                }
+            }
+
+            // Keep one slow name from holding up the preview
+            CComPtr<ISmartRenameRegEx> spsrre;
+            if (SUCCEEDED(spsrm->get_renameRegEx(&spsrre)))
+            {
+                spsrre->put_timeLimit(CSettings::GetRegExTimeLimit());
+            }
+
             // Create the factory for our items
             CComPtr<ISmartRenameItemFactory> spsrif;
             if (SUCCEEDED(CSmartRenameItem::s_CreateInstance(nullptr, IID_PPV_ARGS(&spsrif))))
@@ -0,0 +1,164 @@
+#include "AhoCorasick.h"
+#include <algorithm>
+#include <cstring>
+#include <cwctype>
+#include <queue>
+
+const size_t CAhoCorasick::npos;
+
+CAhoCorasick::CAhoCorasick()
+{
+    // Root state
+    m_states.emplace_back();
+}
+
+void CAhoCorasick::AddPattern(const wchar_t* search, size_t searchLength, const wchar_t* replace, size_t replaceLength, bool caseSensitive, bool matchAll)
+{
+    if (searchLength == 0)
+    {
+        return;
+    }
+
+    Pattern pattern;
+    pattern.search.assign(search, searchLength);
+    pattern.replace.assign(replace, replaceLength);
+    pattern.caseSensitive = caseSensitive;
+    pattern.matchAll = matchAll;
+    m_patterns.push_back(pattern);
+
+    size_t state = 0;
+    for (size_t i = 0; i < searchLength; i++)
+    {
+        wchar_t c = s_Fold(search[i]);
+        auto it = m_states[state].next.find(c);
+        if (it == m_states[state].next.end())
+        {
+            m_states.emplace_back();
+            size_t added = m_states.size() - 1;
+            m_states[state].next[c] = added;
+            state = added;
+        }
+        else
+        {
+            state = it->second;
+        }
+    }
+
+    m_states[state].outputs.push_back(m_patterns.size() - 1);
+}
+
+void CAhoCorasick::Build()
+{
+    // Breadth first so every fail target is finished before it is used
+    std::queue<size_t> pending;
+    for (auto& child : m_states[0].next)
+    {
+        m_states[child.second].fail = 0;
+        m_states[child.second].outputLink = npos;
+        pending.push(child.second);
+    }
+
+    while (!pending.empty())
+    {
+        size_t state = pending.front();
+        pending.pop();
+
+        for (auto& child : m_states[state].next)
+        {
+            wchar_t c = child.first;
+            size_t target = child.second;
+
+            size_t fail = m_states[state].fail;
+            while (fail != 0 && m_states[fail].next.find(c) == m_states[fail].next.end())
+            {
+                fail = m_states[fail].fail;
+            }
+
+            auto it = m_states[fail].next.find(c);
+            fail = (it != m_states[fail].next.end() && it->second != target) ? it->second : 0;
+
+            m_states[target].fail = fail;
+            m_states[target].outputLink = m_states[fail].outputs.empty() ? m_states[fail].outputLink : fail;
+            pending.push(target);
+        }
+    }
+}
+
+bool CAhoCorasick::Replace(const wchar_t* text, size_t length, std::wstring& result) const
+{
+    result.clear();
+
+    // Collect every match as (start, pattern) in one pass over the name
+    std::vector<std::pair<size_t, size_t>> matches;
+    size_t state = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        wchar_t c = s_Fold(text[i]);
+        for (;;)
+        {
+            auto it = m_states[state].next.find(c);
+            if (it != m_states[state].next.end())
+            {
+                state = it->second;
+                break;
+            }
+
+            if (state == 0)
+            {
+                break;
+            }
+            state = m_states[state].fail;
+        }
+
+        size_t output = m_states[state].outputs.empty() ? m_states[state].outputLink : state;
+        while (output != npos)
+        {
+            for (size_t index : m_states[output].outputs)
+            {
+                const Pattern& pattern = m_patterns[index];
+                size_t start = i + 1 - pattern.search.length();
+                if (!pattern.caseSensitive ||
+                    memcmp(text + start, pattern.search.c_str(), pattern.search.length() * sizeof(wchar_t)) == 0)
+                {
+                    matches.push_back(std::make_pair(start, index));
+                }
+            }
+            output = m_states[output].outputLink;
+        }
+    }
+
+    if (matches.empty())
+    {
+        result.assign(text, length);
+        return false;
+    }
+
+    // Leftmost match first, and the earliest added rule for matches that start together
+    std::sort(matches.begin(), matches.end());
+
+    std::vector<bool> used(m_patterns.size(), false);
+    bool replaced = false;
+    size_t copied = 0;
+    for (const auto& match : matches)
+    {
+        const Pattern& pattern = m_patterns[match.second];
+        if (match.first < copied || (used[match.second] && !pattern.matchAll))
+        {
+            continue;
+        }
+
+        result.append(text + copied, match.first - copied);
+        result.append(pattern.replace);
+        copied = match.first + pattern.search.length();
+        used[match.second] = true;
+        replaced = true;
+    }
+
+    result.append(text + copied, length - copied);
+    return replaced;
+}
+
+wchar_t CAhoCorasick::s_Fold(wchar_t c)
+{
+    return static_cast<wchar_t>(towlower(c));
+}
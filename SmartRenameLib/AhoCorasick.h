@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Applies a list of literal search and replace rules to a name in one scan.
+//
+// All search terms go into a single Aho-Corasick automaton built over case
+// folded characters so every rule is found in one pass over the name.  Case
+// sensitive rules are confirmed against the original text when they match.
+// Matches are replaced left to right without overlapping.  When two rules
+// match at the same position the one added first wins.
+//
+// This file has no Windows dependencies so it can be built and tested on any
+// platform.
+class CAhoCorasick
+{
+public:
+    CAhoCorasick();
+
+    // Adds a rule.  Empty search terms are ignored.  Call Build once every rule has been added.
+    void AddPattern(const wchar_t* search, size_t searchLength, const wchar_t* replace, size_t replaceLength, bool caseSensitive, bool matchAll);
+    void Build();
+
+    size_t GetPatternCount() const { return m_patterns.size(); }
+
+    // Returns true if any rule matched
+    bool Replace(const wchar_t* text, size_t length, std::wstring& result) const;
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+private:
+    struct Pattern
+    {
+        std::wstring search;
+        std::wstring replace;
+        bool caseSensitive;
+        bool matchAll;
+    };
+
+    struct State
+    {
+        std::unordered_map<wchar_t, size_t> next;
+        size_t fail = 0;
+        size_t outputLink = npos;       // Nearest state on the fail chain with outputs
+        std::vector<size_t> outputs;    // Patterns ending here, in the order they were added
+    };
+
+    static wchar_t s_Fold(wchar_t c);
+
+    std::vector<Pattern> m_patterns;
+    std::vector<State> m_states;
+};
@@ -0,0 +1,136 @@
+#include "FolderWalker.h"
+#include <system_error>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+bool CFileSystemFolderLister::ListFolder(const std::filesystem::path& folder, std::vector<FOLDER_WALK_NODE<std::filesystem::path>>& children)
+{
+    std::error_code error;
+    std::filesystem::directory_iterator it(folder, error);
+    for (; !error && it != std::filesystem::directory_iterator(); it.increment(error))
+    {
+        FOLDER_WALK_NODE<std::filesystem::path> node;
+        node.entry = it->path();
+        std::error_code typeError;
+        node.isFolder = it->is_directory(typeError) && !it->is_symlink(typeError);
+        children.push_back(std::move(node));
+    }
+    return !error;
+}
+
+#ifdef __linux__
+// The layout getdents64 writes, which glibc does not declare
+struct LINUX_DIRENT64
+{
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+bool CDirentFolderLister::ListFolder(const std::filesystem::path& folder, std::vector<FOLDER_WALK_NODE<std::filesystem::path>>& children)
+{
+    int fd = open(folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    char buffer[32 * 1024];
+    long read = 0;
+    while ((read = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (long offset = 0; offset < read;)
+        {
+            const LINUX_DIRENT64* entry = reinterpret_cast<const LINUX_DIRENT64*>(buffer + offset);
+            offset += entry->d_reclen;
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            {
+                continue;
+            }
+
+            FOLDER_WALK_NODE<std::filesystem::path> node;
+            node.entry = folder / entry->d_name;
+            node.isFolder = (entry->d_type == DT_DIR);
+            if (entry->d_type == DT_UNKNOWN)
+            {
+                // Not every file system reports types
+                struct stat status;
+                node.isFolder = fstatat(fd, entry->d_name, &status, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(status.st_mode);
+            }
+            children.push_back(std::move(node));
+        }
+    }
+
+    close(fd);
+    return read == 0;
+}
+#endif
+
+#ifdef _WIN32
+bool CWin32FolderLister::ListFolder(const PATH_ITEM& folder, std::vector<FOLDER_WALK_NODE<PATH_ITEM>>& children)
+{
+    PATH_ITEM pattern = MakeChildPathItem(folder, L"*", 1);
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileExW(pattern.path.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        // Nothing at all matched, not even . and .. (ex: the root of an empty drive)
+        DWORD error = GetLastError();
+        if (error == ERROR_FILE_NOT_FOUND)
+        {
+            return true;
+        }
+
+        unsigned long none = 0;
+        m_error.compare_exchange_strong(none, error);
+        return false;
+    }
+
+    do
+    {
+        PCWSTR name = data.cFileName;
+        if (wcscmp(name, L".") == 0 || wcscmp(name, L"..") == 0)
+        {
+            continue;
+        }
+
+        DWORD attributes = data.dwFileAttributes;
+        if ((attributes & FILE_ATTRIBUTE_HIDDEN) &&
+            (!m_includeHidden || ((attributes & FILE_ATTRIBUTE_SYSTEM) && !m_includeSuperHidden)))
+        {
+            continue;
+        }
+
+        FOLDER_WALK_NODE<PATH_ITEM> node;
+        node.entry = MakeChildPathItem(folder, name, wcslen(name));
+        // Links and junctions point elsewhere, but other reparse points (ex: cloud
+        // placeholders) are ordinary folders.  dwReserved0 holds the reparse tag.
+        node.isFolder = (attributes & FILE_ATTRIBUTE_DIRECTORY) &&
+            !((attributes & FILE_ATTRIBUTE_REPARSE_POINT) && IsReparseTagNameSurrogate(data.dwReserved0));
+        children.push_back(std::move(node));
+    } while (FindNextFileW(find, &data));
+
+    DWORD error = GetLastError();
+    FindClose(find);
+    if (error != ERROR_NO_MORE_FILES)
+    {
+        unsigned long none = 0;
+        m_error.compare_exchange_strong(none, error);
+        return false;
+    }
+    return true;
+}
+#endif
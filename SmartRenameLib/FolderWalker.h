@@ -0,0 +1,323 @@
+#pragma once
+#include "PathItem.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// An entry found by a folder walk.  A folder holds its contents once it has been
+// listed.
+template <typename TEntry>
+struct FOLDER_WALK_NODE
+{
+    TEntry entry;
+    bool isFolder = false;
+    bool listed = false;        // Set by the walker once children is filled in
+    std::vector<FOLDER_WALK_NODE> children;
+};
+
+// Lists folder trees on a pool of threads.
+//
+// Idle workers take the next folder from a shared queue.  A worker keeps the first
+// subfolder of each folder it lists for itself and queues the rest, so a deep tree
+// stays on one thread until another worker runs dry and steals from the queue.
+// The results are kept as a tree, so Visit reports them in the same depth-first,
+// parent-before-child order a single threaded walk would have.  WalkAndVisit reports
+// them in that order while the walk is still going, so callers can use the first
+// items long before the last folder is listed.
+//
+// TLister lists one folder and is called from every worker at once:
+//     // Returns true if OnWorkerStop should be called when the worker exits
+//     bool OnWorkerStart();
+//     void OnWorkerStop();
+//     // Appends the contents of folder.  Returning false leaves the folder empty
+//     // and the walk carries on with the others.
+//     bool ListFolder(const TEntry& folder, std::vector<FOLDER_WALK_NODE<TEntry>>& children);
+//
+// This file has no Windows dependencies so it can be built and tested on any
+// platform.
+template <typename TEntry>
+class CFolderWalker
+{
+public:
+    typedef FOLDER_WALK_NODE<TEntry> NODE;
+
+    // Lists the folders in nodes and everything below them.  Nodes are at depth 0
+    // and folders are only listed if their contents would be above maxDepth.
+    template <typename TLister>
+    static void Walk(TLister& lister, std::vector<NODE>& nodes, unsigned int maxDepth, unsigned int threadCount)
+    {
+        WALK_STATE state;
+        std::vector<std::thread> threads = s_StartWorkers(lister, state, nodes, maxDepth, threadCount);
+        s_JoinWorkers(threads);
+    }
+
+    // Walks like Walk and calls visit(node, depth) for every node in the order Visit
+    // would, on the calling thread, while the workers list the folders ahead of it.
+    // A folder's contents are visited as soon as it has been listed, so visit must
+    // not look at the children of the node it is given.  If visit returns false the
+    // folders not yet listed are dropped, the walk stops once the ones being listed
+    // are done, and false is returned.
+    template <typename TLister, typename TVisitor>
+    static bool WalkAndVisit(TLister& lister, std::vector<NODE>& nodes, unsigned int maxDepth, unsigned int threadCount, TVisitor&& visit)
+    {
+        WALK_STATE state;
+        std::vector<std::thread> threads = s_StartWorkers(lister, state, nodes, maxDepth, threadCount);
+        bool visited = s_VisitListed(state, nodes, visit, 0);
+        if (!visited)
+        {
+            s_Cancel(state);
+        }
+
+        s_JoinWorkers(threads);
+        return visited;
+    }
+
+    // Calls visit(node, depth) for every node in depth-first order, each folder
+    // before its contents.  Stops and returns false as soon as visit does.
+    template <typename TVisitor>
+    static bool Visit(const std::vector<NODE>& nodes, TVisitor&& visit, unsigned int depth = 0)
+    {
+        for (const NODE& node : nodes)
+        {
+            if (!visit(node, depth) || !Visit(node.children, visit, depth + 1))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    struct FOLDER_WORK
+    {
+        NODE* folder;
+        unsigned int depth;
+    };
+
+    struct WALK_STATE
+    {
+        std::mutex lock;
+        std::condition_variable wake;
+        std::condition_variable listed;     // A folder was listed, for WalkAndVisit
+        std::deque<FOLDER_WORK> queue;
+        size_t pending = 0;         // Folders queued or being listed
+        unsigned int maxDepth = 0;
+        bool canceled = false;
+    };
+
+    template <typename TLister>
+    static std::vector<std::thread> s_StartWorkers(TLister& lister, WALK_STATE& state, std::vector<NODE>& nodes, unsigned int maxDepth, unsigned int threadCount)
+    {
+        state.maxDepth = maxDepth;
+        for (NODE& node : nodes)
+        {
+            if (s_IsListed(node, 0, maxDepth))
+            {
+                state.queue.push_back({ &node, 0 });
+            }
+        }
+
+        // Start every worker even for a single folder.  The ones with nothing to do
+        // wait on the queue for the subfolders the others find.
+        state.pending = state.queue.size();
+        threadCount = (std::max)(1u, threadCount);
+
+        std::vector<std::thread> threads;
+        if (state.pending > 0)
+        {
+            threads.reserve(threadCount);
+            for (unsigned int i = 0; i < threadCount; i++)
+            {
+                threads.emplace_back(s_RunWorker<TLister>, std::ref(lister), std::ref(state));
+            }
+        }
+        return threads;
+    }
+
+    static void s_JoinWorkers(std::vector<std::thread>& threads)
+    {
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    // Whether the walk lists a folder found at depth
+    static bool s_IsListed(const NODE& node, unsigned int depth, unsigned int maxDepth)
+    {
+        return node.isFolder && depth + 1 < maxDepth;
+    }
+
+    template <typename TVisitor>
+    static bool s_VisitListed(WALK_STATE& state, std::vector<NODE>& nodes, TVisitor& visit, unsigned int depth)
+    {
+        for (NODE& node : nodes)
+        {
+            if (!visit(node, depth))
+            {
+                return false;
+            }
+
+            if (s_IsListed(node, depth, state.maxDepth))
+            {
+                {
+                    std::unique_lock<std::mutex> lock(state.lock);
+                    state.listed.wait(lock, [&node] { return node.listed; });
+                }
+
+                if (!s_VisitListed(state, node.children, visit, depth + 1))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Drops the queued folders.  Workers finish the folders they are listing and
+    // don't queue what is in them.
+    static void s_Cancel(WALK_STATE& state)
+    {
+        std::lock_guard<std::mutex> lock(state.lock);
+        state.canceled = true;
+        state.pending -= state.queue.size();
+        state.queue.clear();
+        if (state.pending == 0)
+        {
+            state.wake.notify_all();
+        }
+    }
+
+    template <typename TLister>
+    static void s_RunWorker(TLister& lister, WALK_STATE& state)
+    {
+        bool started = lister.OnWorkerStart();
+
+        std::unique_lock<std::mutex> lock(state.lock);
+        for (;;)
+        {
+            state.wake.wait(lock, [&state] { return !state.queue.empty() || state.pending == 0; });
+            if (state.queue.empty())
+            {
+                break;
+            }
+
+            FOLDER_WORK work = state.queue.front();
+            state.queue.pop_front();
+            lock.unlock();
+
+            // Follow the first subfolder of each folder down without going back to
+            // the queue
+            while (work.folder)
+            {
+                if (!lister.ListFolder(work.folder->entry, work.folder->children))
+                {
+                    work.folder->children.clear();
+                }
+
+                FOLDER_WORK next = { nullptr, work.depth + 1 };
+                size_t queued = 0;
+                lock.lock();
+                work.folder->listed = true;
+                state.listed.notify_one();
+                if (!state.canceled)
+                {
+                    for (NODE& child : work.folder->children)
+                    {
+                        if (!s_IsListed(child, next.depth, state.maxDepth))
+                        {
+                            continue;
+                        }
+
+                        if (next.folder == nullptr)
+                        {
+                            next.folder = &child;
+                        }
+                        else
+                        {
+                            state.queue.push_back({ &child, next.depth });
+                            queued++;
+                        }
+                    }
+                }
+
+                // This folder is done and the one kept for this worker takes its place
+                state.pending += queued;
+                if (next.folder == nullptr && --state.pending == 0)
+                {
+                    state.wake.notify_all();
+                }
+                else if (queued > 0)
+                {
+                    (queued == 1) ? state.wake.notify_one() : state.wake.notify_all();
+                }
+                lock.unlock();
+
+                work = next;
+            }
+
+            lock.lock();
+        }
+        lock.unlock();
+
+        if (started)
+        {
+            lister.OnWorkerStop();
+        }
+    }
+};
+
+// Lists folders with std::filesystem.  Symbolic links are not followed.
+class CFileSystemFolderLister
+{
+public:
+    bool OnWorkerStart() { return false; }
+    void OnWorkerStop() {}
+    bool ListFolder(const std::filesystem::path& folder, std::vector<FOLDER_WALK_NODE<std::filesystem::path>>& children);
+};
+
+#ifdef __linux__
+// Lists folders with getdents64, which returns many entries per call along with
+// their types so most entries need no stat.  Symbolic links are not followed.
+class CDirentFolderLister
+{
+public:
+    bool OnWorkerStart() { return false; }
+    void OnWorkerStop() {}
+    bool ListFolder(const std::filesystem::path& folder, std::vector<FOLDER_WALK_NODE<std::filesystem::path>>& children);
+};
+#endif
+
+#ifdef _WIN32
+// Lists folders with FindFirstFileEx, which returns every entry's name and attributes
+// at once so nothing is looked up per entry.  Symbolic links and junctions are not
+// followed.  Hidden entries are left out unless includeHidden is set, and ones
+// that are also system files unless includeSuperHidden is set too, the way Explorer
+// shows them.
+class CWin32FolderLister
+{
+public:
+    CWin32FolderLister(bool includeHidden, bool includeSuperHidden) :
+        m_includeHidden(includeHidden),
+        m_includeSuperHidden(includeSuperHidden)
+    {
+    }
+
+    bool OnWorkerStart() { return false; }
+    void OnWorkerStop() {}
+    bool ListFolder(const PATH_ITEM& folder, std::vector<FOLDER_WALK_NODE<PATH_ITEM>>& children);
+
+    // The Win32 error of the first folder that could not be listed, or 0
+    unsigned long GetError() const { return m_error.load(); }
+
+private:
+    bool m_includeHidden;
+    bool m_includeSuperHidden;
+    std::atomic<unsigned long> m_error{ 0 };
+};
+#endif
@@ -1,6 +1,11 @@
 #include "stdafx.h"
 #include "Helpers.h"
+#include "FolderWalker.h"
+#include "PathItem.h"
 #include <ShlGuid.h>
+#include <shlobj.h>
+#include <string>
+#include <thread>
 
 HRESULT GetIconIndexFromPath(_In_ PCWSTR path, _Out_ int* index)
 {
@@ -90,68 +95,237 @@ HBITMAP CreateBitmapFromIcon(_In_ HICON hIcon, _In_opt_ UINT width, _In_opt_ UIN
     return hBitmapResult;
 }
 
-HRESULT _ParseEnumItems(_In_ IEnumShellItems* pesi, _In_ ISmartRenameManager* psrm, _In_ int depth = 0)
+// Items a folder is listed into from each IEnumShellItems::Next call
+const ULONG c_enumBatchSize = 64;
+
+// We shouldn't get this deep since we only enum the contents of regular folders but
+// adding just in case
+const unsigned int c_maxEnumDepth = MAX_PATH / 2;
+
+// Items handed to the manager per AddItems call while enumerating
+const size_t c_addItemsBatchSize = 256;
+
+// Longest the items found are held back from the manager before a batch fills up (ms)
+const ULONGLONG c_addItemsInterval = 50;
+
+// Listing folders is mostly waiting on the disk, and a handful of threads already
+// keeps most drives busy
+const unsigned int c_maxEnumThreads = 8;
+
+typedef CFolderWalker<CComPtr<IShellItem>> CShellFolderWalker;
+typedef CFolderWalker<PATH_ITEM> CPathFolderWalker;
+
+// Lists shell folders for CShellFolderWalker.  Shell items are free threaded, so the
+// items found on the walker's threads are used from the caller's afterwards.  Only
+// used for selections outside the file system, which CWin32FolderLister can't list.
+class CShellFolderLister
 {
-    HRESULT hr = E_INVALIDARG;
+public:
+    bool OnWorkerStart()
+    {
+        return SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED));
+    }
+
+    void OnWorkerStop()
+    {
+        CoUninitialize();
+    }
 
-    // We shouldn't get this deep since we only enum the contents of
-    // regular folders but adding just in case
-    if ((pesi) && (depth < (MAX_PATH / 2)))
+    bool ListFolder(_In_ const CComPtr<IShellItem>& folder, _Inout_ std::vector<CShellFolderWalker::NODE>& children)
     {
-        hr = S_OK;
+        // Bind to the IShellItem for the IEnumShellItems interface
+        CComPtr<IEnumShellItems> spesi;
+        HRESULT hr = folder->BindToHandler(nullptr, BHID_EnumItems, IID_PPV_ARGS(&spesi));
+        if (SUCCEEDED(hr))
+        {
+            hr = s_ListItems(spesi, children);
+        }
 
-        ULONG celtFetched;
-        CComPtr<IShellItem> spsi;
-        while ((S_OK == pesi->Next(1, &spsi, &celtFetched)) && (SUCCEEDED(hr)))
+        if (FAILED(hr))
         {
-            CComPtr<ISmartRenameItemFactory> spsrif;
-            hr = psrm->get_renameItemFactory(&spsrif);
-            if (SUCCEEDED(hr))
+            InterlockedCompareExchange(&m_error, hr, S_OK);
+        }
+        return SUCCEEDED(hr);
+    }
+
+    // The first folder that could not be listed
+    HRESULT GetError() { return m_error; }
+
+    static HRESULT s_ListItems(_In_ IEnumShellItems* pesi, _Inout_ std::vector<CShellFolderWalker::NODE>& items)
+    {
+        // Next returns S_FALSE once it runs out of items
+        HRESULT hr = S_OK;
+        do
+        {
+            IShellItem* batch[c_enumBatchSize] = {};
+            ULONG fetched = 0;
+            hr = pesi->Next(ARRAYSIZE(batch), batch, &fetched);
+            for (ULONG i = 0; SUCCEEDED(hr) && i < fetched; i++)
             {
-                CComPtr<ISmartRenameItem> spNewItem;
-                hr = spsrif->Create(spsi, &spNewItem);
-                if (SUCCEEDED(hr))
-                {
-                    spNewItem->put_depth(depth);
-                    hr = psrm->AddItem(spNewItem);
-                }
+                CShellFolderWalker::NODE node;
+                node.entry.Attach(batch[i]);
 
-                if (SUCCEEDED(hr))
-                {
-                    bool isFolder = false;
-                    if (SUCCEEDED(spNewItem->get_isFolder(&isFolder)) && isFolder)
-                    {
-                        // Bind to the IShellItem for the IEnumShellItems interface
-                        CComPtr<IEnumShellItems> spesiNext;
-                        hr = spsi->BindToHandler(nullptr, BHID_EnumItems, IID_PPV_ARGS(&spesiNext));
-                        if (SUCCEEDED(hr))
-                        {
-                            // Parse the folder contents recursively
-                            hr = _ParseEnumItems(spesiNext, psrm, depth + 1);
-                        }
-                    }
-                }
+                // Some items can be both folders and streams (ex: zip folders).
+                SFGAOF att = 0;
+                node.isFolder = SUCCEEDED(node.entry->GetAttributes(SFGAO_STREAM | SFGAO_FOLDER, &att)) && (att & SFGAO_FOLDER) && !(att & SFGAO_STREAM);
+                items.push_back(std::move(node));
             }
+        } while (hr == S_OK);
+
+        return SUCCEEDED(hr) ? S_OK : hr;
+    }
 
-            spsi = nullptr;
+private:
+    volatile LONG m_error = S_OK;
+};
+
+// The file system paths of the selection, or false if any item has none.  These are
+// the only items whose paths come from the shell.
+bool _GetSelectionPaths(_In_ const std::vector<CShellFolderWalker::NODE>& selection, _Out_ std::vector<CPathFolderWalker::NODE>& nodes)
+{
+    nodes.clear();
+    nodes.reserve(selection.size());
+    for (const CShellFolderWalker::NODE& item : selection)
+    {
+        PWSTR path = nullptr;
+        if (FAILED(item.entry->GetDisplayName(SIGDN_FILESYSPATH, &path)))
+        {
+            return false;
         }
+
+        CPathFolderWalker::NODE node;
+        node.entry = MakePathItem(path);
+        node.isFolder = item.isFolder;
+        CoTaskMemFree(path);
+        nodes.push_back(std::move(node));
     }
+    return true;
+}
+
+// Creates the rename items for a selection in depth-first order, each folder before
+// its contents, so item ids follow the order the folders are renamed in.  Items are
+// added as soon as the folder holding them has been listed, while the walk carries
+// on listing the folders after it.  They are handed to the manager in batches; the
+// first item on its own so it shows up right away.  create(node, depth, &item) makes
+// the item for one node.
+template <typename TWalker, typename TLister, typename TCreate>
+HRESULT _AddEnumItems(_In_ TLister& lister, _In_ std::vector<typename TWalker::NODE>& nodes, _In_ unsigned int maxDepth, _In_ ISmartRenameManager* psrm, _In_opt_ HANDLE cancelEvent, _In_ TCreate&& create)
+{
+    std::vector<ISmartRenameItem*> batch;
+    batch.reserve(c_addItemsBatchSize);
+    ULONGLONG lastAddTick = 0;
+    auto addBatch = [&]()
+    {
+        HRESULT hrAdd = batch.empty() ? S_OK : psrm->AddItems(batch.data(), static_cast<UINT>(batch.size()));
+        for (ISmartRenameItem* item : batch)
+        {
+            item->Release();
+        }
+        batch.clear();
+        lastAddTick = GetTickCount64();
+        return hrAdd;
+    };
+
+    HRESULT hr = S_OK;
+    unsigned int threadCount = (std::min)(c_maxEnumThreads, (std::max)(1u, std::thread::hardware_concurrency()));
+    TWalker::WalkAndVisit(lister, nodes, maxDepth, threadCount, [&](_In_ const typename TWalker::NODE& node, _In_ unsigned int depth)
+    {
+        if (cancelEvent && WaitForSingleObject(cancelEvent, 0) == WAIT_OBJECT_0)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_CANCELLED);
+            return false;
+        }
+
+        ISmartRenameItem* pNewItem = nullptr;
+        hr = create(node, depth, &pNewItem);
+        if (SUCCEEDED(hr))
+        {
+            batch.push_back(pNewItem);
+            if (batch.size() >= c_addItemsBatchSize || GetTickCount64() - lastAddTick >= c_addItemsInterval)
+            {
+                hr = addBatch();
+            }
+        }
+        return SUCCEEDED(hr);
+    });
 
+    // The items found before the walk failed or was canceled are kept
+    HRESULT hrAdd = addBatch();
+    if (SUCCEEDED(hr))
+    {
+        hr = hrAdd;
+    }
     return hr;
 }
 
-// Iterate through the data object and add paths to the rotation manager
-HRESULT EnumerateDataObject(_In_ IDataObject* pdo, _In_ ISmartRenameManager* psrm)
+// Iterate through the data object and add paths to the rotation manager.  The
+// folders in the selection are listed on a pool of threads and the items are added
+// on this one as they are found.  Setting cancelEvent stops the enumeration with
+// the items found so far added.  If flags has ExcludeSubfolders the folders aren't
+// listed at all since nothing in them would be renamed.
+//
+// A selection in the file system is listed with FindFirstFileEx and its items are
+// made from the paths and names that returns, if the manager's item factory can.
+// Otherwise the folders are listed and the items made through the shell.
+HRESULT EnumerateDataObject(_In_ IDataObject* pdo, _In_ ISmartRenameManager* psrm, _In_ DWORD flags, _In_opt_ HANDLE cancelEvent)
 {
-    CComPtr<IShellItemArray> spsia;
-    HRESULT hr = SHCreateShellItemArrayFromDataObject(pdo, IID_PPV_ARGS(&spsia));
+    CComPtr<ISmartRenameItemFactory> spsrif;
+    HRESULT hr = psrm->get_renameItemFactory(&spsrif);
     if (SUCCEEDED(hr))
     {
-        CComPtr<IEnumShellItems> spesi;
-        hr = spsia->EnumItems(&spesi);
+        CComPtr<IShellItemArray> spsia;
+        hr = SHCreateShellItemArrayFromDataObject(pdo, IID_PPV_ARGS(&spsia));
         if (SUCCEEDED(hr))
         {
-            hr = _ParseEnumItems(spesi, psrm);
+            CComPtr<IEnumShellItems> spesi;
+            hr = spsia->EnumItems(&spesi);
+            if (SUCCEEDED(hr))
+            {
+                std::vector<CShellFolderWalker::NODE> items;
+                hr = CShellFolderLister::s_ListItems(spesi, items);
+                if (SUCCEEDED(hr))
+                {
+                    // A folder that can't be listed is left empty rather than ending the
+                    // walk.  Its error is still returned once everything else is added.
+                    unsigned int maxDepth = (flags & ExcludeSubfolders) ? 1 : c_maxEnumDepth;
+                    CComPtr<ISmartRenameItemPathFactory> spsripf;
+                    std::vector<CPathFolderWalker::NODE> paths;
+                    if (SUCCEEDED(spsrif->QueryInterface(IID_PPV_ARGS(&spsripf))) && _GetSelectionPaths(items, paths))
+                    {
+                        // Show hidden files only if Explorer does
+                        SHELLSTATE ss = {};
+                        SHGetSetSettings(&ss, SSF_SHOWALLOBJECTS | SSF_SHOWSUPERHIDDEN, FALSE);
+                        CWin32FolderLister lister(!!ss.fShowAllObjects, !!ss.fShowSuperHidden);
+                        hr = _AddEnumItems<CPathFolderWalker>(lister, paths, maxDepth, psrm, cancelEvent,
+                            [&](_In_ const CPathFolderWalker::NODE& node, _In_ unsigned int depth, _Outptr_ ISmartRenameItem** ppItem)
+                            {
+                                return spsripf->CreateFromPath(node.entry.path.c_str(), node.entry.GetName(), node.isFolder, depth, ppItem);
+                            });
+                        if (SUCCEEDED(hr) && lister.GetError() != 0)
+                        {
+                            hr = HRESULT_FROM_WIN32(lister.GetError());
+                        }
+                    }
+                    else
+                    {
+                        CShellFolderLister lister;
+                        hr = _AddEnumItems<CShellFolderWalker>(lister, items, maxDepth, psrm, cancelEvent,
+                            [&](_In_ const CShellFolderWalker::NODE& node, _In_ unsigned int depth, _Outptr_ ISmartRenameItem** ppItem)
+                            {
+                                HRESULT hrCreate = spsrif->Create(node.entry, ppItem);
+                                if (SUCCEEDED(hrCreate))
+                                {
+                                    (*ppItem)->put_depth(depth);
+                                }
+                                return hrCreate;
+                            });
+                        if (SUCCEEDED(hr))
+                        {
+                            hr = lister.GetError();
+                        }
+                    }
+                }
+            }
         }
     }
 
@@ -1,6 +1,6 @@
 #pragma once
 
-HRESULT EnumerateDataObject(_In_ IDataObject* pdo, _In_ ISmartRenameManager* psrm);
+HRESULT EnumerateDataObject(_In_ IDataObject* pdo, _In_ ISmartRenameManager* psrm, _In_ DWORD flags, _In_opt_ HANDLE cancelEvent = nullptr);
 HRESULT GetIconIndexFromPath(_In_ PCWSTR path, _Out_ int* index);
 HBITMAP CreateBitmapFromIcon(_In_ HICON hIcon, _In_opt_ UINT width = 0, _In_opt_ UINT height = 0);
 HWND CreateMsgWindow(_In_ HINSTANCE hInst, _In_ WNDPROC pfnWndProc, _In_ void* p);
@@ -0,0 +1,37 @@
+#include "ItemUpdateRing.h"
+
+const size_t CItemUpdateRing::c_capacity;
+
+bool CItemUpdateRing::Push(unsigned int index)
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) >= c_capacity)
+    {
+        return false;
+    }
+
+    m_items[tail % c_capacity] = index;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+size_t CItemUpdateRing::Drain(unsigned int& first, unsigned int& last)
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+    for (size_t i = head; i < tail; i++)
+    {
+        unsigned int index = m_items[i % c_capacity];
+        if (index < first)
+        {
+            first = index;
+        }
+        if (index > last)
+        {
+            last = index;
+        }
+    }
+
+    m_head.store(tail, std::memory_order_release);
+    return tail - head;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Bounded single producer, single consumer queue of item indices.  A preview
+// worker pushes the index of each item whose new name changed and the manager
+// thread drains everything queued so far in one go.  Neither side takes a lock.
+//
+// Push fails rather than waits when the ring is full so a worker never blocks on
+// the manager thread.  The caller is expected to fall back to reporting every item.
+//
+// This file has no Windows dependencies so it can be built and tested on any
+// platform.
+class CItemUpdateRing
+{
+public:
+    CItemUpdateRing() = default;
+
+    // Producer only
+    bool Push(unsigned int index);
+
+    // Consumer only.  Removes every queued index and widens [first, last] to cover
+    // them.  Returns the number of indices removed.
+    size_t Drain(unsigned int& first, unsigned int& last);
+
+    static const size_t c_capacity = 4096;
+
+private:
+    unsigned int m_items[c_capacity];
+
+    // Kept on separate cache lines so the producer and consumer don't contend
+    alignas(64) std::atomic<size_t> m_head{ 0 };        // Next index to drain
+    alignas(64) std::atomic<size_t> m_tail{ 0 };        // Next free slot
+};
@@ -0,0 +1,1457 @@
+#include "LinearRegEx.h"
+#include <cwctype>
+
+// Upper bound on compiled program size.  Counted repeats are expanded inline
+// so something like (a{1000}){1000} would otherwise explode.
+static const size_t c_maxInstructions = 50000;
+
+// Longest literal built by expanding a counted repeat such as a{4}
+static const size_t c_maxRepeatedLiteral = 256;
+
+// Steps between calls to MatchLimits::poll
+static const size_t c_pollInterval = 4096;
+
+const size_t CLinearRegEx::npos;
+
+// Recursive descent parser producing the node tree in CLinearRegEx::m_nodes
+class CLinearRegEx::CParser
+{
+public:
+    CParser(CLinearRegEx& regex, const wchar_t* pattern, size_t length) :
+        m_regex(regex),
+        m_pattern(pattern),
+        m_length(length)
+    {
+    }
+
+    CompileResult Parse(size_t& root)
+    {
+        root = _ParseAlternate();
+        if (m_result == CompileOk && m_pos < m_length)
+        {
+            // Only an unbalanced ')' stops the top level alternation early
+            m_result = CompileInvalidPattern;
+        }
+        return m_result;
+    }
+
+private:
+    bool _AtEnd() const { return m_pos >= m_length; }
+    wchar_t _Peek(size_t offset = 0) const { return (m_pos + offset < m_length) ? m_pattern[m_pos + offset] : L'\0'; }
+
+    size_t _NewNode(NodeType type)
+    {
+        Node node;
+        node.type = type;
+        m_regex.m_nodes.push_back(node);
+        return m_regex.m_nodes.size() - 1;
+    }
+
+    size_t _Fail(CompileResult result)
+    {
+        if (m_result == CompileOk)
+        {
+            m_result = result;
+        }
+        return _NewNode(NodeEmpty);
+    }
+
+    size_t _ParseAlternate()
+    {
+        size_t first = _ParseConcat();
+        if (m_result != CompileOk || _Peek() != L'|')
+        {
+            return first;
+        }
+
+        size_t alternate = _NewNode(NodeAlternate);
+        m_regex.m_nodes[alternate].children.push_back(first);
+        while (m_result == CompileOk && !_AtEnd() && _Peek() == L'|')
+        {
+            m_pos++;
+            size_t next = _ParseConcat();
+            m_regex.m_nodes[alternate].children.push_back(next);
+        }
+        return alternate;
+    }
+
+    size_t _ParseConcat()
+    {
+        size_t concat = _NewNode(NodeConcat);
+        while (m_result == CompileOk && !_AtEnd() && _Peek() != L'|' && _Peek() != L')')
+        {
+            size_t term = _ParseQuantified();
+            m_regex.m_nodes[concat].children.push_back(term);
+        }
+        return concat;
+    }
+
+    // Parses {n}, {n,} or {n,m} at the current position.  Leaves the position
+    // untouched and returns false if the brace does not start a quantifier, in
+    // which case it is treated as a literal.
+    bool _TryParseBraces(size_t& min, size_t& max)
+    {
+        size_t pos = m_pos + 1;
+        size_t value = 0;
+        bool haveMin = false;
+        while (pos < m_length && iswdigit(m_pattern[pos]))
+        {
+            value = (value < 100000) ? value * 10 + (m_pattern[pos] - L'0') : value;
+            haveMin = true;
+            pos++;
+        }
+
+        if (!haveMin)
+        {
+            return false;
+        }
+
+        min = value;
+        max = value;
+        if (pos < m_length && m_pattern[pos] == L',')
+        {
+            pos++;
+            max = npos;
+            value = 0;
+            bool haveMax = false;
+            while (pos < m_length && iswdigit(m_pattern[pos]))
+            {
+                value = (value < 100000) ? value * 10 + (m_pattern[pos] - L'0') : value;
+                haveMax = true;
+                pos++;
+            }
+
+            if (haveMax)
+            {
+                max = value;
+            }
+        }
+
+        if (pos >= m_length || m_pattern[pos] != L'}')
+        {
+            return false;
+        }
+
+        m_pos = pos + 1;
+        return true;
+    }
+
+    size_t _ParseQuantified()
+    {
+        size_t atom = _ParseAtom();
+        if (m_result != CompileOk || _AtEnd())
+        {
+            return atom;
+        }
+
+        size_t min = 0;
+        size_t max = 0;
+        wchar_t c = _Peek();
+        if (c == L'*')
+        {
+            m_pos++;
+            min = 0;
+            max = npos;
+        }
+        else if (c == L'+')
+        {
+            m_pos++;
+            min = 1;
+            max = npos;
+        }
+        else if (c == L'?')
+        {
+            m_pos++;
+            min = 0;
+            max = 1;
+        }
+        else if (c != L'{' || !_TryParseBraces(min, max))
+        {
+            return atom;
+        }
+
+        NodeType atomType = m_regex.m_nodes[atom].type;
+        if (atomType == NodeBol || atomType == NodeEol ||
+            atomType == NodeWordBoundary || atomType == NodeNotWordBoundary ||
+            (max != npos && min > max))
+        {
+            return _Fail(CompileInvalidPattern);
+        }
+
+        bool greedy = true;
+        if (_Peek() == L'?' && !_AtEnd())
+        {
+            m_pos++;
+            greedy = false;
+        }
+
+        if (!_AtEnd() && (_Peek() == L'*' || _Peek() == L'+' || _Peek() == L'?'))
+        {
+            // Nothing to repeat
+            return _Fail(CompileInvalidPattern);
+        }
+
+        size_t repeat = _NewNode(NodeRepeat);
+        Node& node = m_regex.m_nodes[repeat];
+        node.min = min;
+        node.max = max;
+        node.greedy = greedy;
+        node.children.push_back(atom);
+        return repeat;
+    }
+
+    size_t _ParseAtom()
+    {
+        wchar_t c = _Peek();
+        switch (c)
+        {
+        case L'(':
+            return _ParseGroup();
+
+        case L'[':
+            return _ParseClass();
+
+        case L'.':
+            m_pos++;
+            return _NewNode(NodeAny);
+
+        case L'^':
+            m_pos++;
+            return _NewNode(NodeBol);
+
+        case L'$':
+            m_pos++;
+            return _NewNode(NodeEol);
+
+        case L'\\':
+            return _ParseEscape();
+
+        case L'*':
+        case L'+':
+        case L'?':
+            return _Fail(CompileInvalidPattern);
+
+        case L'{':
+        {
+            size_t min = 0;
+            size_t max = 0;
+            size_t pos = m_pos;
+            if (_TryParseBraces(min, max))
+            {
+                // A quantifier with nothing to repeat
+                m_pos = pos;
+                return _Fail(CompileInvalidPattern);
+            }
+            break;
+        }
+        }
+
+        m_pos++;
+        size_t node = _NewNode(NodeChar);
+        m_regex.m_nodes[node].ch = c;
+        return node;
+    }
+
+    size_t _ParseGroup()
+    {
+        m_pos++;
+
+        size_t group = npos;
+        if (_Peek() == L'?')
+        {
+            wchar_t kind = _Peek(1);
+            if (kind == L':')
+            {
+                m_pos += 2;
+            }
+            else if (kind == L'=' || kind == L'!')
+            {
+                return _Fail(CompileUnsupported);
+            }
+            else if (kind == L'<')
+            {
+                if (_Peek(2) == L'=' || _Peek(2) == L'!')
+                {
+                    return _Fail(CompileUnsupported);
+                }
+
+                m_pos += 2;
+                size_t nameStart = m_pos;
+                while (!_AtEnd() && (iswalnum(_Peek()) || _Peek() == L'_' || _Peek() == L'$'))
+                {
+                    m_pos++;
+                }
+
+                if (_AtEnd() || _Peek() != L'>' || m_pos == nameStart || iswdigit(m_pattern[nameStart]))
+                {
+                    return _Fail(CompileInvalidPattern);
+                }
+
+                std::wstring name(m_pattern + nameStart, m_pos - nameStart);
+                m_pos++;
+
+                group = ++m_regex.m_groupCount;
+                if (!m_regex.m_groupNames.insert(std::make_pair(name, group)).second)
+                {
+                    // Duplicate group name
+                    return _Fail(CompileInvalidPattern);
+                }
+            }
+            else
+            {
+                return _Fail(CompileInvalidPattern);
+            }
+        }
+        else
+        {
+            group = ++m_regex.m_groupCount;
+        }
+
+        size_t child = _ParseAlternate();
+        if (m_result != CompileOk)
+        {
+            return child;
+        }
+
+        if (_Peek() != L')' || _AtEnd())
+        {
+            return _Fail(CompileInvalidPattern);
+        }
+        m_pos++;
+
+        size_t node = _NewNode(NodeGroup);
+        m_regex.m_nodes[node].group = group;
+        m_regex.m_nodes[node].children.push_back(child);
+        return node;
+    }
+
+    // Parses hex digits for \x and \u escapes
+    bool _ParseHex(size_t digits, wchar_t& value)
+    {
+        unsigned int result = 0;
+        for (size_t i = 0; i < digits; i++)
+        {
+            wchar_t c = _Peek(i);
+            if (!iswxdigit(c) || m_pos + i >= m_length)
+            {
+                return false;
+            }
+            result = result * 16 + (iswdigit(c) ? (c - L'0') : (towlower(c) - L'a' + 10));
+        }
+        m_pos += digits;
+        value = static_cast<wchar_t>(result);
+        return true;
+    }
+
+    // Parses the escape following a backslash that represents a single character.
+    // Returns false if it is not a character escape.
+    bool _ParseCharacterEscape(wchar_t c, bool inClass, wchar_t& value)
+    {
+        switch (c)
+        {
+        case L't': value = L'\t'; return true;
+        case L'n': value = L'\n'; return true;
+        case L'r': value = L'\r'; return true;
+        case L'f': value = L'\f'; return true;
+        case L'v': value = L'\v'; return true;
+        case L'b':
+            // \b is backspace inside a class and a word boundary outside one
+            if (inClass)
+            {
+                value = L'\b';
+                return true;
+            }
+            return false;
+        case L'0':
+            if (!iswdigit(_Peek()))
+            {
+                value = L'\0';
+                return true;
+            }
+            return false;
+        case L'x':
+            return _ParseHex(2, value);
+        case L'u':
+            return _ParseHex(4, value);
+        case L'c':
+            if (iswalpha(_Peek()))
+            {
+                value = static_cast<wchar_t>(_Peek() % 32);
+                m_pos++;
+                return true;
+            }
+            return false;
+        }
+
+        // Identity escapes for anything that isn't a letter or digit
+        if (!iswalnum(c) && c != L'_')
+        {
+            value = c;
+            return true;
+        }
+
+        return false;
+    }
+
+    static unsigned _BuiltinFromEscape(wchar_t c)
+    {
+        switch (c)
+        {
+        case L'd': return BuiltinDigit;
+        case L'D': return BuiltinNotDigit;
+        case L'w': return BuiltinWord;
+        case L'W': return BuiltinNotWord;
+        case L's': return BuiltinSpace;
+        case L'S': return BuiltinNotSpace;
+        }
+        return 0;
+    }
+
+    size_t _ParseEscape()
+    {
+        m_pos++;
+        if (_AtEnd())
+        {
+            return _Fail(CompileInvalidPattern);
+        }
+
+        wchar_t c = _Peek();
+        m_pos++;
+
+        if (c == L'b')
+        {
+            return _NewNode(NodeWordBoundary);
+        }
+
+        if (c == L'B')
+        {
+            return _NewNode(NodeNotWordBoundary);
+        }
+
+        if ((c >= L'1' && c <= L'9') || c == L'k')
+        {
+            // Backreferences
+            return _Fail(CompileUnsupported);
+        }
+
+        unsigned builtin = _BuiltinFromEscape(c);
+        if (builtin != 0)
+        {
+            CharClass charClass;
+            charClass.builtins = builtin;
+            m_regex.m_classes.push_back(charClass);
+
+            size_t node = _NewNode(NodeClass);
+            m_regex.m_nodes[node].classIndex = m_regex.m_classes.size() - 1;
+            return node;
+        }
+
+        wchar_t value = 0;
+        if (!_ParseCharacterEscape(c, false, value))
+        {
+            return _Fail(CompileInvalidPattern);
+        }
+
+        size_t node = _NewNode(NodeChar);
+        m_regex.m_nodes[node].ch = value;
+        return node;
+    }
+
+    // Parses a single class atom.  Returns false on a syntax error.  Sets builtin
+    // instead of value for the \d \w \s family.
+    bool _ParseClassAtom(wchar_t& value, unsigned& builtin)
+    {
+        builtin = 0;
+        wchar_t c = _Peek();
+        m_pos++;
+        if (c != L'\\')
+        {
+            value = c;
+            return true;
+        }
+
+        if (_AtEnd())
+        {
+            return false;
+        }
+
+        c = _Peek();
+        m_pos++;
+        builtin = _BuiltinFromEscape(c);
+        if (builtin != 0)
+        {
+            return true;
+        }
+
+        if (c == L'-')
+        {
+            value = c;
+            return true;
+        }
+
+        return _ParseCharacterEscape(c, true, value);
+    }
+
+    size_t _ParseClass()
+    {
+        m_pos++;
+
+        CharClass charClass;
+        if (_Peek() == L'^' && !_AtEnd())
+        {
+            charClass.negated = true;
+            m_pos++;
+        }
+
+        // Unlike POSIX, ECMAScript allows [] (matches nothing) and [^] (matches anything)
+        while (!_AtEnd() && _Peek() != L']')
+        {
+            wchar_t low = 0;
+            unsigned lowBuiltin = 0;
+            if (!_ParseClassAtom(low, lowBuiltin))
+            {
+                return _Fail(CompileInvalidPattern);
+            }
+
+            if (_Peek() == L'-' && m_pos + 1 < m_length && _Peek(1) != L']')
+            {
+                m_pos++;
+                wchar_t high = 0;
+                unsigned highBuiltin = 0;
+                if (!_ParseClassAtom(high, highBuiltin))
+                {
+                    return _Fail(CompileInvalidPattern);
+                }
+
+                if (lowBuiltin != 0 || highBuiltin != 0)
+                {
+                    // Something like [\d-z].  The '-' is a literal.
+                    charClass.builtins |= lowBuiltin | highBuiltin;
+                    if (lowBuiltin == 0)
+                    {
+                        charClass.ranges.push_back(std::make_pair(low, low));
+                    }
+                    if (highBuiltin == 0)
+                    {
+                        charClass.ranges.push_back(std::make_pair(high, high));
+                    }
+                    charClass.ranges.push_back(std::make_pair(L'-', L'-'));
+                }
+                else if (low > high)
+                {
+                    return _Fail(CompileInvalidPattern);
+                }
+                else
+                {
+                    charClass.ranges.push_back(std::make_pair(low, high));
+                }
+            }
+            else if (lowBuiltin != 0)
+            {
+                charClass.builtins |= lowBuiltin;
+            }
+            else
+            {
+                charClass.ranges.push_back(std::make_pair(low, low));
+            }
+        }
+
+        if (_AtEnd())
+        {
+            return _Fail(CompileInvalidPattern);
+        }
+        m_pos++;
+
+        m_regex.m_classes.push_back(charClass);
+        size_t node = _NewNode(NodeClass);
+        m_regex.m_nodes[node].classIndex = m_regex.m_classes.size() - 1;
+        return node;
+    }
+
+    CLinearRegEx& m_regex;
+    const wchar_t* m_pattern;
+    size_t m_length;
+    size_t m_pos = 0;
+    CompileResult m_result = CompileOk;
+};
+
+// Set of NFA threads for one input position, in priority order.  The sparse/dense
+// pair gives O(1) membership tests and clears without touching every entry.
+struct CLinearRegEx::ThreadList
+{
+    std::vector<size_t> sparse;
+    std::vector<size_t> dense;
+    std::vector<size_t> caps;
+    size_t count = 0;
+
+    void Init(size_t programSize, size_t slotCount)
+    {
+        sparse.assign(programSize, 0);
+        dense.assign(programSize, 0);
+        caps.assign(programSize * slotCount, npos);
+        count = 0;
+    }
+
+    bool Contains(size_t pc) const
+    {
+        return sparse[pc] < count && dense[sparse[pc]] == pc;
+    }
+
+    size_t Insert(size_t pc)
+    {
+        sparse[pc] = count;
+        dense[count] = pc;
+        return count++;
+    }
+};
+
+struct CLinearRegEx::SearchState
+{
+    // Pending work for _AddThread.  Restore entries undo a capture slot once
+    // everything reachable after an OpSave has been explored.
+    struct StackEntry
+    {
+        bool restore;
+        size_t pc;
+        size_t slot;
+        size_t value;
+    };
+
+    ThreadList lists[2];
+    std::vector<StackEntry> stack;
+    std::vector<size_t> scratch;
+    std::vector<size_t> captures;
+    size_t slotCount = 0;
+
+    const MatchLimits* limits = nullptr;
+    size_t steps = 0;
+    size_t nextPoll = c_pollInterval;
+    MatchStatus status = MatchOk;
+
+    SearchState(size_t programSize, size_t groupCount)
+    {
+        slotCount = (groupCount + 1) * 2;
+        lists[0].Init(programSize, slotCount);
+        lists[1].Init(programSize, slotCount);
+        scratch.assign(slotCount, npos);
+        captures.assign(slotCount, npos);
+    }
+};
+
+CLinearRegEx::CompileResult CLinearRegEx::Compile(const wchar_t* pattern, size_t length, bool caseSensitive)
+{
+    m_nodes.clear();
+    m_classes.clear();
+    m_program.clear();
+    m_groupNames.clear();
+    m_literalFacts = LiteralFacts();
+    m_groupCount = 0;
+    m_caseSensitive = caseSensitive;
+
+    size_t root = 0;
+    CParser parser(*this, pattern, length);
+    CompileResult result = parser.Parse(root);
+    if (result == CompileOk)
+    {
+        // Wrap the whole pattern in group 0 so the match bounds land in slots 0 and 1
+        _EmitInstruction(OpSave, 0, 0);
+        if (!_Emit(root))
+        {
+            result = CompileTooComplex;
+        }
+        _EmitInstruction(OpSave, 0, 1);
+        _EmitInstruction(OpMatch);
+
+        _AnalyzeLiterals(root, m_literalFacts);
+    }
+
+    // The tree is only needed while compiling
+    m_nodes.clear();
+    m_nodes.shrink_to_fit();
+    m_consumerPcs.clear();
+    m_redirectPcs.clear();
+    m_redirectNext = 0;
+    m_redirecting = false;
+
+    if (result != CompileOk)
+    {
+        m_program.clear();
+        m_classes.clear();
+        m_groupNames.clear();
+        m_literalFacts = LiteralFacts();
+        m_groupCount = 0;
+    }
+
+    return result;
+}
+
+// Works out which literal text every match of a node must start with, end with
+// and contain.  Anything that is not certain is left empty so the facts can only
+// ever rule out names that really can't match.
+void CLinearRegEx::_AnalyzeLiterals(size_t index, LiteralFacts& facts) const
+{
+    facts = LiteralFacts();
+
+    const Node& node = m_nodes[index];
+    switch (node.type)
+    {
+    case NodeEmpty:
+        facts.exact = true;
+        facts.plain = true;
+        break;
+
+    case NodeWordBoundary:
+    case NodeNotWordBoundary:
+        // Zero width so they match exactly the empty string, when they match at all
+        facts.exact = true;
+        break;
+
+    case NodeBol:
+        facts.exact = true;
+        facts.anchoredStart = true;
+        facts.plain = true;
+        break;
+
+    case NodeEol:
+        facts.exact = true;
+        facts.anchoredEnd = true;
+        facts.plain = true;
+        break;
+
+    case NodeChar:
+        facts.prefix.assign(1, m_caseSensitive ? node.ch : s_Fold(node.ch));
+        facts.exact = true;
+        facts.plain = true;
+        break;
+
+    case NodeAny:
+    case NodeClass:
+        break;
+
+    case NodeGroup:
+        _AnalyzeLiterals(node.children[0], facts);
+
+        // Capture groups can be referred to by the replace term
+        facts.plain = facts.plain && (node.group == npos);
+        break;
+
+    case NodeConcat:
+    {
+        bool first = true;
+        LiteralFacts child;
+        for (size_t childIndex : node.children)
+        {
+            _AnalyzeLiterals(childIndex, child);
+            if (first)
+            {
+                facts = child;
+                first = false;
+                continue;
+            }
+
+            // The end of what came before always touches the start of the child
+            std::wstring junction = facts.suffix + child.prefix;
+            if (junction.length() > facts.required.length())
+            {
+                facts.required = junction;
+            }
+
+            if (child.required.length() > facts.required.length())
+            {
+                facts.required = child.required;
+            }
+
+            // ^ is only plain before any text and $ only after all of it
+            facts.plain = facts.plain && child.plain &&
+                (!child.anchoredStart || (facts.exact && facts.prefix.empty())) &&
+                (!facts.anchoredEnd || (child.exact && child.prefix.empty()));
+
+            facts.anchoredStart = facts.anchoredStart || (facts.exact && facts.prefix.empty() && child.anchoredStart);
+            facts.anchoredEnd = child.anchoredEnd || (child.exact && child.prefix.empty() && facts.anchoredEnd);
+
+            if (facts.exact)
+            {
+                facts.prefix += child.prefix;
+            }
+            facts.suffix = child.exact ? (facts.suffix + child.suffix) : child.suffix;
+            facts.exact = facts.exact && child.exact;
+        }
+        break;
+    }
+
+    case NodeAlternate:
+    {
+        // Only what every branch agrees on holds for the alternation
+        _AnalyzeLiterals(node.children[0], facts);
+        LiteralFacts child;
+        for (size_t i = 1; i < node.children.size(); i++)
+        {
+            _AnalyzeLiterals(node.children[i], child);
+
+            size_t common = 0;
+            while (common < facts.prefix.length() && common < child.prefix.length() && facts.prefix[common] == child.prefix[common])
+            {
+                common++;
+            }
+
+            facts.exact = facts.exact && child.exact && facts.prefix == child.prefix;
+            facts.prefix.resize(common);
+
+            common = 0;
+            while (common < facts.suffix.length() && common < child.suffix.length() &&
+                facts.suffix[facts.suffix.length() - common - 1] == child.suffix[child.suffix.length() - common - 1])
+            {
+                common++;
+            }
+            facts.suffix.erase(0, facts.suffix.length() - common);
+
+            facts.anchoredStart = facts.anchoredStart && child.anchoredStart;
+            facts.anchoredEnd = facts.anchoredEnd && child.anchoredEnd;
+        }
+        facts.required.clear();
+        facts.plain = false;
+        break;
+    }
+
+    case NodeRepeat:
+    {
+        if (node.min == 0)
+        {
+            // May match nothing at all
+            break;
+        }
+
+        LiteralFacts child;
+        _AnalyzeLiterals(node.children[0], child);
+        facts = child;
+        if (child.exact && node.min == node.max && child.prefix.length() * node.min <= c_maxRepeatedLiteral)
+        {
+            facts.prefix.clear();
+            for (size_t i = 0; i < node.min; i++)
+            {
+                facts.prefix += child.prefix;
+            }
+            facts.suffix = facts.prefix;
+
+            // Repeating an anchor isn't a literal any more, (^a){2} can't match "aa"
+            facts.plain = facts.plain && (node.min == 1 || (!child.anchoredStart && !child.anchoredEnd));
+        }
+        else
+        {
+            facts.exact = false;
+            facts.plain = false;
+        }
+        break;
+    }
+    }
+
+    // An exact match is its own prefix, suffix and required text
+    if (facts.exact)
+    {
+        facts.suffix = facts.prefix;
+    }
+
+    if (facts.prefix.length() > facts.required.length())
+    {
+        facts.required = facts.prefix;
+    }
+
+    if (facts.suffix.length() > facts.required.length())
+    {
+        facts.required = facts.suffix;
+    }
+}
+
+size_t CLinearRegEx::_EmitInstruction(Opcode op, wchar_t ch, size_t x, size_t y)
+{
+    Instruction inst = { op, ch, x, y };
+    m_program.push_back(inst);
+    return m_program.size() - 1;
+}
+
+// Emits an instruction that matches a character and remembers where it went.  While
+// a loop's fresh copy is emitted it becomes a jump to the same character in the
+// loop's first copy instead.
+void CLinearRegEx::_EmitConsumer(Opcode op, wchar_t ch, size_t x)
+{
+    size_t pc = m_redirecting ?
+        _EmitInstruction(OpJmp, 0, m_redirectPcs[m_redirectNext++]) :
+        _EmitInstruction(op, ch, x);
+    m_consumerPcs.push_back(pc);
+}
+
+// Whether a node can match without consuming anything
+bool CLinearRegEx::_CanBeEmpty(size_t index) const
+{
+    const Node& node = m_nodes[index];
+    switch (node.type)
+    {
+    case NodeChar:
+    case NodeAny:
+    case NodeClass:
+        return false;
+
+    case NodeConcat:
+        for (size_t child : node.children)
+        {
+            if (!_CanBeEmpty(child))
+            {
+                return false;
+            }
+        }
+        return true;
+
+    case NodeAlternate:
+        for (size_t child : node.children)
+        {
+            if (_CanBeEmpty(child))
+            {
+                return true;
+            }
+        }
+        return false;
+
+    case NodeGroup:
+        return _CanBeEmpty(node.children[0]);
+
+    case NodeRepeat:
+        return node.min == 0 || _CanBeEmpty(node.children[0]);
+
+    default:
+        // Empty and the anchors
+        return true;
+    }
+}
+
+bool CLinearRegEx::_Emit(size_t index)
+{
+    if (m_program.size() > c_maxInstructions)
+    {
+        return false;
+    }
+
+    // Copy what we need since m_nodes is not modified here but the reference
+    // would be awkward to hold across the recursive calls.
+    const Node node = m_nodes[index];
+    switch (node.type)
+    {
+    case NodeEmpty:
+        break;
+
+    case NodeChar:
+        _EmitConsumer(OpChar, m_caseSensitive ? node.ch : s_Fold(node.ch));
+        break;
+
+    case NodeAny:
+        _EmitConsumer(OpAny);
+        break;
+
+    case NodeClass:
+        _EmitConsumer(OpClass, 0, node.classIndex);
+        break;
+
+    case NodeBol:
+        _EmitInstruction(OpBol);
+        break;
+
+    case NodeEol:
+        _EmitInstruction(OpEol);
+        break;
+
+    case NodeWordBoundary:
+        _EmitInstruction(OpWordBoundary);
+        break;
+
+    case NodeNotWordBoundary:
+        _EmitInstruction(OpNotWordBoundary);
+        break;
+
+    case NodeConcat:
+        for (size_t child : node.children)
+        {
+            if (!_Emit(child))
+            {
+                return false;
+            }
+        }
+        break;
+
+    case NodeAlternate:
+    {
+        //     split L1, next
+        // L1: <first>
+        //     jmp end
+        // next: split L2, next2 ...
+        std::vector<size_t> jumps;
+        for (size_t i = 0; i < node.children.size(); i++)
+        {
+            bool last = (i + 1 == node.children.size());
+            size_t split = npos;
+            if (!last)
+            {
+                split = _EmitInstruction(OpSplit);
+                m_program[split].x = m_program.size();
+            }
+
+            if (!_Emit(node.children[i]))
+            {
+                return false;
+            }
+
+            if (!last)
+            {
+                jumps.push_back(_EmitInstruction(OpJmp));
+                m_program[split].y = m_program.size();
+            }
+        }
+
+        for (size_t jump : jumps)
+        {
+            m_program[jump].x = m_program.size();
+        }
+        break;
+    }
+
+    case NodeGroup:
+        if (node.group != npos)
+        {
+            _EmitInstruction(OpSave, 0, node.group * 2);
+        }
+
+        if (!_Emit(node.children[0]))
+        {
+            return false;
+        }
+
+        if (node.group != npos)
+        {
+            _EmitInstruction(OpSave, 0, node.group * 2 + 1);
+        }
+        break;
+
+    case NodeRepeat:
+    {
+        size_t child = node.children[0];
+        for (size_t i = 0; i < node.min; i++)
+        {
+            if (!_Emit(child))
+            {
+                return false;
+            }
+        }
+
+        if (node.max == npos && _CanBeEmpty(child))
+        {
+            // Like std::regex, a pass that matches nothing is kept but ends the loop.
+            // A thread's pc has to say whether its pass has matched anything yet, so
+            // the body is emitted twice: once for passes that have, and once for
+            // passes that haven't whose characters jump into the first copy.
+            //    L: split fresh, out (reversed when lazy)
+            //       <body>
+            //       jmp L
+            // fresh: <body with each character a jmp to the same one above>
+            //  out:
+            size_t split = _EmitInstruction(OpSplit);
+            size_t firstConsumer = m_consumerPcs.size();
+            if (!_Emit(child))
+            {
+                return false;
+            }
+            _EmitInstruction(OpJmp, 0, split);
+
+            // Inside another loop's fresh copy every character already jumps into
+            // that loop's first copy, which has this whole loop in it
+            bool redirecting = m_redirecting;
+            if (!redirecting)
+            {
+                m_redirectPcs.assign(m_consumerPcs.begin() + firstConsumer, m_consumerPcs.end());
+                m_redirectNext = 0;
+                m_redirecting = true;
+            }
+
+            size_t fresh = m_program.size();
+            bool emitted = _Emit(child);
+            m_redirecting = redirecting;
+            if (!emitted)
+            {
+                return false;
+            }
+
+            size_t out = m_program.size();
+            m_program[split].x = node.greedy ? fresh : out;
+            m_program[split].y = node.greedy ? out : fresh;
+        }
+        else if (node.max == npos)
+        {
+            // L: split body, out (reversed when lazy)
+            //    <body>
+            //    jmp L
+            size_t split = _EmitInstruction(OpSplit);
+            if (!_Emit(child))
+            {
+                return false;
+            }
+            _EmitInstruction(OpJmp, 0, split);
+
+            size_t body = split + 1;
+            size_t out = m_program.size();
+            m_program[split].x = node.greedy ? body : out;
+            m_program[split].y = node.greedy ? out : body;
+        }
+        else
+        {
+            // Each optional copy can bail out to the end
+            std::vector<size_t> splits;
+            for (size_t i = node.min; i < node.max; i++)
+            {
+                splits.push_back(_EmitInstruction(OpSplit));
+                if (!_Emit(child))
+                {
+                    return false;
+                }
+            }
+
+            size_t out = m_program.size();
+            for (size_t split : splits)
+            {
+                size_t body = split + 1;
+                m_program[split].x = node.greedy ? body : out;
+                m_program[split].y = node.greedy ? out : body;
+            }
+        }
+        break;
+    }
+    }
+
+    return m_program.size() <= c_maxInstructions;
+}
+
+bool CLinearRegEx::Search(const wchar_t* text, size_t length, size_t start, std::vector<size_t>& captures) const
+{
+    if (!IsCompiled())
+    {
+        return false;
+    }
+
+    SearchState state(m_program.size(), m_groupCount);
+    bool matched = _Search(state, text, length, start, npos);
+    if (matched)
+    {
+        captures = state.captures;
+    }
+    return matched;
+}
+
+bool CLinearRegEx::_Search(SearchState& state, const wchar_t* text, size_t length, size_t start, size_t notEmptyAt) const
+{
+    ThreadList* current = &state.lists[0];
+    ThreadList* next = &state.lists[1];
+    current->count = 0;
+    next->count = 0;
+
+    bool matched = false;
+    for (size_t pos = start; pos <= length; pos++)
+    {
+        if (!matched)
+        {
+            // Start a new attempt at this position.  It has lower priority than the
+            // threads already running since those started further to the left.
+            std::fill(state.scratch.begin(), state.scratch.end(), npos);
+            _AddThread(state, *current, 0, text, length, pos, state.scratch.data());
+        }
+
+        if (current->count == 0)
+        {
+            break;
+        }
+
+        if (state.limits && !_CheckLimits(state, current->count))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < current->count; i++)
+        {
+            size_t pc = current->dense[i];
+            const Instruction& inst = m_program[pc];
+            size_t* caps = &current->caps[i * state.slotCount];
+            if (inst.op == OpMatch)
+            {
+                if (caps[0] == pos && pos == notEmptyAt)
+                {
+                    // An empty match where the previous empty match was doesn't
+                    // count.  A longer one from here still can.
+                    continue;
+                }
+
+                matched = true;
+                std::copy(caps, caps + state.slotCount, state.captures.begin());
+
+                // Anything after this thread has lower priority so cut it off
+                break;
+            }
+
+            if (pos < length && _Consumes(inst, text[pos]))
+            {
+                _AddThread(state, *next, pc + 1, text, length, pos + 1, caps);
+            }
+        }
+
+        std::swap(current, next);
+        next->count = 0;
+    }
+
+    return matched;
+}
+
+// Follows every empty transition from pc and adds the resulting threads to
+// list in priority order.  Each program counter is added at most once per
+// position which is what bounds the work to O(program size) per character.
+void CLinearRegEx::_AddThread(SearchState& state, ThreadList& list, size_t pc, const wchar_t* text, size_t length, size_t pos, size_t* caps) const
+{
+    // Work on a copy so the caller's captures survive the OpSave updates
+    std::vector<size_t>& working = state.scratch;
+    if (caps != working.data())
+    {
+        std::copy(caps, caps + state.slotCount, working.begin());
+    }
+
+    state.stack.clear();
+    state.stack.push_back({ false, pc, 0, 0 });
+    while (!state.stack.empty())
+    {
+        SearchState::StackEntry entry = state.stack.back();
+        state.stack.pop_back();
+
+        if (entry.restore)
+        {
+            working[entry.slot] = entry.value;
+            continue;
+        }
+
+        pc = entry.pc;
+        if (list.Contains(pc))
+        {
+            continue;
+        }
+
+        size_t index = list.Insert(pc);
+        const Instruction& inst = m_program[pc];
+        switch (inst.op)
+        {
+        case OpJmp:
+            state.stack.push_back({ false, inst.x, 0, 0 });
+            break;
+
+        case OpSplit:
+            // Push the lower priority branch first so it is explored last
+            state.stack.push_back({ false, inst.y, 0, 0 });
+            state.stack.push_back({ false, inst.x, 0, 0 });
+            break;
+
+        case OpSave:
+            state.stack.push_back({ true, 0, inst.x, working[inst.x] });
+            working[inst.x] = pos;
+            state.stack.push_back({ false, pc + 1, 0, 0 });
+            break;
+
+        case OpBol:
+            if (pos == 0)
+            {
+                state.stack.push_back({ false, pc + 1, 0, 0 });
+            }
+            break;
+
+        case OpEol:
+            if (pos == length)
+            {
+                state.stack.push_back({ false, pc + 1, 0, 0 });
+            }
+            break;
+
+        case OpWordBoundary:
+        case OpNotWordBoundary:
+        {
+            bool before = (pos > 0) && s_IsWordChar(text[pos - 1]);
+            bool after = (pos < length) && s_IsWordChar(text[pos]);
+            if ((before != after) == (inst.op == OpWordBoundary))
+            {
+                state.stack.push_back({ false, pc + 1, 0, 0 });
+            }
+            break;
+        }
+
+        default:
+            // Consuming instruction or match.  The thread waits here for the next character.
+            std::copy(working.begin(), working.end(), list.caps.begin() + index * state.slotCount);
+            break;
+        }
+    }
+}
+
+bool CLinearRegEx::_Consumes(const Instruction& inst, wchar_t c) const
+{
+    switch (inst.op)
+    {
+    case OpChar:
+        return (m_caseSensitive ? c : s_Fold(c)) == inst.ch;
+
+    case OpAny:
+        return !s_IsLineTerminator(c);
+
+    case OpClass:
+    {
+        const CharClass& charClass = m_classes[inst.x];
+        bool contains = _ClassContains(charClass, c);
+        if (!contains && !m_caseSensitive)
+        {
+            contains = _ClassContains(charClass, static_cast<wchar_t>(towlower(c))) ||
+                       _ClassContains(charClass, static_cast<wchar_t>(towupper(c)));
+        }
+        return contains != charClass.negated;
+    }
+
+    default:
+        return false;
+    }
+}
+
+bool CLinearRegEx::_ClassContains(const CharClass& charClass, wchar_t c) const
+{
+    for (const auto& range : charClass.ranges)
+    {
+        if (c >= range.first && c <= range.second)
+        {
+            return true;
+        }
+    }
+
+    unsigned builtins = charClass.builtins;
+    if (builtins != 0)
+    {
+        bool digit = (c >= L'0' && c <= L'9');
+        bool word = s_IsWordChar(c);
+        bool space = s_IsSpace(c);
+        if (((builtins & BuiltinDigit) && digit) ||
+            ((builtins & BuiltinNotDigit) && !digit) ||
+            ((builtins & BuiltinWord) && word) ||
+            ((builtins & BuiltinNotWord) && !word) ||
+            ((builtins & BuiltinSpace) && space) ||
+            ((builtins & BuiltinNotSpace) && !space))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CLinearRegEx::Replace(const wchar_t* text, size_t length, const wchar_t* format, size_t formatLength, bool matchAll, std::wstring& result) const
+{
+    CReplaceTemplate replaceTemplate;
+    replaceTemplate.Parse(format, formatLength, m_groupCount, &m_groupNames);
+    return Replace(text, length, replaceTemplate, matchAll, result);
+}
+
+bool CLinearRegEx::Replace(const wchar_t* text, size_t length, const CReplaceTemplate& replaceTemplate, bool matchAll, std::wstring& result,
+    const MatchLimits* limits, MatchStatus* status) const
+{
+    result.clear();
+    if (status)
+    {
+        *status = MatchOk;
+    }
+
+    if (!IsCompiled())
+    {
+        result.assign(text, length);
+        return false;
+    }
+
+    SearchState state(m_program.size(), m_groupCount);
+    state.limits = limits;
+    bool matchedAny = false;
+    size_t copied = 0;
+    size_t searchFrom = 0;
+    size_t notEmptyAt = npos;
+    while (searchFrom <= length && _Search(state, text, length, searchFrom, notEmptyAt))
+    {
+        matchedAny = true;
+        size_t matchStart = state.captures[0];
+        size_t matchEnd = state.captures[1];
+        result.append(text + copied, matchStart - copied);
+        replaceTemplate.Apply(text, length, state.captures.data(), m_groupCount, copied, result);
+        copied = matchEnd;
+
+        if (!matchAll)
+        {
+            break;
+        }
+
+        // Keep looking from the end of the match, like std::regex_iterator.  An empty
+        // match is allowed there after a longer one, so a* turns "aaa" into "XX".
+        // After an empty match the next one has to move on, or it would repeat.
+        searchFrom = matchEnd;
+        notEmptyAt = (matchEnd == matchStart) ? matchEnd : npos;
+    }
+
+    if (state.status != MatchOk)
+    {
+        // Don't hand back a name that is only partly replaced
+        if (status)
+        {
+            *status = state.status;
+        }
+        result.assign(text, length);
+        return false;
+    }
+
+    result.append(text + copied, length - copied);
+    return matchedAny;
+}
+
+// Counts the steps just taken.  Returns false, with state.status set, once the
+// limits say the match has to stop.
+bool CLinearRegEx::_CheckLimits(SearchState& state, size_t steps) const
+{
+    state.steps += steps;
+    if (state.steps > state.limits->maxSteps)
+    {
+        state.status = MatchStepLimit;
+        return false;
+    }
+
+    if (state.limits->poll && state.steps >= state.nextPoll)
+    {
+        state.nextPoll = state.steps + c_pollInterval;
+        state.status = state.limits->poll(state.limits->context);
+    }
+    return state.status == MatchOk;
+}
+
+wchar_t CLinearRegEx::s_Fold(wchar_t c)
+{
+    return static_cast<wchar_t>(towlower(c));
+}
+
+bool CLinearRegEx::s_IsWordChar(wchar_t c)
+{
+    return (c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z') || (c >= L'0' && c <= L'9') || c == L'_';
+}
+
+bool CLinearRegEx::s_IsSpace(wchar_t c)
+{
+    switch (c)
+    {
+    case L'\t': case L'\n': case L'\v': case L'\f': case L'\r': case L' ':
+    case 0x00A0: case 0x1680: case 0x2028: case 0x2029: case 0x202F:
+    case 0x205F: case 0x3000: case 0xFEFF:
+        return true;
+    }
+    return (c >= 0x2000 && c <= 0x200A);
+}
+
+bool CLinearRegEx::s_IsLineTerminator(wchar_t c)
+{
+    return c == L'\n' || c == L'\r' || c == 0x2028 || c == 0x2029;
+}
@@ -0,0 +1,193 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ReplaceTemplate.h"
+
+// Regular expression engine that runs in time linear in the length of the
+// name being matched.  Patterns are compiled to a Thompson NFA which is
+// simulated in lock step (a Pike VM) so no input is ever backtracked over.
+//
+// Supports the subset of ECMAScript syntax people use for renaming: literals,
+// '.', character classes, the \d \w \s \b escapes, capturing, non-capturing and
+// named groups, alternation, greedy and lazy quantifiers and the ^ $ anchors.
+// Backreferences and lookaround can't be matched in linear time and are
+// rejected when the pattern is compiled.
+//
+// This file has no Windows dependencies so the engine can be built and tested
+// on any platform.
+class CLinearRegEx
+{
+public:
+    enum CompileResult
+    {
+        CompileOk = 0,
+        CompileInvalidPattern,      // Syntax error
+        CompileUnsupported,         // Valid ECMAScript that needs backtracking
+        CompileTooComplex           // Compiled program would be too large
+    };
+
+    // Literal text found in the pattern when it is compiled.  Used to rule names out
+    // before running the engine.  Folded with towlower when the pattern is case
+    // insensitive.
+    struct LiteralFacts
+    {
+        std::wstring prefix;            // Every match starts with this
+        std::wstring suffix;            // Every match ends with this
+        std::wstring required;          // Every match contains this
+        bool exact = false;             // Every match is exactly prefix
+        bool anchoredStart = false;     // Every match starts at the start of the text
+        bool anchoredEnd = false;       // Every match ends at the end of the text
+        bool plain = false;             // Nothing but literal text, a leading ^ and a trailing $
+    };
+
+    enum MatchStatus
+    {
+        MatchOk = 0,
+        MatchStepLimit,             // Ran over MatchLimits::maxSteps
+        MatchStopped                // MatchLimits::poll asked to stop
+    };
+
+    // Bounds the work a single Replace call may do.  A step is one NFA thread
+    // advanced by one character.  poll is called every few thousand steps so the
+    // caller can enforce a time limit or cancel; returning anything but MatchOk
+    // stops the match.
+    struct MatchLimits
+    {
+        size_t maxSteps = npos;
+        MatchStatus (*poll)(void* context) = nullptr;
+        void* context = nullptr;
+    };
+
+    CLinearRegEx() = default;
+
+    CompileResult Compile(const wchar_t* pattern, size_t length, bool caseSensitive);
+    bool IsCompiled() const { return !m_program.empty(); }
+
+    // Number of capture groups, not counting the implicit group 0 for the whole match
+    size_t GetGroupCount() const { return m_groupCount; }
+    const std::map<std::wstring, size_t>& GetGroupNames() const { return m_groupNames; }
+    const LiteralFacts& GetLiteralFacts() const { return m_literalFacts; }
+
+    // Finds the leftmost match at or after start.  On success captures holds a begin
+    // and end offset for each group, with npos for groups that did not participate.
+    bool Search(const wchar_t* text, size_t length, size_t start, std::vector<size_t>& captures) const;
+
+    // Replaces the first or every match with the ECMAScript style format string
+    // ($$, $&, $`, $', $n, $nn and $<name>).  Returns true if anything matched.
+    bool Replace(const wchar_t* text, size_t length, const wchar_t* format, size_t formatLength, bool matchAll, std::wstring& result) const;
+
+    // Same as above with a template that has already been parsed against this pattern.
+    // If limits stop the match early result is the unchanged text, false is returned
+    // and status says why.
+    bool Replace(const wchar_t* text, size_t length, const CReplaceTemplate& replaceTemplate, bool matchAll, std::wstring& result,
+        const MatchLimits* limits = nullptr, MatchStatus* status = nullptr) const;
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+private:
+    enum Opcode
+    {
+        OpChar,                 // Consume ch
+        OpAny,                  // Consume anything but a line terminator
+        OpClass,                // Consume a member of m_classes[x]
+        OpSplit,                // Continue at x, then at y with lower priority
+        OpJmp,                  // Continue at x
+        OpSave,                 // Record the current offset in capture slot x
+        OpBol,                  // Assert start of input
+        OpEol,                  // Assert end of input
+        OpWordBoundary,
+        OpNotWordBoundary,
+        OpMatch
+    };
+
+    struct Instruction
+    {
+        Opcode op;
+        wchar_t ch;
+        size_t x;
+        size_t y;
+    };
+
+    enum ClassBuiltin
+    {
+        BuiltinDigit = 0x1,
+        BuiltinNotDigit = 0x2,
+        BuiltinWord = 0x4,
+        BuiltinNotWord = 0x8,
+        BuiltinSpace = 0x10,
+        BuiltinNotSpace = 0x20
+    };
+
+    struct CharClass
+    {
+        std::vector<std::pair<wchar_t, wchar_t>> ranges;
+        unsigned builtins = 0;
+        bool negated = false;
+    };
+
+    enum NodeType
+    {
+        NodeEmpty,
+        NodeChar,
+        NodeAny,
+        NodeClass,
+        NodeBol,
+        NodeEol,
+        NodeWordBoundary,
+        NodeNotWordBoundary,
+        NodeConcat,
+        NodeAlternate,
+        NodeGroup,
+        NodeRepeat
+    };
+
+    // Parsed form of the pattern.  Nodes refer to each other by index into m_nodes.
+    struct Node
+    {
+        NodeType type = NodeEmpty;
+        wchar_t ch = 0;
+        size_t classIndex = 0;
+        size_t group = npos;            // Capture group for NodeGroup, npos if non-capturing
+        size_t min = 0;
+        size_t max = 0;                 // npos for unbounded repeats
+        bool greedy = true;
+        std::vector<size_t> children;
+    };
+
+    struct ThreadList;
+    struct SearchState;
+    class CParser;
+
+    bool _Search(SearchState& state, const wchar_t* text, size_t length, size_t start, size_t notEmptyAt) const;
+    bool _CheckLimits(SearchState& state, size_t steps) const;
+    void _AddThread(SearchState& state, ThreadList& list, size_t pc, const wchar_t* text, size_t length, size_t pos, size_t* caps) const;
+    bool _Consumes(const Instruction& inst, wchar_t c) const;
+    bool _ClassContains(const CharClass& charClass, wchar_t c) const;
+
+    bool _Emit(size_t node);
+    size_t _EmitInstruction(Opcode op, wchar_t ch = 0, size_t x = 0, size_t y = 0);
+    void _EmitConsumer(Opcode op, wchar_t ch = 0, size_t x = 0);
+    bool _CanBeEmpty(size_t node) const;
+    void _AnalyzeLiterals(size_t node, LiteralFacts& facts) const;
+
+    static wchar_t s_Fold(wchar_t c);
+    static bool s_IsWordChar(wchar_t c);
+    static bool s_IsSpace(wchar_t c);
+    static bool s_IsLineTerminator(wchar_t c);
+
+    std::vector<Node> m_nodes;
+    // Only used while compiling, see _EmitConsumer
+    std::vector<size_t> m_consumerPcs;
+    std::vector<size_t> m_redirectPcs;
+    size_t m_redirectNext = 0;
+    bool m_redirecting = false;
+    std::vector<CharClass> m_classes;
+    std::vector<Instruction> m_program;
+    std::map<std::wstring, size_t> m_groupNames;
+    LiteralFacts m_literalFacts;
+    size_t m_groupCount = 0;
+    bool m_caseSensitive = true;
+};
@@ -0,0 +1,226 @@
+#include "LiteralSearch.h"
+#include <cstring>
+#include <cwchar>
+#include <cwctype>
+
+#if (defined(_M_X64) || defined(__x86_64__)) && (WCHAR_MAX == 0xFFFF || defined(_WIN32))
+#define LITERAL_SEARCH_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define LITERAL_SEARCH_TARGET_AVX2
+#else
+#define LITERAL_SEARCH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+const size_t CLiteralSearch::npos;
+
+#ifdef LITERAL_SEARCH_SIMD
+static bool s_IsAvx2Supported()
+{
+#ifdef _MSC_VER
+    int info[4] = {};
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    // The OS must save the YMM registers as well as the CPU supporting AVX2
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+static const bool c_useAvx2 = s_IsAvx2Supported();
+
+// Checks the candidate positions in mask, which has two bits set for every 16-bit
+// lane where the first and last characters matched.  Returns the offset of the
+// first full match or npos.
+static size_t s_CheckCandidates(unsigned mask, const wchar_t* text, size_t pos, const wchar_t* term, size_t termLength)
+{
+    while (mask != 0)
+    {
+#ifdef _MSC_VER
+        unsigned long bit;
+        _BitScanForward(&bit, mask);
+#else
+        unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+        size_t candidate = pos + bit / 2;
+        if (termLength <= 2 || memcmp(text + candidate + 1, term + 1, (termLength - 2) * sizeof(wchar_t)) == 0)
+        {
+            return candidate;
+        }
+
+        // Clear both bits for this lane
+        mask &= ~(3u << bit);
+    }
+    return CLiteralSearch::npos;
+}
+
+static size_t s_FindSse2(const wchar_t* text, size_t length, size_t start, const wchar_t* term, size_t termLength, size_t& next)
+{
+    const __m128i first = _mm_set1_epi16(static_cast<short>(term[0]));
+    const __m128i last = _mm_set1_epi16(static_cast<short>(term[termLength - 1]));
+
+    size_t pos = start;
+    for (; pos + 8 + termLength - 1 <= length; pos += 8)
+    {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos + termLength - 1));
+        __m128i eq = _mm_and_si128(_mm_cmpeq_epi16(blockFirst, first), _mm_cmpeq_epi16(blockLast, last));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(eq));
+        if (mask != 0)
+        {
+            size_t found = s_CheckCandidates(mask, text, pos, term, termLength);
+            if (found != CLiteralSearch::npos)
+            {
+                return found;
+            }
+        }
+    }
+
+    next = pos;
+    return CLiteralSearch::npos;
+}
+
+LITERAL_SEARCH_TARGET_AVX2
+static size_t s_FindAvx2(const wchar_t* text, size_t length, size_t start, const wchar_t* term, size_t termLength, size_t& next)
+{
+    const __m256i first = _mm256_set1_epi16(static_cast<short>(term[0]));
+    const __m256i last = _mm256_set1_epi16(static_cast<short>(term[termLength - 1]));
+
+    size_t pos = start;
+    for (; pos + 16 + termLength - 1 <= length; pos += 16)
+    {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos + termLength - 1));
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi16(blockFirst, first), _mm256_cmpeq_epi16(blockLast, last));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(eq));
+        if (mask != 0)
+        {
+            size_t found = s_CheckCandidates(mask, text, pos, term, termLength);
+            if (found != CLiteralSearch::npos)
+            {
+                return found;
+            }
+        }
+    }
+
+    next = pos;
+    return CLiteralSearch::npos;
+}
+#endif
+
+void CLiteralSearch::Init(const wchar_t* searchTerm, size_t length, bool caseSensitive)
+{
+    m_caseSensitive = caseSensitive;
+    if (caseSensitive)
+    {
+        m_searchTerm.assign(searchTerm, length);
+    }
+    else
+    {
+        Fold(searchTerm, length, m_searchTerm);
+    }
+}
+
+size_t CLiteralSearch::Find(const wchar_t* text, size_t length, size_t start) const
+{
+    size_t termLength = m_searchTerm.length();
+    if (termLength == 0 || start > length || length - start < termLength)
+    {
+        return npos;
+    }
+
+#ifdef LITERAL_SEARCH_SIMD
+    // The vector loops stop short of the end of the text.  The scalar loop picks up
+    // from wherever they left off.
+    size_t next = start;
+    size_t found = c_useAvx2 ?
+        s_FindAvx2(text, length, start, m_searchTerm.c_str(), termLength, next) :
+        s_FindSse2(text, length, start, m_searchTerm.c_str(), termLength, next);
+    if (found != npos)
+    {
+        return found;
+    }
+    start = next;
+#endif
+
+    return _FindScalar(text, length, start);
+}
+
+size_t CLiteralSearch::_FindScalar(const wchar_t* text, size_t length, size_t start) const
+{
+    const wchar_t* term = m_searchTerm.c_str();
+    size_t termLength = m_searchTerm.length();
+    for (size_t pos = start; pos + termLength <= length; pos++)
+    {
+        if (text[pos] == term[0] && memcmp(text + pos, term, termLength * sizeof(wchar_t)) == 0)
+        {
+            return pos;
+        }
+    }
+    return npos;
+}
+
+bool CLiteralSearch::Replace(const wchar_t* text, size_t length, const wchar_t* replaceTerm, size_t replaceLength, bool matchAll, std::wstring& result) const
+{
+    result.clear();
+
+    // Search a folded copy but copy the unmatched parts from the original
+    std::wstring folded;
+    const wchar_t* searchText = text;
+    if (!m_caseSensitive)
+    {
+        Fold(text, length, folded);
+        searchText = folded.c_str();
+    }
+
+    bool matched = false;
+    size_t copied = 0;
+    size_t pos = Find(searchText, length, 0);
+    while (pos != npos)
+    {
+        if (!matched)
+        {
+            matched = true;
+            result.reserve(length + replaceLength);
+        }
+
+        result.append(text + copied, pos - copied);
+        result.append(replaceTerm, replaceLength);
+        copied = pos + m_searchTerm.length();
+
+        if (!matchAll)
+        {
+            break;
+        }
+
+        pos = Find(searchText, length, copied);
+    }
+
+    result.append(text + copied, length - copied);
+    return matched;
+}
+
+void CLiteralSearch::Fold(const wchar_t* text, size_t length, std::wstring& folded)
+{
+    folded.resize(length);
+    for (size_t i = 0; i < length; i++)
+    {
+        folded[i] = static_cast<wchar_t>(towlower(text[i]));
+    }
+}
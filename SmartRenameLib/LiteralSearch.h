@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Plain text search used when regular expressions are turned off.
+//
+// The search term is folded once when the object is set up and the name once per
+// Replace call, after which every occurrence is found by one forward scan.  On x64
+// builds with a 16-bit wchar_t the scan compares the first and last character of
+// the term against 8 (SSE2) or 16 (AVX2) positions at a time and only checks the
+// rest of the term where both agree.
+//
+// This file has no Windows dependencies so it can be built and tested on any
+// platform.
+class CLiteralSearch
+{
+public:
+    CLiteralSearch() = default;
+
+    void Init(const wchar_t* searchTerm, size_t length, bool caseSensitive);
+
+    // Finds the term in text starting at start.  text must already be folded with
+    // Fold when the search is case insensitive.  Returns npos if there is no match.
+    size_t Find(const wchar_t* text, size_t length, size_t start) const;
+
+    // Replaces the first or every non-overlapping occurrence in a single left to
+    // right pass.  Returns true if anything matched.
+    bool Replace(const wchar_t* text, size_t length, const wchar_t* replaceTerm, size_t replaceLength, bool matchAll, std::wstring& result) const;
+
+    static void Fold(const wchar_t* text, size_t length, std::wstring& folded);
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+private:
+    size_t _FindScalar(const wchar_t* text, size_t length, size_t start) const;
+
+    std::wstring m_searchTerm;
+    bool m_caseSensitive = true;
+};
@@ -0,0 +1,67 @@
+#include "PathItem.h"
+
+namespace
+{
+    bool IsSeparator(wchar_t c)
+    {
+        return c == L'\\' || c == L'/';
+    }
+
+#ifdef _WIN32
+    const wchar_t c_separator = L'\\';
+#else
+    const wchar_t c_separator = L'/';
+#endif
+}
+
+PATH_ITEM MakePathItem(const wchar_t* path)
+{
+    PATH_ITEM item;
+    item.path = path;
+    item.nameOffset = FindFileNameOffset(item.path.c_str(), item.path.size());
+    return item;
+}
+
+PATH_ITEM MakeChildPathItem(const PATH_ITEM& folder, const wchar_t* name, size_t length)
+{
+    PATH_ITEM item;
+    item.path.reserve(folder.path.size() + 1 + length);
+    item.path = folder.path;
+    if (!item.path.empty() && !IsSeparator(item.path.back()))
+    {
+        item.path.push_back(c_separator);
+    }
+    item.nameOffset = item.path.size();
+    item.path.append(name, length);
+    return item;
+}
+
+size_t FindFileNameOffset(const wchar_t* path, size_t length)
+{
+    size_t offset = 0;
+    for (size_t i = 0; i + 1 < length; i++)
+    {
+        if (IsSeparator(path[i]))
+        {
+            offset = i + 1;
+        }
+    }
+    return offset;
+}
+
+size_t FindExtensionOffset(const wchar_t* name, size_t length)
+{
+    if (length == 2 && name[0] == L'.' && name[1] == L'.')
+    {
+        return length;
+    }
+
+    for (size_t i = length; i > 1; i--)
+    {
+        if (name[i - 1] == L'.')
+        {
+            return i - 1;
+        }
+    }
+    return length;
+}
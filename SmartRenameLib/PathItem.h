@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// A rename item as a folder listing finds it: its full path and where its name
+// starts in that path.  Rename items are built from these without asking the shell
+// for anything.
+//
+// This file has no Windows dependencies so it can be built and tested on any
+// platform.
+struct PATH_ITEM
+{
+    std::wstring path;
+    size_t nameOffset = 0;
+
+    const wchar_t* GetName() const { return path.c_str() + nameOffset; }
+};
+
+// The item for a full path, named after what follows its last \ or /
+PATH_ITEM MakePathItem(const wchar_t* path);
+
+// The item for the entry called name in folder
+PATH_ITEM MakeChildPathItem(const PATH_ITEM& folder, const wchar_t* name, size_t length);
+
+// Where the name starts in path.  A separator at the very end is part of the name,
+// ex: C:\, like PathFindFileName.
+size_t FindFileNameOffset(const wchar_t* path, size_t length);
+
+// Where the extension starts in name, at its last dot, or length if it has none.
+// A dot at the start of the name does not start an extension, so neither ".", ".."
+// nor ".gitignore" have one.
+size_t FindExtensionOffset(const wchar_t* name, size_t length);
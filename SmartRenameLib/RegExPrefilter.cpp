@@ -0,0 +1,72 @@
+#include "RegExPrefilter.h"
+#include <cwctype>
+
+void CRegExPrefilter::Init(const CLinearRegEx::LiteralFacts& facts, bool caseSensitive)
+{
+    m_caseSensitive = caseSensitive;
+    m_prefix = facts.anchoredStart ? facts.prefix : std::wstring();
+    m_suffix = facts.anchoredEnd ? facts.suffix : std::wstring();
+
+    // No need to search for text the prefix or suffix check has already found
+    m_required = facts.required;
+    if (m_required == m_prefix || m_required == m_suffix)
+    {
+        m_required.clear();
+    }
+
+    if (!m_required.empty())
+    {
+        m_search.Init(m_required.c_str(), m_required.length(), caseSensitive);
+    }
+}
+
+bool CRegExPrefilter::MayMatch(const wchar_t* text, size_t length) const
+{
+    if (m_prefix.length() > length || m_suffix.length() > length)
+    {
+        return false;
+    }
+
+    if (!m_prefix.empty() && !_Equals(text, m_prefix))
+    {
+        return false;
+    }
+
+    if (!m_suffix.empty() && !_Equals(text + length - m_suffix.length(), m_suffix))
+    {
+        return false;
+    }
+
+    if (m_required.empty())
+    {
+        return true;
+    }
+
+    if (m_required.length() > length)
+    {
+        return false;
+    }
+
+    if (m_caseSensitive)
+    {
+        return m_search.Find(text, length, 0) != CLiteralSearch::npos;
+    }
+
+    std::wstring folded;
+    CLiteralSearch::Fold(text, length, folded);
+    return m_search.Find(folded.c_str(), folded.length(), 0) != CLiteralSearch::npos;
+}
+
+// Literals are already folded when the pattern is case insensitive
+bool CRegExPrefilter::_Equals(const wchar_t* text, const std::wstring& literal) const
+{
+    for (size_t i = 0; i < literal.length(); i++)
+    {
+        wchar_t c = m_caseSensitive ? text[i] : static_cast<wchar_t>(towlower(text[i]));
+        if (c != literal[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include "LinearRegEx.h"
+#include "LiteralSearch.h"
+
+// Rules out names a regular expression can't possibly match before the regular
+// expression engine runs.
+//
+// Uses the literal facts found when a pattern is compiled: text every match must
+// contain, which is looked for with CLiteralSearch, and text a match anchored to
+// the start or end of the name must begin or end with.  A prefilter that has not
+// been initialized lets every name through.
+//
+// This file has no Windows dependencies so it can be built and tested on any
+// platform.
+class CRegExPrefilter
+{
+public:
+    CRegExPrefilter() = default;
+
+    void Init(const CLinearRegEx::LiteralFacts& facts, bool caseSensitive);
+    bool IsActive() const { return !m_required.empty() || !m_prefix.empty() || !m_suffix.empty(); }
+
+    // Returns false only when the pattern can't match anywhere in text
+    bool MayMatch(const wchar_t* text, size_t length) const;
+
+private:
+    bool _Equals(const wchar_t* text, const std::wstring& literal) const;
+
+    CLiteralSearch m_search;
+    std::wstring m_required;        // Empty when a prefix or suffix check already covers it
+    std::wstring m_prefix;          // Only set for patterns anchored to the start
+    std::wstring m_suffix;          // Only set for patterns anchored to the end
+    bool m_caseSensitive = true;
+};
@@ -0,0 +1,170 @@
+#include "ReplaceTemplate.h"
+#include <cwctype>
+
+const size_t CReplaceTemplate::npos;
+
+void CReplaceTemplate::Parse(const wchar_t* format, size_t length, size_t groupCount, const std::map<std::wstring, size_t>* groupNames)
+{
+    m_ops.clear();
+    m_literals.clear();
+
+    for (size_t i = 0; i < length; i++)
+    {
+        wchar_t c = format[i];
+        wchar_t next = (i + 1 < length) ? format[i + 1] : L'\0';
+        if (c == L'\\' && (next == L'U' || next == L'L' || next == L'E'))
+        {
+            _AddOp((next == L'U') ? OpUpper : ((next == L'L') ? OpLower : OpEndCase));
+            i++;
+        }
+        else if (c != L'$' || i + 1 >= length)
+        {
+            _AddLiteral(&format[i], 1);
+        }
+        else if (next == L'$')
+        {
+            _AddLiteral(&format[i], 1);
+            i++;
+        }
+        else if (next == L'&')
+        {
+            _AddOp(OpGroup, 0);
+            i++;
+        }
+        else if (next == L'`')
+        {
+            _AddOp(OpPrefix);
+            i++;
+        }
+        else if (next == L'\'')
+        {
+            _AddOp(OpSuffix);
+            i++;
+        }
+        else if (next >= L'0' && next <= L'9')
+        {
+            // Prefer a two digit group number if that group exists
+            size_t group = next - L'0';
+            i++;
+            if (i + 1 < length && format[i + 1] >= L'0' && format[i + 1] <= L'9')
+            {
+                size_t twoDigit = group * 10 + (format[i + 1] - L'0');
+                if (twoDigit >= 1 && twoDigit <= groupCount)
+                {
+                    group = twoDigit;
+                    i++;
+                }
+            }
+            _AddOp(OpGroup, group);
+        }
+        else if (next == L'<' && groupNames && !groupNames->empty())
+        {
+            size_t close = i + 2;
+            while (close < length && format[close] != L'>')
+            {
+                close++;
+            }
+
+            if (close >= length)
+            {
+                _AddLiteral(&format[i], 1);
+                continue;
+            }
+
+            // Unknown names are replaced with nothing
+            auto it = groupNames->find(std::wstring(format + i + 2, close - (i + 2)));
+            if (it != groupNames->end())
+            {
+                _AddOp(OpGroup, it->second);
+            }
+            i = close;
+        }
+        else
+        {
+            _AddLiteral(&format[i], 1);
+        }
+    }
+}
+
+void CReplaceTemplate::Apply(const wchar_t* text, size_t length, const size_t* captures, size_t groupCount, size_t prefixStart, std::wstring& result) const
+{
+    CaseMode caseMode = CaseNone;
+    for (const Op& op : m_ops)
+    {
+        switch (op.type)
+        {
+        case OpLiteral:
+            s_Append(m_literals.c_str() + op.offset, op.length, caseMode, result);
+            break;
+
+        case OpGroup:
+            // Groups the pattern doesn't have, or that didn't participate, add nothing
+            if (op.offset <= groupCount)
+            {
+                size_t begin = captures[op.offset * 2];
+                size_t end = captures[op.offset * 2 + 1];
+                if (begin != npos && end != npos)
+                {
+                    s_Append(text + begin, end - begin, caseMode, result);
+                }
+            }
+            break;
+
+        case OpPrefix:
+            s_Append(text + prefixStart, captures[0] - prefixStart, caseMode, result);
+            break;
+
+        case OpSuffix:
+            s_Append(text + captures[1], length - captures[1], caseMode, result);
+            break;
+
+        case OpUpper:
+            caseMode = CaseUpper;
+            break;
+
+        case OpLower:
+            caseMode = CaseLower;
+            break;
+
+        case OpEndCase:
+            caseMode = CaseNone;
+            break;
+        }
+    }
+}
+
+void CReplaceTemplate::_AddLiteral(const wchar_t* text, size_t length)
+{
+    // Extend the previous literal when possible so plain text stays a single copy
+    if (!m_ops.empty() && m_ops.back().type == OpLiteral && m_ops.back().offset + m_ops.back().length == m_literals.length())
+    {
+        m_ops.back().length += length;
+    }
+    else
+    {
+        _AddOp(OpLiteral, m_literals.length(), length);
+    }
+    m_literals.append(text, length);
+}
+
+void CReplaceTemplate::_AddOp(OpType type, size_t offset, size_t length)
+{
+    Op op = { type, offset, length };
+    m_ops.push_back(op);
+}
+
+void CReplaceTemplate::s_Append(const wchar_t* text, size_t length, CaseMode caseMode, std::wstring& result)
+{
+    if (caseMode == CaseNone)
+    {
+        result.append(text, length);
+        return;
+    }
+
+    size_t start = result.length();
+    result.append(text, length);
+    for (size_t i = start; i < result.length(); i++)
+    {
+        result[i] = static_cast<wchar_t>((caseMode == CaseUpper) ? towupper(result[i]) : towlower(result[i]));
+    }
+}
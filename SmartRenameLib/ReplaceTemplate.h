@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+// Regular expression replace term parsed once into a list of operations.
+//
+// Understands the ECMAScript substitutions ($$, $&, $`, $', $n, $nn and
+// $<name>) plus the case conversion escapes \U (upper case), \L (lower case)
+// and \E (stop converting).  Case conversion applies to the literal text and
+// to the captured text that follows it.  Any other backslash is copied as is.
+//
+// This file has no Windows dependencies so it can be built and tested on any
+// platform.
+class CReplaceTemplate
+{
+public:
+    CReplaceTemplate() = default;
+
+    // groupCount decides whether $nn refers to one or two digit group numbers.
+    // groupNames may be null when the pattern has no named groups.
+    void Parse(const wchar_t* format, size_t length, size_t groupCount, const std::map<std::wstring, size_t>* groupNames);
+
+    // Appends the replacement for one match to result.  captures holds a begin and
+    // end offset into text for group 0 through groupCount, npos for groups that did
+    // not participate in the match.  $` expands to the text from prefixStart, which
+    // is where the previous match ended, up to the match.
+    void Apply(const wchar_t* text, size_t length, const size_t* captures, size_t groupCount, size_t prefixStart, std::wstring& result) const;
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+private:
+    enum OpType
+    {
+        OpLiteral,      // m_literals[offset, offset + length)
+        OpGroup,        // Capture group
+        OpPrefix,       // Text before the match
+        OpSuffix,       // Text after the match
+        OpUpper,
+        OpLower,
+        OpEndCase
+    };
+
+    struct Op
+    {
+        OpType type;
+        size_t offset;                  // Group number for OpGroup
+        size_t length;
+    };
+
+    enum CaseMode
+    {
+        CaseNone,
+        CaseUpper,
+        CaseLower
+    };
+
+    void _AddLiteral(const wchar_t* text, size_t length);
+    void _AddOp(OpType type, size_t offset = 0, size_t length = 0);
+    static void s_Append(const wchar_t* text, size_t length, CaseMode caseMode, std::wstring& result);
+
+    std::vector<Op> m_ops;
+    std::wstring m_literals;
+};
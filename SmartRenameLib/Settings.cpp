@@ -16,15 +16,19 @@ const wchar_t c_flags[] = L"Flags";
 const wchar_t c_searchText[] = L"SearchText";
 const wchar_t c_replaceText[] = L"ReplaceText";
 const wchar_t c_mruEnabled[] = L"MRUEnabled";
+const wchar_t c_useLinearRegEx[] = L"UseLinearRegEx";
+const wchar_t c_regExTimeLimit[] = L"RegExTimeLimit";
 
 const bool c_enabledDefault = true;
 const bool c_showIconOnMenuDefault = true;
 const bool c_extendedContextMenuOnlyDefaut = false;
 const bool c_persistStateDefault = true;
 const bool c_mruEnabledDefault = true;
+const bool c_useLinearRegExDefault = false;
 
 const DWORD c_maxMRUSizeDefault = 10;
 const DWORD c_flagsDefault = 0;
+const DWORD c_regExTimeLimitDefault = 2000;
 
 bool CSettings::GetEnabled()
 {
@@ -116,6 +120,26 @@ bool CSettings::SetReplaceText(_In_ PCWSTR text)
     return SetRegStringValue(c_replaceText, text);
 }
 
+bool CSettings::GetUseLinearRegEx()
+{
+    return GetRegBoolValue(c_useLinearRegEx, c_useLinearRegExDefault);
+}
+
+bool CSettings::SetUseLinearRegEx(_In_ bool useLinearRegEx)
+{
+    return SetRegBoolValue(c_useLinearRegEx, useLinearRegEx);
+}
+
+DWORD CSettings::GetRegExTimeLimit()
+{
+    return GetRegDWORDValue(c_regExTimeLimit, c_regExTimeLimitDefault);
+}
+
+bool CSettings::SetRegExTimeLimit(_In_ DWORD milliseconds)
+{
+    return SetRegDWORDValue(c_regExTimeLimit, milliseconds);
+}
+
 bool CSettings::SetRegBoolValue(_In_ PCWSTR valueName, _In_ bool value)
 {
     DWORD dwValue = value ? 1 : 0;
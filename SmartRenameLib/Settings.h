@@ -30,6 +30,13 @@ public:
     static bool GetReplaceText(__out_ecount(cchBuf) PWSTR text, DWORD cchBuf);
     static bool SetReplaceText(_In_ PCWSTR text);
 
+    static bool GetUseLinearRegEx();
+    static bool SetUseLinearRegEx(_In_ bool useLinearRegEx);
+
+    // Milliseconds a single name may spend in the regular expression, 0 for no limit
+    static DWORD GetRegExTimeLimit();
+    static bool SetRegExTimeLimit(_In_ DWORD milliseconds);
+
 private:
     static bool GetRegBoolValue(_In_ PCWSTR valueName, _In_ bool defaultValue);
     static bool SetRegBoolValue(_In_ PCWSTR valueName, _In_ bool value);
@@ -0,0 +1,147 @@
+#include "ShapeMatcher.h"
+#include <cwctype>
+
+void CShapeMatcher::Init(const CLinearRegEx::LiteralFacts& facts, bool caseSensitive, bool matchAll)
+{
+    m_shape = ShapeNone;
+    m_replace = nullptr;
+    m_literal.clear();
+
+    // An empty literal matches between every character, leave that to the engine
+    if (!facts.plain || !facts.exact || facts.prefix.empty())
+    {
+        return;
+    }
+
+    if (facts.anchoredStart && facts.anchoredEnd)
+    {
+        m_shape = ShapeWhole;
+    }
+    else if (facts.anchoredStart)
+    {
+        m_shape = ShapePrefix;
+    }
+    else if (facts.anchoredEnd)
+    {
+        m_shape = ShapeSuffix;
+    }
+    else
+    {
+        m_shape = ShapeLiteral;
+    }
+
+    m_literal = facts.prefix;
+    if (m_shape == ShapeLiteral)
+    {
+        m_search.Init(m_literal.c_str(), m_literal.length(), caseSensitive);
+    }
+
+    if (caseSensitive)
+    {
+        m_replace = matchAll ? s_SelectReplace<true, true>(m_shape) : s_SelectReplace<true, false>(m_shape);
+    }
+    else
+    {
+        m_replace = matchAll ? s_SelectReplace<false, true>(m_shape) : s_SelectReplace<false, false>(m_shape);
+    }
+}
+
+template <bool caseSensitive, bool matchAll>
+CShapeMatcher::ReplaceFunction CShapeMatcher::s_SelectReplace(Shape shape)
+{
+    switch (shape)
+    {
+    case ShapeLiteral:
+        return s_Replace<ShapeLiteral, caseSensitive, matchAll>;
+
+    case ShapePrefix:
+        return s_Replace<ShapePrefix, caseSensitive, matchAll>;
+
+    case ShapeSuffix:
+        return s_Replace<ShapeSuffix, caseSensitive, matchAll>;
+
+    case ShapeWhole:
+        return s_Replace<ShapeWhole, caseSensitive, matchAll>;
+
+    default:
+        return nullptr;
+    }
+}
+
+template <CShapeMatcher::Shape shape, bool caseSensitive, bool matchAll>
+bool CShapeMatcher::s_Replace(const CShapeMatcher& matcher, const wchar_t* text, size_t length, const CReplaceTemplate& replaceTemplate, std::wstring& result)
+{
+    result.clear();
+
+    const std::wstring& literal = matcher.m_literal;
+    size_t captures[2] = { CReplaceTemplate::npos, CReplaceTemplate::npos };
+    if (literal.length() > length)
+    {
+        result.assign(text, length);
+        return false;
+    }
+
+    if (shape != ShapeLiteral)
+    {
+        // Anchored shapes match at most once so matchAll makes no difference
+        size_t start = (shape == ShapeSuffix) ? (length - literal.length()) : 0;
+        if ((shape == ShapeWhole && literal.length() != length) || !s_Equals<caseSensitive>(text + start, literal))
+        {
+            result.assign(text, length);
+            return false;
+        }
+
+        captures[0] = start;
+        captures[1] = start + literal.length();
+        result.append(text, start);
+        replaceTemplate.Apply(text, length, captures, 0, 0, result);
+        result.append(text + captures[1], length - captures[1]);
+        return true;
+    }
+
+    // The literal search wants the name folded the same way as the literal
+    std::wstring folded;
+    const wchar_t* searchText = text;
+    if (!caseSensitive)
+    {
+        CLiteralSearch::Fold(text, length, folded);
+        searchText = folded.c_str();
+    }
+
+    bool matched = false;
+    size_t copied = 0;
+    size_t pos = matcher.m_search.Find(searchText, length, 0);
+    while (pos != CLiteralSearch::npos)
+    {
+        matched = true;
+        captures[0] = pos;
+        captures[1] = pos + literal.length();
+        result.append(text + copied, pos - copied);
+        replaceTemplate.Apply(text, length, captures, 0, copied, result);
+        copied = captures[1];
+
+        if (!matchAll)
+        {
+            break;
+        }
+
+        pos = matcher.m_search.Find(searchText, length, copied);
+    }
+
+    result.append(text + copied, length - copied);
+    return matched;
+}
+
+template <bool caseSensitive>
+bool CShapeMatcher::s_Equals(const wchar_t* text, const std::wstring& literal)
+{
+    for (size_t i = 0; i < literal.length(); i++)
+    {
+        wchar_t c = caseSensitive ? text[i] : static_cast<wchar_t>(towlower(text[i]));
+        if (c != literal[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include "LinearRegEx.h"
+#include "LiteralSearch.h"
+#include "ReplaceTemplate.h"
+
+// Replaces matches of regular expressions that are nothing but literal text,
+// without running a regular expression engine.
+//
+// Recognizes four shapes from the literal facts found when a pattern is compiled:
+// a literal anywhere in the name (foo), a prefix (^IMG_), a suffix or extension
+// (\.jpeg$) and the whole name (^foo$).  Each shape has its own matcher compiled
+// for every combination of case sensitivity and match all occurrences, and Init
+// picks the one the pattern needs.  Other patterns leave the matcher inactive.
+//
+// This file has no Windows dependencies so it can be built and tested on any
+// platform.
+class CShapeMatcher
+{
+public:
+    enum Shape
+    {
+        ShapeNone = 0,      // Needs a regular expression engine
+        ShapeLiteral,
+        ShapePrefix,
+        ShapeSuffix,
+        ShapeWhole
+    };
+
+    CShapeMatcher() = default;
+
+    void Init(const CLinearRegEx::LiteralFacts& facts, bool caseSensitive, bool matchAll);
+    Shape GetShape() const { return m_shape; }
+    bool IsActive() const { return m_shape != ShapeNone; }
+
+    // Same result as the regular expression engine.  Returns true if anything matched.
+    bool Replace(const wchar_t* text, size_t length, const CReplaceTemplate& replaceTemplate, std::wstring& result) const
+    {
+        return m_replace(*this, text, length, replaceTemplate, result);
+    }
+
+private:
+    typedef bool (*ReplaceFunction)(const CShapeMatcher& matcher, const wchar_t* text, size_t length, const CReplaceTemplate& replaceTemplate, std::wstring& result);
+
+    template <Shape shape, bool caseSensitive, bool matchAll>
+    static bool s_Replace(const CShapeMatcher& matcher, const wchar_t* text, size_t length, const CReplaceTemplate& replaceTemplate, std::wstring& result);
+
+    template <bool caseSensitive>
+    static bool s_Equals(const wchar_t* text, const std::wstring& literal);
+
+    template <bool caseSensitive, bool matchAll>
+    static ReplaceFunction s_SelectReplace(Shape shape);
+
+    Shape m_shape = ShapeNone;
+    ReplaceFunction m_replace = nullptr;
+    std::wstring m_literal;             // Folded when the pattern is case insensitive
+    CLiteralSearch m_search;            // ShapeLiteral only
+};
@@ -14,12 +14,21 @@ enum SmartRenameFlags
     ExtensionOnly = 0x100
 };
 
+// The search term could not be compiled as a regular expression with the current flags
+#define SR_E_INVALIDPATTERN MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x200)
+// The search term is valid but uses features the selected regular expression engine does not support
+#define SR_E_UNSUPPORTEDPATTERN MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x201)
+// A name took longer than the time limit, or too many steps, to run through the regular expression
+#define SR_E_EVALUATIONLIMIT MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x202)
+
 interface __declspec(uuid("3ECBA62B-E0F0-4472-AA2E-DEE7A1AA46B9")) ISmartRenameRegExEvents : public IUnknown
 {
 public:
     IFACEMETHOD(OnSearchTermChanged)(_In_ PCWSTR searchTerm) = 0;
     IFACEMETHOD(OnReplaceTermChanged)(_In_ PCWSTR replaceTerm) = 0;
     IFACEMETHOD(OnFlagsChanged)(_In_ DWORD flags) = 0;
+    IFACEMETHOD(OnPatternError)(_In_ HRESULT hr) = 0;
+    IFACEMETHOD(OnRulesChanged)() = 0;
 };
 
 interface __declspec(uuid("E3ED45B5-9CE0-47E2-A595-67EB950B9B72")) ISmartRenameRegEx : public IUnknown
@@ -34,6 +43,42 @@ public:
     IFACEMETHOD(get_flags)(_Out_ DWORD* flags) = 0;
     IFACEMETHOD(put_flags)(_In_ DWORD flags) = 0;
     IFACEMETHOD(Replace)(_In_ PCWSTR source, _Outptr_ PWSTR* result) = 0;
+    // Replaces count names in one call.  Each result is written null terminated into arena at
+    // offsets[i] and its status to results[i].  If arena fills up the call stops and returns
+    // HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER); processed says how many items completed.
+    // cancelEvent is checked while names are matched and stops the call with
+    // HRESULT_FROM_WIN32(ERROR_CANCELLED) once signaled.
+    IFACEMETHOD(ReplaceBatch)(_In_ UINT count, _In_reads_(count) const PCWSTR* sources, _In_opt_ HANDLE cancelEvent, _Out_writes_(arenaSize) PWSTR arena, _In_ UINT arenaSize,
+        _Out_writes_(count) UINT* offsets, _Out_writes_(count) HRESULT* results, _Out_ UINT* processed) = 0;
+    // Longest a single name may spend in the regular expression before it fails with
+    // SR_E_EVALUATIONLIMIT.  0, the default, means no limit.
+    IFACEMETHOD(get_timeLimit)(_Out_ DWORD* milliseconds) = 0;
+    IFACEMETHOD(put_timeLimit)(_In_ DWORD milliseconds) = 0;
+    // Extra rules applied in order after the search and replace terms.  flags takes the
+    // CaseSensitive, MatchAllOccurences and UseRegularExpressions values of SmartRenameFlags.
+    IFACEMETHOD(AddRule)(_In_ PCWSTR searchTerm, _In_ PCWSTR replaceTerm, _In_ DWORD flags) = 0;
+    IFACEMETHOD(ClearRules)() = 0;
+    IFACEMETHOD(GetRuleCount)(_Out_ UINT* count) = 0;
+};
+
+// A string borrowed from an item.  text is null terminated and stays valid until the
+// item is unpinned.  Two views of the same string with the same generation have the
+// same text, so callers can cache what they did with one.
+struct SMARTRENAME_STRING_VIEW
+{
+    PCWSTR text;
+    UINT length;
+    ULONG generation;
+};
+
+// What a list shows for an item, read by index without creating the item
+struct SMARTRENAME_ITEM_DISPLAY
+{
+    int id;
+    int iconIndex;          // -1 until the item has been asked for its icon
+    UINT depth;
+    bool selected;
+    bool shouldRename;      // ShouldRenameItem under the manager's flags
 };
 
 interface __declspec(uuid("C7F59201-4DE1-4855-A3A2-26FC3279C8A5")) ISmartRenameItem : public IUnknown
@@ -54,6 +99,13 @@ public:
     IFACEMETHOD(put_depth)(_In_ int depth) = 0;
     IFACEMETHOD(ShouldRenameItem)(_In_ DWORD flags, _Out_ bool* shouldRename) = 0;
     IFACEMETHOD(Reset)() = 0;
+    // Read the strings above without copying them.  Views can only be taken while the
+    // item is pinned.  Pin and Unpin calls nest and must be balanced.
+    IFACEMETHOD(Pin)() = 0;
+    IFACEMETHOD(Unpin)() = 0;
+    IFACEMETHOD(get_pathView)(_Out_ SMARTRENAME_STRING_VIEW* view) = 0;
+    IFACEMETHOD(get_originalNameView)(_Out_ SMARTRENAME_STRING_VIEW* view) = 0;
+    IFACEMETHOD(get_newNameView)(_Out_ SMARTRENAME_STRING_VIEW* view) = 0;
 };
 
 interface __declspec(uuid("{26CBFFD9-13B3-424E-BAC9-D12B0539149C}")) ISmartRenameItemFactory : public IUnknown
@@ -62,15 +114,34 @@ public:
     IFACEMETHOD(Create)(_In_ IShellItem* psi, _COM_Outptr_ ISmartRenameItem** ppItem) = 0;
 };
 
+// Creates items from what a folder listing already returned, without asking the shell
+// about each one.  A shell item is only made from the path if get_shellItem is called.
+// name is the item's name as listed, usually the end of path.
+interface __declspec(uuid("9D2F6C1B-3A8E-4F57-B0D4-6E1C2A7F8B35")) ISmartRenameItemPathFactory : public IUnknown
+{
+public:
+    IFACEMETHOD(CreateFromPath)(_In_ PCWSTR path, _In_ PCWSTR name, _In_ bool isFolder, _In_ UINT depth, _COM_Outptr_ ISmartRenameItem** ppItem) = 0;
+};
+
 interface __declspec(uuid("87FC43F9-7634-43D9-99A5-20876AFCE4AD")) ISmartRenameManagerEvents : public IUnknown
 {
 public:
     IFACEMETHOD(OnItemAdded)(_In_ ISmartRenameItem* renameItem) = 0;
+    // count items were added by AddItems, at firstIndex or after.  Items are normally
+    // added in the order they were created, so these are [firstIndex, firstIndex + count).
+    // Otherwise every item from firstIndex on may have moved.
+    IFACEMETHOD(OnItemsAdded)(_In_ UINT firstIndex, _In_ UINT count) = 0;
     IFACEMETHOD(OnUpdate)(_In_ ISmartRenameItem* renameItem) = 0;
+    // Items [firstIndex, firstIndex + count) may have new names.  Preview passes report
+    // their results this way, once per batch rather than once per item.
+    IFACEMETHOD(OnItemsUpdated)(_In_ UINT firstIndex, _In_ UINT count) = 0;
     IFACEMETHOD(OnError)(_In_ ISmartRenameItem* renameItem) = 0;
-    IFACEMETHOD(OnRegExStarted)(_In_ DWORD threadId) = 0;
-    IFACEMETHOD(OnRegExCanceled)(_In_ DWORD threadId) = 0;
-    IFACEMETHOD(OnRegExCompleted)(_In_ DWORD threadId) = 0;
+    // passId identifies one preview pass.  It is an opaque number that increases with
+    // every pass, not a thread id, so listeners can match the events of the newest
+    // pass and ignore those of passes it replaced.
+    IFACEMETHOD(OnRegExStarted)(_In_ DWORD passId) = 0;
+    IFACEMETHOD(OnRegExCanceled)(_In_ DWORD passId) = 0;
+    IFACEMETHOD(OnRegExCompleted)(_In_ DWORD passId) = 0;
     IFACEMETHOD(OnRenameStarted)() = 0;
     IFACEMETHOD(OnRenameCompleted)() = 0;
 };
@@ -82,15 +153,33 @@ public:
     IFACEMETHOD(UnAdvise)(_In_ DWORD cookie) = 0;
     IFACEMETHOD(Start)() = 0;
     IFACEMETHOD(Stop)() = 0;
+    // Removes every item, ex: to enumerate the selection again with other flags.
+    // Listeners aren't told, they should drop what they show themselves.
     IFACEMETHOD(Reset)() = 0;
     IFACEMETHOD(Shutdown)() = 0;
     IFACEMETHOD(Rename)(_In_ HWND hwndParent) = 0;
     IFACEMETHOD(AddItem)(_In_ ISmartRenameItem* pItem) = 0;
+    // Adds a batch of items with one lock and one OnItemsAdded for all of them rather
+    // than an OnItemAdded per item.  Items already added are skipped and S_FALSE is
+    // returned.
+    IFACEMETHOD(AddItems)(_In_reads_(count) ISmartRenameItem* const* items, _In_ UINT count) = 0;
     IFACEMETHOD(GetItemByIndex)(_In_ UINT index, _COM_Outptr_ ISmartRenameItem** ppItem) = 0;
     IFACEMETHOD(GetItemById)(_In_ int id, _COM_Outptr_ ISmartRenameItem** ppItem) = 0;
+    // Reads the item at index under a shared lock without creating an item for it, so
+    // it is cheap enough for every row a list paints.  Copies the original name into
+    // text, or the new name if newName is true and the item would be renamed.
+    IFACEMETHOD(GetItemDisplay)(_In_ UINT index, _In_ bool newName, _Out_ SMARTRENAME_ITEM_DISPLAY* display, _Out_writes_opt_(cchText) PWSTR text, _In_ UINT cchText) = 0;
     IFACEMETHOD(GetItemCount)(_Out_ UINT* count) = 0;
+    // Both counts are kept up to date as items change so they are cheap to call
     IFACEMETHOD(GetSelectedItemCount)(_Out_ UINT* count) = 0;
     IFACEMETHOD(GetRenameItemCount)(_Out_ UINT* count) = 0;
+    // Items [firstIndex, firstIndex + count) are evaluated ahead of the rest by preview
+    // passes, including one already running.  Typically the rows the user can see.
+    IFACEMETHOD(SetPriorityRange)(_In_ UINT firstIndex, _In_ UINT count) = 0;
+    IFACEMETHOD(GetPriorityRange)(_Out_ UINT* firstIndex, _Out_ UINT* count) = 0;
+    // Queues a preview pass over every item, ex: to preview items added since the
+    // last pass.  Supersedes the pass in flight like an edit would.
+    IFACEMETHOD(RefreshPreview)() = 0;
     IFACEMETHOD(get_flags)(_Out_ DWORD* flags) = 0;
     IFACEMETHOD(put_flags)(_In_ DWORD flags) = 0;
     IFACEMETHOD(get_renameRegEx)(_COM_Outptr_ ISmartRenameRegEx** ppRegEx) = 0;
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "SmartRenameItem.h"
+#include "PathItem.h"
 #include "helpers.h"
 
 int CSmartRenameItem::s_id = 0;
@@ -15,6 +16,13 @@ IFACEMETHODIMP_(ULONG) CSmartRenameItem::Release()
 
     if (refCount == 0)
     {
+        // Until it is out of the store's cache the store could still hand this
+        // facade out, but it won't once the count is zero
+        std::shared_ptr<CSmartRenameItemStore> store = _GetStore();
+        if (store)
+        {
+            store->RemoveFacade(m_id, this);
+        }
         delete this;
     }
     return refCount;
@@ -22,9 +30,18 @@ IFACEMETHODIMP_(ULONG) CSmartRenameItem::Release()
 
 IFACEMETHODIMP CSmartRenameItem::QueryInterface(_In_ REFIID riid, _Outptr_ void** ppv)
 {
+    // Lets the item store recognize the items it can turn into facades
+    if (IsEqualIID(riid, __uuidof(CSmartRenameItem)))
+    {
+        *ppv = this;
+        AddRef();
+        return S_OK;
+    }
+
     static const QITAB qit[] = {
         QITABENT(CSmartRenameItem, ISmartRenameItem),
         QITABENT(CSmartRenameItem, ISmartRenameItemFactory),
+        QITABENT(CSmartRenameItem, ISmartRenameItemPathFactory),
         { 0 }
     };
     return QISearch(this, qit, riid, ppv);
@@ -33,6 +50,12 @@ IFACEMETHODIMP CSmartRenameItem::QueryInterface(_In_ REFIID riid, _Outptr_ void*
 IFACEMETHODIMP CSmartRenameItem::get_path(_Outptr_ PWSTR* path)
 {
     *path = nullptr;
+    std::shared_ptr<CSmartRenameItemStore> store = _GetStore();
+    if (store)
+    {
+        return store->GetString(m_id, CSmartRenameItemStore::ItemPath, path);
+    }
+
     CSRWSharedAutoLock lock(&m_lock);
     HRESULT hr = m_path ? S_OK : E_FAIL;
     if (SUCCEEDED(hr))
@@ -44,11 +67,26 @@ IFACEMETHODIMP CSmartRenameItem::get_path(_Outptr_ PWSTR* path)
 
 IFACEMETHODIMP CSmartRenameItem::get_shellItem(_Outptr_ IShellItem** ppsi)
 {
-    return SHCreateItemFromParsingName(m_path, nullptr, IID_PPV_ARGS(ppsi));
+    *ppsi = nullptr;
+    PWSTR path = nullptr;
+    HRESULT hr = get_path(&path);
+    if (SUCCEEDED(hr))
+    {
+        hr = SHCreateItemFromParsingName(path, nullptr, IID_PPV_ARGS(ppsi));
+        CoTaskMemFree(path);
+    }
+    return hr;
 }
 
 IFACEMETHODIMP CSmartRenameItem::get_originalName(_Outptr_ PWSTR* originalName)
 {
+    *originalName = nullptr;
+    std::shared_ptr<CSmartRenameItemStore> store = _GetStore();
+    if (store)
+    {
+        return store->GetString(m_id, CSmartRenameItemStore::ItemOriginalName, originalName);
+    }
+
     CSRWSharedAutoLock lock(&m_lock);
     HRESULT hr = m_originalName ? S_OK : E_FAIL;
     if (SUCCEEDED(hr))
@@ -60,9 +98,16 @@ IFACEMETHODIMP CSmartRenameItem::get_originalName(_Outptr_ PWSTR* originalName)
 
 IFACEMETHODIMP CSmartRenameItem::put_newName(_In_opt_ PCWSTR newName)
 {
-    CSRWSharedAutoLock lock(&m_lock);
-    CoTaskMemFree(m_newName);
+    std::shared_ptr<CSmartRenameItemStore> store = _GetStore();
+    if (store)
+    {
+        return store->PutNewName(m_id, newName);
+    }
+
+    CSRWExclusiveAutoLock lock(&m_lock);
+    _RetireString(m_newName);
     m_newName = nullptr;
+    m_newNameGeneration = CSmartRenameItemStore::s_NextGeneration();
     HRESULT hr = S_OK;
     if (newName != nullptr)
     {
@@ -73,6 +118,13 @@ IFACEMETHODIMP CSmartRenameItem::put_newName(_In_opt_ PCWSTR newName)
 
 IFACEMETHODIMP CSmartRenameItem::get_newName(_Outptr_ PWSTR* newName)
 {
+    *newName = nullptr;
+    std::shared_ptr<CSmartRenameItemStore> store = _GetStore();
+    if (store)
+    {
+        return store->GetString(m_id, CSmartRenameItemStore::ItemNewName, newName);
+    }
+
     CSRWSharedAutoLock lock(&m_lock);
     HRESULT hr = m_newName ? S_OK : E_FAIL;
     if (SUCCEEDED(hr))
@@ -84,41 +136,67 @@ IFACEMETHODIMP CSmartRenameItem::get_newName(_Outptr_ PWSTR* newName)
 
 IFACEMETHODIMP CSmartRenameItem::get_isFolder(_Out_ bool* isFolder)
 {
-    CSRWSharedAutoLock lock(&m_lock);
-    *isFolder = m_isFolder;
-    return S_OK;
+    CSmartRenameItemStore::ITEM_ATTRIBUTES attributes;
+    HRESULT hr = _GetAttributes(&attributes);
+    *isFolder = attributes.isFolder;
+    return hr;
 }
 
 IFACEMETHODIMP CSmartRenameItem::get_isSubFolderContent(_Out_ bool* isSubFolderContent)
 {
-    CSRWSharedAutoLock lock(&m_lock);
-    *isSubFolderContent = m_depth > 0;
-    return S_OK;
+    CSmartRenameItemStore::ITEM_ATTRIBUTES attributes;
+    HRESULT hr = _GetAttributes(&attributes);
+    *isSubFolderContent = attributes.depth > 0;
+    return hr;
 }
 
 IFACEMETHODIMP CSmartRenameItem::get_selected(_Out_ bool* selected)
 {
-    CSRWSharedAutoLock lock(&m_lock);
-    *selected = m_selected;
-    return S_OK;
+    CSmartRenameItemStore::ITEM_ATTRIBUTES attributes;
+    HRESULT hr = _GetAttributes(&attributes);
+    *selected = attributes.selected;
+    return hr;
 }
 
 IFACEMETHODIMP CSmartRenameItem::put_selected(_In_ bool selected)
 {
-    CSRWSharedAutoLock lock(&m_lock);
+    std::shared_ptr<CSmartRenameItemStore> store = _GetStore();
+    if (store)
+    {
+        return store->PutSelected(m_id, selected);
+    }
+
+    CSRWExclusiveAutoLock lock(&m_lock);
     m_selected = selected;
     return S_OK;
 }
 
 IFACEMETHODIMP CSmartRenameItem::get_id(_Out_ int* id)
 {
-    CSRWSharedAutoLock lock(&m_lock);
     *id = m_id;
     return S_OK;
 }
 
 IFACEMETHODIMP CSmartRenameItem::get_iconIndex(_Out_ int* iconIndex)
 {
+    std::shared_ptr<CSmartRenameItemStore> store = _GetStore();
+    if (store)
+    {
+        // Facades come and go so the icon is remembered by the store
+        store->GetIconIndex(m_id, iconIndex);
+        if (*iconIndex == -1)
+        {
+            PWSTR path = nullptr;
+            if (SUCCEEDED(get_path(&path)))
+            {
+                GetIconIndexFromPath(path, iconIndex);
+                store->PutIconIndex(m_id, *iconIndex);
+                CoTaskMemFree(path);
+            }
+        }
+        return S_OK;
+    }
+
     if (m_iconIndex == -1)
     {
         GetIconIndexFromPath((PCWSTR)m_path, &m_iconIndex);
@@ -129,12 +207,21 @@ IFACEMETHODIMP CSmartRenameItem::get_iconIndex(_Out_ int* iconIndex)
 
 IFACEMETHODIMP CSmartRenameItem::get_depth(_Out_ UINT* depth)
 {
-    *depth = m_depth;
-    return S_OK;
+    CSmartRenameItemStore::ITEM_ATTRIBUTES attributes;
+    HRESULT hr = _GetAttributes(&attributes);
+    *depth = attributes.depth;
+    return hr;
 }
 
 IFACEMETHODIMP CSmartRenameItem::put_depth(_In_ int depth)
 {
+    std::shared_ptr<CSmartRenameItemStore> store = _GetStore();
+    if (store)
+    {
+        return store->PutDepth(m_id, depth);
+    }
+
+    CSRWExclusiveAutoLock lock(&m_lock);
     m_depth = depth;
     return S_OK;
 }
@@ -143,11 +230,12 @@ IFACEMETHODIMP CSmartRenameItem::ShouldRenameItem(_In_ DWORD flags, _Out_ bool*
 {
     // Should we perform a rename on this item given its
     // state and the options that were set?
-    bool hasChanged = m_newName != nullptr && (lstrcmp(m_originalName, m_newName) != 0);
-    bool excludeBecauseFolder = (m_isFolder && (flags & SmartRenameFlags::ExcludeFolders));
-    bool excludeBecauseFile = (!m_isFolder && (flags & SmartRenameFlags::ExcludeFiles));
-    bool excludeBecauseSubFolderContent = (m_depth > 0 && (flags & SmartRenameFlags::ExcludeSubfolders));
-    *shouldRename = (m_selected && hasChanged && !excludeBecauseFile &&
+    CSmartRenameItemStore::ITEM_ATTRIBUTES attributes;
+    HRESULT hr = _GetAttributes(&attributes);
+    bool excludeBecauseFolder = (attributes.isFolder && (flags & SmartRenameFlags::ExcludeFolders));
+    bool excludeBecauseFile = (!attributes.isFolder && (flags & SmartRenameFlags::ExcludeFiles));
+    bool excludeBecauseSubFolderContent = (attributes.depth > 0 && (flags & SmartRenameFlags::ExcludeSubfolders));
+    *shouldRename = (SUCCEEDED(hr) && attributes.selected && attributes.hasChanged && !excludeBecauseFile &&
                      !excludeBecauseFolder && !excludeBecauseSubFolderContent);
 
     return S_OK;
@@ -155,12 +243,162 @@ IFACEMETHODIMP CSmartRenameItem::ShouldRenameItem(_In_ DWORD flags, _Out_ bool*
 
 IFACEMETHODIMP CSmartRenameItem::Reset()
 {
-    CSRWSharedAutoLock lock(&m_lock);
+    return put_newName(nullptr);
+}
+
+IFACEMETHODIMP CSmartRenameItem::Pin()
+{
+    // The store can't change while the item is pinned, see _Bind
+    CSRWExclusiveAutoLock lock(&m_lock);
+    if (m_pinCount++ == 0 && m_store)
+    {
+        m_store->Pin();
+    }
+    return S_OK;
+}
+
+IFACEMETHODIMP CSmartRenameItem::Unpin()
+{
+    CSRWExclusiveAutoLock lock(&m_lock);
+    HRESULT hr = (m_pinCount > 0) ? S_OK : E_UNEXPECTED;
+    if (SUCCEEDED(hr) && --m_pinCount == 0)
+    {
+        if (m_store)
+        {
+            m_store->Unpin();
+        }
+
+        for (PWSTR value : m_retiredStrings)
+        {
+            CoTaskMemFree(value);
+        }
+        m_retiredStrings.clear();
+    }
+    return hr;
+}
+
+IFACEMETHODIMP CSmartRenameItem::get_pathView(_Out_ SMARTRENAME_STRING_VIEW* view)
+{
+    return _GetStringView(CSmartRenameItemStore::ItemPath, view);
+}
+
+IFACEMETHODIMP CSmartRenameItem::get_originalNameView(_Out_ SMARTRENAME_STRING_VIEW* view)
+{
+    return _GetStringView(CSmartRenameItemStore::ItemOriginalName, view);
+}
+
+IFACEMETHODIMP CSmartRenameItem::get_newNameView(_Out_ SMARTRENAME_STRING_VIEW* view)
+{
+    return _GetStringView(CSmartRenameItemStore::ItemNewName, view);
+}
+
+bool CSmartRenameItem::_TryAddRef()
+{
+    long refCount = m_refCount;
+    while (refCount > 0)
+    {
+        long previous = InterlockedCompareExchange(&m_refCount, refCount + 1, refCount);
+        if (previous == refCount)
+        {
+            return true;
+        }
+        refCount = previous;
+    }
+    return false;
+}
+
+bool CSmartRenameItem::_Bind(_In_ const std::shared_ptr<CSmartRenameItemStore>& store, _Out_opt_ std::shared_ptr<CSmartRenameItemStore>* previousStore)
+{
+    CSRWExclusiveAutoLock lock(&m_lock);
+    if (m_pinCount > 0)
+    {
+        return false;
+    }
+
+    // The store has its own copy of everything now
+    CoTaskMemFree(m_path);
+    CoTaskMemFree(m_originalName);
     CoTaskMemFree(m_newName);
+    m_path = nullptr;
+    m_originalName = nullptr;
     m_newName = nullptr;
+
+    if (previousStore)
+    {
+        *previousStore = m_store;
+    }
+    m_store = store;
+    return true;
+}
+
+std::shared_ptr<CSmartRenameItemStore> CSmartRenameItem::_GetStore()
+{
+    CSRWSharedAutoLock lock(&m_lock);
+    return m_store;
+}
+
+HRESULT CSmartRenameItem::_GetAttributes(_Out_ CSmartRenameItemStore::ITEM_ATTRIBUTES* attributes)
+{
+    std::shared_ptr<CSmartRenameItemStore> store = _GetStore();
+    if (store)
+    {
+        return store->GetAttributes(m_id, attributes);
+    }
+
+    CSRWSharedAutoLock lock(&m_lock);
+    attributes->selected = m_selected;
+    attributes->isFolder = m_isFolder;
+    attributes->hasChanged = m_newName != nullptr && (lstrcmp(m_originalName, m_newName) != 0);
+    attributes->depth = m_depth;
     return S_OK;
 }
 
+HRESULT CSmartRenameItem::_GetStringView(_In_ CSmartRenameItemStore::ItemString which, _Out_ SMARTRENAME_STRING_VIEW* view)
+{
+    *view = {};
+    std::shared_ptr<CSmartRenameItemStore> store;
+    HRESULT hr = S_OK;
+    {
+        CSRWSharedAutoLock lock(&m_lock);
+        hr = (m_pinCount > 0) ? S_OK : E_UNEXPECTED;
+        if (SUCCEEDED(hr))
+        {
+            store = m_store;
+            if (!store)
+            {
+                PCWSTR text = (which == CSmartRenameItemStore::ItemPath) ? m_path : ((which == CSmartRenameItemStore::ItemOriginalName) ? m_originalName : m_newName);
+                hr = text ? S_OK : E_FAIL;
+                if (SUCCEEDED(hr))
+                {
+                    // The path and original name never change outside a store
+                    view->text = text;
+                    view->length = static_cast<UINT>(wcslen(text));
+                    view->generation = (which == CSmartRenameItemStore::ItemNewName) ? m_newNameGeneration : 0;
+                }
+            }
+        }
+    }
+
+    // Outside the lock since the store locks itself before its items
+    if (SUCCEEDED(hr) && store)
+    {
+        hr = store->GetStringView(m_id, which, view);
+    }
+    return hr;
+}
+
+void CSmartRenameItem::_RetireString(_In_opt_ PWSTR value)
+{
+    if (value && m_pinCount > 0)
+    {
+        m_retiredStrings.push_back(value);
+    }
+    else
+    {
+        CoTaskMemFree(value);
+    }
+}
+
 HRESULT CSmartRenameItem::s_CreateInstance(_In_opt_ IShellItem* psi, _In_ REFIID iid, _Outptr_ void** resultInterface)
 {
     *resultInterface = nullptr;
@@ -184,14 +422,48 @@ HRESULT CSmartRenameItem::s_CreateInstance(_In_opt_ IShellItem* psi, _In_ REFIID
     return hr;
 }
 
+HRESULT CSmartRenameItem::s_CreateInstanceFromPath(_In_ PCWSTR path, _In_ PCWSTR name, _In_ bool isFolder, _In_ UINT depth, _In_ REFIID iid, _Outptr_ void** resultInterface)
+{
+    *resultInterface = nullptr;
+
+    CSmartRenameItem *newRenameItem = new CSmartRenameItem();
+    HRESULT hr = newRenameItem ? S_OK : E_OUTOFMEMORY;
+    if (SUCCEEDED(hr))
+    {
+        hr = newRenameItem->_InitFromPath(path, name, isFolder, depth);
+        if (SUCCEEDED(hr))
+        {
+            hr = newRenameItem->QueryInterface(iid, resultInterface);
+        }
+
+        newRenameItem->Release();
+    }
+    return hr;
+}
+
 CSmartRenameItem::CSmartRenameItem() :
     m_refCount(1),
     m_id(++s_id)
 {
 }
 
+CSmartRenameItem::CSmartRenameItem(_In_ int id) :
+    m_refCount(1),
+    m_id(id)
+{
+}
+
 CSmartRenameItem::~CSmartRenameItem()
 {
+    if (m_pinCount > 0 && m_store)
+    {
+        m_store->Unpin();
+    }
+
+    for (PWSTR value : m_retiredStrings)
+    {
+        CoTaskMemFree(value);
+    }
     CoTaskMemFree(m_path);
     CoTaskMemFree(m_newName);
     CoTaskMemFree(m_originalName);
@@ -200,20 +472,34 @@ CSmartRenameItem::~CSmartRenameItem()
 HRESULT CSmartRenameItem::_Init(_In_ IShellItem* psi)
 {
     // Get the full filesystem path from the shell item
-    HRESULT hr = psi->GetDisplayName(SIGDN_FILESYSPATH, &m_path);
+    PWSTR path = nullptr;
+    HRESULT hr = psi->GetDisplayName(SIGDN_FILESYSPATH, &path);
     if (SUCCEEDED(hr))
     {
-        hr = SHStrDup(PathFindFileName(m_path), &m_originalName);
+        // Check if we are a folder now so we can check this attribute quickly later
+        SFGAOF att = 0;
+        hr = psi->GetAttributes(SFGAO_STREAM | SFGAO_FOLDER, &att);
         if (SUCCEEDED(hr))
         {
-            // Check if we are a folder now so we can check this attribute quickly later
-            SFGAOF att = 0;
-            hr = psi->GetAttributes(SFGAO_STREAM | SFGAO_FOLDER, &att);
-            if (SUCCEEDED(hr))
-            {
-                // Some items can be both folders and streams (ex: zip folders).
-                m_isFolder = (att & SFGAO_FOLDER) && !(att & SFGAO_STREAM);
-            }
+            // Some items can be both folders and streams (ex: zip folders).
+            hr = _InitFromPath(path, path + FindFileNameOffset(path, wcslen(path)), (att & SFGAO_FOLDER) && !(att & SFGAO_STREAM), 0);
+        }
+        CoTaskMemFree(path);
+    }
+
+    return hr;
+}
+
+HRESULT CSmartRenameItem::_InitFromPath(_In_ PCWSTR path, _In_ PCWSTR name, _In_ bool isFolder, _In_ UINT depth)
+{
+    HRESULT hr = SHStrDup(path, &m_path);
+    if (SUCCEEDED(hr))
+    {
+        hr = SHStrDup(name, &m_originalName);
+        if (SUCCEEDED(hr))
+        {
+            m_isFolder = isFolder;
+            m_depth = depth;
         }
     }
 
@@ -1,11 +1,19 @@
 #pragma once
 #include "stdafx.h"
 #include "SmartRenameInterfaces.h"
+#include "SmartRenameItemStore.h"
 #include "srwlock.h"
+#include <memory>
+#include <vector>
 
-class CSmartRenameItem :
+// A rename item.  Once added to a manager it keeps nothing but its id and is a facade
+// over the manager's CSmartRenameItemStore, which may also create these on demand.
+// Items created from a path never touch the shell unless get_shellItem or
+// get_iconIndex is called.
+class __declspec(uuid("5B1B2A39-6A0C-4C5F-9E3C-2D7C9A0E1F48")) CSmartRenameItem :
     public ISmartRenameItem,
-    public ISmartRenameItemFactory
+    public ISmartRenameItemFactory,
+    public ISmartRenameItemPathFactory
 {
 public:
     // IUnknown
@@ -29,6 +37,11 @@ public:
     IFACEMETHODIMP put_depth(_In_ int depth);
     IFACEMETHODIMP Reset();
     IFACEMETHODIMP ShouldRenameItem(_In_ DWORD flags, _Out_ bool* shouldRename);
+    IFACEMETHODIMP Pin();
+    IFACEMETHODIMP Unpin();
+    IFACEMETHODIMP get_pathView(_Out_ SMARTRENAME_STRING_VIEW* view);
+    IFACEMETHODIMP get_originalNameView(_Out_ SMARTRENAME_STRING_VIEW* view);
+    IFACEMETHODIMP get_newNameView(_Out_ SMARTRENAME_STRING_VIEW* view);
 
     // ISmartRenameItemFactory
     IFACEMETHODIMP Create(_In_ IShellItem* psi, _Outptr_ ISmartRenameItem** ppItem)
@@ -36,15 +49,39 @@ public:
         return CSmartRenameItem::s_CreateInstance(psi, IID_PPV_ARGS(ppItem));
     }
 
+    // ISmartRenameItemPathFactory
+    IFACEMETHODIMP CreateFromPath(_In_ PCWSTR path, _In_ PCWSTR name, _In_ bool isFolder, _In_ UINT depth, _COM_Outptr_ ISmartRenameItem** ppItem)
+    {
+        return CSmartRenameItem::s_CreateInstanceFromPath(path, name, isFolder, depth, IID_PPV_ARGS(ppItem));
+    }
+
 public:
     static HRESULT s_CreateInstance(_In_opt_ IShellItem* psi, _In_ REFIID iid, _Outptr_ void** resultInterface);
+    static HRESULT s_CreateInstanceFromPath(_In_ PCWSTR path, _In_ PCWSTR name, _In_ bool isFolder, _In_ UINT depth, _In_ REFIID iid, _Outptr_ void** resultInterface);
 
 protected:
+    friend class CSmartRenameItemStore;
+
     static int s_id;
     CSmartRenameItem();
+    // Used by the store for facades over items it already has
+    explicit CSmartRenameItem(_In_ int id);
     virtual ~CSmartRenameItem();
 
     HRESULT _Init(_In_ IShellItem* psi);
+    HRESULT _InitFromPath(_In_ PCWSTR path, _In_ PCWSTR name, _In_ bool isFolder, _In_ UINT depth);
+
+    // Fails once the last reference is being released
+    bool _TryAddRef();
+    // Gives the store the item was bound to before, if any.  Fails if the item is
+    // pinned.
+    bool _Bind(_In_ const std::shared_ptr<CSmartRenameItemStore>& store, _Out_opt_ std::shared_ptr<CSmartRenameItemStore>* previousStore);
+    std::shared_ptr<CSmartRenameItemStore> _GetStore();
+    HRESULT _GetAttributes(_Out_ CSmartRenameItemStore::ITEM_ATTRIBUTES* attributes);
+    HRESULT _GetStringView(_In_ CSmartRenameItemStore::ItemString which, _Out_ SMARTRENAME_STRING_VIEW* view);
+    // Frees a string replaced while the item is not in a store, or keeps it until
+    // the item is unpinned
+    void _RetireString(_In_opt_ PWSTR value);
 
     bool     m_selected = true;
     bool     m_isFolder = false;
@@ -55,6 +92,10 @@ protected:
     PWSTR    m_path = nullptr;
     PWSTR    m_originalName = nullptr;
     PWSTR    m_newName = nullptr;
+    ULONG    m_newNameGeneration = 0;
+    long     m_pinCount = 0;
+    std::vector<PWSTR> m_retiredStrings;
+    std::shared_ptr<CSmartRenameItemStore> m_store;
     CSRWLock m_lock;
     long     m_refCount = 0;
 };
\ No newline at end of file
@@ -0,0 +1,762 @@
+#include "stdafx.h"
+#include "SmartRenameItemStore.h"
+#include "SmartRenameItem.h"
+#include "PathItem.h"
+#include <algorithm>
+
+// Replaced names are only compacted away once there is at least this much of them
+const size_t c_minCompactText = 64 * 1024;
+
+// Characters in a text block.  Longer strings get a block of their own.
+const size_t c_textBlockSize = 64 * 1024;
+
+volatile LONG CSmartRenameItemStore::s_generation = 0;
+
+HRESULT CSmartRenameItemStore::Add(_In_ ISmartRenameItem* item)
+{
+    // Read everything first.  The item may be a facade over this store.
+    ITEM_COPY copy;
+    s_CopyItem(item, &copy);
+
+    HRESULT hr = S_FALSE;
+    {
+        CSRWExclusiveAutoLock lock(&m_lock);
+        UINT index = 0;
+        if (_Insert(copy, shared_from_this(), &index))
+        {
+            hr = S_OK;
+        }
+    }
+
+    _ReleaseCopy(copy);
+    return hr;
+}
+
+HRESULT CSmartRenameItemStore::AddRange(_In_reads_(count) ISmartRenameItem* const* items, _In_ UINT count, _Out_ UINT* firstIndex, _Out_ UINT* addedCount)
+{
+    *firstIndex = 0;
+    *addedCount = 0;
+
+    std::vector<ITEM_COPY> copies(count);
+    for (UINT u = 0; u < count; u++)
+    {
+        s_CopyItem(items[u], &copies[u]);
+    }
+
+    {
+        CSRWExclusiveAutoLock lock(&m_lock);
+        size_t capacity = m_ids.size() + count;
+        m_ids.reserve(capacity);
+        m_paths.reserve(capacity);
+        m_originalNames.reserve(capacity);
+        m_newNames.reserve(capacity);
+        m_extensionOffsets.reserve(capacity);
+        m_depths.reserve(capacity);
+        m_iconIndexes.reserve(capacity);
+        m_selected.reserve(capacity);
+        m_folders.reserve(capacity);
+        m_changed.reserve(capacity);
+        m_facades.reserve(capacity);
+        m_index.reserve(capacity);
+
+        std::shared_ptr<CSmartRenameItemStore> self = shared_from_this();
+        UINT first = UINT_MAX;
+        for (ITEM_COPY& copy : copies)
+        {
+            UINT index = 0;
+            if (_Insert(copy, self, &index))
+            {
+                first = (std::min)(first, index);
+                (*addedCount)++;
+            }
+        }
+
+        if (*addedCount > 0)
+        {
+            *firstIndex = first;
+        }
+    }
+
+    for (ITEM_COPY& copy : copies)
+    {
+        _ReleaseCopy(copy);
+    }
+
+    return (*addedCount == count) ? S_OK : S_FALSE;
+}
+
+UINT CSmartRenameItemStore::GetCount()
+{
+    CSRWSharedAutoLock lock(&m_lock);
+    return static_cast<UINT>(m_ids.size());
+}
+
+HRESULT CSmartRenameItemStore::GetItemAt(_In_ UINT index, _COM_Outptr_ ISmartRenameItem** ppItem)
+{
+    *ppItem = nullptr;
+    {
+        // Most items asked for already have a facade, which only needs the shared lock
+        CSRWSharedAutoLock lock(&m_lock);
+        if (index >= m_ids.size())
+        {
+            return E_FAIL;
+        }
+        if (_TryGetFacade(index, ppItem))
+        {
+            return S_OK;
+        }
+    }
+
+    // The items may have changed while the lock was released so check again
+    CSRWExclusiveAutoLock lock(&m_lock);
+    return (index < m_ids.size()) ? _GetFacade(index, ppItem) : E_FAIL;
+}
+
+HRESULT CSmartRenameItemStore::GetItemById(_In_ int id, _COM_Outptr_ ISmartRenameItem** ppItem)
+{
+    *ppItem = nullptr;
+    UINT index = 0;
+    {
+        CSRWSharedAutoLock lock(&m_lock);
+        if (!_Find(id, &index))
+        {
+            return E_FAIL;
+        }
+        if (_TryGetFacade(index, ppItem))
+        {
+            return S_OK;
+        }
+    }
+
+    CSRWExclusiveAutoLock lock(&m_lock);
+    return _Find(id, &index) ? _GetFacade(index, ppItem) : E_FAIL;
+}
+
+HRESULT CSmartRenameItemStore::GetDisplayAt(_In_ UINT index, _In_ DWORD flags, _In_ bool newName, _Out_ SMARTRENAME_ITEM_DISPLAY* display, _Out_writes_opt_(cchText) PWSTR text, _In_ UINT cchText)
+{
+    *display = {};
+    if (text && cchText)
+    {
+        text[0] = L'\0';
+    }
+
+    CSRWSharedAutoLock lock(&m_lock);
+    if (index >= m_ids.size())
+    {
+        return E_FAIL;
+    }
+
+    display->id = m_ids[index];
+    display->iconIndex = m_iconIndexes[index];
+    display->depth = m_depths[index];
+    display->selected = m_selected[index];
+    display->shouldRename = m_selected[index] && m_changed[index] && !s_IsClassExcluded(_GetClass(index), flags);
+
+    if (text && cchText)
+    {
+        // Same as the item's views: no new name is shown unless it would be used
+        const STRING_SPAN& span = newName ? m_newNames[index] : m_originalNames[index];
+        if (span.text && (!newName || display->shouldRename))
+        {
+            StringCchCopyN(text, cchText, span.text, span.length);
+        }
+    }
+
+    return S_OK;
+}
+
+HRESULT CSmartRenameItemStore::GetAt(_In_ UINT index, _Out_ ITEM_ATTRIBUTES* attributes, _Inout_opt_ std::wstring* names, _Out_opt_ UINT* extensionOffset)
+{
+    CSRWSharedAutoLock lock(&m_lock);
+    HRESULT hr = (index < m_ids.size()) ? S_OK : E_FAIL;
+    if (SUCCEEDED(hr))
+    {
+        _GetAttributes(index, attributes);
+        if (names)
+        {
+            const STRING_SPAN& originalName = m_originalNames[index];
+            hr = originalName.text ? S_OK : E_FAIL;
+            if (SUCCEEDED(hr))
+            {
+                names->append(originalName.text, originalName.length + 1);
+            }
+        }
+
+        if (extensionOffset)
+        {
+            *extensionOffset = m_extensionOffsets[index];
+        }
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameItemStore::PutNewNameAt(_In_ UINT index, _In_opt_ PCWSTR newName, _Out_opt_ bool* changed)
+{
+    CSRWExclusiveAutoLock lock(&m_lock);
+    HRESULT hr = (index < m_ids.size()) ? S_OK : E_FAIL;
+    bool result = SUCCEEDED(hr) && _SetNewName(index, newName);
+    if (changed)
+    {
+        *changed = result;
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameItemStore::GetNamesAt(_In_reads_(count) const UINT* indexes, _In_ UINT count, _Inout_ std::wstring* names, _Out_writes_(count) UINT* nameOffsets, _Out_writes_(count) UINT* extensionOffsets)
+{
+    HRESULT hr = S_OK;
+    CSRWSharedAutoLock lock(&m_lock);
+    for (UINT u = 0; u < count; u++)
+    {
+        UINT index = indexes[u];
+        nameOffsets[u] = c_noName;
+        extensionOffsets[u] = 0;
+        if (index < m_ids.size() && m_originalNames[index].text)
+        {
+            const STRING_SPAN& originalName = m_originalNames[index];
+            nameOffsets[u] = static_cast<UINT>(names->length());
+            extensionOffsets[u] = m_extensionOffsets[index];
+            names->append(originalName.text, originalName.length + 1);
+        }
+        else
+        {
+            hr = S_FALSE;
+        }
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameItemStore::PutNewNamesAt(_In_reads_(count) const UINT* indexes, _In_reads_(count) const PCWSTR* newNames, _In_ UINT count, _Out_opt_ std::vector<UINT>* changed)
+{
+    if (changed)
+    {
+        changed->clear();
+    }
+
+    HRESULT hr = S_OK;
+    CSRWExclusiveAutoLock lock(&m_lock);
+    for (UINT u = 0; u < count; u++)
+    {
+        UINT index = indexes[u];
+        if (index >= m_ids.size())
+        {
+            hr = E_FAIL;
+        }
+        else if (_SetNewName(index, newNames[u]) && changed)
+        {
+            changed->push_back(index);
+        }
+    }
+    return hr;
+}
+
+bool CSmartRenameItemStore::ClearNewNames(_Out_ UINT* first, _Out_ UINT* last)
+{
+    *first = UINT_MAX;
+    *last = 0;
+
+    CSRWExclusiveAutoLock lock(&m_lock);
+    for (UINT u = 0; u < m_ids.size(); u++)
+    {
+        if (_SetNewName(u, nullptr))
+        {
+            *first = (std::min)(*first, u);
+            *last = u;
+        }
+    }
+    return *first <= *last;
+}
+
+UINT CSmartRenameItemStore::GetSelectedCount()
+{
+    CSRWSharedAutoLock lock(&m_lock);
+    return m_selectedCount;
+}
+
+UINT CSmartRenameItemStore::GetRenameCount(_In_ DWORD flags)
+{
+    CSRWSharedAutoLock lock(&m_lock);
+    UINT count = 0;
+    for (UINT c = 0; c < c_itemClassCount; c++)
+    {
+        if (!s_IsClassExcluded(c, flags))
+        {
+            count += m_renameableCounts[c];
+        }
+    }
+    return count;
+}
+
+UINT CSmartRenameItemStore::GetIncludedIndexes(_In_ DWORD flags, _Out_ std::vector<UINT>* indexes)
+{
+    indexes->clear();
+
+    CSRWSharedAutoLock lock(&m_lock);
+    UINT count = static_cast<UINT>(m_ids.size());
+    const std::vector<UINT>* included[c_itemClassCount] = {};
+    UINT includedCount = 0;
+    size_t includedSize = 0;
+    for (UINT c = 0; c < c_itemClassCount; c++)
+    {
+        if (!s_IsClassExcluded(c, flags) && !m_classIndexes[c].empty())
+        {
+            included[includedCount++] = &m_classIndexes[c];
+            includedSize += m_classIndexes[c].size();
+        }
+    }
+
+    if (includedSize == count)
+    {
+        // Nothing is excluded
+        indexes->resize(count);
+        for (UINT u = 0; u < count; u++)
+        {
+            (*indexes)[u] = u;
+        }
+    }
+    else if (includedCount > 0)
+    {
+        indexes->reserve(includedSize);
+        indexes->assign(included[0]->begin(), included[0]->end());
+        std::vector<UINT> merged;
+        for (UINT i = 1; i < includedCount; i++)
+        {
+            merged.resize(indexes->size() + included[i]->size());
+            std::merge(indexes->begin(), indexes->end(), included[i]->begin(), included[i]->end(), merged.begin());
+            indexes->swap(merged);
+        }
+    }
+    return count;
+}
+
+void CSmartRenameItemStore::ClearExcludedNewNames(_In_ DWORD flags, _Out_ std::vector<UINT>* cleared)
+{
+    cleared->clear();
+
+    // Most passes have nothing to clear, so look before taking the lock exclusively
+    {
+        CSRWSharedAutoLock lock(&m_lock);
+        bool found = false;
+        for (UINT c = 0; c < c_itemClassCount && !found; c++)
+        {
+            if (s_IsClassExcluded(c, flags))
+            {
+                for (UINT index : m_classIndexes[c])
+                {
+                    if (m_newNames[index].text)
+                    {
+                        found = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (!found)
+        {
+            return;
+        }
+    }
+
+    CSRWExclusiveAutoLock lock(&m_lock);
+    for (UINT c = 0; c < c_itemClassCount; c++)
+    {
+        if (s_IsClassExcluded(c, flags))
+        {
+            for (UINT index : m_classIndexes[c])
+            {
+                if (_SetNewName(index, nullptr))
+                {
+                    cleared->push_back(index);
+                }
+            }
+        }
+    }
+}
+
+HRESULT CSmartRenameItemStore::GetString(_In_ int id, _In_ ItemString which, _Outptr_ PWSTR* value)
+{
+    *value = nullptr;
+    CSRWSharedAutoLock lock(&m_lock);
+    UINT index = 0;
+    HRESULT hr = _Find(id, &index) ? S_OK : E_FAIL;
+    if (SUCCEEDED(hr))
+    {
+        PCWSTR text = _GetStrings(which)[index].text;
+        hr = text ? SHStrDup(text, value) : E_FAIL;
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameItemStore::GetStringView(_In_ int id, _In_ ItemString which, _Out_ SMARTRENAME_STRING_VIEW* view)
+{
+    *view = {};
+    CSRWSharedAutoLock lock(&m_lock);
+    UINT index = 0;
+    HRESULT hr = _Find(id, &index) ? S_OK : E_FAIL;
+    if (SUCCEEDED(hr))
+    {
+        const STRING_SPAN& span = _GetStrings(which)[index];
+        hr = span.text ? S_OK : E_FAIL;
+        if (SUCCEEDED(hr))
+        {
+            view->text = span.text;
+            view->length = span.length;
+            view->generation = span.generation;
+        }
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameItemStore::PutNewName(_In_ int id, _In_opt_ PCWSTR newName)
+{
+    CSRWExclusiveAutoLock lock(&m_lock);
+    UINT index = 0;
+    HRESULT hr = _Find(id, &index) ? S_OK : E_FAIL;
+    if (SUCCEEDED(hr))
+    {
+        _SetNewName(index, newName);
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameItemStore::GetAttributes(_In_ int id, _Out_ ITEM_ATTRIBUTES* attributes)
+{
+    CSRWSharedAutoLock lock(&m_lock);
+    UINT index = 0;
+    HRESULT hr = _Find(id, &index) ? S_OK : E_FAIL;
+    if (SUCCEEDED(hr))
+    {
+        _GetAttributes(index, attributes);
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameItemStore::PutSelected(_In_ int id, _In_ bool selected)
+{
+    CSRWExclusiveAutoLock lock(&m_lock);
+    UINT index = 0;
+    HRESULT hr = _Find(id, &index) ? S_OK : E_FAIL;
+    if (SUCCEEDED(hr))
+    {
+        _CountItem(index, false);
+        m_selected[index] = selected;
+        _CountItem(index, true);
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameItemStore::PutDepth(_In_ int id, _In_ UINT depth)
+{
+    CSRWExclusiveAutoLock lock(&m_lock);
+    UINT index = 0;
+    HRESULT hr = _Find(id, &index) ? S_OK : E_FAIL;
+    if (SUCCEEDED(hr))
+    {
+        UINT previousClass = _GetClass(index);
+        _CountItem(index, false);
+        m_depths[index] = depth;
+        _CountItem(index, true);
+
+        UINT itemClass = _GetClass(index);
+        if (itemClass != previousClass)
+        {
+            std::vector<UINT>& previous = m_classIndexes[previousClass];
+            previous.erase(std::lower_bound(previous.begin(), previous.end(), index));
+            std::vector<UINT>& current = m_classIndexes[itemClass];
+            current.insert(std::lower_bound(current.begin(), current.end(), index), index);
+        }
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameItemStore::GetIconIndex(_In_ int id, _Out_ int* iconIndex)
+{
+    *iconIndex = -1;
+    CSRWSharedAutoLock lock(&m_lock);
+    UINT index = 0;
+    HRESULT hr = _Find(id, &index) ? S_OK : E_FAIL;
+    if (SUCCEEDED(hr))
+    {
+        *iconIndex = m_iconIndexes[index];
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameItemStore::PutIconIndex(_In_ int id, _In_ int iconIndex)
+{
+    CSRWExclusiveAutoLock lock(&m_lock);
+    UINT index = 0;
+    HRESULT hr = _Find(id, &index) ? S_OK : E_FAIL;
+    if (SUCCEEDED(hr))
+    {
+        m_iconIndexes[index] = iconIndex;
+    }
+    return hr;
+}
+
+void CSmartRenameItemStore::RemoveFacade(_In_ int id, _In_ CSmartRenameItem* facade)
+{
+    CSRWExclusiveAutoLock lock(&m_lock);
+
+    // The entry may already point at a newer facade if this one was being released
+    // while someone asked for the item
+    UINT index = 0;
+    if (_Find(id, &index) && m_facades[index] == facade)
+    {
+        m_facades[index] = nullptr;
+    }
+}
+
+UINT CSmartRenameItemStore::s_FindExtension(_In_opt_ PCWSTR name)
+{
+    return name ? static_cast<UINT>(FindExtensionOffset(name, wcslen(name))) : 0;
+}
+
+void CSmartRenameItemStore::s_CopyItem(_In_ ISmartRenameItem* item, _Out_ ITEM_COPY* copy)
+{
+    item->get_id(&copy->id);
+    item->get_selected(&copy->selected);
+    item->get_isFolder(&copy->isFolder);
+    item->get_depth(&copy->depth);
+    item->get_path(&copy->path);
+    item->get_originalName(&copy->originalName);
+    item->get_newName(&copy->newName);
+    item->QueryInterface(__uuidof(CSmartRenameItem), reinterpret_cast<void**>(&copy->facade));
+}
+
+void CSmartRenameItemStore::_ReleaseCopy(_Inout_ ITEM_COPY& copy)
+{
+    // An item moved over from another store must not be handed out by it any more
+    if (copy.previousStore && copy.previousStore.get() != this)
+    {
+        copy.previousStore->RemoveFacade(copy.id, copy.facade);
+    }
+    copy.previousStore = nullptr;
+
+    if (copy.facade)
+    {
+        copy.facade->Release();
+        copy.facade = nullptr;
+    }
+    CoTaskMemFree(copy.path);
+    CoTaskMemFree(copy.originalName);
+    CoTaskMemFree(copy.newName);
+    copy.path = nullptr;
+    copy.originalName = nullptr;
+    copy.newName = nullptr;
+}
+
+bool CSmartRenameItemStore::_Insert(_Inout_ ITEM_COPY& copy, _In_ const std::shared_ptr<CSmartRenameItemStore>& self, _Out_ UINT* index)
+{
+    if (_Find(copy.id, index))
+    {
+        return false;
+    }
+
+    // Items are normally added in the order they were created
+    *index = static_cast<UINT>(m_ids.size());
+    if (!m_ids.empty() && m_ids.back() > copy.id)
+    {
+        *index = static_cast<UINT>(std::lower_bound(m_ids.begin(), m_ids.end(), copy.id) - m_ids.begin());
+    }
+
+    m_ids.insert(m_ids.begin() + *index, copy.id);
+    m_paths.insert(m_paths.begin() + *index, _AddString(copy.path));
+    m_originalNames.insert(m_originalNames.begin() + *index, _AddString(copy.originalName));
+    m_newNames.insert(m_newNames.begin() + *index, STRING_SPAN{ nullptr, 0, 0 });
+    m_extensionOffsets.insert(m_extensionOffsets.begin() + *index, s_FindExtension(copy.originalName));
+    m_depths.insert(m_depths.begin() + *index, copy.depth);
+    m_iconIndexes.insert(m_iconIndexes.begin() + *index, -1);
+    m_selected.insert(m_selected.begin() + *index, copy.selected);
+    m_folders.insert(m_folders.begin() + *index, copy.isFolder);
+    m_changed.insert(m_changed.begin() + *index, false);
+    m_facades.insert(m_facades.begin() + *index, nullptr);
+
+    // Move the index of every item after this one
+    for (UINT u = *index; u < m_ids.size(); u++)
+    {
+        m_index[m_ids[u]] = u;
+    }
+
+    std::vector<UINT>& classIndexes = m_classIndexes[_GetClass(*index)];
+    if (*index + 1 == m_ids.size())
+    {
+        classIndexes.push_back(*index);
+    }
+    else
+    {
+        for (std::vector<UINT>& indexes : m_classIndexes)
+        {
+            for (std::vector<UINT>::iterator it = std::lower_bound(indexes.begin(), indexes.end(), *index); it != indexes.end(); ++it)
+            {
+                (*it)++;
+            }
+        }
+        classIndexes.insert(std::lower_bound(classIndexes.begin(), classIndexes.end(), *index), *index);
+    }
+
+    _CountItem(*index, true);
+    _SetNewName(*index, copy.newName);
+
+    // A pinned item keeps its own strings since views of them may be out
+    if (copy.facade && copy.facade->_Bind(self, &copy.previousStore))
+    {
+        m_facades[*index] = copy.facade;
+    }
+    return true;
+}
+
+bool CSmartRenameItemStore::_Find(_In_ int id, _Out_ UINT* index)
+{
+    std::unordered_map<int, UINT>::const_iterator it = m_index.find(id);
+    *index = (it != m_index.end()) ? it->second : 0;
+    return it != m_index.end();
+}
+
+CSmartRenameItemStore::STRING_SPAN CSmartRenameItemStore::_AddString(_In_opt_ PCWSTR value)
+{
+    STRING_SPAN span = { nullptr, 0, 0 };
+    if (value)
+    {
+        span.length = static_cast<UINT>(wcslen(value));
+        size_t size = span.length + 1;
+        if (m_textBlocks.empty() || m_textBlocks.back().size - m_textBlocks.back().used < size)
+        {
+            size_t blockSize = (std::max)(c_textBlockSize, size);
+            m_textBlocks.push_back({ std::make_unique<wchar_t[]>(blockSize), blockSize, 0 });
+        }
+
+        TEXT_BLOCK& block = m_textBlocks.back();
+        wchar_t* text = block.text.get() + block.used;
+        wmemcpy(text, value, size);
+        block.used += size;
+        m_usedText += size;
+
+        span.text = text;
+        span.generation = s_NextGeneration();
+    }
+    return span;
+}
+
+void CSmartRenameItemStore::_FreeString(_Inout_ STRING_SPAN& span)
+{
+    if (span.text)
+    {
+        m_freeText += span.length + 1;
+        span = { nullptr, 0, 0 };
+    }
+}
+
+void CSmartRenameItemStore::_CompactText()
+{
+    std::vector<TEXT_BLOCK> textBlocks;
+    textBlocks.swap(m_textBlocks);
+    m_usedText = 0;
+    m_freeText = 0;
+
+    // Every string that moves gets a new generation
+    for (std::vector<STRING_SPAN>* spans : { &m_paths, &m_originalNames, &m_newNames })
+    {
+        for (STRING_SPAN& span : *spans)
+        {
+            if (span.text)
+            {
+                span = _AddString(span.text);
+            }
+        }
+    }
+}
+
+bool CSmartRenameItemStore::_SetNewName(_In_ UINT index, _In_opt_ PCWSTR newName)
+{
+    PCWSTR currentNewName = m_newNames[index].text;
+    if ((currentNewName == nullptr && newName == nullptr) ||
+        (currentNewName != nullptr && newName != nullptr && wcscmp(currentNewName, newName) == 0))
+    {
+        return false;
+    }
+
+    _CountItem(index, false);
+    _FreeString(m_newNames[index]);
+    m_newNames[index] = _AddString(newName);
+    m_changed[index] = (newName != nullptr) && (lstrcmp(m_originalNames[index].text, newName) != 0);
+    _CountItem(index, true);
+
+    // Views may still point at the replaced names while the store is pinned
+    if (m_freeText >= c_minCompactText && m_freeText * 2 > m_usedText && m_pinCount == 0)
+    {
+        _CompactText();
+    }
+    return true;
+}
+
+void CSmartRenameItemStore::_GetAttributes(_In_ UINT index, _Out_ ITEM_ATTRIBUTES* attributes)
+{
+    attributes->selected = m_selected[index];
+    attributes->isFolder = m_folders[index];
+    attributes->hasChanged = m_changed[index];
+    attributes->depth = m_depths[index];
+}
+
+bool CSmartRenameItemStore::s_IsClassExcluded(_In_ UINT itemClass, _In_ DWORD flags)
+{
+    // Same exclusions as ISmartRenameItem::ShouldRenameItem
+    bool isFolder = (itemClass & 1) != 0;
+    bool isSubFolderContent = (itemClass & 2) != 0;
+    return (isFolder && (flags & SmartRenameFlags::ExcludeFolders)) ||
+        (!isFolder && (flags & SmartRenameFlags::ExcludeFiles)) ||
+        (isSubFolderContent && (flags & SmartRenameFlags::ExcludeSubfolders));
+}
+
+void CSmartRenameItemStore::_CountItem(_In_ UINT index, _In_ bool add)
+{
+    // Called with add false before an item changes and true after
+    if (m_selected[index])
+    {
+        UINT& renameableCount = m_renameableCounts[_GetClass(index)];
+        if (add)
+        {
+            m_selectedCount++;
+            renameableCount += m_changed[index] ? 1 : 0;
+        }
+        else
+        {
+            m_selectedCount--;
+            renameableCount -= m_changed[index] ? 1 : 0;
+        }
+    }
+}
+
+bool CSmartRenameItemStore::_TryGetFacade(_In_ UINT index, _Out_ ISmartRenameItem** ppItem)
+{
+    // Hand out the cached facade unless its last reference is already being released.
+    // A facade being released waits in RemoveFacade for the exclusive lock, so it
+    // can't be deleted while we hold either.
+    CSmartRenameItem* facade = m_facades[index];
+    if (facade != nullptr && facade->_TryAddRef())
+    {
+        *ppItem = facade;
+        return true;
+    }
+
+    *ppItem = nullptr;
+    return false;
+}
+
+HRESULT CSmartRenameItemStore::_GetFacade(_In_ UINT index, _COM_Outptr_ ISmartRenameItem** ppItem)
+{
+    if (!_TryGetFacade(index, ppItem))
+    {
+        CSmartRenameItem* facade = new CSmartRenameItem(m_ids[index]);
+        if (facade == nullptr)
+        {
+            return E_OUTOFMEMORY;
+        }
+        facade->_Bind(shared_from_this(), nullptr);
+        m_facades[index] = facade;
+        *ppItem = facade;
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,198 @@
+#pragma once
+#include "stdafx.h"
+#include <climits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "srwlock.h"
+
+class CSmartRenameItem;
+
+// The manager's items, kept as parallel arrays in id order instead of one object per
+// item.  The names live in a few large text blocks and the per item flags in bit
+// vectors, so a preview pass reads them sequentially.
+//
+// ISmartRenameItem objects are thin facades over an entry.  They are only created
+// when someone asks for an item and are cached weakly, so an item that is still
+// referenced is handed out again rather than duplicated.
+class CSmartRenameItemStore :
+    public std::enable_shared_from_this<CSmartRenameItemStore>
+{
+public:
+    // Everything about an item other than its names
+    struct ITEM_ATTRIBUTES
+    {
+        bool selected = true;
+        bool isFolder = false;
+        bool hasChanged = false;        // Has a new name that differs from the original
+        UINT depth = 0;
+    };
+
+    static const UINT c_noName = UINT_MAX;
+
+    enum ItemString
+    {
+        ItemPath,
+        ItemOriginalName,
+        ItemNewName
+    };
+
+    // Copies the item into the store.  A CSmartRenameItem becomes a facade over its
+    // entry unless it is pinned; any other item is copied once and not consulted again.
+    // Returns S_FALSE if an item with the same id was already added.
+    HRESULT Add(_In_ ISmartRenameItem* item);
+    // Adds the items like Add, taking the lock once for all of them.  Reports how
+    // many were added and the lowest index any of them went to.  Returns S_FALSE if
+    // some were already added.
+    HRESULT AddRange(_In_reads_(count) ISmartRenameItem* const* items, _In_ UINT count, _Out_ UINT* firstIndex, _Out_ UINT* addedCount);
+    UINT GetCount();
+    HRESULT GetItemAt(_In_ UINT index, _COM_Outptr_ ISmartRenameItem** ppItem);
+    HRESULT GetItemById(_In_ int id, _COM_Outptr_ ISmartRenameItem** ppItem);
+    // Used by lists to paint a row.  Only takes the shared lock and never creates a
+    // facade.  The name is copied into text, truncated to fit.
+    HRESULT GetDisplayAt(_In_ UINT index, _In_ DWORD flags, _In_ bool newName, _Out_ SMARTRENAME_ITEM_DISPLAY* display, _Out_writes_opt_(cchText) PWSTR text, _In_ UINT cchText);
+
+    // Used by preview passes, which work on indexes and never create facades.
+    // GetAt appends the original name to names, null terminated, and gives the
+    // offset of its extension within it.  PutNewNameAt says whether the new name
+    // differs from the one it replaced.
+    HRESULT GetAt(_In_ UINT index, _Out_ ITEM_ATTRIBUTES* attributes, _Inout_opt_ std::wstring* names, _Out_opt_ UINT* extensionOffset);
+    HRESULT PutNewNameAt(_In_ UINT index, _In_opt_ PCWSTR newName, _Out_opt_ bool* changed);
+    // Same as GetAt and PutNewNameAt for a chunk of items, taking the lock once for
+    // all of them.  GetNamesAt gives where each name starts in names, or c_noName
+    // for items it couldn't read, and returns S_FALSE if there were any.
+    // PutNewNamesAt lists the items whose new name changed.
+    HRESULT GetNamesAt(_In_reads_(count) const UINT* indexes, _In_ UINT count, _Inout_ std::wstring* names, _Out_writes_(count) UINT* nameOffsets, _Out_writes_(count) UINT* extensionOffsets);
+    HRESULT PutNewNamesAt(_In_reads_(count) const UINT* indexes, _In_reads_(count) const PCWSTR* newNames, _In_ UINT count, _Out_opt_ std::vector<UINT>* changed);
+    // Clears every new name and reports the range of items that had one.  Returns
+    // false if none did.
+    bool ClearNewNames(_Out_ UINT* first, _Out_ UINT* last);
+
+    // Kept current as items change so neither has to look at the items
+    UINT GetSelectedCount();
+    UINT GetRenameCount(_In_ DWORD flags);
+
+    // Used by preview passes so they only visit the items the exclude flags leave.
+    // GetIncludedIndexes lists them in order and returns the number of items they
+    // were taken from.  ClearExcludedNewNames clears the new names of the others and
+    // lists the ones that had one.
+    UINT GetIncludedIndexes(_In_ DWORD flags, _Out_ std::vector<UINT>* indexes);
+    void ClearExcludedNewNames(_In_ DWORD flags, _Out_ std::vector<UINT>* cleared);
+
+    // Used by the facades, which refer to their entry by id
+    HRESULT GetString(_In_ int id, _In_ ItemString which, _Outptr_ PWSTR* value);
+    // Only valid while the store is pinned
+    HRESULT GetStringView(_In_ int id, _In_ ItemString which, _Out_ SMARTRENAME_STRING_VIEW* view);
+    HRESULT PutNewName(_In_ int id, _In_opt_ PCWSTR newName);
+    HRESULT GetAttributes(_In_ int id, _Out_ ITEM_ATTRIBUTES* attributes);
+    HRESULT PutSelected(_In_ int id, _In_ bool selected);
+    HRESULT PutDepth(_In_ int id, _In_ UINT depth);
+    HRESULT GetIconIndex(_In_ int id, _Out_ int* iconIndex);
+    HRESULT PutIconIndex(_In_ int id, _In_ int iconIndex);
+
+    // Called by a facade whose last reference is gone, just before it is deleted
+    void RemoveFacade(_In_ int id, _In_ CSmartRenameItem* facade);
+
+    // Text is never moved or reused while the store is pinned, so string views stay
+    // valid.  Does not take the lock, so facades can call it under their own.
+    void Pin() { InterlockedIncrement(&m_pinCount); }
+    void Unpin() { InterlockedDecrement(&m_pinCount); }
+
+    // Generations for strings kept outside a store come from the same counter
+    static ULONG s_NextGeneration() { return static_cast<ULONG>(InterlockedIncrement(&s_generation)); }
+
+private:
+    // A null terminated string in one of the text blocks, or no string if text is null
+    struct STRING_SPAN
+    {
+        PCWSTR text;
+        UINT length;
+        ULONG generation;
+    };
+
+    // Strings are appended to the last block until it is full.  Blocks never move or
+    // grow, so a string stays where it is until the text is compacted.
+    struct TEXT_BLOCK
+    {
+        std::unique_ptr<wchar_t[]> text;
+        size_t size;
+        size_t used;
+    };
+
+    // An item's values, read before the store is locked since the item may be a
+    // facade over this store
+    struct ITEM_COPY
+    {
+        int id = 0;
+        bool selected = true;
+        bool isFolder = false;
+        UINT depth = 0;
+        PWSTR path = nullptr;
+        PWSTR originalName = nullptr;
+        PWSTR newName = nullptr;
+        CSmartRenameItem* facade = nullptr;     // Referenced
+        std::shared_ptr<CSmartRenameItemStore> previousStore;
+    };
+
+    static void s_CopyItem(_In_ ISmartRenameItem* item, _Out_ ITEM_COPY* copy);
+    // Called without m_lock held once the copy has been inserted, or not
+    void _ReleaseCopy(_Inout_ ITEM_COPY& copy);
+
+    // Items are classed by whether they are a folder (1) and whether they are in a
+    // subfolder of the selection (2), which is what the exclude flags go by
+    static const UINT c_itemClassCount = 4;
+    static bool s_IsClassExcluded(_In_ UINT itemClass, _In_ DWORD flags);
+
+    // Where the extension of a name starts, including its dot, or the length of
+    // the name if it has none.  Follows std::filesystem::path: a leading dot is
+    // part of the stem.
+    static UINT s_FindExtension(_In_opt_ PCWSTR name);
+
+    // Called with m_lock held, exclusively for the ones that change anything
+    bool _Find(_In_ int id, _Out_ UINT* index);
+    // Returns false if an item with the same id is already in the store
+    bool _Insert(_Inout_ ITEM_COPY& copy, _In_ const std::shared_ptr<CSmartRenameItemStore>& self, _Out_ UINT* index);
+    STRING_SPAN _AddString(_In_opt_ PCWSTR value);
+    void _FreeString(_Inout_ STRING_SPAN& span);
+    void _CompactText();
+    bool _SetNewName(_In_ UINT index, _In_opt_ PCWSTR newName);
+    void _GetAttributes(_In_ UINT index, _Out_ ITEM_ATTRIBUTES* attributes);
+    void _CountItem(_In_ UINT index, _In_ bool add);
+    UINT _GetClass(_In_ UINT index) const { return (m_folders[index] ? 1 : 0) | ((m_depths[index] > 0) ? 2 : 0); }
+    // _TryGetFacade only needs the shared lock; _GetFacade creates one if there is
+    // none and needs the exclusive lock
+    bool _TryGetFacade(_In_ UINT index, _Out_ ISmartRenameItem** ppItem);
+    HRESULT _GetFacade(_In_ UINT index, _COM_Outptr_ ISmartRenameItem** ppItem);
+
+    const std::vector<STRING_SPAN>& _GetStrings(_In_ ItemString which) const { return (which == ItemPath) ? m_paths : ((which == ItemOriginalName) ? m_originalNames : m_newNames); }
+
+    CSRWLock m_lock;
+
+    _Guarded_by_(m_lock) std::vector<int> m_ids;
+    _Guarded_by_(m_lock) std::vector<STRING_SPAN> m_paths;
+    _Guarded_by_(m_lock) std::vector<STRING_SPAN> m_originalNames;
+    _Guarded_by_(m_lock) std::vector<STRING_SPAN> m_newNames;
+    _Guarded_by_(m_lock) std::vector<UINT> m_extensionOffsets;        // Into the original name
+    _Guarded_by_(m_lock) std::vector<UINT> m_depths;
+    _Guarded_by_(m_lock) std::vector<int> m_iconIndexes;
+    _Guarded_by_(m_lock) std::vector<bool> m_selected;
+    _Guarded_by_(m_lock) std::vector<bool> m_folders;
+    _Guarded_by_(m_lock) std::vector<bool> m_changed;
+    _Guarded_by_(m_lock) std::vector<CSmartRenameItem*> m_facades;     // Not referenced
+    _Guarded_by_(m_lock) std::unordered_map<int, UINT> m_index;
+    _Guarded_by_(m_lock) std::vector<UINT> m_classIndexes[c_itemClassCount];  // In order
+
+    // Replaced new names are left in the blocks until they make up most of the text
+    _Guarded_by_(m_lock) std::vector<TEXT_BLOCK> m_textBlocks;
+    _Guarded_by_(m_lock) size_t m_usedText = 0;
+    _Guarded_by_(m_lock) size_t m_freeText = 0;
+    volatile LONG m_pinCount = 0;
+
+    static volatile LONG s_generation;
+
+    // Selected items, and selected items with a changed name for each class so the
+    // exclude flags can be applied to the totals
+    _Guarded_by_(m_lock) UINT m_selectedCount = 0;
+    _Guarded_by_(m_lock) UINT m_renameableCounts[c_itemClassCount] = {};
+};
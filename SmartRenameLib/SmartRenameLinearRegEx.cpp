@@ -0,0 +1,46 @@
+#include "stdafx.h"
+#include "SmartRenameLinearRegEx.h"
+
+HRESULT CSmartRenameLinearRegEx::s_CreateInstance(_Outptr_ ISmartRenameRegEx** renameRegEx)
+{
+    *renameRegEx = nullptr;
+
+    CSmartRenameLinearRegEx *newRenameRegEx = new CSmartRenameLinearRegEx();
+    HRESULT hr = newRenameRegEx ? S_OK : E_OUTOFMEMORY;
+    if (SUCCEEDED(hr))
+    {
+        hr = newRenameRegEx->QueryInterface(IID_PPV_ARGS(renameRegEx));
+        newRenameRegEx->Release();
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameLinearRegEx::_CompileRegEx(_In_ PCWSTR searchTerm, _In_ DWORD flags, _Out_ std::shared_ptr<COMPILED_PATTERN>& pattern)
+{
+    std::shared_ptr<LINEAR_REGEX_PATTERN> regexPattern = std::make_shared<LINEAR_REGEX_PATTERN>();
+    pattern = regexPattern;
+
+    HRESULT hr = S_OK;
+    switch (regexPattern->regex.Compile(searchTerm, wcslen(searchTerm), (flags & CaseSensitive) != 0))
+    {
+    case CLinearRegEx::CompileOk:
+        regexPattern->prefilter.Init(regexPattern->regex.GetLiteralFacts(), (flags & CaseSensitive) != 0);
+        regexPattern->shapeMatcher.Init(regexPattern->regex.GetLiteralFacts(), (flags & CaseSensitive) != 0, (flags & MatchAllOccurences) != 0);
+        break;
+
+    case CLinearRegEx::CompileInvalidPattern:
+        hr = SR_E_INVALIDPATTERN;
+        break;
+
+    default:
+        hr = SR_E_UNSUPPORTEDPATTERN;
+        break;
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameLinearRegEx::_ReplaceRegEx(_In_ const COMPILED_PATTERN* pattern, _In_ const std::wstring& source, _In_ const CReplaceTemplate& replaceTemplate, _In_ DWORD flags,
+    _In_opt_ const EVALUATION_LIMITS* limits, _Out_ std::wstring& result)
+{
+    return s_ReplaceLinear(static_cast<const LINEAR_REGEX_PATTERN*>(pattern)->regex, source, replaceTemplate, flags, limits, result);
+}
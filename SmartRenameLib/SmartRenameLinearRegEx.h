@@ -0,0 +1,28 @@
+#pragma once
+#include "stdafx.h"
+#include "SmartRenameRegEx.h"
+#include "LinearRegEx.h"
+
+// ISmartRenameRegEx that matches with CLinearRegEx instead of std::wregex.  Matching
+// is linear in the length of the name so patterns like (a+)+$ can't hang the preview.
+// Patterns needing backreferences or lookaround fail with SR_E_UNSUPPORTEDPATTERN.
+class CSmartRenameLinearRegEx : public CSmartRenameRegEx
+{
+public:
+    static HRESULT s_CreateInstance(_Outptr_ ISmartRenameRegEx **renameRegEx);
+
+protected:
+    CSmartRenameLinearRegEx() = default;
+
+    HRESULT _CompileRegEx(_In_ PCWSTR searchTerm, _In_ DWORD flags, _Out_ std::shared_ptr<COMPILED_PATTERN>& pattern) override;
+    HRESULT _ReplaceRegEx(_In_ const COMPILED_PATTERN* pattern, _In_ const std::wstring& source, _In_ const CReplaceTemplate& replaceTemplate, _In_ DWORD flags,
+        _In_opt_ const EVALUATION_LIMITS* limits, _Out_ std::wstring& result) override;
+
+    struct LINEAR_REGEX_PATTERN : public COMPILED_PATTERN
+    {
+        size_t GetGroupCount() const override { return regex.GetGroupCount(); }
+        const std::map<std::wstring, size_t>* GetGroupNames() const override { return &regex.GetGroupNames(); }
+
+        CLinearRegEx regex;
+    };
+};
@@ -4,11 +4,11 @@
 #include <algorithm>
 #include <shlobj.h>
 #include "helpers.h"
-#include <filesystem>
+#include <atomic>
+#include <climits>
+#include <memory>
 #include <vector>
 
-namespace fs = std::filesystem;
-
 extern HINSTANCE g_hInst;
 
 // The default FOF flags to use in the rename operations
@@ -96,13 +96,20 @@ IFACEMETHODIMP CSmartRenameManager::Rename(_In_ HWND hwndParent)
 
 IFACEMETHODIMP CSmartRenameManager::Reset()
 {
-    // Stop all threads and wait
-    // Reset all rename items
-    return E_NOTIMPL;
+    // Stop the pass in flight without waiting for it.  It keeps the old store alive
+    // until it notices; the updates it still reports only cause a redraw.
+    _CancelRegExWorkerThread();
+
+    // Start over with no items.  The flags, terms and listeners are kept.
+    CSRWExclusiveAutoLock lock(&m_lockRegExJob);
+    m_clearNewNamesPending = false;
+    _ClearSmartRenameItems();
+    return S_OK;
 }
 
 IFACEMETHODIMP CSmartRenameManager::Shutdown()
 {
+    _StopRegExWorkerThread();
     _ClearRegEx();
     _Cleanup();
     return S_OK;
@@ -110,21 +117,8 @@ IFACEMETHODIMP CSmartRenameManager::Shutdown()
 
 IFACEMETHODIMP CSmartRenameManager::AddItem(_In_ ISmartRenameItem* pItem)
 {
-    HRESULT hr = E_FAIL;
-    // Scope lock
-    {
-        CSRWExclusiveAutoLock lock(&m_lockItems);
-        int id = 0;
-        pItem->get_id(&id);
-        // Verify the item isn't already added
-        if (m_renameItems.find(id) == m_renameItems.end())
-        {
-            m_renameItems[id] = pItem;
-            pItem->AddRef();
-            hr = S_OK;
-        }
-    }
-
+    // Verify the item isn't already added
+    HRESULT hr = (m_itemStore->Add(pItem) == S_OK) ? S_OK : E_FAIL;
     if (SUCCEEDED(hr))
     {
         _OnItemAdded(pItem);
@@ -133,84 +127,89 @@ IFACEMETHODIMP CSmartRenameManager::AddItem(_In_ ISmartRenameItem* pItem)
     return hr;
 }
 
-IFACEMETHODIMP CSmartRenameManager::GetItemByIndex(_In_ UINT index, _COM_Outptr_ ISmartRenameItem** ppItem)
+IFACEMETHODIMP CSmartRenameManager::AddItems(_In_reads_(count) ISmartRenameItem* const* items, _In_ UINT count)
 {
-    *ppItem = nullptr;
-    CSRWSharedAutoLock lock(&m_lockItems);
-    HRESULT hr = E_FAIL;
-    if (index < m_renameItems.size())
+    UINT firstIndex = 0;
+    UINT addedCount = 0;
+    HRESULT hr = m_itemStore->AddRange(items, count, &firstIndex, &addedCount);
+    if (addedCount > 0)
     {
-        std::map<int, ISmartRenameItem*>::iterator it = m_renameItems.begin();
-        std::advance(it, index);
-        *ppItem = it->second;
-        (*ppItem)->AddRef();
-        hr = S_OK;
+        _OnItemsAdded(firstIndex, addedCount);
     }
 
     return hr;
 }
 
-IFACEMETHODIMP CSmartRenameManager::GetItemById(_In_ int id, _COM_Outptr_ ISmartRenameItem** ppItem)
+IFACEMETHODIMP CSmartRenameManager::GetItemByIndex(_In_ UINT index, _COM_Outptr_ ISmartRenameItem** ppItem)
 {
-    *ppItem = nullptr;
+    return m_itemStore->GetItemAt(index, ppItem);
+}
 
-    CSRWSharedAutoLock lock(&m_lockItems);
-    HRESULT hr = E_FAIL;
-    std::map<int, ISmartRenameItem*>::iterator it;
-    it = m_renameItems.find(id);
-    if (it !=  m_renameItems.end())
-    {
-        *ppItem = m_renameItems[id];
-        (*ppItem)->AddRef();
-        hr = S_OK;
-    }
+IFACEMETHODIMP CSmartRenameManager::GetItemById(_In_ int id, _COM_Outptr_ ISmartRenameItem** ppItem)
+{
+    return m_itemStore->GetItemById(id, ppItem);
+}
 
-    return hr;
+IFACEMETHODIMP CSmartRenameManager::GetItemDisplay(_In_ UINT index, _In_ bool newName, _Out_ SMARTRENAME_ITEM_DISPLAY* display, _Out_writes_opt_(cchText) PWSTR text, _In_ UINT cchText)
+{
+    DWORD flags = 0;
+    get_flags(&flags);
+    return m_itemStore->GetDisplayAt(index, flags, newName, display, text, cchText);
 }
 
 IFACEMETHODIMP CSmartRenameManager::GetItemCount(_Out_ UINT* count)
 {
-    CSRWSharedAutoLock lock(&m_lockItems);
-    *count = static_cast<UINT>(m_renameItems.size());
+    *count = m_itemStore->GetCount();
     return S_OK;
 }
 
 IFACEMETHODIMP CSmartRenameManager::GetSelectedItemCount(_Out_ UINT* count)
 {
-    *count = 0;
-    CSRWSharedAutoLock lock(&m_lockItems);
-
-    for (std::map<int, ISmartRenameItem*>::iterator it = m_renameItems.begin(); it != m_renameItems.end(); ++it)
-    {
-        ISmartRenameItem* pItem = it->second;
-        bool selected = false;
-        if (SUCCEEDED(pItem->get_selected(&selected)) && selected)
-        {
-            (*count)++;
-        }
-    }
-
+    *count = m_itemStore->GetSelectedCount();
     return S_OK;
 }
 
 IFACEMETHODIMP CSmartRenameManager::GetRenameItemCount(_Out_ UINT* count)
 {
-    *count = 0;
-    CSRWSharedAutoLock lock(&m_lockItems);
+    *count = m_itemStore->GetRenameCount(m_flags);
+    return S_OK;
+}
 
-    for (std::map<int, ISmartRenameItem*>::iterator it = m_renameItems.begin(); it != m_renameItems.end(); ++it)
+IFACEMETHODIMP CSmartRenameManager::SetPriorityRange(_In_ UINT firstIndex, _In_ UINT count)
+{
+    bool changed = false;
     {
-        ISmartRenameItem* pItem = it->second;
-        bool shouldRename = false;
-        if (SUCCEEDED(pItem->ShouldRenameItem(m_flags, &shouldRename)) && shouldRename)
+        CSRWExclusiveAutoLock lock(&m_lockPriority);
+        if (m_priorityFirst != firstIndex || m_priorityCount != count)
         {
-            (*count)++;
+            m_priorityFirst = firstIndex;
+            m_priorityCount = count;
+            changed = true;
         }
     }
- 
+
+    if (changed)
+    {
+        // Workers of the pass in flight pick up the new range before their next chunk
+        InterlockedIncrement(&m_priorityGeneration);
+    }
+
     return S_OK;
 }
 
+IFACEMETHODIMP CSmartRenameManager::GetPriorityRange(_Out_ UINT* firstIndex, _Out_ UINT* count)
+{
+    CSRWSharedAutoLock lock(&m_lockPriority);
+    *firstIndex = m_priorityFirst;
+    *count = m_priorityCount;
+    return S_OK;
+}
+
+IFACEMETHODIMP CSmartRenameManager::RefreshPreview()
+{
+    return _PerformRegExRename();
+}
+
 IFACEMETHODIMP CSmartRenameManager::get_flags(_Out_ DWORD* flags)
 {
     _EnsureRegEx();
@@ -245,7 +244,19 @@ IFACEMETHODIMP CSmartRenameManager::put_renameRegEx(_In_ ISmartRenameRegEx* pReg
 {
     _ClearRegEx();
     m_spRegEx = pRegEx;
-    return S_OK;
+
+    // A null regex means the default one is created on demand
+    HRESULT hr = S_OK;
+    if (m_spRegEx)
+    {
+        hr = _InitRegEx();
+        if (SUCCEEDED(hr))
+        {
+            // Keep our flags in sync with the new regex
+            m_spRegEx->get_flags(&m_flags);
+        }
+    }
+    return hr;
 }
 
 IFACEMETHODIMP CSmartRenameManager::get_renameItemFactory(_COM_Outptr_ ISmartRenameItemFactory** ppItemFactory)
@@ -287,6 +298,22 @@ IFACEMETHODIMP CSmartRenameManager::OnFlagsChanged(_In_ DWORD flags)
     return S_OK;
 }
 
+IFACEMETHODIMP CSmartRenameManager::OnRulesChanged()
+{
+    _PerformRegExRename();
+    return S_OK;
+}
+
+IFACEMETHODIMP CSmartRenameManager::OnPatternError(_In_ HRESULT /*hr*/)
+{
+    // The search term does not compile so every item would fail.  Don't start a
+    // preview pass, just stop the one in flight and clear the stale previews.
+    // The error may have come from a flags change so pick those up too.
+    m_spRegEx->get_flags(&m_flags);
+    _ClearNewNamesWhenIdle();
+    return S_OK;
+}
+
 HRESULT CSmartRenameManager::s_CreateInstance(_Outptr_ ISmartRenameManager** ppsrm)
 {
     *ppsrm = nullptr;
@@ -305,22 +332,31 @@ HRESULT CSmartRenameManager::s_CreateInstance(_Outptr_ ISmartRenameManager** pps
 }
 
 CSmartRenameManager::CSmartRenameManager() :
-    m_refCount(1)
+    m_refCount(1),
+    m_itemStore(std::make_shared<CSmartRenameItemStore>())
 {
-    InitializeCriticalSection(&m_critsecReentrancy);
 }
 
 CSmartRenameManager::~CSmartRenameManager()
 {
-    DeleteCriticalSection(&m_critsecReentrancy);
+    _StopRegExWorkerThread();
 }
 
 HRESULT CSmartRenameManager::_Init()
 {
     // Guaranteed to succeed
     m_startFileOpWorkerEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
-    m_startRegExWorkerEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    m_regExJobEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
     m_cancelRegExWorkerEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    m_regExIdleEvent = CreateEvent(nullptr, TRUE, TRUE, nullptr);
+
+    // One preview worker per processor, each with its own update ring.  These are
+    // fixed for the life of the manager so the workers and the manager thread can read
+    // them without a lock.
+    SYSTEM_INFO systemInfo = { 0 };
+    GetSystemInfo(&systemInfo);
+    m_regExWorkerCount = (std::max)(1u, static_cast<UINT>(systemInfo.dwNumberOfProcessors));
+    m_updateRings.reset(new CItemUpdateRing[m_regExWorkerCount]);
 
     m_hwndMessage = CreateMsgWindow(g_hInst, s_msgWndProc, this);
 
@@ -330,10 +366,11 @@ HRESULT CSmartRenameManager::_Init()
 // Custom messages for worker threads
 enum
 {
-    SRM_REGEX_ITEM_UPDATED = (WM_APP + 1),  // Single smart rename item processed by regex worker thread
+    SRM_REGEX_ITEMS_UPDATED = (WM_APP + 1), // Regex workers queued updated items in the update rings
     SRM_REGEX_STARTED,                      // RegEx operation was started
     SRM_REGEX_CANCELED,                     // Regex operation was canceled
     SRM_REGEX_COMPLETE,                     // Regex worker thread completed
+    SRM_REGEX_IDLE,                         // Regex worker thread stopped with names left to clear
     SRM_FILEOP_COMPLETE                     // File Operation worker thread completed
 };
 
@@ -377,28 +414,42 @@ LRESULT CSmartRenameManager::_WndProc(_In_ HWND hwnd, _In_ UINT msg, _In_ WPARAM
 
     switch (msg)
     {
-    case SRM_REGEX_ITEM_UPDATED:
-    {
-        int id = static_cast<int>(lParam);
-        CComPtr<ISmartRenameItem> spItem;
-        if (SUCCEEDED(GetItemById(id, &spItem)))
-        {
-            _OnUpdate(spItem);
-        }
+    case SRM_REGEX_ITEMS_UPDATED:
+        _DrainItemUpdates();
         break;
-    }
+
     case SRM_REGEX_STARTED:
         _OnRegExStarted(static_cast<DWORD>(wParam));
         break;
 
     case SRM_REGEX_CANCELED:
+        // Report the items updated before the pass stopped first
+        _DrainItemUpdates();
         _OnRegExCanceled(static_cast<DWORD>(wParam));
         break;
 
     case SRM_REGEX_COMPLETE:
+        _DrainItemUpdates();
         _OnRegExCompleted(static_cast<DWORD>(wParam));
         break;
 
+    case SRM_REGEX_IDLE:
+        {
+            // Unless a job was queued since the names were to be cleared
+            bool clear = false;
+            {
+                CSRWExclusiveAutoLock lock(&m_lockRegExJob);
+                clear = m_clearNewNamesPending && !m_regExJobPending;
+                m_clearNewNamesPending = false;
+            }
+
+            if (clear)
+            {
+                _ClearNewNames();
+            }
+        }
+        break;
+
     default:
         lRes = DefWindowProc(hwnd, msg, wParam, lParam);
         break;
@@ -468,7 +519,7 @@ HRESULT CSmartRenameManager::_CreateFileOpWorkerThread()
     if (SUCCEEDED(hr))
     {
         pwtd->hwndManager = m_hwndMessage;
-        pwtd->startEvent = m_startRegExWorkerEvent;
+        pwtd->startEvent = m_startFileOpWorkerEvent;
         pwtd->cancelEvent = nullptr;
         pwtd->spsrm = this;
         m_fileOpWorkerThreadHandle = CreateThread(nullptr, 0, s_fileOpWorkerThread, pwtd, 0, nullptr);
@@ -578,243 +629,802 @@ DWORD WINAPI CSmartRenameManager::s_fileOpWorkerThread(_In_ void* pv)
     return 0;
 }
 
+// Edits closer together than this are treated as one burst, such as typing
+const ULONGLONG c_regExBurstInterval = 250;
+
+// Longest a job in a burst waits for the next edit before it is evaluated
+const ULONGLONG c_regExMaxCoalesceDelay = 150;
+
 HRESULT CSmartRenameManager::_PerformRegExRename()
 {
-    HRESULT hr = E_FAIL;
+    // Safe from any thread and never dropped.  The newest job always runs.
+    CSRWExclusiveAutoLock lock(&m_lockRegExJob);
+    HRESULT hr = _EnsureRegExWorkerThread();
+    if (SUCCEEDED(hr))
+    {
+        // Queue a job for the worker thread.  It supersedes the pass in flight, which
+        // stops at its next cancel check; the worker thread then picks this one up.
+        ULONGLONG now = GetTickCount64();
+        m_regExJobInterval = now - m_regExJobQueuedTick;
+        m_regExJobQueuedTick = now;
+        m_regExPassId = static_cast<DWORD>(InterlockedIncrement(&m_nextRegExPassId));
+        m_regExJobPending = true;
+        m_clearNewNamesPending = false;
+        ResetEvent(m_regExIdleEvent);
+        SetEvent(m_cancelRegExWorkerEvent);
+        SetEvent(m_regExJobEvent);
+    }
+
+    return hr;
+}
+
+// Takes the newest queued job, if there is one.  Returns false when the worker thread
+// should exit.  Called on the worker thread.
+bool CSmartRenameManager::_TakeRegExJob(_Inout_ bool* runJob, _Inout_ DWORD* passId)
+{
+    CSRWExclusiveAutoLock lock(&m_lockRegExJob);
+    if (m_regExShutdown)
+    {
+        return false;
+    }
+
+    if (m_regExJobPending)
+    {
+        *runJob = true;
+        *passId = m_regExPassId;
+        m_regExJobPending = false;
+    }
+
+    // A job queued from here on sets the cancel event again
+    ResetEvent(m_cancelRegExWorkerEvent);
+    return true;
+}
+
+// How long the newest job waits for another edit before it is evaluated.  Edits that
+// aren't part of a burst run right away.  In a burst the wait scales with how long a
+// pass takes, so a cheap preview keeps up with typing while an expensive one waits for
+// a pause instead of starting a pass per character.  Called on the worker thread.
+DWORD CSmartRenameManager::_GetRegExCoalesceDelay()
+{
+    CSRWSharedAutoLock lock(&m_lockRegExJob);
+    if (m_regExJobInterval > c_regExBurstInterval)
+    {
+        return 0;
+    }
+
+    return static_cast<DWORD>((std::min)(c_regExMaxCoalesceDelay, m_regExPassTicks / 2));
+}
+
+// Number of names the regex worker hands to ISmartRenameRegEx::ReplaceBatch at once
+const UINT c_regExBatchSize = 64;
+
+// Number of items a preview worker takes at a time.  Each worker starts with its own
+// share of the chunks and steals from the end of another worker's share once its
+// own runs out.
+const UINT c_regExChunkSize = 256;
+
+// An item of the chunk a worker is evaluating.  Its original name is kept in the
+// worker's name buffer.
+struct PENDING_REGEX_ITEM
+{
+    UINT index = 0;
+    UINT nameOffset = 0;
+    UINT nameLength = 0;
+    UINT extensionOffset = 0;   // Within the name, nameLength if there is no extension
+};
+
+// Buffers each preview worker reuses from chunk to chunk
+struct REGEX_WORKER_SCRATCH
+{
+    UINT worker = 0;
+    std::vector<UINT> claimed;          // Items of the chunk no other worker took
+    std::vector<UINT> nameOffsets;
+    std::vector<UINT> extensionOffsets;
+    std::vector<PENDING_REGEX_ITEM> items;  // The claimed items that have a name
+    std::wstring names;         // Original names of the chunk, null terminated
+    std::vector<PCWSTR> sources;
+    std::vector<UINT> offsets;
+    std::vector<HRESULT> results;
+    std::vector<wchar_t> arena;
+    std::wstring newNames;      // New names of the chunk, null terminated
+    std::vector<UINT> newNameOffsets;   // Into newNames, or c_noName if not renamed
+    std::vector<UINT> updateIndexes;
+    std::vector<PCWSTR> updateNames;
+    std::vector<UINT> changed;
+};
 
-    if (!TryEnterCriticalSection(&m_critsecReentrancy))
+// The chunks [next, end) still waiting in one worker's share
+struct REGEX_CHUNK_RANGE
+{
+    CSRWLock lock;
+    UINT next = 0;
+    UINT end = 0;
+};
+
+// New name computed by a worker and applied in item order once every worker is done.
+// Only used with EnumerateItems, where the number an item gets depends on how many
+// renamed items come before it.
+struct REGEX_ITEM_RESULT
+{
+    bool computed = false;
+    std::wstring newName;       // Empty when the item is not renamed
+};
+
+// Shared by the worker threads of one preview pass
+struct REGEX_PASS
+{
+    HWND hwndManager = nullptr;
+    HANDLE cancelEvent = nullptr;
+    ISmartRenameManager* psrm = nullptr;
+    std::shared_ptr<CSmartRenameItemStore> itemStore;
+    ISmartRenameRegEx* pRenameRegEx = nullptr;
+    DWORD flags = 0;
+    DWORD passId = 0;           // Reported with every message so listeners see one pass
+    CItemUpdateRing* updateRings = nullptr;     // Indexed by worker
+    volatile LONG* updatesPosted = nullptr;
+    volatile LONG* updatesOverflowed = nullptr;
+    volatile LONG* priorityGeneration = nullptr;   // Bumped when the priority range changes
+    UINT itemCount = 0;
+    std::vector<UINT> indexes;  // The items the exclude flags leave, which are all the pass visits
+    UINT workerCount = 0;
+    std::unique_ptr<REGEX_CHUNK_RANGE[]> ranges;
+    std::unique_ptr<std::atomic<bool>[]> claimed;   // Set once a worker has taken an item
+    std::vector<REGEX_ITEM_RESULT> results;
+    volatile LONG canceled = 0;
+};
+
+// Helper threads that join the preview worker thread on each pass.  They are created
+// once and wait on wakeSemaphore between passes.
+struct REGEX_HELPER_POOL
+{
+    HANDLE wakeSemaphore = nullptr;
+    HANDLE doneEvent = nullptr;
+    std::vector<HANDLE> threads;
+    REGEX_PASS* pass = nullptr;
+    volatile LONG nextWorker = 0;
+    volatile LONG running = 0;
+    volatile bool exit = false;
+};
+
+// Builds the name an item would be renamed to from the regex result, before any
+// enumeration.  Returns false if the item is not renamed.
+static bool s_BuildNewName(_In_ DWORD flags, _In_ const PENDING_REGEX_ITEM& pending, _In_ PCWSTR originalName, _In_opt_ PCWSTR newName, _Out_ std::wstring& resultName)
+{
+    resultName.clear();
+
+    // newName == nullptr likely means we have an empty search string.  Leave the
+    // result empty so we clear the renamed column
+    if (newName == nullptr)
+    {
+        return false;
+    }
+
+    if (flags & NameOnly)
     {
-        // Ensure we do not re-enter since we pump messages here.
-        // TODO: If we do, post a message back to ourselves
+        resultName.assign(newName);
+        resultName.append(originalName + pending.extensionOffset, pending.nameLength - pending.extensionOffset);
+    }
+    else if (flags & ExtensionOnly)
+    {
+        if (pending.extensionOffset < pending.nameLength)
+        {
+            // The stem and the dot
+            resultName.assign(originalName, pending.extensionOffset + 1);
+            resultName.append(newName);
+        }
+        else
+        {
+            resultName.assign(originalName, pending.nameLength);
+        }
     }
     else
     {
-        // Ensure previous thread is canceled
-        _CancelRegExWorkerThread();
+        resultName.assign(newName);
+    }
 
-        // Create worker thread which will message us progress and completion.
-        hr = _CreateRegExWorkerThread();
-        if (SUCCEEDED(hr))
+    // No change from originalName so leave the result empty so we clear it from
+    // our UI as well.
+    if (lstrcmp(originalName, resultName.c_str()) == 0)
+    {
+        resultName.clear();
+        return false;
+    }
+
+    return true;
+}
+
+// The part of the name the regex is run on.  With NameOnly the stem is cut off in
+// place by s_ApplyRegExBatch.
+static PCWSTR s_GetRegExSource(_In_ DWORD flags, _In_ const PENDING_REGEX_ITEM& pending, _In_ PCWSTR originalName, _Out_ UINT* length)
+{
+    if (flags & NameOnly)
+    {
+        *length = pending.extensionOffset;
+        return originalName;
+    }
+
+    if (flags & ExtensionOnly)
+    {
+        // Without the dot
+        UINT offset = (std::min)(pending.extensionOffset + 1, pending.nameLength);
+        *length = pending.nameLength - offset;
+        return originalName + offset;
+    }
+
+    *length = pending.nameLength;
+    return originalName;
+}
+
+// Queues an updated item for the manager thread and wakes it if it isn't already
+// due to drain the update rings
+static void s_QueueItemUpdate(_In_ REGEX_PASS* pass, _In_ UINT worker, _In_ UINT index)
+{
+    if (!pass->updateRings[worker].Push(index))
+    {
+        InterlockedExchange(pass->updatesOverflowed, 1);
+    }
+
+    if (InterlockedExchange(pass->updatesPosted, 1) == 0)
+    {
+        PostMessage(pass->hwndManager, SRM_REGEX_ITEMS_UPDATED, pass->passId, 0);
+    }
+}
+
+// Sets the item's new name and tells the manager thread if it changed
+static void s_UpdateNewName(_In_ REGEX_PASS* pass, _In_ UINT worker, _In_ UINT index, _In_opt_ PCWSTR newName)
+{
+    bool changed = false;
+    if (SUCCEEDED(pass->itemStore->PutNewNameAt(index, newName, &changed)) && changed)
+    {
+        s_QueueItemUpdate(pass, worker, index);
+    }
+}
+
+// Runs a batch of the chunk's names through the regex and adds their new names to
+// the worker's, or records them for the enumeration pass.  Returns
+// HRESULT_FROM_WIN32(ERROR_CANCELLED) if the pass was canceled while the names were
+// being matched.
+static HRESULT s_ApplyRegExBatch(_In_ REGEX_PASS* pass, _Inout_ REGEX_WORKER_SCRATCH& scratch, _In_ UINT first, _In_ UINT count)
+{
+    const PENDING_REGEX_ITEM* batch = scratch.items.data() + first;
+    scratch.sources.resize(count);
+    scratch.offsets.resize(count);
+    scratch.results.assign(count, E_FAIL);
+
+    // Start with room for every name to double in length and grow if that isn't enough
+    size_t arenaSize = MAX_PATH;
+    for (UINT i = 0; i < count; i++)
+    {
+        UINT length = 0;
+        scratch.sources[i] = s_GetRegExSource(pass->flags, batch[i], &scratch.names[batch[i].nameOffset], &length);
+        arenaSize += (length + 1) * 2;
+        if (pass->flags & NameOnly)
         {
-            ResetEvent(m_cancelRegExWorkerEvent);
+            scratch.names[batch[i].nameOffset + batch[i].extensionOffset] = L'\0';
+        }
+    }
 
-            // Signal the worker thread that they can start working. We needed to wait until we
-            // were ready to process thread messages.
-            SetEvent(m_startRegExWorkerEvent);
+    HRESULT hr = E_FAIL;
+    do
+    {
+        if (scratch.arena.size() < arenaSize)
+        {
+            scratch.arena.resize(arenaSize);
         }
+        UINT processed = 0;
+        hr = pass->pRenameRegEx->ReplaceBatch(count, scratch.sources.data(), pass->cancelEvent, scratch.arena.data(), static_cast<UINT>(scratch.arena.size()),
+            scratch.offsets.data(), scratch.results.data(), &processed);
+        arenaSize = scratch.arena.size() * 2;
+    } while (hr == HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
+
+    if (hr == HRESULT_FROM_WIN32(ERROR_CANCELLED))
+    {
+        return hr;
     }
 
-    return hr;
+    // Put back the extensions cut off above
+    if (pass->flags & NameOnly)
+    {
+        for (UINT i = 0; i < count; i++)
+        {
+            if (batch[i].extensionOffset < batch[i].nameLength)
+            {
+                scratch.names[batch[i].nameOffset + batch[i].extensionOffset] = L'.';
+            }
+        }
+    }
+
+    std::wstring resultName;
+    for (UINT i = 0; i < count; i++)
+    {
+        const PENDING_REGEX_ITEM& pending = batch[i];
+
+        // Failure here means we didn't match anything or had nothing to match
+        // Call put_newName with null in that case to reset it
+        PCWSTR newName = (SUCCEEDED(hr) && SUCCEEDED(scratch.results[i])) ? scratch.arena.data() + scratch.offsets[i] : nullptr;
+        bool renamed = s_BuildNewName(pass->flags, pending, &scratch.names[pending.nameOffset], newName, resultName);
+
+        if (pass->flags & EnumerateItems)
+        {
+            REGEX_ITEM_RESULT& result = pass->results[pending.index];
+            result.computed = true;
+            result.newName.swap(resultName);
+        }
+        else if (renamed)
+        {
+            scratch.newNameOffsets.push_back(static_cast<UINT>(scratch.newNames.length()));
+            scratch.newNames.append(resultName.c_str(), resultName.length() + 1);
+        }
+        else
+        {
+            scratch.newNameOffsets.push_back(CSmartRenameItemStore::c_noName);
+        }
+    }
+
+    return S_OK;
 }
 
-HRESULT CSmartRenameManager::_CreateRegExWorkerThread()
+// Takes the next chunk from this worker's share, or steals the last chunk of the
+// first other worker that has any left.  Returns false when there is no work left.
+static bool s_TakeRegExChunk(_In_ REGEX_PASS* pass, _In_ UINT worker, _Out_ UINT* chunk)
 {
-    WorkerThreadData* pwtd = new WorkerThreadData;
-    HRESULT hr = pwtd ? S_OK : E_OUTOFMEMORY;
-    if (SUCCEEDED(hr))
     {
-        pwtd->hwndManager = m_hwndMessage;
-        pwtd->startEvent = m_startRegExWorkerEvent;
-        pwtd->cancelEvent = m_cancelRegExWorkerEvent;
-        pwtd->hwndParent = m_hwndParent;
-        pwtd->spsrm = this;
-        m_regExWorkerThreadHandle = CreateThread(nullptr, 0, s_regexWorkerThread, pwtd, 0, nullptr);
-        hr = (m_regExWorkerThreadHandle) ? S_OK : E_FAIL;
-        if (FAILED(hr))
+        REGEX_CHUNK_RANGE& own = pass->ranges[worker];
+        CSRWExclusiveAutoLock lock(&own.lock);
+        if (own.next < own.end)
         {
-            delete pwtd;
+            *chunk = own.next++;
+            return true;
         }
     }
 
-    return hr;
+    for (UINT i = 1; i < pass->workerCount; i++)
+    {
+        REGEX_CHUNK_RANGE& victim = pass->ranges[(worker + i) % pass->workerCount];
+        CSRWExclusiveAutoLock lock(&victim.lock);
+        if (victim.next < victim.end)
+        {
+            *chunk = --victim.end;
+            return true;
+        }
+    }
+
+    return false;
 }
 
-DWORD WINAPI CSmartRenameManager::s_regexWorkerThread(_In_ void* pv)
+static bool s_IsRegExPassCanceled(_In_ REGEX_PASS* pass)
 {
-    if (SUCCEEDED(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE)))
+    if (pass->canceled)
     {
-        WorkerThreadData* pwtd = reinterpret_cast<WorkerThreadData*>(pv);
-        if (pwtd)
+        return true;
+    }
+
+    if (WaitForSingleObject(pass->cancelEvent, 0) == WAIT_OBJECT_0)
+    {
+        InterlockedExchange(&pass->canceled, 1);
+        return true;
+    }
+
+    return false;
+}
+
+// Evaluates the items at positions [begin, end) of the pass's indexes that no other
+// worker has taken.  Their names are read from the store under one lock and their new
+// names written back under another, so workers don't queue up on the store item by
+// item.  Returns false, leaving the items alone, if the pass was canceled.
+static bool s_EvaluateRegExItems(_In_ REGEX_PASS* pass, _Inout_ REGEX_WORKER_SCRATCH& scratch, _In_ UINT begin, _In_ UINT end)
+{
+    // Check if cancel event is signaled
+    if (s_IsRegExPassCanceled(pass))
+    {
+        return false;
+    }
+
+    // Skip items another worker already took for the priority range
+    scratch.claimed.clear();
+    for (UINT position = begin; position < end; position++)
+    {
+        UINT u = pass->indexes[position];
+        if (!pass->claimed[u].exchange(true))
+        {
+            scratch.claimed.push_back(u);
+        }
+    }
+
+    UINT claimedCount = static_cast<UINT>(scratch.claimed.size());
+    scratch.nameOffsets.resize(claimedCount);
+    scratch.extensionOffsets.resize(claimedCount);
+    scratch.names.clear();
+    pass->itemStore->GetNamesAt(scratch.claimed.data(), claimedCount, &scratch.names, scratch.nameOffsets.data(), scratch.extensionOffsets.data());
+
+    scratch.items.clear();
+    for (UINT i = 0; i < claimedCount; i++)
+    {
+        if (scratch.nameOffsets[i] != CSmartRenameItemStore::c_noName)
         {
-            PostMessage(pwtd->hwndManager, SRM_REGEX_STARTED, GetCurrentThreadId(), 0);
+            PENDING_REGEX_ITEM pending;
+            pending.index = scratch.claimed[i];
+            pending.nameOffset = scratch.nameOffsets[i];
+            pending.nameLength = static_cast<UINT>(wcslen(&scratch.names[pending.nameOffset]));
+            pending.extensionOffset = scratch.extensionOffsets[i];
+            scratch.items.push_back(pending);
+        }
+    }
 
-            // Wait to be told we can begin
-            if (WaitForSingleObject(pwtd->startEvent, INFINITE) == WAIT_OBJECT_0)
+    UINT count = static_cast<UINT>(scratch.items.size());
+    scratch.newNames.clear();
+    scratch.newNameOffsets.clear();
+    for (UINT first = 0; first < count; first += c_regExBatchSize)
+    {
+        if (s_IsRegExPassCanceled(pass) ||
+            s_ApplyRegExBatch(pass, scratch, first, (std::min)(c_regExBatchSize, count - first)) == HRESULT_FROM_WIN32(ERROR_CANCELLED))
+        {
+            // Canceled in the middle of matching a name
+            InterlockedExchange(&pass->canceled, 1);
+            return false;
+        }
+    }
+
+    if (!(pass->flags & EnumerateItems) && count > 0)
+    {
+        // Any failure here means an item went away, which leaves it nothing to update
+        scratch.updateIndexes.resize(count);
+        scratch.updateNames.resize(count);
+        for (UINT i = 0; i < count; i++)
+        {
+            UINT offset = scratch.newNameOffsets[i];
+            scratch.updateIndexes[i] = scratch.items[i].index;
+            scratch.updateNames[i] = (offset != CSmartRenameItemStore::c_noName) ? scratch.newNames.c_str() + offset : nullptr;
+        }
+
+        pass->itemStore->PutNewNamesAt(scratch.updateIndexes.data(), scratch.updateNames.data(), count, &scratch.changed);
+        for (UINT index : scratch.changed)
+        {
+            s_QueueItemUpdate(pass, scratch.worker, index);
+        }
+    }
+    return true;
+}
+
+// Evaluates chunks until none are left or the pass is canceled.  Whenever the priority
+// range changes, which is what the user can see, the worker evaluates it before going
+// back to its chunks so visible rows never wait behind the rest of the pass.
+static void s_RunRegExWorker(_In_ REGEX_PASS* pass, _In_ UINT worker)
+{
+    REGEX_WORKER_SCRATCH scratch;
+    scratch.worker = worker;
+
+    LONG servedGeneration = -1;
+    UINT chunk = 0;
+    while (!pass->canceled)
+    {
+        LONG generation = *pass->priorityGeneration;
+        if (generation != servedGeneration)
+        {
+            servedGeneration = generation;
+
+            UINT first = 0;
+            UINT count = 0;
+            pass->psrm->GetPriorityRange(&first, &count);
+            UINT end = (count > pass->itemCount - (std::min)(first, pass->itemCount)) ? pass->itemCount : first + count;
+
+            // The range is in items, so find the positions of the included ones in it
+            first = static_cast<UINT>(std::lower_bound(pass->indexes.begin(), pass->indexes.end(), first) - pass->indexes.begin());
+            end = static_cast<UINT>(std::lower_bound(pass->indexes.begin(), pass->indexes.end(), end) - pass->indexes.begin());
+            if (first < end)
             {
-                CComPtr<ISmartRenameRegEx> spRenameRegEx;
-                if (SUCCEEDED(pwtd->spsrm->get_renameRegEx(&spRenameRegEx)))
-                {
-                    DWORD flags = 0;
-                    spRenameRegEx->get_flags(&flags);
+                s_EvaluateRegExItems(pass, scratch, first, end);
+            }
+            continue;
+        }
 
-                    UINT itemCount = 0;
-                    unsigned long itemEnumIndex = 1;
-                    pwtd->spsrm->GetItemCount(&itemCount);
-                    for (UINT u = 0; u <= itemCount; u++)
-                    {
-                        // Check if cancel event is signaled
-                        if (WaitForSingleObject(pwtd->cancelEvent, 0) == WAIT_OBJECT_0)
-                        {
-                            // Canceled from manager
-                            // Send the manager thread the canceled message
-                            PostMessage(pwtd->hwndManager, SRM_REGEX_CANCELED, GetCurrentThreadId(), 0);
-                            break;
-                        }
+        UINT positionCount = static_cast<UINT>(pass->indexes.size());
+        if (!s_TakeRegExChunk(pass, worker, &chunk) ||
+            !s_EvaluateRegExItems(pass, scratch, chunk * c_regExChunkSize, (std::min)(positionCount, (chunk + 1) * c_regExChunkSize)))
+        {
+            break;
+        }
+    }
+}
 
-                        CComPtr<ISmartRenameItem> spItem;
-                        if (SUCCEEDED(pwtd->spsrm->GetItemByIndex(u, &spItem)))
-                        {
-                            int id = -1;
-                            spItem->get_id(&id);
-
-                            bool isFolder = false;
-                            bool isSubFolderContent = false;
-                            spItem->get_isFolder(&isFolder);
-                            spItem->get_isSubFolderContent(&isSubFolderContent);
-                            if ((isFolder && (flags & SmartRenameFlags::ExcludeFolders)) ||
-                                (!isFolder && (flags & SmartRenameFlags::ExcludeFiles)) ||
-                                (isSubFolderContent && (flags & SmartRenameFlags::ExcludeSubfolders)))
-                            {
-                                // Exclude this item from renaming.  Ensure new name is cleared.
-                                spItem->put_newName(nullptr);
+static DWORD WINAPI s_regexHelperThread(_In_ void* pv)
+{
+    REGEX_HELPER_POOL* pool = reinterpret_cast<REGEX_HELPER_POOL*>(pv);
+    HRESULT hrInit = CoInitializeEx(nullptr, COINIT_MULTITHREADED | COINIT_DISABLE_OLE1DDE);
+    while (WaitForSingleObject(pool->wakeSemaphore, INFINITE) == WAIT_OBJECT_0 && !pool->exit)
+    {
+        // Worker 0 is the preview worker thread itself
+        UINT worker = static_cast<UINT>(InterlockedIncrement(&pool->nextWorker));
+        s_RunRegExWorker(pool->pass, worker);
+        if (InterlockedDecrement(&pool->running) == 0)
+        {
+            SetEvent(pool->doneEvent);
+        }
+    }
 
-                                // Send the manager thread the item processed message
-                                PostMessage(pwtd->hwndManager, SRM_REGEX_ITEM_UPDATED, GetCurrentThreadId(), id);
+    if (SUCCEEDED(hrInit))
+    {
+        CoUninitialize();
+    }
+    return 0;
+}
 
-                                continue;
-                            }
+// Applies the names computed by the workers in item order so enumerated names are
+// numbered the same way no matter which worker handled which item
+static void s_ApplyEnumeratedNames(_In_ REGEX_PASS* pass)
+{
+    unsigned long itemEnumIndex = 1;
+    for (UINT u : pass->indexes)
+    {
+        if (s_IsRegExPassCanceled(pass))
+        {
+            break;
+        }
 
-                            PWSTR originalName = nullptr;
-                            if (SUCCEEDED(spItem->get_originalName(&originalName)))
-                            {
-                                PWSTR currentNewName = nullptr;
-                                spItem->get_newName(&currentNewName);
+        REGEX_ITEM_RESULT& result = pass->results[u];
+        if (!result.computed)
+        {
+            continue;
+        }
 
-                                wchar_t sourceName[MAX_PATH] = { 0 };
-                                if (flags & NameOnly)
-                                {
-                                    StringCchCopy(sourceName, ARRAYSIZE(sourceName), fs::path(originalName).stem().c_str());
-                                }
-                                else if (flags & ExtensionOnly)
-                                {
-                                    std::wstring extension = fs::path(originalName).extension().wstring();
-                                    if (!extension.empty() && extension.front() == '.')
-                                    {
-                                        extension = extension.erase(0, 1);
-                                    }
-                                    StringCchCopy(sourceName, ARRAYSIZE(sourceName), extension.c_str());
-                                }
-                                else
-                                {
-                                    StringCchCopy(sourceName, ARRAYSIZE(sourceName), originalName);
-                                }
+        PCWSTR newNameToUse = nullptr;
+        wchar_t uniqueName[MAX_PATH] = { 0 };
+        if (!result.newName.empty())
+        {
+            newNameToUse = result.newName.c_str();
+            unsigned long countUsed = 0;
+            if (GetEnumeratedFileName(uniqueName, ARRAYSIZE(uniqueName), newNameToUse, nullptr, itemEnumIndex, &countUsed))
+            {
+                newNameToUse = uniqueName;
+            }
+            itemEnumIndex++;
+        }
 
+        s_UpdateNewName(pass, 0, u, newNameToUse);
+    }
+}
 
-                                PWSTR newName = nullptr;
-                                // Failure here means we didn't match anything or had nothing to match
-                                // Call put_newName with null in that case to reset it
-                                spRenameRegEx->Replace(sourceName, &newName);
+// Runs one preview pass over every item using the helper pool
+// Returns false if the pass was canceled
+static bool s_RunRegExPass(_In_ REGEX_PASS* pass, _In_ REGEX_HELPER_POOL* pool)
+{
+    PostMessage(pass->hwndManager, SRM_REGEX_STARTED, pass->passId, 0);
 
-                                wchar_t resultName[MAX_PATH] = { 0 };
+    // Excluded items only need their new names cleared, which is usually already
+    // done, so the workers never look at them
+    std::vector<UINT> cleared;
+    pass->itemStore->ClearExcludedNewNames(pass->flags, &cleared);
+    for (UINT index : cleared)
+    {
+        s_QueueItemUpdate(pass, 0, index);
+    }
 
-                                PWSTR newNameToUse = nullptr;
+    pass->itemCount = pass->itemStore->GetIncludedIndexes(pass->flags, &pass->indexes);
+    if (pass->flags & EnumerateItems)
+    {
+        pass->results.resize(pass->itemCount);
+    }
+    pass->claimed.reset(new std::atomic<bool>[pass->itemCount]());
+
+    // One worker per pool thread, this thread included, but never more workers
+    // than chunks
+    UINT chunkCount = (static_cast<UINT>(pass->indexes.size()) + c_regExChunkSize - 1) / c_regExChunkSize;
+    UINT helperCount = (std::min)(static_cast<UINT>(pool->threads.size()), (chunkCount > 1) ? chunkCount - 1 : 0);
+    pass->workerCount = helperCount + 1;
+    pass->ranges.reset(new REGEX_CHUNK_RANGE[pass->workerCount]);
+    for (UINT i = 0; i < pass->workerCount; i++)
+    {
+        pass->ranges[i].next = static_cast<UINT>((static_cast<ULONGLONG>(chunkCount) * i) / pass->workerCount);
+        pass->ranges[i].end = static_cast<UINT>((static_cast<ULONGLONG>(chunkCount) * (i + 1)) / pass->workerCount);
+    }
 
-                                // newName == nullptr likely means we have an empty search string.  We should leave newNameToUse
-                                // as nullptr so we clear the renamed column
-                                if (newName != nullptr)
-                                {
-                                    newNameToUse = resultName;
-                                    if (flags & NameOnly)
-                                    {
-                                        StringCchPrintf(resultName, ARRAYSIZE(resultName), L"%s%s", newName, fs::path(originalName).extension().c_str());
-                                    }
-                                    else if (flags & ExtensionOnly)
-                                    {
-                                        std::wstring extension = fs::path(originalName).extension().wstring();
-                                        if (!extension.empty())
-                                        {
-                                            StringCchPrintf(resultName, ARRAYSIZE(resultName), L"%s.%s", fs::path(originalName).stem().c_str(), newName);
-                                        }
-                                        else
-                                        {
-                                            StringCchCopy(resultName, ARRAYSIZE(resultName), originalName);
-                                        }
-                                    }
-                                    else
-                                    {
-                                        StringCchCopy(resultName, ARRAYSIZE(resultName), newName);
-                                    }
-                                }
-                                
-                                // No change from originalName so set newName to
-                                // null so we clear it from our UI as well.
-                                if (lstrcmp(originalName, newNameToUse) == 0)
-                                {
-                                    newNameToUse = nullptr;
-                                }
+    if (helperCount > 0)
+    {
+        pool->pass = pass;
+        pool->nextWorker = 0;
+        pool->running = helperCount;
+        ResetEvent(pool->doneEvent);
+        ReleaseSemaphore(pool->wakeSemaphore, helperCount, nullptr);
+    }
 
-                                wchar_t uniqueName[MAX_PATH] = { 0 };
-                                if (newNameToUse != nullptr && (flags & EnumerateItems))
-                                {
-                                    unsigned long countUsed = 0;
-                                    if (GetEnumeratedFileName(uniqueName, ARRAYSIZE(uniqueName), newNameToUse, nullptr, itemEnumIndex, &countUsed))
-                                    {
-                                        newNameToUse = uniqueName;
-                                    }
-                                    itemEnumIndex++;
-                                }
+    s_RunRegExWorker(pass, 0);
 
-                                spItem->put_newName(newNameToUse);
+    if (helperCount > 0)
+    {
+        WaitForSingleObject(pool->doneEvent, INFINITE);
+        pool->pass = nullptr;
+    }
 
-                                // Was there a change?
-                                if (lstrcmp(currentNewName, newNameToUse) != 0)
-                                {
-                                    // Send the manager thread the item processed message
-                                    PostMessage(pwtd->hwndManager, SRM_REGEX_ITEM_UPDATED, GetCurrentThreadId(), id);
-                                }
+    if (!pass->canceled && (pass->flags & EnumerateItems))
+    {
+        s_ApplyEnumeratedNames(pass);
+    }
 
-                                CoTaskMemFree(newName);
-                                CoTaskMemFree(currentNewName);
-                                CoTaskMemFree(originalName);
-                            }
-                        }
-                    }
+    if (pass->canceled)
+    {
+        // Canceled from manager
+        // Send the manager thread the canceled message
+        PostMessage(pass->hwndManager, SRM_REGEX_CANCELED, pass->passId, 0);
+    }
+
+    // Send the manager thread the completion message
+    PostMessage(pass->hwndManager, SRM_REGEX_COMPLETE, pass->passId, 0);
+    return !pass->canceled;
+}
+
+// Lives until the manager shuts down.  Each time a job is queued it runs a pass for
+// the newest one; jobs that were superseded before they started are dropped.
+DWORD WINAPI CSmartRenameManager::s_regexWorkerThread(_In_ void* pv)
+{
+    CSmartRenameManager* pThis = reinterpret_cast<CSmartRenameManager*>(pv);
+    if (SUCCEEDED(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE)))
+    {
+        // One helper per additional worker
+        REGEX_HELPER_POOL pool;
+        pool.wakeSemaphore = CreateSemaphore(nullptr, 0, MAXLONG, nullptr);
+        pool.doneEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+        if (pool.wakeSemaphore && pool.doneEvent)
+        {
+            for (UINT i = 1; i < pThis->m_regExWorkerCount; i++)
+            {
+                HANDLE thread = CreateThread(nullptr, 0, s_regexHelperThread, &pool, 0, nullptr);
+                if (thread)
+                {
+                    pool.threads.push_back(thread);
                 }
             }
+        }
 
-            // Send the manager thread the completion message
-            PostMessage(pwtd->hwndManager, SRM_REGEX_COMPLETE, GetCurrentThreadId(), 0);
+        while (WaitForSingleObject(pThis->m_regExJobEvent, INFINITE) == WAIT_OBJECT_0)
+        {
+            bool runJob = false;
+            DWORD passId = 0;
+            bool exit = !pThis->_TakeRegExJob(&runJob, &passId);
 
-            delete pwtd;
+            // Let a burst of edits settle so only the last one is evaluated
+            DWORD delay = (runJob && !exit) ? pThis->_GetRegExCoalesceDelay() : 0;
+            while (delay > 0 && WaitForSingleObject(pThis->m_regExJobEvent, delay) == WAIT_OBJECT_0)
+            {
+                exit = !pThis->_TakeRegExJob(&runJob, &passId);
+                delay = exit ? 0 : pThis->_GetRegExCoalesceDelay();
+            }
+
+            if (exit)
+            {
+                break;
+            }
+
+            CComPtr<ISmartRenameRegEx> spRenameRegEx;
+            if (runJob && SUCCEEDED(pThis->get_renameRegEx(&spRenameRegEx)))
+            {
+                REGEX_PASS pass;
+                pass.hwndManager = pThis->m_hwndMessage;
+                pass.cancelEvent = pThis->m_cancelRegExWorkerEvent;
+                pass.psrm = pThis;
+                {
+                    CSRWSharedAutoLock lock(&pThis->m_lockRegExJob);
+                    pass.itemStore = pThis->m_itemStore;
+                }
+                pass.pRenameRegEx = spRenameRegEx;
+                pass.passId = passId;
+                pass.updateRings = pThis->m_updateRings.get();
+                pass.updatesPosted = &pThis->m_updatesPosted;
+                pass.updatesOverflowed = &pThis->m_updatesOverflowed;
+                pass.priorityGeneration = &pThis->m_priorityGeneration;
+                spRenameRegEx->get_flags(&pass.flags);
+
+                // A canceled pass still shows a pass costs at least that much
+                ULONGLONG start = GetTickCount64();
+                bool completed = s_RunRegExPass(&pass, &pool);
+                ULONGLONG elapsed = GetTickCount64() - start;
+
+                CSRWExclusiveAutoLock lock(&pThis->m_lockRegExJob);
+                pThis->m_regExPassTicks = completed ? elapsed : (std::max)(pThis->m_regExPassTicks, elapsed);
+            }
+
+            CSRWExclusiveAutoLock lock(&pThis->m_lockRegExJob);
+            if (!pThis->m_regExJobPending)
+            {
+                SetEvent(pThis->m_regExIdleEvent);
+                if (pThis->m_clearNewNamesPending)
+                {
+                    PostMessage(pThis->m_hwndMessage, SRM_REGEX_IDLE, 0, 0);
+                }
+            }
         }
+
+        pool.exit = true;
+        if (!pool.threads.empty())
+        {
+            ReleaseSemaphore(pool.wakeSemaphore, static_cast<LONG>(pool.threads.size()), nullptr);
+        }
+        for (HANDLE thread : pool.threads)
+        {
+            WaitForSingleObject(thread, INFINITE);
+            CloseHandle(thread);
+        }
+
+        if (pool.wakeSemaphore)
+        {
+            CloseHandle(pool.wakeSemaphore);
+        }
+        if (pool.doneEvent)
+        {
+            CloseHandle(pool.doneEvent);
+        }
+
         CoUninitialize();
     }
 
     return 0;
 }
 
-void CSmartRenameManager::_CancelRegExWorkerThread()
+// Starts the worker thread the first time a job is queued.  Called with m_lockRegExJob
+// held so two threads queuing the first job can't both start one.
+HRESULT CSmartRenameManager::_EnsureRegExWorkerThread()
 {
-    if (m_startRegExWorkerEvent)
+    HRESULT hr = S_OK;
+    if (m_regExShutdown)
     {
-        SetEvent(m_startRegExWorkerEvent);
+        hr = E_UNEXPECTED;
     }
+    else if (!m_regExWorkerThreadHandle)
+    {
+        m_regExWorkerThreadHandle = CreateThread(nullptr, 0, s_regexWorkerThread, this, 0, nullptr);
+        hr = (m_regExWorkerThreadHandle) ? S_OK : E_FAIL;
+    }
+
+    return hr;
+}
 
+// Stops the pass in flight, if any, without waiting for it
+void CSmartRenameManager::_CancelRegExWorkerThread()
+{
+    CSRWExclusiveAutoLock lock(&m_lockRegExJob);
+    m_regExJobPending = false;
     if (m_cancelRegExWorkerEvent)
     {
         SetEvent(m_cancelRegExWorkerEvent);
     }
-
-    _WaitForRegExWorkerThread();
 }
 
+// Waits until no pass is running or queued
 void CSmartRenameManager::_WaitForRegExWorkerThread()
 {
-    if (m_regExWorkerThreadHandle)
+    HANDLE thread = nullptr;
+    {
+        CSRWSharedAutoLock lock(&m_lockRegExJob);
+        thread = m_regExWorkerThreadHandle;
+    }
+
+    if (thread)
     {
-        WaitForSingleObject(m_regExWorkerThreadHandle, INFINITE);
-        CloseHandle(m_regExWorkerThreadHandle);
+        HANDLE handles[] = { m_regExIdleEvent, thread };
+        WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, INFINITE);
+    }
+}
+
+void CSmartRenameManager::_StopRegExWorkerThread()
+{
+    // Once shut down no job can start the worker thread again
+    HANDLE thread = nullptr;
+    {
+        CSRWExclusiveAutoLock lock(&m_lockRegExJob);
+        m_regExShutdown = true;
+        m_regExJobPending = false;
+        thread = m_regExWorkerThreadHandle;
         m_regExWorkerThreadHandle = nullptr;
+        if (thread)
+        {
+            SetEvent(m_cancelRegExWorkerEvent);
+            SetEvent(m_regExJobEvent);
+        }
+    }
+
+    if (thread)
+    {
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
     }
 }
 
@@ -877,6 +1487,19 @@ void CSmartRenameManager::_OnItemAdded(_In_ ISmartRenameItem* renameItem)
     }
 }
 
+void CSmartRenameManager::_OnItemsAdded(_In_ UINT firstIndex, _In_ UINT count)
+{
+    CSRWSharedAutoLock lock(&m_lockEvents);
+
+    for (std::vector<RENAME_MGR_EVENT>::iterator it = m_renameManagerEvents.begin(); it != m_renameManagerEvents.end(); ++it)
+    {
+        if (it->pEvents)
+        {
+            it->pEvents->OnItemsAdded(firstIndex, count);
+        }
+    }
+}
+
 void CSmartRenameManager::_OnUpdate(_In_ ISmartRenameItem* renameItem)
 {
     CSRWSharedAutoLock lock(&m_lockEvents);
@@ -890,6 +1513,19 @@ void CSmartRenameManager::_OnUpdate(_In_ ISmartRenameItem* renameItem)
     }
 }
 
+void CSmartRenameManager::_OnItemsUpdated(_In_ UINT firstIndex, _In_ UINT count)
+{
+    CSRWSharedAutoLock lock(&m_lockEvents);
+
+    for (std::vector<RENAME_MGR_EVENT>::iterator it = m_renameManagerEvents.begin(); it != m_renameManagerEvents.end(); ++it)
+    {
+        if (it->pEvents)
+        {
+            it->pEvents->OnItemsUpdated(firstIndex, count);
+        }
+    }
+}
+
 void CSmartRenameManager::_OnError(_In_ ISmartRenameItem* renameItem)
 {
     CSRWSharedAutoLock lock(&m_lockEvents);
@@ -903,7 +1539,7 @@ void CSmartRenameManager::_OnError(_In_ ISmartRenameItem* renameItem)
     }
 }
 
-void CSmartRenameManager::_OnRegExStarted(_In_ DWORD threadId)
+void CSmartRenameManager::_OnRegExStarted(_In_ DWORD passId)
 {
     CSRWSharedAutoLock lock(&m_lockEvents);
 
@@ -911,12 +1547,12 @@ void CSmartRenameManager::_OnRegExStarted(_In_ DWORD threadId)
     {
         if (it->pEvents)
         {
-            it->pEvents->OnRegExStarted(threadId);
+            it->pEvents->OnRegExStarted(passId);
         }
     }
 }
 
-void CSmartRenameManager::_OnRegExCanceled(_In_ DWORD threadId)
+void CSmartRenameManager::_OnRegExCanceled(_In_ DWORD passId)
 {
     CSRWSharedAutoLock lock(&m_lockEvents);
 
@@ -924,12 +1560,12 @@ void CSmartRenameManager::_OnRegExCanceled(_In_ DWORD threadId)
     {
         if (it->pEvents)
         {
-            it->pEvents->OnRegExCanceled(threadId);
+            it->pEvents->OnRegExCanceled(passId);
         }
     }
 }
 
-void CSmartRenameManager::_OnRegExCompleted(_In_ DWORD threadId)
+void CSmartRenameManager::_OnRegExCompleted(_In_ DWORD passId)
 {
     CSRWSharedAutoLock lock(&m_lockEvents);
 
@@ -937,7 +1573,7 @@ void CSmartRenameManager::_OnRegExCompleted(_In_ DWORD threadId)
     {
         if (it->pEvents)
         {
-            it->pEvents->OnRegExCompleted(threadId);
+            it->pEvents->OnRegExCompleted(passId);
         }
     }
 }
@@ -988,16 +1624,88 @@ void CSmartRenameManager::_ClearEventHandlers()
 
 void CSmartRenameManager::_ClearSmartRenameItems()
 {
-    CSRWExclusiveAutoLock lock(&m_lockItems);
+    // Item objects still in use keep the old store alive
+    m_itemStore = std::make_shared<CSmartRenameItemStore>();
+}
+
+void CSmartRenameManager::_ClearNewNames()
+{
+    // Report this as a regular preview pass so listeners defer their count
+    // updates until all of the items have been cleared.
+    DWORD passId = static_cast<DWORD>(InterlockedIncrement(&m_nextRegExPassId));
+    _OnRegExStarted(passId);
+
+    UINT first = 0;
+    UINT last = 0;
+    bool cleared = m_itemStore->ClearNewNames(&first, &last);
+
+    // Anything a canceled pass left in the update rings is covered here too
+    _DrainItemUpdates();
+    if (cleared)
+    {
+        _OnItemsUpdated(first, last - first + 1);
+    }
+
+    _OnRegExCompleted(passId);
+}
+
+// Stops the pass in flight and clears every new name once it has, without waiting
+// for it.  A regex can't be stopped part way through a name so a pass may take a
+// while to notice.  Called on the manager thread.
+void CSmartRenameManager::_ClearNewNamesWhenIdle()
+{
+    bool idle = false;
+    {
+        CSRWExclusiveAutoLock lock(&m_lockRegExJob);
+        m_regExJobPending = false;
+        if (m_cancelRegExWorkerEvent)
+        {
+            SetEvent(m_cancelRegExWorkerEvent);
+        }
+
+        // Otherwise the worker posts SRM_REGEX_IDLE once it stops
+        idle = (WaitForSingleObject(m_regExIdleEvent, 0) == WAIT_OBJECT_0);
+        m_clearNewNamesPending = !idle;
+    }
 
-    // Cleanup smart rename items
-    for (std::map<int, ISmartRenameItem*>::iterator it = m_renameItems.begin(); it != m_renameItems.end(); ++it)
+    if (idle)
     {
-        ISmartRenameItem* pItem = it->second;
-        pItem->Release();
+        _ClearNewNames();
+    }
+}
+
+// Reports everything the preview workers have queued since the last drain as one
+// range.  Called on the manager thread.
+void CSmartRenameManager::_DrainItemUpdates()
+{
+    // Clear first so an update queued while we drain posts another wakeup
+    InterlockedExchange(&m_updatesPosted, 0);
+
+    UINT first = UINT_MAX;
+    UINT last = 0;
+    size_t drained = 0;
+    if (m_updateRings)
+    {
+        for (UINT i = 0; i < m_regExWorkerCount; i++)
+        {
+            drained += m_updateRings[i].Drain(first, last);
+        }
+    }
+
+    if (InterlockedExchange(&m_updatesOverflowed, 0))
+    {
+        // Some updates didn't fit so report every item
+        UINT itemCount = 0;
+        GetItemCount(&itemCount);
+        first = 0;
+        last = itemCount ? itemCount - 1 : 0;
+        drained = itemCount;
     }
 
-    m_renameItems.clear();
+    if (drained > 0)
+    {
+        _OnItemsUpdated(first, last - first + 1);
+    }
 }
 
 void CSmartRenameManager::_Cleanup()
@@ -1011,8 +1719,11 @@ void CSmartRenameManager::_Cleanup()
     CloseHandle(m_startFileOpWorkerEvent);
     m_startFileOpWorkerEvent = nullptr;
 
-    CloseHandle(m_startRegExWorkerEvent);
-    m_startRegExWorkerEvent = nullptr;
+    CloseHandle(m_regExJobEvent);
+    m_regExJobEvent = nullptr;
+
+    CloseHandle(m_regExIdleEvent);
+    m_regExIdleEvent = nullptr;
 
     CloseHandle(m_cancelRegExWorkerEvent);
     m_cancelRegExWorkerEvent = nullptr;
@@ -1,7 +1,10 @@
 #pragma once
 #include <vector>
+#include <memory>
 #include <map>
 #include "srwlock.h"
+#include "ItemUpdateRing.h"
+#include "SmartRenameItemStore.h"
 
 class CSmartRenameManager :
     public ISmartRenameManager,
@@ -22,11 +25,16 @@ public:
     IFACEMETHODIMP Shutdown();
     IFACEMETHODIMP Rename(_In_ HWND hwndParent);
     IFACEMETHODIMP AddItem(_In_ ISmartRenameItem* pItem);
+    IFACEMETHODIMP AddItems(_In_reads_(count) ISmartRenameItem* const* items, _In_ UINT count);
     IFACEMETHODIMP GetItemByIndex(_In_ UINT index, _COM_Outptr_ ISmartRenameItem** ppItem);
     IFACEMETHODIMP GetItemById(_In_ int id, _COM_Outptr_ ISmartRenameItem** ppItem);
+    IFACEMETHODIMP GetItemDisplay(_In_ UINT index, _In_ bool newName, _Out_ SMARTRENAME_ITEM_DISPLAY* display, _Out_writes_opt_(cchText) PWSTR text, _In_ UINT cchText);
     IFACEMETHODIMP GetItemCount(_Out_ UINT* count);
     IFACEMETHODIMP GetSelectedItemCount(_Out_ UINT* count);
     IFACEMETHODIMP GetRenameItemCount(_Out_ UINT* count);
+    IFACEMETHODIMP SetPriorityRange(_In_ UINT firstIndex, _In_ UINT count);
+    IFACEMETHODIMP GetPriorityRange(_Out_ UINT* firstIndex, _Out_ UINT* count);
+    IFACEMETHODIMP RefreshPreview();
     IFACEMETHODIMP get_flags(_Out_ DWORD* flags);
     IFACEMETHODIMP put_flags(_In_ DWORD flags);
     IFACEMETHODIMP get_renameRegEx(_COM_Outptr_ ISmartRenameRegEx** ppRegEx);
@@ -38,6 +46,8 @@ public:
     IFACEMETHODIMP OnSearchTermChanged(_In_ PCWSTR searchTerm);
     IFACEMETHODIMP OnReplaceTermChanged(_In_ PCWSTR replaceTerm);
     IFACEMETHODIMP OnFlagsChanged(_In_ DWORD flags);
+    IFACEMETHODIMP OnPatternError(_In_ HRESULT hr);
+    IFACEMETHODIMP OnRulesChanged();
 
     static HRESULT s_CreateInstance(_Outptr_ ISmartRenameManager** ppsrm);
 
@@ -51,30 +61,39 @@ protected:
     void _Cancel();
 
     void _OnItemAdded(_In_ ISmartRenameItem* renameItem);
+    void _OnItemsAdded(_In_ UINT firstIndex, _In_ UINT count);
     void _OnUpdate(_In_ ISmartRenameItem* renameItem);
+    void _OnItemsUpdated(_In_ UINT firstIndex, _In_ UINT count);
     void _OnError(_In_ ISmartRenameItem* renameItem);
-    void _OnRegExStarted(_In_ DWORD threadId);
-    void _OnRegExCanceled(_In_ DWORD threadId);
-    void _OnRegExCompleted(_In_ DWORD threadId);
+    void _OnRegExStarted(_In_ DWORD passId);
+    void _OnRegExCanceled(_In_ DWORD passId);
+    void _OnRegExCompleted(_In_ DWORD passId);
     void _OnRenameStarted();
     void _OnRenameCompleted();
 
     void _ClearEventHandlers();
     void _ClearSmartRenameItems();
+    void _ClearNewNames();
+    void _ClearNewNamesWhenIdle();
+    void _DrainItemUpdates();
 
     HRESULT _PerformRegExRename();
     HRESULT _PerformFileOperation();
  
-    HRESULT _CreateRegExWorkerThread();
+    HRESULT _EnsureRegExWorkerThread();
     void _CancelRegExWorkerThread();
     void _WaitForRegExWorkerThread();
+    void _StopRegExWorkerThread();
+    bool _TakeRegExJob(_Inout_ bool* runJob, _Inout_ DWORD* passId);
+    DWORD _GetRegExCoalesceDelay();
     HRESULT _CreateFileOpWorkerThread();
 
     HRESULT _EnsureRegEx();
     HRESULT _InitRegEx();
     void _ClearRegEx();
 
-    // Thread proc for performing the regex rename of each item
+    // Thread proc for the preview worker, which runs a regex rename pass over every
+    // item each time a job is queued
     static DWORD WINAPI s_regexWorkerThread(_In_ void* pv);
     // Thread proc for performing the actual file operation that does the file rename
     static DWORD WINAPI s_fileOpWorkerThread(_In_ void* pv);
@@ -82,15 +101,44 @@ protected:
     static LRESULT CALLBACK s_msgWndProc(_In_ HWND hwnd, _In_ UINT uMsg, _In_ WPARAM wParam, _In_ LPARAM lParam);
     LRESULT _WndProc(_In_ HWND hwnd, _In_ UINT msg, _In_ WPARAM wParam, _In_ LPARAM lParam);
 
-    HANDLE m_regExWorkerThreadHandle = nullptr;
-    HANDLE m_startRegExWorkerEvent = nullptr;
+    HANDLE m_regExJobEvent = nullptr;
     HANDLE m_cancelRegExWorkerEvent = nullptr;
+    HANDLE m_regExIdleEvent = nullptr;
+
+    // The preview job queue.  Only the newest job is kept; queuing one cancels the
+    // pass in flight.  Passes are numbered in the order they are queued and the
+    // number is the passId listeners are given.  The worker thread is started by the
+    // first job queued.
+    CSRWLock m_lockRegExJob;
+    _Guarded_by_(m_lockRegExJob) HANDLE m_regExWorkerThreadHandle = nullptr;
+    _Guarded_by_(m_lockRegExJob) bool m_regExJobPending = false;
+    _Guarded_by_(m_lockRegExJob) bool m_regExShutdown = false;
+    _Guarded_by_(m_lockRegExJob) DWORD m_regExPassId = 0;
+    _Guarded_by_(m_lockRegExJob) ULONGLONG m_regExJobQueuedTick = 0;
+    _Guarded_by_(m_lockRegExJob) ULONGLONG m_regExJobInterval = 0;      // Time since the job before it
+    _Guarded_by_(m_lockRegExJob) ULONGLONG m_regExPassTicks = 0;        // How long the last pass took
+    _Guarded_by_(m_lockRegExJob) bool m_clearNewNamesPending = false;   // Clear them once the pass in flight stops
+    volatile LONG m_nextRegExPassId = 0;
+
+    // One ring per preview worker.  Workers queue the index of each item they update
+    // and post a single wakeup, which m_updatesPosted keeps from repeating until the
+    // manager thread has drained the rings.  m_updatesOverflowed is set when a ring
+    // was full and means every item has to be treated as updated.
+    std::unique_ptr<CItemUpdateRing[]> m_updateRings;
+    UINT m_regExWorkerCount = 0;
+    volatile LONG m_updatesPosted = 0;
+    volatile LONG m_updatesOverflowed = 0;
+
+    // Items preview passes evaluate before any others, normally the visible rows
+    CSRWLock m_lockPriority;
+    _Guarded_by_(m_lockPriority) UINT m_priorityFirst = 0;
+    _Guarded_by_(m_lockPriority) UINT m_priorityCount = 0;
+    volatile LONG m_priorityGeneration = 0;
 
     HANDLE m_fileOpWorkerThreadHandle = nullptr;
     HANDLE m_startFileOpWorkerEvent = nullptr;
 
     CSRWLock m_lockEvents;
-    CSRWLock m_lockItems;
 
     DWORD m_flags = 0;
 
@@ -107,14 +155,17 @@ protected:
     CComPtr<ISmartRenameRegEx> m_spRegEx;
 
     _Guarded_by_(m_lockEvents) std::vector<RENAME_MGR_EVENT> m_renameManagerEvents;
-    _Guarded_by_(m_lockItems) std::map<int, ISmartRenameItem*> m_renameItems;
+
+    // Items in id order, which is the order they were created in.  Lookups by index
+    // and by id are both O(1).  Replaced rather than emptied when the items are
+    // cleared so item objects that outlive the manager keep working.  Replaced
+    // under m_lockRegExJob, which the preview worker holds to read it.
+    std::shared_ptr<CSmartRenameItemStore> m_itemStore;
 
     // Parent HWND used by IFileOperation
     HWND m_hwndParent = nullptr;
 
     HWND m_hwndMessage = nullptr;
 
-    CRITICAL_SECTION m_critsecReentrancy;
-
     long m_refCount;
 };
\ No newline at end of file
@@ -2,7 +2,6 @@
 #include "SmartRenameRegEx.h"
 #include <regex>
 #include <string>
-#include <algorithm>
 
 
 using namespace std;
@@ -73,34 +72,39 @@ IFACEMETHODIMP CSmartRenameRegEx::UnAdvise(_In_ DWORD cookie)
 
 IFACEMETHODIMP CSmartRenameRegEx::get_searchTerm(_Outptr_ PWSTR* searchTerm)
 {
-    *searchTerm = nullptr;
-    HRESULT hr = m_searchTerm ? S_OK : E_FAIL;
-    if (SUCCEEDED(hr))
-    {
-        CSRWSharedAutoLock lock(&m_lock);
-        hr = SHStrDup(m_searchTerm, searchTerm);
-    }
-    return hr;
+    std::shared_ptr<const REGEX_STATE> state = _GetState();
+    return SHStrDup(state->searchTerm.c_str(), searchTerm);
 }
 
 IFACEMETHODIMP CSmartRenameRegEx::put_searchTerm(_In_ PCWSTR searchTerm)
 {
     bool changed = false;
+    HRESULT hrPattern = S_OK;
     HRESULT hr = searchTerm ? S_OK : E_INVALIDARG;
     if (SUCCEEDED(hr))
     {
         CSRWExclusiveAutoLock lock(&m_lock);
-        if (m_searchTerm == nullptr || lstrcmp(searchTerm, m_searchTerm) != 0)
+        std::shared_ptr<const REGEX_STATE> current = _GetState();
+        if (current->searchTerm != searchTerm)
         {
             changed = true;
-            CoTaskMemFree(m_searchTerm);
-            hr = SHStrDup(searchTerm, &m_searchTerm);
+            std::shared_ptr<REGEX_STATE> state = std::make_shared<REGEX_STATE>(*current);
+            state->searchTerm = searchTerm;
+            hrPattern = _CompilePattern(*state);
+            _SetState(state);
         }
     }
 
     if (SUCCEEDED(hr) && changed)
     {
-        _OnSearchTermChanged();
+        if (SUCCEEDED(hrPattern))
+        {
+            _OnSearchTermChanged(searchTerm);
+        }
+        else
+        {
+            _OnPatternError(hrPattern);
+        }
     }
 
     return hr;
@@ -108,14 +112,8 @@ IFACEMETHODIMP CSmartRenameRegEx::put_searchTerm(_In_ PCWSTR searchTerm)
 
 IFACEMETHODIMP CSmartRenameRegEx::get_replaceTerm(_Outptr_ PWSTR* replaceTerm)
 {
-    *replaceTerm = nullptr;
-    HRESULT hr = m_replaceTerm ? S_OK : E_FAIL;
-    if (SUCCEEDED(hr))
-    {
-        CSRWSharedAutoLock lock(&m_lock);
-        hr = SHStrDup(m_replaceTerm, replaceTerm);
-    }
-    return hr;
+    std::shared_ptr<const REGEX_STATE> state = _GetState();
+    return SHStrDup(state->replace->replaceTerm.c_str(), replaceTerm);
 }
 
 IFACEMETHODIMP CSmartRenameRegEx::put_replaceTerm(_In_ PCWSTR replaceTerm)
@@ -125,17 +123,19 @@ IFACEMETHODIMP CSmartRenameRegEx::put_replaceTerm(_In_ PCWSTR replaceTerm)
     if (SUCCEEDED(hr))
     {
         CSRWExclusiveAutoLock lock(&m_lock);
-        if (m_replaceTerm == nullptr || lstrcmp(replaceTerm, m_replaceTerm) != 0)
+        std::shared_ptr<const REGEX_STATE> current = _GetState();
+        if (current->replace->replaceTerm != replaceTerm)
         {
             changed = true;
-            CoTaskMemFree(m_replaceTerm);
-            hr = SHStrDup(replaceTerm, &m_replaceTerm);
+            std::shared_ptr<REGEX_STATE> state = std::make_shared<REGEX_STATE>(*current);
+            _CompileReplace(*state, replaceTerm);
+            _SetState(state);
         }
     }
 
     if (SUCCEEDED(hr) && changed)
     {
-        _OnReplaceTermChanged();
+        _OnReplaceTermChanged(replaceTerm);
     }
 
     return hr;
@@ -143,16 +143,52 @@ IFACEMETHODIMP CSmartRenameRegEx::put_replaceTerm(_In_ PCWSTR replaceTerm)
 
 IFACEMETHODIMP CSmartRenameRegEx::get_flags(_Out_ DWORD* flags)
 {
-    *flags = m_flags;
+    *flags = _GetState()->flags;
+    return S_OK;
+}
+
+IFACEMETHODIMP CSmartRenameRegEx::get_timeLimit(_Out_ DWORD* milliseconds)
+{
+    *milliseconds = _GetState()->timeLimit;
+    return S_OK;
+}
+
+IFACEMETHODIMP CSmartRenameRegEx::put_timeLimit(_In_ DWORD milliseconds)
+{
+    CSRWExclusiveAutoLock lock(&m_lock);
+    std::shared_ptr<REGEX_STATE> state = std::make_shared<REGEX_STATE>(*_GetState());
+    state->timeLimit = milliseconds;
+    _SetState(state);
     return S_OK;
 }
 
 IFACEMETHODIMP CSmartRenameRegEx::put_flags(_In_ DWORD flags)
 {
-    if (m_flags != flags)
+    bool changed = false;
+    HRESULT hrPattern = S_OK;
     {
-        m_flags = flags;
-        _OnFlagsChanged();
+        CSRWExclusiveAutoLock lock(&m_lock);
+        std::shared_ptr<const REGEX_STATE> current = _GetState();
+        if (current->flags != flags)
+        {
+            changed = true;
+            std::shared_ptr<REGEX_STATE> state = std::make_shared<REGEX_STATE>(*current);
+            state->flags = flags;
+            hrPattern = _CompilePattern(*state);
+            _SetState(state);
+        }
+    }
+
+    if (changed)
+    {
+        if (SUCCEEDED(hrPattern))
+        {
+            _OnFlagsChanged(flags);
+        }
+        else
+        {
+            _OnPatternError(hrPattern);
+        }
     }
     return S_OK;
 }
@@ -174,94 +210,449 @@ HRESULT CSmartRenameRegEx::s_CreateInstance(_Outptr_ ISmartRenameRegEx** renameR
 CSmartRenameRegEx::CSmartRenameRegEx() :
     m_refCount(1)
 {
-    // Init to empty strings
-    SHStrDup(L"", &m_searchTerm);
-    SHStrDup(L"", &m_replaceTerm);
+    // Start with empty terms
+    std::shared_ptr<REGEX_STATE> state = std::make_shared<REGEX_STATE>();
+    _CompilePattern(*state);
+    _SetState(state);
 }
 
 CSmartRenameRegEx::~CSmartRenameRegEx()
 {
-    CoTaskMemFree(m_searchTerm);
-    CoTaskMemFree(m_replaceTerm);
 }
 
 HRESULT CSmartRenameRegEx::Replace(_In_ PCWSTR source, _Outptr_ PWSTR* result)
 {
     *result = nullptr;
 
-    CSRWSharedAutoLock lock(&m_lock);
-    HRESULT hr = (source && wcslen(source) > 0 && m_searchTerm && wcslen(m_searchTerm) > 0) ? S_OK : E_INVALIDARG;
+    std::shared_ptr<const REGEX_STATE> state = _GetState();
+    EVALUATION_LIMITS limits;
+    limits.deadline = state->timeLimit ? GetTickCount64() + state->timeLimit : 0;
+
+    std::wstring res;
+    HRESULT hr = _ReplaceOne(state.get(), source, &limits, res);
     if (SUCCEEDED(hr))
     {
-        wstring res = source;
-        try
+        *result = StrDup(res.c_str());
+        hr = (*result) ? S_OK : E_OUTOFMEMORY;
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameRegEx::ReplaceBatch(_In_ UINT count, _In_reads_(count) const PCWSTR* sources, _In_opt_ HANDLE cancelEvent, _Out_writes_(arenaSize) PWSTR arena, _In_ UINT arenaSize,
+    _Out_writes_(count) UINT* offsets, _Out_writes_(count) HRESULT* results, _Out_ UINT* processed)
+{
+    *processed = 0;
+
+    // One snapshot for the whole batch so every name sees the same terms and flags
+    std::shared_ptr<const REGEX_STATE> state = _GetState();
+
+    EVALUATION_LIMITS limits;
+    limits.cancelEvent = cancelEvent;
+
+    HRESULT hr = S_OK;
+    UINT used = 0;
+    std::wstring res;
+    for (UINT i = 0; i < count; i++)
+    {
+        // Each name gets the full time limit
+        limits.deadline = state->timeLimit ? GetTickCount64() + state->timeLimit : 0;
+
+        offsets[i] = 0;
+        results[i] = _ReplaceOne(state.get(), sources[i], &limits, res);
+        if (results[i] == HRESULT_FROM_WIN32(ERROR_CANCELLED) ||
+            (cancelEvent && WaitForSingleObject(cancelEvent, 0) == WAIT_OBJECT_0))
         {
-            // TODO: creating the regex could be costly.  May want to cache this.
-            std::wstring sourceToUse(source);
-            std::wstring searchTerm(m_searchTerm);
-            std::wstring replaceTerm(m_replaceTerm ? wstring(m_replaceTerm) : wstring(L""));
+            hr = HRESULT_FROM_WIN32(ERROR_CANCELLED);
+            break;
+        }
 
-            if (m_flags & UseRegularExpressions)
+        if (SUCCEEDED(results[i]))
+        {
+            size_t cch = res.length() + 1;
+            if (cch > arenaSize - used)
             {
-                std::wregex pattern(m_searchTerm, (!(m_flags & CaseSensitive)) ? regex_constants::icase | regex_constants::ECMAScript : regex_constants::ECMAScript);
-                if (m_flags & MatchAllOccurences)
-                {
-                    res = regex_replace(wstring(source), pattern, replaceTerm);
-                }
-                else
-                {
-                    std::wsmatch m;
-                    if (std::regex_search(sourceToUse, m, pattern))
-                    {
-                        res = sourceToUse.replace(m.prefix().length(), m.length(), replaceTerm);
-                    }
-                }
+                hr = HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+                break;
+            }
+
+            CopyMemory(arena + used, res.c_str(), cch * sizeof(wchar_t));
+            offsets[i] = used;
+            used += static_cast<UINT>(cch);
+        }
+
+        (*processed)++;
+    }
+
+    return hr;
+}
+
+// Replaces a single name using one snapshot of the state
+HRESULT CSmartRenameRegEx::_ReplaceOne(_In_ const REGEX_STATE* state, _In_ PCWSTR source, _In_opt_ const EVALUATION_LIMITS* limits, _Out_ std::wstring& result)
+{
+    const COMPILED_PATTERN* pattern = state->pattern.get();
+    const COMPILED_REPLACE* replace = state->replace.get();
+    const COMPILED_RULES* rules = state->rules.get();
+    DWORD flags = state->flags;
+
+    result.clear();
+    bool hasSearchTerm = !state->searchTerm.empty();
+    bool hasRules = (rules && (rules->literalRules.GetPatternCount() > 0 || !rules->regExRules.empty()));
+    HRESULT hr = (source && source[0] != L'\0' && (hasSearchTerm || hasRules)) ? S_OK : E_INVALIDARG;
+    if (SUCCEEDED(hr) && hasSearchTerm)
+    {
+        // Fail fast if the search term did not compile.  There is no point in retrying per item.
+        hr = pattern->hr;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        try
+        {
+            if (!hasSearchTerm)
+            {
+                result = source;
+            }
+            else if (flags & UseRegularExpressions)
+            {
+                hr = _ApplyRegEx(pattern, source, replace->replaceTemplate, flags, limits, result);
             }
             else
             {
                 // Simple search and replace
-                size_t pos = 0;
-                do
-                {
-                    pos = _Find(sourceToUse, searchTerm, (!(m_flags & CaseSensitive)), pos);
-                    if (pos != std::string::npos)
-                    {
-                        res = sourceToUse.replace(pos, searchTerm.length(), replaceTerm);
-                        pos += replaceTerm.length();
-                    }
-
-                    if (!(m_flags & MatchAllOccurences))
-                    {
-                        break;
-                    }
-                } while (pos != std::string::npos);
+                const CLiteralSearch& search = static_cast<const LITERAL_PATTERN*>(pattern)->search;
+                search.Replace(source, wcslen(source), replace->replaceTerm.c_str(), replace->replaceTerm.length(), (flags & MatchAllOccurences) != 0, result);
             }
 
-            *result = StrDup(res.c_str());
-            hr = (*result) ? S_OK : E_OUTOFMEMORY;
+            if (SUCCEEDED(hr) && hasRules)
+            {
+                hr = _ApplyRules(rules, limits, result);
+            }
         }
         catch (regex_error e)
         {
-            hr = E_FAIL;
+            // std::regex gives up on its own when backtracking gets out of hand
+            bool limitReached = (e.code() == regex_constants::error_complexity || e.code() == regex_constants::error_stack);
+            hr = limitReached ? SR_E_EVALUATIONLIMIT : E_FAIL;
+        }
+    }
+    return hr;
+}
+
+// Runs the regular expression unless the pattern is plain literal text or its
+// prefilter shows the name can't match
+HRESULT CSmartRenameRegEx::_ApplyRegEx(_In_ const COMPILED_PATTERN* pattern, _In_ const std::wstring& source, _In_ const CReplaceTemplate& replaceTemplate, _In_ DWORD flags,
+    _In_opt_ const EVALUATION_LIMITS* limits, _Out_ std::wstring& result)
+{
+    if (pattern->shapeMatcher.IsActive())
+    {
+        pattern->shapeMatcher.Replace(source.c_str(), source.length(), replaceTemplate, result);
+        return S_OK;
+    }
+
+    if (!pattern->prefilter.MayMatch(source.c_str(), source.length()))
+    {
+        result = source;
+        return S_OK;
+    }
+    return _ReplaceRegEx(pattern, source, replaceTemplate, flags, limits, result);
+}
+
+HRESULT CSmartRenameRegEx::s_CheckLimits(_In_opt_ const EVALUATION_LIMITS* limits)
+{
+    HRESULT hr = S_OK;
+    if (limits)
+    {
+        if (limits->cancelEvent && WaitForSingleObject(limits->cancelEvent, 0) == WAIT_OBJECT_0)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_CANCELLED);
+        }
+        else if (limits->deadline && GetTickCount64() >= limits->deadline)
+        {
+            hr = SR_E_EVALUATIONLIMIT;
+        }
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameRegEx::s_ReplaceLinear(_In_ const CLinearRegEx& regex, _In_ const std::wstring& source, _In_ const CReplaceTemplate& replaceTemplate, _In_ DWORD flags,
+    _In_opt_ const EVALUATION_LIMITS* limits, _Out_ std::wstring& result)
+{
+    // The engine polls the limits as it goes so a long name can be abandoned part way through
+    CLinearRegEx::MatchLimits matchLimits;
+    if (limits)
+    {
+        matchLimits.poll = s_PollLimits;
+        matchLimits.context = const_cast<EVALUATION_LIMITS*>(limits);
+    }
+
+    CLinearRegEx::MatchStatus status = CLinearRegEx::MatchOk;
+    regex.Replace(source.c_str(), source.length(), replaceTemplate, (flags & MatchAllOccurences) != 0, result, limits ? &matchLimits : nullptr, &status);
+
+    HRESULT hr = S_OK;
+    if (status == CLinearRegEx::MatchStepLimit)
+    {
+        hr = SR_E_EVALUATIONLIMIT;
+    }
+    else if (status == CLinearRegEx::MatchStopped)
+    {
+        hr = s_CheckLimits(limits);
+    }
+    return hr;
+}
+
+CLinearRegEx::MatchStatus CSmartRenameRegEx::s_PollLimits(_In_ void* context)
+{
+    return SUCCEEDED(s_CheckLimits(static_cast<const EVALUATION_LIMITS*>(context))) ? CLinearRegEx::MatchOk : CLinearRegEx::MatchStopped;
+}
+
+// Runs the name through the literal rules in one scan and then through each
+// regular expression rule in turn
+HRESULT CSmartRenameRegEx::_ApplyRules(_In_ const COMPILED_RULES* rules, _In_opt_ const EVALUATION_LIMITS* limits, _Inout_ std::wstring& name)
+{
+    HRESULT hr = S_OK;
+    std::wstring ruleResult;
+    if (rules->literalRules.GetPatternCount() > 0)
+    {
+        if (rules->literalRules.Replace(name.c_str(), name.length(), ruleResult))
+        {
+            name.swap(ruleResult);
+        }
+    }
+
+    for (const COMPILED_RULE& rule : rules->regExRules)
+    {
+        hr = _ApplyRegEx(rule.pattern.get(), name, rule.replaceTemplate, rule.flags, limits, ruleResult);
+        if (FAILED(hr))
+        {
+            break;
+        }
+        name.swap(ruleResult);
+    }
+    return hr;
+}
+
+IFACEMETHODIMP CSmartRenameRegEx::AddRule(_In_ PCWSTR searchTerm, _In_ PCWSTR replaceTerm, _In_ DWORD flags)
+{
+    HRESULT hr = (searchTerm && searchTerm[0] != L'\0') ? S_OK : E_INVALIDARG;
+    if (SUCCEEDED(hr))
+    {
+        RENAME_RULE rule;
+        rule.searchTerm = searchTerm;
+        rule.replaceTerm = replaceTerm ? replaceTerm : L"";
+        rule.flags = flags & (CaseSensitive | MatchAllOccurences | UseRegularExpressions);
+
+        // Regular expression rules are compiled here so a bad pattern is rejected up front
+        if (rule.flags & UseRegularExpressions)
+        {
+            hr = _CompileRegEx(searchTerm, rule.flags, rule.pattern);
         }
+
+        if (SUCCEEDED(hr))
+        {
+            CSRWExclusiveAutoLock lock(&m_lock);
+            m_rules.push_back(rule);
+
+            std::shared_ptr<REGEX_STATE> state = std::make_shared<REGEX_STATE>(*_GetState());
+            _CompileRules(*state);
+            _SetState(state);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        _OnRulesChanged();
     }
+
     return hr;
 }
 
-size_t CSmartRenameRegEx::_Find(std::wstring data, std::wstring toSearch, bool caseInsensitive, size_t pos)
+IFACEMETHODIMP CSmartRenameRegEx::ClearRules()
+{
+    bool changed = false;
+    {
+        CSRWExclusiveAutoLock lock(&m_lock);
+        if (!m_rules.empty())
+        {
+            changed = true;
+            m_rules.clear();
+
+            std::shared_ptr<REGEX_STATE> state = std::make_shared<REGEX_STATE>(*_GetState());
+            _CompileRules(*state);
+            _SetState(state);
+        }
+    }
+
+    if (changed)
+    {
+        _OnRulesChanged();
+    }
+
+    return S_OK;
+}
+
+IFACEMETHODIMP CSmartRenameRegEx::GetRuleCount(_Out_ UINT* count)
+{
+    CSRWSharedAutoLock lock(&m_lock);
+    *count = static_cast<UINT>(m_rules.size());
+    return S_OK;
+}
+
+// Rebuilds the compiled rules into a state that has not been published yet.  Called
+// with m_lock held exclusive.
+void CSmartRenameRegEx::_CompileRules(_Inout_ REGEX_STATE& state)
+{
+    std::shared_ptr<COMPILED_RULES> rules;
+    if (!m_rules.empty())
+    {
+        rules = std::make_shared<COMPILED_RULES>();
+        for (const RENAME_RULE& rule : m_rules)
+        {
+            if (rule.flags & UseRegularExpressions)
+            {
+                COMPILED_RULE compiledRule;
+                compiledRule.pattern = rule.pattern;
+                compiledRule.replaceTemplate.Parse(rule.replaceTerm.c_str(), rule.replaceTerm.length(), rule.pattern->GetGroupCount(), rule.pattern->GetGroupNames());
+                compiledRule.flags = rule.flags;
+                rules->regExRules.push_back(compiledRule);
+            }
+            else
+            {
+                rules->literalRules.AddPattern(rule.searchTerm.c_str(), rule.searchTerm.length(), rule.replaceTerm.c_str(), rule.replaceTerm.length(),
+                    (rule.flags & CaseSensitive) != 0, (rule.flags & MatchAllOccurences) != 0);
+            }
+        }
+        rules->literalRules.Build();
+    }
+
+    state.rules = rules;
+}
+
+// Compiles the search term for the flags in a state that has not been published yet.
+// Called with m_lock held exclusive whenever the search term or flags change so
+// Replace never has to build the regex.
+HRESULT CSmartRenameRegEx::_CompilePattern(_Inout_ REGEX_STATE& state)
 {
-    if (caseInsensitive)
+    std::shared_ptr<COMPILED_PATTERN> pattern;
+    HRESULT hr = S_OK;
+    if ((state.flags & UseRegularExpressions) && !state.searchTerm.empty())
+    {
+        hr = _CompileRegEx(state.searchTerm.c_str(), state.flags, pattern);
+    }
+    else
     {
-        // Convert to lower
-        std::transform(data.begin(), data.end(), data.begin(), ::towlower);
-        std::transform(toSearch.begin(), toSearch.end(), toSearch.begin(), ::towlower);
+        std::shared_ptr<LITERAL_PATTERN> literalPattern = std::make_shared<LITERAL_PATTERN>();
+        literalPattern->search.Init(state.searchTerm.c_str(), state.searchTerm.length(), (state.flags & CaseSensitive) != 0);
+        pattern = literalPattern;
     }
 
-    // Find sub string position in given string starting at position pos
-    return data.find(toSearch, pos);
+    if (!pattern)
+    {
+        pattern = std::make_shared<COMPILED_PATTERN>();
+    }
+
+    pattern->version = ++m_patternVersion;
+    pattern->hr = hr;
+    state.pattern = pattern;
+
+    // $n and $<name> resolve against the new pattern's groups
+    _CompileReplace(state, state.replace ? state.replace->replaceTerm : std::wstring());
+    return hr;
 }
 
-void CSmartRenameRegEx::_OnSearchTermChanged()
+// Parses the replace term against the state's pattern.  Called with m_lock held exclusive.
+void CSmartRenameRegEx::_CompileReplace(_Inout_ REGEX_STATE& state, _In_ const std::wstring& replaceTerm)
+{
+    std::shared_ptr<COMPILED_REPLACE> replace = std::make_shared<COMPILED_REPLACE>();
+    replace->replaceTerm = replaceTerm;
+    replace->replaceTemplate.Parse(replace->replaceTerm.c_str(), replace->replaceTerm.length(), state.pattern->GetGroupCount(), state.pattern->GetGroupNames());
+    state.replace = replace;
+}
+
+HRESULT CSmartRenameRegEx::_CompileRegEx(_In_ PCWSTR searchTerm, _In_ DWORD flags, _Out_ std::shared_ptr<COMPILED_PATTERN>& pattern)
+{
+    std::shared_ptr<STD_REGEX_PATTERN> regexPattern = std::make_shared<STD_REGEX_PATTERN>();
+    pattern = regexPattern;
+
+    HRESULT hr = S_OK;
+    try
+    {
+        regexPattern->regex.assign(searchTerm, (!(flags & CaseSensitive)) ? regex_constants::icase | regex_constants::ECMAScript : regex_constants::ECMAScript);
+    }
+    catch (regex_error e)
+    {
+        hr = SR_E_INVALIDPATTERN;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // std::wregex doesn't expose its parse tree so borrow the linear engine's
+        // analysis, and keep the linear program for evaluations that have limits.
+        // Patterns it can't handle (backreferences, lookaround) simply go without a
+        // prefilter.
+        CLinearRegEx& linear = regexPattern->linear;
+        if (linear.Compile(searchTerm, wcslen(searchTerm), (flags & CaseSensitive) != 0) == CLinearRegEx::CompileOk)
+        {
+            regexPattern->prefilter.Init(linear.GetLiteralFacts(), (flags & CaseSensitive) != 0);
+            regexPattern->shapeMatcher.Init(linear.GetLiteralFacts(), (flags & CaseSensitive) != 0, (flags & MatchAllOccurences) != 0);
+        }
+    }
+    return hr;
+}
+
+HRESULT CSmartRenameRegEx::_ReplaceRegEx(_In_ const COMPILED_PATTERN* pattern, _In_ const std::wstring& source, _In_ const CReplaceTemplate& replaceTemplate, _In_ DWORD flags,
+    _In_opt_ const EVALUATION_LIMITS* limits, _Out_ std::wstring& result)
+{
+    const STD_REGEX_PATTERN* regexPattern = static_cast<const STD_REGEX_PATTERN*>(pattern);
+
+    // std::regex can't be interrupted while it looks for a match, so one bad match
+    // could run far past a time limit or cancel.  With either set, every pattern
+    // the linear engine supports runs on it instead.
+    if (limits && (limits->deadline || limits->cancelEvent) && regexPattern->linear.IsCompiled())
+    {
+        return s_ReplaceLinear(regexPattern->linear, source, replaceTemplate, flags, limits, result);
+    }
+
+    size_t groupCount = regexPattern->GetGroupCount();
+    std::vector<size_t> captures((groupCount + 1) * 2);
+
+    // Same iteration regex_replace uses, but each match is expanded with the parsed template
+    // Only backreferences and lookaround get here with limits, which are checked
+    // between matches
+    HRESULT hr = S_OK;
+    result.clear();
+    size_t copied = 0;
+    for (wsregex_iterator it(source.begin(), source.end(), regexPattern->regex), end; it != end; ++it)
+    {
+        hr = s_CheckLimits(limits);
+        if (FAILED(hr))
+        {
+            result = source;
+            return hr;
+        }
+
+        const wsmatch& match = *it;
+        for (size_t group = 0; group <= groupCount; group++)
+        {
+            bool matched = (group < match.size()) && match[group].matched;
+            captures[group * 2] = matched ? static_cast<size_t>(match.position(group)) : CReplaceTemplate::npos;
+            captures[group * 2 + 1] = matched ? static_cast<size_t>(match.position(group) + match.length(group)) : CReplaceTemplate::npos;
+        }
+
+        result.append(source, copied, captures[0] - copied);
+        replaceTemplate.Apply(source.c_str(), source.length(), captures.data(), groupCount, copied, result);
+        copied = captures[1];
+
+        if (!(flags & MatchAllOccurences))
+        {
+            break;
+        }
+    }
+
+    result.append(source, copied, std::wstring::npos);
+    return hr;
+}
+
+void CSmartRenameRegEx::_OnSearchTermChanged(_In_ PCWSTR searchTerm)
 {
     CSRWSharedAutoLock lock(&m_lockEvents);
 
@@ -269,12 +660,12 @@ void CSmartRenameRegEx::_OnSearchTermChanged()
     {
         if (it->pEvents)
         {
-            it->pEvents->OnSearchTermChanged(m_searchTerm);
+            it->pEvents->OnSearchTermChanged(searchTerm);
         }
     }
 }
 
-void CSmartRenameRegEx::_OnReplaceTermChanged()
+void CSmartRenameRegEx::_OnReplaceTermChanged(_In_ PCWSTR replaceTerm)
 {
     CSRWSharedAutoLock lock(&m_lockEvents);
 
@@ -282,12 +673,12 @@ void CSmartRenameRegEx::_OnReplaceTermChanged()
     {
         if (it->pEvents)
         {
-            it->pEvents->OnReplaceTermChanged(m_replaceTerm);
+            it->pEvents->OnReplaceTermChanged(replaceTerm);
         }
     }
 }
 
-void CSmartRenameRegEx::_OnFlagsChanged()
+void CSmartRenameRegEx::_OnFlagsChanged(_In_ DWORD flags)
 {
     CSRWSharedAutoLock lock(&m_lockEvents);
 
@@ -295,7 +686,33 @@ void CSmartRenameRegEx::_OnFlagsChanged()
     {
         if (it->pEvents)
         {
-            it->pEvents->OnFlagsChanged(m_flags);
+            it->pEvents->OnFlagsChanged(flags);
         }
     }
 }
+
+void CSmartRenameRegEx::_OnPatternError(_In_ HRESULT hr)
+{
+    CSRWSharedAutoLock lock(&m_lockEvents);
+
+    for (std::vector<RENAME_REGEX_EVENT>::iterator it = m_renameRegExEvents.begin(); it != m_renameRegExEvents.end(); ++it)
+    {
+        if (it->pEvents)
+        {
+            it->pEvents->OnPatternError(hr);
+        }
+    }
+}
+
+void CSmartRenameRegEx::_OnRulesChanged()
+{
+    CSRWSharedAutoLock lock(&m_lockEvents);
+
+    for (std::vector<RENAME_REGEX_EVENT>::iterator it = m_renameRegExEvents.begin(); it != m_renameRegExEvents.end(); ++it)
+    {
+        if (it->pEvents)
+        {
+            it->pEvents->OnRulesChanged();
+        }
+    }
+}
\ No newline at end of file
@@ -2,7 +2,16 @@
 #include "stdafx.h"
 #include <vector>
 #include <string>
+#include <memory>
+#include <map>
+#include <regex>
 #include "srwlock.h"
+#include "LiteralSearch.h"
+#include "AhoCorasick.h"
+#include "ReplaceTemplate.h"
+#include "LinearRegEx.h"
+#include "RegExPrefilter.h"
+#include "ShapeMatcher.h"
 
 #define DEFAULT_FLAGS MatchAllOccurences
 
@@ -24,6 +33,13 @@ public:
     IFACEMETHODIMP get_flags(_Out_ DWORD* flags);
     IFACEMETHODIMP put_flags(_In_ DWORD flags);
     IFACEMETHODIMP Replace(_In_ PCWSTR source, _Outptr_ PWSTR* result);
+    IFACEMETHODIMP ReplaceBatch(_In_ UINT count, _In_reads_(count) const PCWSTR* sources, _In_opt_ HANDLE cancelEvent, _Out_writes_(arenaSize) PWSTR arena, _In_ UINT arenaSize,
+        _Out_writes_(count) UINT* offsets, _Out_writes_(count) HRESULT* results, _Out_ UINT* processed);
+    IFACEMETHODIMP AddRule(_In_ PCWSTR searchTerm, _In_ PCWSTR replaceTerm, _In_ DWORD flags);
+    IFACEMETHODIMP ClearRules();
+    IFACEMETHODIMP GetRuleCount(_Out_ UINT* count);
+    IFACEMETHODIMP get_timeLimit(_Out_ DWORD* milliseconds);
+    IFACEMETHODIMP put_timeLimit(_In_ DWORD milliseconds);
 
     static HRESULT s_CreateInstance(_Outptr_ ISmartRenameRegEx **renameRegEx);
 
@@ -31,15 +47,127 @@ protected:
     CSmartRenameRegEx();
     virtual ~CSmartRenameRegEx();
 
-    void _OnSearchTermChanged();
-    void _OnReplaceTermChanged();
-    void _OnFlagsChanged();
+    void _OnSearchTermChanged(_In_ PCWSTR searchTerm);
+    void _OnReplaceTermChanged(_In_ PCWSTR replaceTerm);
+    void _OnFlagsChanged(_In_ DWORD flags);
+    void _OnPatternError(_In_ HRESULT hr);
+    void _OnRulesChanged();
 
-    size_t _Find(std::wstring data, std::wstring toSearch, bool caseInsensitive, size_t pos);
+    // The search term compiled against the current flags.  Rebuilt whenever either
+    // changes and shared read-only by every Replace call.
+    struct COMPILED_PATTERN
+    {
+        virtual ~COMPILED_PATTERN() = default;
+
+        // Used to resolve $n and $<name> when replace templates are parsed
+        virtual size_t GetGroupCount() const { return 0; }
+        virtual const std::map<std::wstring, size_t>* GetGroupNames() const { return nullptr; }
+
+        ULONG version = 0;
+        HRESULT hr = S_OK;
+
+        // Regular expressions only.  Lets names that can't match skip the engine,
+        // and patterns that are plain literal text skip it altogether.
+        CRegExPrefilter prefilter;
+        CShapeMatcher shapeMatcher;
+    };
+
+    // Used when regular expressions are off.  The search term is folded up front.
+    struct LITERAL_PATTERN : public COMPILED_PATTERN
+    {
+        CLiteralSearch search;
+    };
+
+    struct STD_REGEX_PATTERN : public COMPILED_PATTERN
+    {
+        size_t GetGroupCount() const override { return regex.mark_count(); }
+
+        std::wregex regex;
+        CLinearRegEx linear;            // Not compiled when the pattern needs backtracking
+    };
+
+    // The replace term and, for regular expressions, the template parsed from it.
+    // Rebuilt whenever the replace term or the search pattern changes.
+    struct COMPILED_REPLACE
+    {
+        std::wstring replaceTerm;
+        CReplaceTemplate replaceTemplate;
+    };
+
+    // Checked while a name runs through a regular expression
+    struct EVALUATION_LIMITS
+    {
+        ULONGLONG deadline = 0;         // GetTickCount64 value, 0 for no time limit
+        HANDLE cancelEvent = nullptr;
+    };
+
+    // S_OK to keep going, SR_E_EVALUATIONLIMIT or HRESULT_FROM_WIN32(ERROR_CANCELLED) to stop
+    static HRESULT s_CheckLimits(_In_opt_ const EVALUATION_LIMITS* limits);
+
+    // Runs a name through CLinearRegEx, which checks the limits as it matches
+    static HRESULT s_ReplaceLinear(_In_ const CLinearRegEx& regex, _In_ const std::wstring& source, _In_ const CReplaceTemplate& replaceTemplate, _In_ DWORD flags,
+        _In_opt_ const EVALUATION_LIMITS* limits, _Out_ std::wstring& result);
+    static CLinearRegEx::MatchStatus s_PollLimits(_In_ void* context);
+
+    // Regular expression engine hooks.  Only called when UseRegularExpressions is set
+    // and the search term is not empty.
+    virtual HRESULT _CompileRegEx(_In_ PCWSTR searchTerm, _In_ DWORD flags, _Out_ std::shared_ptr<COMPILED_PATTERN>& pattern);
+    virtual HRESULT _ReplaceRegEx(_In_ const COMPILED_PATTERN* pattern, _In_ const std::wstring& source, _In_ const CReplaceTemplate& replaceTemplate, _In_ DWORD flags,
+        _In_opt_ const EVALUATION_LIMITS* limits, _Out_ std::wstring& result);
+
+    // The rule list compiled for matching.  Literal rules share one automaton and
+    // regular expression rules run after it in the order they were added.
+    struct COMPILED_RULE
+    {
+        std::shared_ptr<COMPILED_PATTERN> pattern;
+        CReplaceTemplate replaceTemplate;
+        DWORD flags;
+    };
+
+    struct COMPILED_RULES
+    {
+        CAhoCorasick literalRules;
+        std::vector<COMPILED_RULE> regExRules;
+    };
+
+    struct RENAME_RULE
+    {
+        std::wstring searchTerm;
+        std::wstring replaceTerm;
+        DWORD flags;
+        std::shared_ptr<COMPILED_PATTERN> pattern;
+    };
+
+    // Everything Replace needs, published together.  A state is never modified once
+    // published; setters copy the current one, change the copy and swap it in, so
+    // a reader that loads it once sees one consistent set of terms and flags.
+    struct REGEX_STATE
+    {
+        std::wstring searchTerm;
+        DWORD flags = DEFAULT_FLAGS;
+        DWORD timeLimit = 0;
+        std::shared_ptr<const COMPILED_PATTERN> pattern;
+        std::shared_ptr<const COMPILED_REPLACE> replace;
+        std::shared_ptr<const COMPILED_RULES> rules;        // Null when there are no rules
+    };
+
+    std::shared_ptr<const REGEX_STATE> _GetState() const { return std::atomic_load(&m_state); }
+    void _SetState(_In_ const std::shared_ptr<const REGEX_STATE>& state) { std::atomic_store(&m_state, state); }
+
+    HRESULT _CompilePattern(_Inout_ REGEX_STATE& state);
+    void _CompileReplace(_Inout_ REGEX_STATE& state, _In_ const std::wstring& replaceTerm);
+    void _CompileRules(_Inout_ REGEX_STATE& state);
+    HRESULT _ApplyRegEx(_In_ const COMPILED_PATTERN* pattern, _In_ const std::wstring& source, _In_ const CReplaceTemplate& replaceTemplate, _In_ DWORD flags,
+        _In_opt_ const EVALUATION_LIMITS* limits, _Out_ std::wstring& result);
+    HRESULT _ReplaceOne(_In_ const REGEX_STATE* state, _In_ PCWSTR source, _In_opt_ const EVALUATION_LIMITS* limits, _Out_ std::wstring& result);
+    HRESULT _ApplyRules(_In_ const COMPILED_RULES* rules, _In_opt_ const EVALUATION_LIMITS* limits, _Inout_ std::wstring& name);
+
+    // Read without a lock through _GetState.  m_lock only keeps setters from racing
+    // each other.
+    std::shared_ptr<const REGEX_STATE> m_state;
 
-    DWORD m_flags = DEFAULT_FLAGS;
-    PWSTR m_searchTerm = nullptr;
-    PWSTR m_replaceTerm = nullptr;
+    _Guarded_by_(m_lock) ULONG m_patternVersion = 0;
+    _Guarded_by_(m_lock) std::vector<RENAME_RULE> m_rules;
 
     CSRWLock m_lock;
     CSRWLock m_lockEvents;
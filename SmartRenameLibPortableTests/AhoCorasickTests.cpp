@@ -0,0 +1,89 @@
+#include "PortableTests.h"
+#include <AhoCorasick.h>
+#include <cwchar>
+
+struct LITERAL_RULE
+{
+    const wchar_t* search;
+    const wchar_t* replace;
+    bool caseSensitive;
+    bool matchAll;
+};
+
+static std::wstring s_Replace(const LITERAL_RULE* rules, size_t ruleCount, const wchar_t* text)
+{
+    CAhoCorasick automaton;
+    for (size_t i = 0; i < ruleCount; i++)
+    {
+        automaton.AddPattern(rules[i].search, wcslen(rules[i].search), rules[i].replace, wcslen(rules[i].replace), rules[i].caseSensitive, rules[i].matchAll);
+    }
+    automaton.Build();
+
+    std::wstring result;
+    automaton.Replace(text, wcslen(text), result);
+    return result;
+}
+
+PORTABLE_TEST_METHOD(VerifyAhoCorasickRules)
+{
+    // The same rules as VerifyLiteralRules in SmartRenameRegExTests.cpp
+    LITERAL_RULE rules[] =
+    {
+        { L"teh", L"the", false, true },
+        { L"ACME_", L"", true, false },
+        { L"_en-US", L"", false, true },
+        { L"", L"x", false, true },
+    };
+    size_t ruleCount = sizeof(rules) / sizeof(rules[0]);
+
+    CAhoCorasick automaton;
+    for (const LITERAL_RULE& rule : rules)
+    {
+        automaton.AddPattern(rule.search, wcslen(rule.search), rule.replace, wcslen(rule.replace), rule.caseSensitive, rule.matchAll);
+    }
+    automaton.Build();
+    CHECK(automaton.GetPatternCount() == 3);
+
+    CHECK(s_Replace(rules, ruleCount, L"ACME_teh_report_en-US.docx") == L"the_report.docx");
+    CHECK(s_Replace(rules, ruleCount, L"acme_TEH_teh.txt") == L"acme_the_the.txt");
+    CHECK(s_Replace(rules, ruleCount, L"ACME_ACME_x.txt") == L"ACME_x.txt");
+
+    std::wstring result;
+    CHECK(!automaton.Replace(L"report.docx", 11, result));
+    CHECK(result == L"report.docx");
+}
+
+PORTABLE_TEST_METHOD(VerifyAhoCorasickOverlaps)
+{
+    // At the same position the rule added first wins
+    LITERAL_RULE sameStart[] =
+    {
+        { L"ab", L"1", true, true },
+        { L"abc", L"2", true, true },
+    };
+    CHECK(s_Replace(sameStart, 2, L"abcab") == L"1c1");
+
+    // Matches are taken left to right and don't overlap
+    LITERAL_RULE leftmost[] =
+    {
+        { L"bcd", L"X", true, true },
+        { L"abc", L"Y", true, true },
+    };
+    CHECK(s_Replace(leftmost, 2, L"abcd") == L"Yd");
+
+    // A term that starts inside another is found through the fail links, and the
+    // one that starts first wins
+    LITERAL_RULE nested[] =
+    {
+        { L"hers", L"1", true, true },
+        { L"he", L"2", true, true },
+        { L"she", L"3", true, true },
+    };
+    CHECK(s_Replace(nested, 3, L"ushers") == L"u3rs");
+
+    LITERAL_RULE repeated[] =
+    {
+        { L"aa", L"b", true, true },
+    };
+    CHECK(s_Replace(repeated, 1, L"aaaaa") == L"bba");
+}
@@ -0,0 +1,128 @@
+#include <FolderWalker.h>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+// Times CFolderWalker for a range of thread counts.
+//
+//     FolderWalkerBenchmark [--folders count] [--files count] [--latency ms] [--path folder]
+//
+// By default it walks a made up tree of about count folders under one root, each
+// holding files and three subfolders, where every listing waits latency ms the way a
+// slow or network drive would.  With --path it walks a real folder instead.
+
+struct SYNTHETIC_ENTRY
+{
+    unsigned int index = 0;     // Folders are numbered breadth first from the root at 0
+};
+
+class CSyntheticFolderLister
+{
+public:
+    CSyntheticFolderLister(unsigned int folderCount, unsigned int fileCount, unsigned int latency) :
+        m_folderCount(folderCount),
+        m_fileCount(fileCount),
+        m_latency(latency)
+    {
+    }
+
+    bool OnWorkerStart() { return false; }
+    void OnWorkerStop() {}
+
+    bool ListFolder(const SYNTHETIC_ENTRY& folder, std::vector<FOLDER_WALK_NODE<SYNTHETIC_ENTRY>>& children)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_latency));
+        for (unsigned int i = 1; i <= c_fanOut; i++)
+        {
+            unsigned int index = folder.index * c_fanOut + i;
+            if (index < m_folderCount)
+            {
+                FOLDER_WALK_NODE<SYNTHETIC_ENTRY> node;
+                node.entry.index = index;
+                node.isFolder = true;
+                children.push_back(std::move(node));
+            }
+        }
+
+        for (unsigned int i = 0; i < m_fileCount; i++)
+        {
+            children.emplace_back();
+        }
+        return true;
+    }
+
+private:
+    static const unsigned int c_fanOut = 3;
+
+    unsigned int m_folderCount;
+    unsigned int m_fileCount;
+    unsigned int m_latency;
+};
+
+template <typename TEntry, typename TLister>
+static void s_Time(TLister& lister, const TEntry& root, unsigned int threadCount)
+{
+    std::vector<FOLDER_WALK_NODE<TEntry>> nodes(1);
+    nodes[0].entry = root;
+    nodes[0].isFolder = true;
+
+    size_t count = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CFolderWalker<TEntry>::WalkAndVisit(lister, nodes, UINT_MAX, threadCount, [&](const FOLDER_WALK_NODE<TEntry>&, unsigned int)
+    {
+        count++;
+        return true;
+    });
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("%2u threads: %8.1f ms, %zu items\n", threadCount, elapsed, count);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int folderCount = 1024;
+    unsigned int fileCount = 16;
+    unsigned int latency = 5;
+    const char* path = nullptr;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--folders") == 0)
+        {
+            folderCount = static_cast<unsigned int>(atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "--files") == 0)
+        {
+            fileCount = static_cast<unsigned int>(atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "--latency") == 0)
+        {
+            latency = static_cast<unsigned int>(atoi(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "--path") == 0)
+        {
+            path = argv[i + 1];
+        }
+    }
+
+    for (unsigned int threadCount : { 1u, 2u, 4u, 8u, 16u })
+    {
+        if (path)
+        {
+#ifdef __linux__
+            CDirentFolderLister lister;
+#else
+            CFileSystemFolderLister lister;
+#endif
+            s_Time(lister, std::filesystem::path(path), threadCount);
+        }
+        else
+        {
+            CSyntheticFolderLister lister(folderCount, fileCount, latency);
+            s_Time(lister, SYNTHETIC_ENTRY(), threadCount);
+        }
+    }
+    return 0;
+}
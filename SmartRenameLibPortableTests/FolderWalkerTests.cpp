@@ -0,0 +1,199 @@
+#include "PortableTests.h"
+#include <FolderWalker.h>
+#include <chrono>
+#include <climits>
+#include <mutex>
+#include <set>
+#include <thread>
+
+// The same checks as SmartRenameLibUnitTests\FolderWalkerTests.cpp
+
+typedef CFolderWalker<std::filesystem::path> CPathWalker;
+
+struct WALKED_ITEM
+{
+    std::filesystem::path path;
+    unsigned int depth;
+};
+
+// Lists folders slowly and remembers which threads listed them
+class CRecordingFolderLister : public CFileSystemFolderLister
+{
+public:
+    bool ListFolder(const std::filesystem::path& folder, std::vector<FOLDER_WALK_NODE<std::filesystem::path>>& children)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_threads.insert(std::this_thread::get_id());
+        }
+        return CFileSystemFolderLister::ListFolder(folder, children);
+    }
+
+    size_t GetThreadCount()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_threads.size();
+    }
+
+private:
+    std::mutex m_lock;
+    std::set<std::thread::id> m_threads;
+};
+
+// a, a/b and a/b/c, each holding two files, plus a few other folders next to a
+static void s_CreateTree(CTempFolder& folder)
+{
+    std::filesystem::path path;
+    for (const char* name : { "a", "b", "c" })
+    {
+        path /= name;
+        folder.AddFolder(path);
+        folder.AddFile(path / "foo.txt");
+        folder.AddFile(path / "bar.txt");
+    }
+
+    for (const char* name : { "d", "e", "f", "g" })
+    {
+        folder.AddFolder(name);
+        folder.AddFile(std::filesystem::path(name) / "foo.txt");
+    }
+}
+
+static std::vector<CPathWalker::NODE> s_GetRoot(const CTempFolder& folder)
+{
+    std::vector<CPathWalker::NODE> nodes(1);
+    nodes[0].entry = folder.GetPath();
+    nodes[0].isFolder = true;
+    return nodes;
+}
+
+template <typename TLister>
+static std::vector<WALKED_ITEM> s_Walk(const CTempFolder& folder, unsigned int maxDepth, unsigned int threadCount)
+{
+    std::vector<CPathWalker::NODE> nodes = s_GetRoot(folder);
+    TLister lister;
+    CPathWalker::Walk(lister, nodes, maxDepth, threadCount);
+
+    std::vector<WALKED_ITEM> items;
+    CPathWalker::Visit(nodes, [&](const CPathWalker::NODE& node, unsigned int depth)
+    {
+        items.push_back({ node.entry, depth });
+        return true;
+    });
+    return items;
+}
+
+static bool s_IsSameWalk(const std::vector<WALKED_ITEM>& items, const std::vector<WALKED_ITEM>& expected)
+{
+    if (items.size() != expected.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if (items[i].path != expected[i].path || items[i].depth != expected[i].depth)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+PORTABLE_TEST_METHOD(VerifyDepthFirstOrder)
+{
+    CTempFolder folder;
+    s_CreateTree(folder);
+
+    std::vector<WALKED_ITEM> items = s_Walk<CFileSystemFolderLister>(folder, UINT_MAX, 4);
+    CHECK(items.size() == 1 + 3 * 3 + 4 * 2);
+
+    // Every item comes right after its folder or after something else in it
+    for (size_t i = 1; i < items.size(); i++)
+    {
+        size_t parent = i - 1;
+        while (items[parent].depth >= items[i].depth)
+        {
+            parent--;
+        }
+        CHECK(items[parent].depth + 1 == items[i].depth);
+        CHECK(items[i].path.parent_path() == items[parent].path);
+    }
+}
+
+PORTABLE_TEST_METHOD(VerifySameOrderOnAnyThreadCount)
+{
+    CTempFolder folder;
+    s_CreateTree(folder);
+
+    std::vector<WALKED_ITEM> expected = s_Walk<CFileSystemFolderLister>(folder, UINT_MAX, 1);
+    for (unsigned int threadCount : { 2u, 4u, 16u })
+    {
+        CHECK(s_IsSameWalk(s_Walk<CFileSystemFolderLister>(folder, UINT_MAX, threadCount), expected));
+    }
+
+#ifdef __linux__
+    // getdents64 returns entries in a different order, so only compare counts
+    CHECK(s_Walk<CDirentFolderLister>(folder, UINT_MAX, 4).size() == expected.size());
+#endif
+}
+
+PORTABLE_TEST_METHOD(VerifyWorkersShareOneFolder)
+{
+    CTempFolder folder;
+    s_CreateTree(folder);
+
+    // A single folder passed in still has its subfolders listed by several workers
+    std::vector<CPathWalker::NODE> nodes = s_GetRoot(folder);
+    CRecordingFolderLister lister;
+    CPathWalker::Walk(lister, nodes, UINT_MAX, 4);
+    CHECK(lister.GetThreadCount() > 1);
+}
+
+PORTABLE_TEST_METHOD(VerifyVisitWhileWalking)
+{
+    CTempFolder folder;
+    s_CreateTree(folder);
+
+    std::vector<WALKED_ITEM> expected = s_Walk<CFileSystemFolderLister>(folder, UINT_MAX, 1);
+    for (unsigned int threadCount : { 1u, 4u })
+    {
+        // Items are visited in the same order as once the walk is done
+        std::vector<CPathWalker::NODE> nodes = s_GetRoot(folder);
+        CFileSystemFolderLister lister;
+        std::vector<WALKED_ITEM> items;
+        CHECK(CPathWalker::WalkAndVisit(lister, nodes, UINT_MAX, threadCount, [&](const CPathWalker::NODE& node, unsigned int depth)
+        {
+            items.push_back({ node.entry, depth });
+            return true;
+        }));
+        CHECK(s_IsSameWalk(items, expected));
+
+        // Stopping part way returns false and visits nothing else
+        nodes = s_GetRoot(folder);
+        size_t visited = 0;
+        CHECK(!CPathWalker::WalkAndVisit(lister, nodes, UINT_MAX, threadCount, [&](const CPathWalker::NODE&, unsigned int)
+        {
+            return ++visited < 5;
+        }));
+        CHECK(visited == 5);
+    }
+}
+
+PORTABLE_TEST_METHOD(VerifyMaxDepth)
+{
+    CTempFolder folder;
+    s_CreateTree(folder);
+
+    // Contents of the temp folder and of a, d, e, f and g, but nothing in b
+    std::vector<WALKED_ITEM> items = s_Walk<CFileSystemFolderLister>(folder, 3, 4);
+    CHECK(items.size() == 1 + 5 + 2 + 1 + 4);
+    for (const WALKED_ITEM& item : items)
+    {
+        CHECK(item.depth < 3);
+    }
+
+    // Nothing below the folders passed in
+    CHECK(s_Walk<CFileSystemFolderLister>(folder, 1, 4).size() == 1);
+}
@@ -0,0 +1,82 @@
+#include "PortableTests.h"
+#include <ItemUpdateRing.h>
+#include <climits>
+#include <memory>
+#include <thread>
+
+// The same checks as VerifyItemUpdateRing and VerifyItemUpdateRingAcrossThreads in
+// SmartRenameLibUnitTests\SmartRenameManagerTests.cpp
+
+PORTABLE_TEST_METHOD(VerifyItemUpdateRing)
+{
+    std::unique_ptr<CItemUpdateRing> ring(new CItemUpdateRing());
+    unsigned int first = UINT_MAX;
+    unsigned int last = 0;
+    CHECK(ring->Drain(first, last) == 0);
+    CHECK(first == UINT_MAX && last == 0);
+
+    CHECK(ring->Push(7));
+    CHECK(ring->Push(3));
+    CHECK(ring->Push(12));
+    CHECK(ring->Drain(first, last) == 3);
+    CHECK(first == 3 && last == 12);
+
+    // A full ring refuses more until it is drained
+    for (size_t i = 0; i < CItemUpdateRing::c_capacity; i++)
+    {
+        CHECK(ring->Push(static_cast<unsigned int>(i)));
+    }
+    CHECK(!ring->Push(0));
+    CHECK(ring->Drain(first, last) == CItemUpdateRing::c_capacity);
+    CHECK(ring->Push(0));
+}
+
+PORTABLE_TEST_METHOD(VerifyItemUpdateRingWraps)
+{
+    std::unique_ptr<CItemUpdateRing> ring(new CItemUpdateRing());
+
+    // Each round starts partway through the slots so pushes wrap past the end
+    unsigned int next = 0;
+    for (int round = 0; round < 5; round++)
+    {
+        size_t count = CItemUpdateRing::c_capacity - 1 - round;
+        for (size_t i = 0; i < count; i++)
+        {
+            CHECK(ring->Push(next++));
+        }
+
+        unsigned int first = UINT_MAX;
+        unsigned int last = 0;
+        CHECK(ring->Drain(first, last) == count);
+        CHECK(first == next - count && last == next - 1);
+    }
+}
+
+PORTABLE_TEST_METHOD(VerifyItemUpdateRingAcrossThreads)
+{
+    std::unique_ptr<CItemUpdateRing> ring(new CItemUpdateRing());
+    const unsigned int pushCount = 1000000;
+    std::thread producer([&ring, pushCount]()
+    {
+        for (unsigned int u = 0; u < pushCount; u++)
+        {
+            while (!ring->Push(u))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    size_t drained = 0;
+    unsigned int first = UINT_MAX;
+    unsigned int last = 0;
+    while (drained < pushCount)
+    {
+        drained += ring->Drain(first, last);
+    }
+    producer.join();
+
+    CHECK(drained == pushCount);
+    CHECK(first == 0 && last == pushCount - 1);
+    CHECK(ring->Drain(first, last) == 0);
+}
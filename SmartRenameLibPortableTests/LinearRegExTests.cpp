@@ -0,0 +1,256 @@
+#include "PortableTests.h"
+#include <LinearRegEx.h>
+#include <ReplaceTemplate.h>
+#include <cwchar>
+#include <regex>
+
+// The engine checks from SmartRenameLibUnitTests\LinearRegExTests.cpp and
+// SmartRenameRegExTests.cpp, calling CLinearRegEx directly instead of going
+// through ISmartRenameRegEx
+
+struct SEARCH_REPLACE_EXPECTED
+{
+    const wchar_t* search;
+    const wchar_t* replace;
+    const wchar_t* test;
+    const wchar_t* expected;
+};
+
+// Returns false if any row doesn't give what it expects
+static bool s_VerifyTable(const SEARCH_REPLACE_EXPECTED* table, size_t count, bool caseSensitive, bool matchAll)
+{
+    bool passed = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        CLinearRegEx regex;
+        std::wstring result;
+        if (regex.Compile(table[i].search, wcslen(table[i].search), caseSensitive) != CLinearRegEx::CompileOk)
+        {
+            fprintf(stderr, "%ls failed to compile\n", table[i].search);
+            passed = false;
+            continue;
+        }
+
+        regex.Replace(table[i].test, wcslen(table[i].test), table[i].replace, wcslen(table[i].replace), matchAll, result);
+        if (result != table[i].expected)
+        {
+            fprintf(stderr, "%ls -> %ls on %ls gave %ls\n", table[i].search, table[i].replace, table[i].test, result.c_str());
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+PORTABLE_TEST_METHOD(VerifyRegExReplaceFirstOnly)
+{
+    SEARCH_REPLACE_EXPECTED table[] =
+    {
+        { L"B", L"BB", L"ABA", L"ABBA" },
+        { L"B", L"A", L"ABBBA", L"AABBA" },
+        { L".", L"Foo", L"AAAAAA", L"FooAAAAA" },
+        { L"^Foo", L"Baa", L"FooBarFoo", L"BaaBarFoo" },
+        { L"Foo$", L"Baa", L"FooBarFoo", L"FooBarBaa" },
+        { L"a|ab", L"X", L"ab", L"Xb" },
+        { L"a+?", L"X", L"aaa", L"Xaa" },
+    };
+
+    CHECK(s_VerifyTable(table, sizeof(table) / sizeof(table[0]), false, false));
+}
+
+PORTABLE_TEST_METHOD(VerifyRegExReplaceAll)
+{
+    SEARCH_REPLACE_EXPECTED table[] =
+    {
+        { L"B", L"A", L"ABBBA", L"AAAAA" },
+        { L"b", L"BBB", L"AbABAb", L"ABBBABBBABBB" },
+        { L"[0-9]+", L"#", L"a1b22c333", L"a#b#c#" },
+        { L"\\bcat\\b", L"dog", L"cat concat cat", L"dog concat dog" },
+        { L"a{2,3}", L"X", L"aaaaa", L"XX" },
+        { L"[^a]", L"-", L"abab", L"a-a-" },
+        { L"$", L"!", L"abc", L"abc!" },
+    };
+
+    CHECK(s_VerifyTable(table, sizeof(table) / sizeof(table[0]), false, true));
+}
+
+PORTABLE_TEST_METHOD(VerifyRegExReplaceAllCaseSensitive)
+{
+    SEARCH_REPLACE_EXPECTED table[] =
+    {
+        { L"b", L"BBB", L"AbABAb", L"ABBBABABBB" },
+        { L"[a-z]", L"_", L"aBcD", L"_B_D" },
+    };
+
+    CHECK(s_VerifyTable(table, sizeof(table) / sizeof(table[0]), true, true));
+}
+
+PORTABLE_TEST_METHOD(VerifyRegExGroupSubstitution)
+{
+    SEARCH_REPLACE_EXPECTED table[] =
+    {
+        { L"(\\w+)-(\\w+)", L"$2-$1", L"foo-bar.txt", L"bar-foo.txt" },
+        { L"(?:IMG|DSC)_(\\d+)", L"Photo $1", L"IMG_0042.jpg", L"Photo 0042.jpg" },
+        { L"(?<year>\\d{4})(?<month>\\d{2})", L"$<month>-$<year>", L"202401.log", L"01-2024.log" },
+        { L"(a)|b", L"[$1]", L"b", L"[]" },
+        { L"foo", L"$$&$&", L"foo", L"$&foo" },
+        { L"(a|b)*", L"$1", L"abab", L"b" },
+    };
+
+    CHECK(s_VerifyTable(table, sizeof(table) / sizeof(table[0]), false, false));
+}
+
+PORTABLE_TEST_METHOD(VerifyRegExCaseConversion)
+{
+    SEARCH_REPLACE_EXPECTED table[] =
+    {
+        { L"(?<name>\\w+)\\.txt", L"\\U$<name>\\E.txt", L"readme.txt", L"README.txt" },
+        { L"^(\\w)(\\w*)", L"\\U$1\\L$2", L"hELLO", L"Hello" },
+        { L"o", L"[$`|$']", L"foo", L"f[f|o][|]" },
+        { L"b", L"<$`>", L"abcab", L"a<a>ca<ca>" },
+    };
+
+    CHECK(s_VerifyTable(table, sizeof(table) / sizeof(table[0]), false, true));
+}
+
+PORTABLE_TEST_METHOD(VerifyRegExCompileResults)
+{
+    struct PATTERN_EXPECTED
+    {
+        const wchar_t* pattern;
+        CLinearRegEx::CompileResult expected;
+    };
+
+    PATTERN_EXPECTED table[] =
+    {
+        { L"a{2,3}", CLinearRegEx::CompileOk },
+        { L"a{", CLinearRegEx::CompileOk },
+        { L"[^]", CLinearRegEx::CompileOk },
+        { L"(a", CLinearRegEx::CompileInvalidPattern },
+        { L"a)", CLinearRegEx::CompileInvalidPattern },
+        { L"*a", CLinearRegEx::CompileInvalidPattern },
+        { L"a**", CLinearRegEx::CompileInvalidPattern },
+        { L"[z-a]", CLinearRegEx::CompileInvalidPattern },
+        { L"\\q", CLinearRegEx::CompileInvalidPattern },
+        { L"(a)\\1", CLinearRegEx::CompileUnsupported },
+        { L"(?=a)", CLinearRegEx::CompileUnsupported },
+        { L"(?<!a)b", CLinearRegEx::CompileUnsupported },
+        { L"((a{100}){100}){100}", CLinearRegEx::CompileTooComplex },
+    };
+
+    for (const PATTERN_EXPECTED& row : table)
+    {
+        CLinearRegEx regex;
+        CHECK(regex.Compile(row.pattern, wcslen(row.pattern), true) == row.expected);
+    }
+}
+
+PORTABLE_TEST_METHOD(VerifyRegExEmptyMatches)
+{
+    // Like std::regex_iterator an empty match may follow a longer one where it
+    // ended, but not another empty one
+    SEARCH_REPLACE_EXPECTED table[] =
+    {
+        { L"a*", L"X", L"aaa", L"XX" },
+        { L"a*", L"X", L"ab", L"XXbX" },
+        { L".*", L"Foo", L"AAAAAA", L"FooFoo" },
+        { L"x*", L"-", L"abc", L"-a-b-c-" },
+        { L"", L"-", L"ab", L"-a-b-" },
+        { L"(a*)*", L"[$1]", L"aab", L"[][]b[]" },
+        { L"(a|)+", L"[$1]", L"aab", L"[][]b[]" },
+        { L"(|a)+", L"[$&]", L"aab", L"[][a][][a][]b[]" },
+    };
+
+    CHECK(s_VerifyTable(table, sizeof(table) / sizeof(table[0]), true, true));
+}
+
+PORTABLE_TEST_METHOD(VerifyRegExCapturesMatchStdRegex)
+{
+    // A loop pass that matches nothing ends the loop but its groups are kept, the
+    // same as std::wregex
+    const wchar_t* patterns[] = { L"(a*)*", L"(a|)+", L"(a|b)*", L"(\\w+)\\.(\\w+)", L"(a)|b", L"(a*)+b" };
+    const wchar_t* texts[] = { L"", L"b", L"aaa", L"aab", L"foo.txt", L"abab" };
+    for (const wchar_t* pattern : patterns)
+    {
+        CLinearRegEx linear;
+        CHECK(linear.Compile(pattern, wcslen(pattern), true) == CLinearRegEx::CompileOk);
+        std::wregex standard(pattern);
+        for (const wchar_t* text : texts)
+        {
+            std::vector<size_t> captures;
+            std::wcmatch match;
+            bool matched = std::regex_search(text, match, standard);
+            CHECK(linear.Search(text, wcslen(text), 0, captures) == matched);
+            if (!matched)
+            {
+                continue;
+            }
+
+            CHECK(captures.size() == match.size() * 2);
+            for (size_t group = 0; group < match.size(); group++)
+            {
+                size_t begin = match[group].matched ? static_cast<size_t>(match.position(group)) : CLinearRegEx::npos;
+                size_t end = match[group].matched ? begin + match.length(group) : CLinearRegEx::npos;
+                CHECK(captures[group * 2] == begin && captures[group * 2 + 1] == end);
+            }
+        }
+    }
+}
+
+PORTABLE_TEST_METHOD(VerifyRegExNestedQuantifierIsLinear)
+{
+    // (a+)+$ against a long run of a's followed by a mismatch takes exponential
+    // time with a backtracking engine
+    std::wstring name(50000, L'a');
+    name += L'!';
+
+    CLinearRegEx regex;
+    const wchar_t* pattern = L"(a+)+$";
+    CHECK(regex.Compile(pattern, wcslen(pattern), true) == CLinearRegEx::CompileOk);
+
+    std::wstring result;
+    CHECK(!regex.Replace(name.c_str(), name.length(), L"X", 1, true, result));
+    CHECK(result == name);
+}
+
+PORTABLE_TEST_METHOD(VerifyRegExMatchLimits)
+{
+    std::wstring name(50000, L'a');
+    name += L'!';
+
+    CLinearRegEx regex;
+    const wchar_t* pattern = L"(a+)+$";
+    CHECK(regex.Compile(pattern, wcslen(pattern), true) == CLinearRegEx::CompileOk);
+
+    CReplaceTemplate replaceTemplate;
+    replaceTemplate.Parse(L"X", 1, regex.GetGroupCount(), &regex.GetGroupNames());
+
+    // Running out of steps leaves the name as it was
+    CLinearRegEx::MatchLimits limits;
+    limits.maxSteps = 10000;
+    CLinearRegEx::MatchStatus status = CLinearRegEx::MatchOk;
+    std::wstring result;
+    CHECK(!regex.Replace(name.c_str(), name.length(), replaceTemplate, true, result, &limits, &status));
+    CHECK(status == CLinearRegEx::MatchStepLimit);
+    CHECK(result == name);
+
+    // The poll callback can stop the match
+    int polls = 0;
+    limits.maxSteps = CLinearRegEx::npos;
+    limits.context = &polls;
+    limits.poll = [](void* context)
+    {
+        (*static_cast<int*>(context))++;
+        return CLinearRegEx::MatchStopped;
+    };
+    CHECK(!regex.Replace(name.c_str(), name.length(), replaceTemplate, true, result, &limits, &status));
+    CHECK(status == CLinearRegEx::MatchStopped);
+    CHECK(polls == 1);
+    CHECK(result == name);
+
+    // Short names finish before the first poll
+    polls = 0;
+    CHECK(regex.Replace(L"aaa", 3, replaceTemplate, true, result, &limits, &status));
+    CHECK(status == CLinearRegEx::MatchOk);
+    CHECK(polls == 0);
+    CHECK(result == L"X");
+}
@@ -0,0 +1,85 @@
+#include "PortableTests.h"
+#include <LiteralSearch.h>
+#include <cwchar>
+#include <random>
+
+// Where the SIMD scan is built these lengths cross the 8 and 16 character blocks
+// it compares at a time, and the checks agree with a plain std::wstring::find
+// either way.
+
+static size_t s_Find(const wchar_t* term, const wchar_t* text, bool caseSensitive, size_t start = 0)
+{
+    CLiteralSearch search;
+    search.Init(term, wcslen(term), caseSensitive);
+    std::wstring folded(text);
+    if (!caseSensitive)
+    {
+        CLiteralSearch::Fold(text, wcslen(text), folded);
+    }
+    return search.Find(folded.c_str(), folded.length(), start);
+}
+
+static std::wstring s_Replace(const wchar_t* term, const wchar_t* replace, const wchar_t* text, bool caseSensitive, bool matchAll)
+{
+    CLiteralSearch search;
+    search.Init(term, wcslen(term), caseSensitive);
+    std::wstring result;
+    search.Replace(text, wcslen(text), replace, wcslen(replace), matchAll, result);
+    return result;
+}
+
+PORTABLE_TEST_METHOD(VerifyLiteralFind)
+{
+    CHECK(s_Find(L"bar", L"foobar", true) == 3);
+    CHECK(s_Find(L"BAR", L"foobar", true) == CLiteralSearch::npos);
+    CHECK(s_Find(L"BAR", L"fooBar", false) == 3);
+    CHECK(s_Find(L"a", L"banana", true, 2) == 3);
+    CHECK(s_Find(L"ana", L"banana", true, 2) == 3);
+    CHECK(s_Find(L"x", L"", true) == CLiteralSearch::npos);
+    CHECK(s_Find(L"longer than text", L"short", true) == CLiteralSearch::npos);
+
+    // Matches at either end of a name longer than a block
+    CHECK(s_Find(L"IMG", L"IMG_0001_holiday-final.jpeg", true) == 0);
+    CHECK(s_Find(L".jpeg", L"IMG_0001_holiday-final.jpeg", true) == 22);
+    CHECK(s_Find(L"g", L"IMG_0001_holiday-final.jpeg", false) == 2);
+}
+
+PORTABLE_TEST_METHOD(VerifyLiteralReplace)
+{
+    CHECK(s_Replace(L"B", L"BB", L"ABA", true, false) == L"ABBA");
+    CHECK(s_Replace(L"B", L"A", L"ABBBA", true, true) == L"AAAAA");
+    CHECK(s_Replace(L"b", L"BBB", L"AbABAb", true, true) == L"ABBBABABBB");
+    CHECK(s_Replace(L"b", L"BBB", L"AbABAb", false, true) == L"ABBBABBBABBB");
+
+    // Occurrences don't overlap
+    CHECK(s_Replace(L"aa", L"b", L"aaaaa", true, true) == L"bba");
+    CHECK(s_Replace(L"foo", L"", L"foo.foo", true, true) == L".");
+    CHECK(s_Replace(L"zzz", L"y", L"foo", true, true) == L"foo");
+}
+
+PORTABLE_TEST_METHOD(VerifyLiteralFindMatchesStdFind)
+{
+    std::mt19937 random(12345);
+    for (int i = 0; i < 2000; i++)
+    {
+        // A small alphabet so partial matches are common
+        std::wstring text(random() % 70, L'a');
+        for (wchar_t& ch : text)
+        {
+            ch = static_cast<wchar_t>(L'a' + random() % 3);
+        }
+
+        size_t termLength = 1 + random() % 5;
+        size_t termStart = text.empty() ? 0 : random() % text.length();
+        std::wstring term = text.substr(termStart, termLength);
+        if (term.empty())
+        {
+            term = L"a";
+        }
+
+        size_t start = text.empty() ? 0 : random() % (text.length() + 1);
+        size_t expected = text.find(term, start);
+        size_t found = s_Find(term.c_str(), text.c_str(), true, start);
+        CHECK(found == ((expected == std::wstring::npos) ? CLiteralSearch::npos : expected));
+    }
+}
@@ -0,0 +1,122 @@
+#include "PortableTests.h"
+#include <FolderWalker.h>
+#include <PathItem.h>
+#include <climits>
+#include <cwchar>
+
+typedef CFolderWalker<PATH_ITEM> CPathItemWalker;
+
+// Lists PATH_ITEM folders by name the way CWin32FolderLister does, with
+// std::filesystem standing in for FindFirstFileEx
+class CPathItemLister
+{
+public:
+    bool OnWorkerStart() { return false; }
+    void OnWorkerStop() {}
+
+    bool ListFolder(const PATH_ITEM& folder, std::vector<FOLDER_WALK_NODE<PATH_ITEM>>& children)
+    {
+        std::vector<FOLDER_WALK_NODE<std::filesystem::path>> found;
+        bool listed = m_lister.ListFolder(folder.path, found);
+        for (const FOLDER_WALK_NODE<std::filesystem::path>& entry : found)
+        {
+            std::wstring name = entry.entry.filename().wstring();
+            FOLDER_WALK_NODE<PATH_ITEM> node;
+            node.entry = MakeChildPathItem(folder, name.c_str(), name.size());
+            node.isFolder = entry.isFolder;
+            children.push_back(std::move(node));
+        }
+        return listed;
+    }
+
+private:
+    CFileSystemFolderLister m_lister;
+};
+
+static size_t s_FindFileName(const wchar_t* path)
+{
+    return FindFileNameOffset(path, wcslen(path));
+}
+
+static size_t s_FindExtension(const wchar_t* name)
+{
+    return FindExtensionOffset(name, wcslen(name));
+}
+
+PORTABLE_TEST_METHOD(VerifyFindFileName)
+{
+    CHECK(s_FindFileName(L"c:\\foo\\bar/baz.txt") == 11);
+    CHECK(s_FindFileName(L"baz.txt") == 0);
+    CHECK(s_FindFileName(L"") == 0);
+
+    // A separator at the very end belongs to the name, like PathFindFileName
+    CHECK(s_FindFileName(L"c:\\") == 0);
+    CHECK(s_FindFileName(L"c:\\foo\\") == 3);
+    CHECK(s_FindFileName(L"\\\\server\\share") == 9);
+}
+
+PORTABLE_TEST_METHOD(VerifyFindExtension)
+{
+    CHECK(s_FindExtension(L"foo.txt") == 3);
+    CHECK(s_FindExtension(L"foo.tar.gz") == 7);
+    CHECK(s_FindExtension(L"foo") == 3);
+    CHECK(s_FindExtension(L"foo.") == 3);
+    CHECK(s_FindExtension(L"a..") == 2);
+    CHECK(s_FindExtension(L"") == 0);
+
+    // A leading dot is part of the stem
+    CHECK(s_FindExtension(L".gitignore") == 10);
+    CHECK(s_FindExtension(L".foo.txt") == 4);
+    CHECK(s_FindExtension(L".") == 1);
+    CHECK(s_FindExtension(L"..") == 2);
+}
+
+PORTABLE_TEST_METHOD(VerifyMakePathItem)
+{
+    PATH_ITEM item = MakePathItem(L"c:\\foo\\bar/baz.txt");
+    CHECK(item.path == L"c:\\foo\\bar/baz.txt");
+    CHECK(std::wstring(item.GetName()) == L"baz.txt");
+
+    // Children get one separator between the folder and their name
+    PATH_ITEM child = MakeChildPathItem(MakePathItem(L"c:\\foo"), L"bar.txt", 7);
+    CHECK(child.path.size() == 14 && child.path.compare(0, 6, L"c:\\foo") == 0);
+    CHECK(child.path[6] == L'\\' || child.path[6] == L'/');
+    CHECK(std::wstring(child.GetName()) == L"bar.txt");
+
+    child = MakeChildPathItem(MakePathItem(L"c:\\"), L"bar.txt", 3);
+    CHECK(child.path == L"c:\\bar");
+    CHECK(std::wstring(child.GetName()) == L"bar");
+
+    child = MakeChildPathItem(MakePathItem(L"/"), L"bar", 3);
+    CHECK(child.path == L"/bar" && child.nameOffset == 1);
+}
+
+PORTABLE_TEST_METHOD(VerifyWalkedPathItems)
+{
+    CTempFolder folder;
+    folder.AddFolder("foo");
+    folder.AddFile("foo/foo.txt");
+    folder.AddFolder("foo/bar");
+    folder.AddFile("foo/bar/.hidden");
+
+    std::vector<CPathItemWalker::NODE> nodes(1);
+    nodes[0].entry = MakePathItem(folder.GetPath().wstring().c_str());
+    nodes[0].isFolder = true;
+    CPathItemLister lister;
+    CPathItemWalker::Walk(lister, nodes, UINT_MAX, 2);
+
+    // Every item's path is the real one and its name is the end of it
+    size_t count = 0;
+    bool ok = true;
+    CPathItemWalker::Visit(nodes, [&](const CPathItemWalker::NODE& node, unsigned int depth)
+    {
+        std::filesystem::path path(node.entry.path);
+        ok = ok && std::filesystem::exists(path) && (std::filesystem::is_directory(path) == node.isFolder);
+        ok = ok && (depth == 0 || path.filename().wstring() == node.entry.GetName());
+        ok = ok && node.entry.nameOffset == FindFileNameOffset(node.entry.path.c_str(), node.entry.path.size());
+        count++;
+        return true;
+    });
+    CHECK(ok);
+    CHECK(count == 5);
+}
@@ -0,0 +1,65 @@
+#include "PortableTests.h"
+#include <atomic>
+#include <fstream>
+#include <random>
+
+struct REGISTERED_TEST
+{
+    const char* name;
+    PORTABLE_TEST_PROC proc;
+};
+
+static std::vector<REGISTERED_TEST>& s_GetTests()
+{
+    static std::vector<REGISTERED_TEST> tests;
+    return tests;
+}
+
+static int s_failures = 0;
+
+PORTABLE_TEST::PORTABLE_TEST(const char* name, PORTABLE_TEST_PROC proc)
+{
+    s_GetTests().push_back({ name, proc });
+}
+
+void ReportFailure(const char* file, int line, const char* expression)
+{
+    fprintf(stderr, "%s(%d): check failed: %s\n", file, line, expression);
+    s_failures++;
+}
+
+CTempFolder::CTempFolder()
+{
+    static std::atomic<unsigned int> s_count(0);
+    std::random_device random;
+    m_path = std::filesystem::temp_directory_path() /
+        ("SmartRenamePortableTests-" + std::to_string(random()) + "-" + std::to_string(s_count++));
+    std::filesystem::create_directories(m_path);
+}
+
+CTempFolder::~CTempFolder()
+{
+    std::error_code error;
+    std::filesystem::remove_all(m_path, error);
+}
+
+void CTempFolder::AddFile(const std::filesystem::path& path)
+{
+    std::ofstream file(m_path / path);
+}
+
+void CTempFolder::AddFolder(const std::filesystem::path& path)
+{
+    std::filesystem::create_directories(m_path / path);
+}
+
+int main()
+{
+    for (const REGISTERED_TEST& test : s_GetTests())
+    {
+        int failures = s_failures;
+        test.proc();
+        printf("%s %s\n", (failures == s_failures) ? "PASS" : "FAIL", test.name);
+    }
+    return (s_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A minimal test runner for code that has to build off Windows, where the
+// CppUnitTest framework used by SmartRenameLibUnitTests isn't available.
+
+typedef std::function<void()> PORTABLE_TEST_PROC;
+
+struct PORTABLE_TEST
+{
+    PORTABLE_TEST(const char* name, PORTABLE_TEST_PROC proc);
+};
+
+void ReportFailure(const char* file, int line, const char* expression);
+
+#define PORTABLE_TEST_METHOD(name) \
+    static void name(); \
+    static PORTABLE_TEST s_test##name(#name, name); \
+    static void name()
+
+#define CHECK(expression) \
+    do \
+    { \
+        if (!(expression)) \
+        { \
+            ReportFailure(__FILE__, __LINE__, #expression); \
+            return; \
+        } \
+    } while (0)
+
+// Creates an empty folder for a test and deletes it along with its contents
+class CTempFolder
+{
+public:
+    CTempFolder();
+    ~CTempFolder();
+
+    const std::filesystem::path& GetPath() const { return m_path; }
+    void AddFile(const std::filesystem::path& path);
+    void AddFolder(const std::filesystem::path& path);
+
+private:
+    std::filesystem::path m_path;
+};
@@ -0,0 +1,105 @@
+#include "PortableTests.h"
+#include <LinearRegEx.h>
+#include <RegExPrefilter.h>
+#include <cwchar>
+
+// The same checks as VerifyLiteralFacts and VerifyPrefilter in
+// SmartRenameLibUnitTests\LinearRegExTests.cpp
+
+PORTABLE_TEST_METHOD(VerifyLiteralFacts)
+{
+    struct PATTERN_FACTS
+    {
+        const wchar_t* pattern;
+        const wchar_t* prefix;
+        const wchar_t* suffix;
+        const wchar_t* required;
+        bool anchoredStart;
+        bool anchoredEnd;
+    };
+
+    PATTERN_FACTS table[] =
+    {
+        { L"IMG_\\d+", L"IMG_", L"", L"IMG_", false, false },
+        { L"\\.jpeg$", L".jpeg", L".jpeg", L".jpeg", false, true },
+        { L"(.*)-final", L"", L"-final", L"-final", false, false },
+        { L"^(IMG|DSC)_(\\d+)", L"", L"", L"_", true, false },
+        { L"^foo(bar|baz)$", L"fooba", L"", L"fooba", true, true },
+        { L"ab{3}c", L"abbbc", L"abbbc", L"abbbc", false, false },
+        { L"a*b?", L"", L"", L"", false, false },
+    };
+
+    for (const PATTERN_FACTS& row : table)
+    {
+        CLinearRegEx regex;
+        CHECK(regex.Compile(row.pattern, wcslen(row.pattern), true) == CLinearRegEx::CompileOk);
+
+        const CLinearRegEx::LiteralFacts& facts = regex.GetLiteralFacts();
+        CHECK(facts.prefix == row.prefix);
+        CHECK(facts.suffix == row.suffix);
+        CHECK(facts.required == row.required);
+        CHECK(facts.anchoredStart == row.anchoredStart);
+        CHECK(facts.anchoredEnd == row.anchoredEnd);
+    }
+}
+
+PORTABLE_TEST_METHOD(VerifyPrefilter)
+{
+    struct PATTERN_NAME_EXPECTED
+    {
+        const wchar_t* pattern;
+        bool caseSensitive;
+        const wchar_t* name;
+        bool mayMatch;
+    };
+
+    PATTERN_NAME_EXPECTED table[] =
+    {
+        { L"IMG_\\d+", true, L"IMG_0042.jpg", true },
+        { L"IMG_\\d+", true, L"img_0042.jpg", false },
+        { L"IMG_\\d+", false, L"img_0042.jpg", true },
+        { L"IMG_\\d+", true, L"DSC_0042.jpg", false },
+        { L"\\.jpeg$", true, L"photo.jpeg", true },
+        { L"\\.jpeg$", true, L"photo.jpeg.bak", false },
+        { L"^foo(bar|baz)$", true, L"foobaz", true },
+        { L"^foo(bar|baz)$", true, L"xfoobaz", false },
+        { L"^foo(bar|baz)$", false, L"FOOBAR", true },
+        { L"^foo(bar|baz)$", true, L"fo", false },
+        { L"a*b?", true, L"zzz", true },
+    };
+
+    for (const PATTERN_NAME_EXPECTED& row : table)
+    {
+        CLinearRegEx regex;
+        CHECK(regex.Compile(row.pattern, wcslen(row.pattern), row.caseSensitive) == CLinearRegEx::CompileOk);
+
+        CRegExPrefilter prefilter;
+        prefilter.Init(regex.GetLiteralFacts(), row.caseSensitive);
+        CHECK(prefilter.MayMatch(row.name, wcslen(row.name)) == row.mayMatch);
+    }
+}
+
+PORTABLE_TEST_METHOD(VerifyPrefilterNeverRejectsAMatch)
+{
+    const wchar_t* patterns[] = { L"IMG_\\d+", L"\\.jpe?g$", L"^(IMG|DSC)_", L"(.*)-final", L"^foo(bar|baz)$", L"ab{2}c", L"x|y" };
+    const wchar_t* names[] = { L"IMG_0042.jpg", L"dsc_1.JPEG", L"holiday-final", L"foobaz", L"FOOBAR", L"abbc", L"zzz", L"", L"y" };
+    for (const wchar_t* pattern : patterns)
+    {
+        for (int caseSensitive = 0; caseSensitive < 2; caseSensitive++)
+        {
+            CLinearRegEx regex;
+            CHECK(regex.Compile(pattern, wcslen(pattern), caseSensitive != 0) == CLinearRegEx::CompileOk);
+            CRegExPrefilter prefilter;
+            prefilter.Init(regex.GetLiteralFacts(), caseSensitive != 0);
+
+            for (const wchar_t* name : names)
+            {
+                std::vector<size_t> captures;
+                if (regex.Search(name, wcslen(name), 0, captures))
+                {
+                    CHECK(prefilter.MayMatch(name, wcslen(name)));
+                }
+            }
+        }
+    }
+}
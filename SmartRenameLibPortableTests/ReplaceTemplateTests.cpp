@@ -0,0 +1,67 @@
+#include "PortableTests.h"
+#include <ReplaceTemplate.h>
+#include <cwchar>
+
+// "xxfoo-BARyy" matched at "foo-BAR", with groups for "foo", "BAR" and a third
+// group that didn't participate
+static const wchar_t c_text[] = L"xxfoo-BARyy";
+static const size_t c_captures[] = { 2, 9, 2, 5, 6, 9, CReplaceTemplate::npos, CReplaceTemplate::npos };
+static const size_t c_groupCount = 3;
+
+static std::wstring s_Expand(const wchar_t* format, const std::map<std::wstring, size_t>* groupNames = nullptr, size_t prefixStart = 0)
+{
+    CReplaceTemplate replaceTemplate;
+    replaceTemplate.Parse(format, wcslen(format), c_groupCount, groupNames);
+
+    std::wstring result;
+    replaceTemplate.Apply(c_text, wcslen(c_text), c_captures, c_groupCount, prefixStart, result);
+    return result;
+}
+
+PORTABLE_TEST_METHOD(VerifyTemplateSubstitutions)
+{
+    CHECK(s_Expand(L"$2-$1") == L"BAR-foo");
+    CHECK(s_Expand(L"[$&]") == L"[foo-BAR]");
+    CHECK(s_Expand(L"$$1") == L"$1");
+    CHECK(s_Expand(L"a$") == L"a$");
+    CHECK(s_Expand(L"a\\b") == L"a\\b");
+
+    // Groups that didn't participate or don't exist add nothing
+    CHECK(s_Expand(L"[$3]") == L"[]");
+    CHECK(s_Expand(L"[$9]") == L"[]");
+
+    // Two digits only when the pattern has that many groups
+    CHECK(s_Expand(L"$12") == L"foo2");
+    CHECK(s_Expand(L"$03") == L"");
+}
+
+PORTABLE_TEST_METHOD(VerifyTemplatePrefixAndSuffix)
+{
+    CHECK(s_Expand(L"[$`|$']") == L"[xx|yy]");
+
+    // With match all the prefix starts where the previous match ended
+    CHECK(s_Expand(L"[$`|$']", nullptr, 1) == L"[x|yy]");
+    CHECK(s_Expand(L"[$`]", nullptr, 2) == L"[]");
+}
+
+PORTABLE_TEST_METHOD(VerifyTemplateNamedGroups)
+{
+    std::map<std::wstring, size_t> groupNames;
+    groupNames[L"first"] = 1;
+    groupNames[L"second"] = 2;
+
+    CHECK(s_Expand(L"$<second>.$<first>", &groupNames) == L"BAR.foo");
+    CHECK(s_Expand(L"[$<missing>]", &groupNames) == L"[]");
+    CHECK(s_Expand(L"$<second", &groupNames) == L"$<second");
+
+    // Without named groups $< is plain text
+    CHECK(s_Expand(L"$<first>") == L"$<first>");
+}
+
+PORTABLE_TEST_METHOD(VerifyTemplateCaseConversion)
+{
+    CHECK(s_Expand(L"\\U$1\\E-$2") == L"FOO-BAR");
+    CHECK(s_Expand(L"\\L$2X\\EY") == L"barxY");
+    CHECK(s_Expand(L"\\Uab\\Lc$2") == L"ABcbar");
+    CHECK(s_Expand(L"\\U$`$'") == L"XXYY");
+}
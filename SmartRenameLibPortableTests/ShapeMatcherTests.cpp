@@ -0,0 +1,66 @@
+#include "PortableTests.h"
+#include <LinearRegEx.h>
+#include <ShapeMatcher.h>
+#include <cwchar>
+
+// The same checks as VerifyShapeMatchers in SmartRenameLibUnitTests\LinearRegExTests.cpp
+
+PORTABLE_TEST_METHOD(VerifyShapeMatchers)
+{
+    struct SHAPE_EXPECTED
+    {
+        const wchar_t* pattern;
+        CShapeMatcher::Shape shape;
+    };
+
+    SHAPE_EXPECTED table[] =
+    {
+        { L"final", CShapeMatcher::ShapeLiteral },
+        { L"^IMG_", CShapeMatcher::ShapePrefix },
+        { L"\\.jpeg$", CShapeMatcher::ShapeSuffix },
+        { L"^(?:ab){2}$", CShapeMatcher::ShapeWhole },
+        { L"(final)", CShapeMatcher::ShapeNone },
+        { L"\\bfinal\\b", CShapeMatcher::ShapeNone },
+        { L"a^b", CShapeMatcher::ShapeNone },
+        { L"(?:^a){2}", CShapeMatcher::ShapeNone },
+        { L"^$", CShapeMatcher::ShapeNone },
+    };
+
+    const wchar_t* names[] = { L"IMG_final.jpeg", L"img_FINAL_final.JPEG", L"abab", L"ABAB", L"", L"a^b", L"finalfinal" };
+    const wchar_t* replaces[] = { L"X", L"[$`|$&|$']", L"\\U$&" };
+
+    for (const SHAPE_EXPECTED& row : table)
+    {
+        for (int flags = 0; flags < 4; flags++)
+        {
+            bool caseSensitive = (flags & 1) != 0;
+            bool matchAll = (flags & 2) != 0;
+
+            CLinearRegEx regex;
+            CHECK(regex.Compile(row.pattern, wcslen(row.pattern), caseSensitive) == CLinearRegEx::CompileOk);
+
+            CShapeMatcher matcher;
+            matcher.Init(regex.GetLiteralFacts(), caseSensitive, matchAll);
+            CHECK(matcher.GetShape() == row.shape);
+            if (!matcher.IsActive())
+            {
+                continue;
+            }
+
+            // Must agree with the engine on every name
+            for (const wchar_t* replace : replaces)
+            {
+                CReplaceTemplate replaceTemplate;
+                replaceTemplate.Parse(replace, wcslen(replace), regex.GetGroupCount(), &regex.GetGroupNames());
+                for (const wchar_t* name : names)
+                {
+                    std::wstring expected;
+                    std::wstring result;
+                    bool engineMatched = regex.Replace(name, wcslen(name), replaceTemplate, matchAll, expected);
+                    CHECK(matcher.Replace(name, wcslen(name), replaceTemplate, result) == engineMatched);
+                    CHECK(result == expected);
+                }
+            }
+        }
+    }
+}
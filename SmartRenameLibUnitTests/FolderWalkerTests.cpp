@@ -0,0 +1,201 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include <FolderWalker.h>
+#include "TestFileHelper.h"
+#include <chrono>
+#include <climits>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace FolderWalkerTests
+{
+    typedef CFolderWalker<std::filesystem::path> CPathWalker;
+
+    struct WalkedItem
+    {
+        std::filesystem::path path;
+        unsigned int depth;
+    };
+
+    // Lists folders slowly and remembers which threads listed them
+    class CRecordingFolderLister : public CFileSystemFolderLister
+    {
+    public:
+        bool ListFolder(const std::filesystem::path& folder, std::vector<FOLDER_WALK_NODE<std::filesystem::path>>& children)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_threads.insert(std::this_thread::get_id());
+            }
+            return CFileSystemFolderLister::ListFolder(folder, children);
+        }
+
+        size_t GetThreadCount()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_threads.size();
+        }
+
+    private:
+        std::mutex m_lock;
+        std::set<std::thread::id> m_threads;
+    };
+
+    TEST_CLASS(FolderWalkerTests)
+    {
+    public:
+        // a, a\b and a\b\c, each holding two files, plus a few other folders next to a
+        void CreateTree(_In_ CTestFileHelper& testFileHelper)
+        {
+            std::wstring folder;
+            for (PCWSTR name : { L"a", L"b", L"c" })
+            {
+                folder += (folder.empty() ? L"" : L"\\") + std::wstring(name);
+                Assert::IsTrue(testFileHelper.AddFolder(folder));
+                Assert::IsTrue(testFileHelper.AddFile(folder + L"\\foo.txt"));
+                Assert::IsTrue(testFileHelper.AddFile(folder + L"\\bar.txt"));
+            }
+
+            for (PCWSTR name : { L"d", L"e", L"f", L"g" })
+            {
+                Assert::IsTrue(testFileHelper.AddFolder(name));
+                Assert::IsTrue(testFileHelper.AddFile(std::wstring(name) + L"\\foo.txt"));
+            }
+        }
+
+        std::vector<WalkedItem> Walk(_In_ CTestFileHelper& testFileHelper, _In_ unsigned int maxDepth, _In_ unsigned int threadCount)
+        {
+            std::vector<CPathWalker::NODE> nodes(1);
+            nodes[0].entry = testFileHelper.GetTempDirectory();
+            nodes[0].isFolder = true;
+
+            CFileSystemFolderLister lister;
+            CPathWalker::Walk(lister, nodes, maxDepth, threadCount);
+
+            std::vector<WalkedItem> items;
+            CPathWalker::Visit(nodes, [&](const CPathWalker::NODE& node, unsigned int depth)
+            {
+                items.push_back({ node.entry, depth });
+                return true;
+            });
+            return items;
+        }
+
+        TEST_METHOD(VerifyDepthFirstOrder)
+        {
+            CTestFileHelper testFileHelper;
+            CreateTree(testFileHelper);
+
+            std::vector<WalkedItem> items = Walk(testFileHelper, UINT_MAX, 4);
+            Assert::IsTrue(items.size() == 1 + 3 * 3 + 4 * 2);
+
+            // Every item comes right after its folder or after something else in it
+            for (size_t i = 1; i < items.size(); i++)
+            {
+                size_t parent = i - 1;
+                while (items[parent].depth >= items[i].depth)
+                {
+                    parent--;
+                }
+                Assert::IsTrue(items[parent].depth + 1 == items[i].depth);
+                Assert::IsTrue(items[i].path.parent_path() == items[parent].path);
+            }
+        }
+
+        TEST_METHOD(VerifySameOrderOnAnyThreadCount)
+        {
+            CTestFileHelper testFileHelper;
+            CreateTree(testFileHelper);
+
+            std::vector<WalkedItem> expected = Walk(testFileHelper, UINT_MAX, 1);
+            for (unsigned int threadCount : { 2u, 4u, 16u })
+            {
+                std::vector<WalkedItem> items = Walk(testFileHelper, UINT_MAX, threadCount);
+                Assert::IsTrue(items.size() == expected.size());
+                for (size_t i = 0; i < items.size(); i++)
+                {
+                    Assert::IsTrue(items[i].path == expected[i].path && items[i].depth == expected[i].depth);
+                }
+            }
+        }
+
+        TEST_METHOD(VerifyWorkersShareOneFolder)
+        {
+            CTestFileHelper testFileHelper;
+            CreateTree(testFileHelper);
+
+            // A single folder passed in still has its subfolders listed by several
+            // workers
+            std::vector<CPathWalker::NODE> nodes(1);
+            nodes[0].entry = testFileHelper.GetTempDirectory();
+            nodes[0].isFolder = true;
+
+            CRecordingFolderLister lister;
+            CPathWalker::Walk(lister, nodes, UINT_MAX, 4);
+            Assert::IsTrue(lister.GetThreadCount() > 1);
+        }
+
+        TEST_METHOD(VerifyVisitWhileWalking)
+        {
+            CTestFileHelper testFileHelper;
+            CreateTree(testFileHelper);
+
+            std::vector<WalkedItem> expected = Walk(testFileHelper, UINT_MAX, 1);
+            for (unsigned int threadCount : { 1u, 4u })
+            {
+                std::vector<CPathWalker::NODE> nodes(1);
+                nodes[0].entry = testFileHelper.GetTempDirectory();
+                nodes[0].isFolder = true;
+
+                // Items are visited in the same order as once the walk is done
+                CFileSystemFolderLister lister;
+                std::vector<WalkedItem> items;
+                Assert::IsTrue(CPathWalker::WalkAndVisit(lister, nodes, UINT_MAX, threadCount, [&](const CPathWalker::NODE& node, unsigned int depth)
+                {
+                    items.push_back({ node.entry, depth });
+                    return true;
+                }));
+                Assert::IsTrue(items.size() == expected.size());
+                for (size_t i = 0; i < items.size(); i++)
+                {
+                    Assert::IsTrue(items[i].path == expected[i].path && items[i].depth == expected[i].depth);
+                }
+
+                // Stopping part way returns false and visits nothing else
+                nodes.resize(1);
+                nodes[0].children.clear();
+                nodes[0].listed = false;
+                size_t visited = 0;
+                Assert::IsFalse(CPathWalker::WalkAndVisit(lister, nodes, UINT_MAX, threadCount, [&](const CPathWalker::NODE&, unsigned int)
+                {
+                    return ++visited < 5;
+                }));
+                Assert::IsTrue(visited == 5);
+            }
+        }
+
+        TEST_METHOD(VerifyMaxDepth)
+        {
+            CTestFileHelper testFileHelper;
+            CreateTree(testFileHelper);
+
+            // Contents of the temp folder and of a, d, e, f and g, but nothing in b
+            std::vector<WalkedItem> items = Walk(testFileHelper, 3, 4);
+            Assert::IsTrue(items.size() == 1 + 5 + 2 + 1 + 4);
+            for (const WalkedItem& item : items)
+            {
+                Assert::IsTrue(item.depth < 3);
+            }
+
+            // Nothing below the folders passed in
+            items = Walk(testFileHelper, 1, 4);
+            Assert::IsTrue(items.size() == 1);
+        }
+    };
+}
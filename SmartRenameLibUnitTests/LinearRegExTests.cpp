@@ -0,0 +1,432 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include <SmartRenameInterfaces.h>
+#include <SmartRenameLinearRegEx.h>
+#include <LinearRegEx.h>
+#include <RegExPrefilter.h>
+#include <ShapeMatcher.h>
+#include <chrono>
+#include <strsafe.h>
+#include "MockSmartRenameRegExEvents.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace LinearRegExTests
+{
+    struct SearchReplaceExpected
+    {
+        PCWSTR search;
+        PCWSTR replace;
+        PCWSTR test;
+        PCWSTR expected;
+    };
+
+    void VerifyTable(_In_ ISmartRenameRegEx* renameRegEx, _In_ const SearchReplaceExpected* sreTable, _In_ int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            PWSTR result = nullptr;
+            Assert::IsTrue(renameRegEx->put_searchTerm(sreTable[i].search) == S_OK);
+            Assert::IsTrue(renameRegEx->put_replaceTerm(sreTable[i].replace) == S_OK);
+            Assert::IsTrue(renameRegEx->Replace(sreTable[i].test, &result) == S_OK);
+            Assert::IsTrue(wcscmp(result, sreTable[i].expected) == 0);
+            CoTaskMemFree(result);
+        }
+    }
+
+    TEST_CLASS(LinearRegExTests)
+    {
+    public:
+        TEST_METHOD(VerifyReplaceFirstOnly)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameLinearRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(UseRegularExpressions) == S_OK);
+
+            SearchReplaceExpected sreTable[] =
+            {
+                { L"B", L"BB", L"ABA", L"ABBA" },
+                { L"B", L"A", L"ABBBA", L"AABBA" },
+                { L".", L"Foo", L"AAAAAA", L"FooAAAAA" },
+                { L"^Foo", L"Baa", L"FooBarFoo", L"BaaBarFoo" },
+                { L"Foo$", L"Baa", L"FooBarFoo", L"FooBarBaa" },
+            };
+
+            VerifyTable(renameRegEx, sreTable, ARRAYSIZE(sreTable));
+        }
+
+        TEST_METHOD(VerifyReplaceAll)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameLinearRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(MatchAllOccurences | UseRegularExpressions) == S_OK);
+
+            SearchReplaceExpected sreTable[] =
+            {
+                { L"B", L"A", L"ABBBA", L"AAAAA" },
+                { L"b", L"BBB", L"AbABAb", L"ABBBABBBABBB" },
+                { L".*", L"Foo", L"AAAAAA", L"FooFoo" },
+                { L"x*", L"-", L"abc", L"-a-b-c-" },
+                { L"[0-9]+", L"#", L"a1b22c333", L"a#b#c#" },
+                { L"\\bcat\\b", L"dog", L"cat concat cat", L"dog concat dog" },
+            };
+
+            VerifyTable(renameRegEx, sreTable, ARRAYSIZE(sreTable));
+        }
+
+        TEST_METHOD(VerifyReplaceAllCaseSensitive)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameLinearRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(MatchAllOccurences | UseRegularExpressions | CaseSensitive) == S_OK);
+
+            SearchReplaceExpected sreTable[] =
+            {
+                { L"b", L"BBB", L"AbABAb", L"ABBBABABBB" },
+                { L"[a-z]", L"_", L"aBcD", L"_B_D" },
+            };
+
+            VerifyTable(renameRegEx, sreTable, ARRAYSIZE(sreTable));
+        }
+
+        TEST_METHOD(VerifyGroupSubstitution)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameLinearRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(UseRegularExpressions) == S_OK);
+
+            SearchReplaceExpected sreTable[] =
+            {
+                { L"(\\w+)-(\\w+)", L"$2-$1", L"foo-bar.txt", L"bar-foo.txt" },
+                { L"(?:IMG|DSC)_(\\d+)", L"Photo $1", L"IMG_0042.jpg", L"Photo 0042.jpg" },
+                { L"(?<year>\\d{4})(?<month>\\d{2})", L"$<month>-$<year>", L"202401.log", L"01-2024.log" },
+                { L"(a)|b", L"[$1]", L"b", L"[]" },
+                { L"foo", L"$$&$&", L"foo", L"$&foo" },
+            };
+
+            VerifyTable(renameRegEx, sreTable, ARRAYSIZE(sreTable));
+        }
+
+        TEST_METHOD(VerifyCaseConversion)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameLinearRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(UseRegularExpressions | MatchAllOccurences) == S_OK);
+
+            SearchReplaceExpected sreTable[] =
+            {
+                { L"(?<name>\\w+)\\.txt", L"\\U$<name>\\E.txt", L"readme.txt", L"README.txt" },
+                { L"^(\\w)(\\w*)", L"\\U$1\\L$2", L"hELLO", L"Hello" },
+                { L"o", L"[$`|$']", L"foo", L"f[f|o][|]" },
+                { L"b", L"<$`>", L"abcab", L"a<a>ca<ca>" },
+            };
+
+            VerifyTable(renameRegEx, sreTable, ARRAYSIZE(sreTable));
+        }
+
+        TEST_METHOD(VerifyUnsupportedPattern)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameLinearRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            CMockSmartRenameRegExEvents* mockEvents = new CMockSmartRenameRegExEvents();
+            CComPtr<ISmartRenameRegExEvents> regExEvents;
+            Assert::IsTrue(mockEvents->QueryInterface(IID_PPV_ARGS(&regExEvents)) == S_OK);
+            DWORD cookie = 0;
+            Assert::IsTrue(renameRegEx->Advise(regExEvents, &cookie) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(MatchAllOccurences | UseRegularExpressions) == S_OK);
+
+            // Backreferences need backtracking
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(a)\\1") == S_OK);
+            Assert::IsTrue(mockEvents->m_patternError == SR_E_UNSUPPORTEDPATTERN);
+
+            PWSTR result = nullptr;
+            Assert::IsTrue(renameRegEx->Replace(L"aa", &result) == SR_E_UNSUPPORTEDPATTERN);
+            Assert::IsTrue(result == nullptr);
+
+            mockEvents->m_patternError = S_OK;
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(a") == S_OK);
+            Assert::IsTrue(mockEvents->m_patternError == SR_E_INVALIDPATTERN);
+
+            Assert::IsTrue(renameRegEx->UnAdvise(cookie) == S_OK);
+            mockEvents->Release();
+        }
+
+        TEST_METHOD(VerifyNestedQuantifierIsLinear)
+        {
+            // (a+)+$ against a long run of a's followed by a mismatch takes exponential
+            // time with a backtracking engine.
+            std::wstring name(50000, L'a');
+            name += L'!';
+
+            CLinearRegEx regex;
+            PCWSTR pattern = L"(a+)+$";
+            Assert::IsTrue(regex.Compile(pattern, wcslen(pattern), true) == CLinearRegEx::CompileOk);
+
+            std::wstring result;
+            Assert::IsFalse(regex.Replace(name.c_str(), name.length(), L"X", 1, true, result));
+            Assert::IsTrue(result == name);
+        }
+
+        TEST_METHOD(VerifyMatchLimits)
+        {
+            std::wstring name(50000, L'a');
+            name += L'!';
+
+            CLinearRegEx regex;
+            PCWSTR pattern = L"(a+)+$";
+            Assert::IsTrue(regex.Compile(pattern, wcslen(pattern), true) == CLinearRegEx::CompileOk);
+
+            CReplaceTemplate replaceTemplate;
+            replaceTemplate.Parse(L"X", 1, regex.GetGroupCount(), &regex.GetGroupNames());
+
+            // Running out of steps leaves the name as it was
+            CLinearRegEx::MatchLimits limits;
+            limits.maxSteps = 10000;
+            CLinearRegEx::MatchStatus status = CLinearRegEx::MatchOk;
+            std::wstring result;
+            Assert::IsFalse(regex.Replace(name.c_str(), name.length(), replaceTemplate, true, result, &limits, &status));
+            Assert::IsTrue(status == CLinearRegEx::MatchStepLimit);
+            Assert::IsTrue(result == name);
+
+            // The poll callback can stop the match
+            limits.maxSteps = CLinearRegEx::npos;
+            limits.poll = [](void*) { return CLinearRegEx::MatchStopped; };
+            Assert::IsFalse(regex.Replace(name.c_str(), name.length(), replaceTemplate, true, result, &limits, &status));
+            Assert::IsTrue(status == CLinearRegEx::MatchStopped);
+            Assert::IsTrue(result == name);
+
+            // Short names finish before the first poll
+            Assert::IsTrue(regex.Replace(L"aaa", 3, replaceTemplate, true, result, &limits, &status));
+            Assert::IsTrue(status == CLinearRegEx::MatchOk);
+            Assert::IsTrue(result == L"X");
+        }
+
+        TEST_METHOD(VerifyCancelDuringMatch)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameLinearRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(UseRegularExpressions) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(a+)+$") == S_OK);
+            Assert::IsTrue(renameRegEx->put_replaceTerm(L"X") == S_OK);
+
+            // Ends in an a so the prefilter lets it through to the engine
+            std::wstring name(50000, L'a');
+            name += L"!a";
+            PCWSTR sources[] = { name.c_str() };
+            std::vector<wchar_t> arena(name.length() * 2);
+            UINT offsets[ARRAYSIZE(sources)] = { 0 };
+            HRESULT results[ARRAYSIZE(sources)] = { 0 };
+            UINT processed = 0;
+
+            // Already signaled so the engine stops at its first poll
+            HANDLE cancelEvent = CreateEvent(nullptr, TRUE, TRUE, nullptr);
+            Assert::IsTrue(renameRegEx->ReplaceBatch(ARRAYSIZE(sources), sources, cancelEvent, arena.data(), static_cast<UINT>(arena.size()), offsets, results, &processed) == HRESULT_FROM_WIN32(ERROR_CANCELLED));
+            Assert::IsTrue(results[0] == HRESULT_FROM_WIN32(ERROR_CANCELLED));
+            Assert::IsTrue(processed == 0);
+            CloseHandle(cancelEvent);
+        }
+
+        TEST_METHOD(VerifyCompileResults)
+        {
+            struct PatternExpected
+            {
+                PCWSTR pattern;
+                CLinearRegEx::CompileResult expected;
+            };
+
+            PatternExpected table[] =
+            {
+                { L"a{2,3}", CLinearRegEx::CompileOk },
+                { L"a{", CLinearRegEx::CompileOk },
+                { L"[^]", CLinearRegEx::CompileOk },
+                { L"(a", CLinearRegEx::CompileInvalidPattern },
+                { L"a)", CLinearRegEx::CompileInvalidPattern },
+                { L"a**", CLinearRegEx::CompileInvalidPattern },
+                { L"[z-a]", CLinearRegEx::CompileInvalidPattern },
+                { L"(?=a)", CLinearRegEx::CompileUnsupported },
+                { L"(?<!a)b", CLinearRegEx::CompileUnsupported },
+                { L"((a{100}){100}){100}", CLinearRegEx::CompileTooComplex },
+            };
+
+            for (int i = 0; i < ARRAYSIZE(table); i++)
+            {
+                CLinearRegEx regex;
+                Assert::IsTrue(regex.Compile(table[i].pattern, wcslen(table[i].pattern), true) == table[i].expected);
+            }
+        }
+
+        TEST_METHOD(VerifyLiteralFacts)
+        {
+            struct PatternFacts
+            {
+                PCWSTR pattern;
+                PCWSTR prefix;
+                PCWSTR suffix;
+                PCWSTR required;
+                bool anchoredStart;
+                bool anchoredEnd;
+            };
+
+            PatternFacts table[] =
+            {
+                { L"IMG_\\d+", L"IMG_", L"", L"IMG_", false, false },
+                { L"\\.jpeg$", L".jpeg", L".jpeg", L".jpeg", false, true },
+                { L"(.*)-final", L"", L"-final", L"-final", false, false },
+                { L"^(IMG|DSC)_(\\d+)", L"", L"", L"_", true, false },
+                { L"^foo(bar|baz)$", L"fooba", L"", L"fooba", true, true },
+                { L"ab{3}c", L"abbbc", L"abbbc", L"abbbc", false, false },
+                { L"a*b?", L"", L"", L"", false, false },
+            };
+
+            for (int i = 0; i < ARRAYSIZE(table); i++)
+            {
+                CLinearRegEx regex;
+                Assert::IsTrue(regex.Compile(table[i].pattern, wcslen(table[i].pattern), true) == CLinearRegEx::CompileOk);
+
+                const CLinearRegEx::LiteralFacts& facts = regex.GetLiteralFacts();
+                Assert::IsTrue(facts.prefix == table[i].prefix);
+                Assert::IsTrue(facts.suffix == table[i].suffix);
+                Assert::IsTrue(facts.required == table[i].required);
+                Assert::IsTrue(facts.anchoredStart == table[i].anchoredStart);
+                Assert::IsTrue(facts.anchoredEnd == table[i].anchoredEnd);
+            }
+        }
+
+        TEST_METHOD(VerifyPrefilter)
+        {
+            struct PatternNameExpected
+            {
+                PCWSTR pattern;
+                bool caseSensitive;
+                PCWSTR name;
+                bool mayMatch;
+            };
+
+            PatternNameExpected table[] =
+            {
+                { L"IMG_\\d+", true, L"IMG_0042.jpg", true },
+                { L"IMG_\\d+", true, L"img_0042.jpg", false },
+                { L"IMG_\\d+", false, L"img_0042.jpg", true },
+                { L"IMG_\\d+", true, L"DSC_0042.jpg", false },
+                { L"\\.jpeg$", true, L"photo.jpeg", true },
+                { L"\\.jpeg$", true, L"photo.jpeg.bak", false },
+                { L"^foo(bar|baz)$", true, L"foobaz", true },
+                { L"^foo(bar|baz)$", true, L"xfoobaz", false },
+                { L"^foo(bar|baz)$", false, L"FOOBAR", true },
+                { L"a*b?", true, L"zzz", true },
+            };
+
+            for (int i = 0; i < ARRAYSIZE(table); i++)
+            {
+                CLinearRegEx regex;
+                Assert::IsTrue(regex.Compile(table[i].pattern, wcslen(table[i].pattern), table[i].caseSensitive) == CLinearRegEx::CompileOk);
+
+                CRegExPrefilter prefilter;
+                prefilter.Init(regex.GetLiteralFacts(), table[i].caseSensitive);
+                Assert::IsTrue(prefilter.MayMatch(table[i].name, wcslen(table[i].name)) == table[i].mayMatch);
+            }
+        }
+
+        TEST_METHOD(VerifyShapeMatchers)
+        {
+            struct ShapeExpected
+            {
+                PCWSTR pattern;
+                CShapeMatcher::Shape shape;
+            };
+
+            ShapeExpected table[] =
+            {
+                { L"final", CShapeMatcher::ShapeLiteral },
+                { L"^IMG_", CShapeMatcher::ShapePrefix },
+                { L"\\.jpeg$", CShapeMatcher::ShapeSuffix },
+                { L"^(?:ab){2}$", CShapeMatcher::ShapeWhole },
+                { L"(final)", CShapeMatcher::ShapeNone },
+                { L"\\bfinal\\b", CShapeMatcher::ShapeNone },
+                { L"a^b", CShapeMatcher::ShapeNone },
+                { L"(?:^a){2}", CShapeMatcher::ShapeNone },
+                { L"^$", CShapeMatcher::ShapeNone },
+            };
+
+            PCWSTR names[] = { L"IMG_final.jpeg", L"img_FINAL_final.JPEG", L"abab", L"ABAB", L"", L"a^b" };
+            PCWSTR replace = L"[$`|$&|$']";
+
+            for (int i = 0; i < ARRAYSIZE(table); i++)
+            {
+                for (int flags = 0; flags < 4; flags++)
+                {
+                    bool caseSensitive = (flags & 1) != 0;
+                    bool matchAll = (flags & 2) != 0;
+
+                    CLinearRegEx regex;
+                    Assert::IsTrue(regex.Compile(table[i].pattern, wcslen(table[i].pattern), caseSensitive) == CLinearRegEx::CompileOk);
+
+                    CShapeMatcher matcher;
+                    matcher.Init(regex.GetLiteralFacts(), caseSensitive, matchAll);
+                    Assert::IsTrue(matcher.GetShape() == table[i].shape);
+                    if (!matcher.IsActive())
+                    {
+                        continue;
+                    }
+
+                    // Must agree with the engine on every name
+                    CReplaceTemplate replaceTemplate;
+                    replaceTemplate.Parse(replace, wcslen(replace), regex.GetGroupCount(), &regex.GetGroupNames());
+                    for (int j = 0; j < ARRAYSIZE(names); j++)
+                    {
+                        std::wstring expected;
+                        std::wstring result;
+                        bool engineMatched = regex.Replace(names[j], wcslen(names[j]), replaceTemplate, matchAll, expected);
+                        Assert::IsTrue(matcher.Replace(names[j], wcslen(names[j]), replaceTemplate, result) == engineMatched);
+                        Assert::IsTrue(result == expected);
+                    }
+                }
+            }
+        }
+
+        TEST_METHOD(BenchmarkShapeMatchers)
+        {
+            std::vector<std::wstring> names;
+            for (int i = 0; i < 100000; i++)
+            {
+                wchar_t name[MAX_PATH];
+                StringCchPrintf(name, ARRAYSIZE(name), L"IMG_%05d_holiday-final.jpeg", i);
+                names.push_back(name);
+            }
+
+            PCWSTR patterns[] = { L"holiday", L"^IMG_", L"\\.jpeg$", L"^IMG_00001_holiday-final\\.jpeg$" };
+            for (int i = 0; i < ARRAYSIZE(patterns); i++)
+            {
+                CLinearRegEx regex;
+                Assert::IsTrue(regex.Compile(patterns[i], wcslen(patterns[i]), false) == CLinearRegEx::CompileOk);
+
+                CShapeMatcher matcher;
+                matcher.Init(regex.GetLiteralFacts(), false, true);
+                Assert::IsTrue(matcher.IsActive());
+
+                CReplaceTemplate replaceTemplate;
+                replaceTemplate.Parse(L"X", 1, 0, nullptr);
+
+                std::wstring result;
+                auto start = std::chrono::steady_clock::now();
+                for (const std::wstring& name : names)
+                {
+                    regex.Replace(name.c_str(), name.length(), replaceTemplate, true, result);
+                }
+                auto engineDone = std::chrono::steady_clock::now();
+                for (const std::wstring& name : names)
+                {
+                    matcher.Replace(name.c_str(), name.length(), replaceTemplate, result);
+                }
+                auto shapeDone = std::chrono::steady_clock::now();
+
+                long long engineMs = std::chrono::duration_cast<std::chrono::milliseconds>(engineDone - start).count();
+                long long shapeMs = std::chrono::duration_cast<std::chrono::milliseconds>(shapeDone - engineDone).count();
+
+                wchar_t message[MAX_PATH];
+                StringCchPrintf(message, ARRAYSIZE(message), L"%s (shape %d): engine %lld ms, shape matcher %lld ms\n", patterns[i], matcher.GetShape(), engineMs, shapeMs);
+                Logger::WriteMessage(message);
+            }
+        }
+    };
+}
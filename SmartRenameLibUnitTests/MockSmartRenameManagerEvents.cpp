@@ -34,31 +34,47 @@ IFACEMETHODIMP CMockSmartRenameManagerEvents::OnItemAdded(_In_ ISmartRenameItem*
     return S_OK;
 }
 
+IFACEMETHODIMP CMockSmartRenameManagerEvents::OnItemsAdded(_In_ UINT firstIndex, _In_ UINT count)
+{
+    m_itemsAddedCalls++;
+    m_itemsAddedFirst = firstIndex;
+    m_itemsAddedCount = count;
+    return S_OK;
+}
+
 IFACEMETHODIMP CMockSmartRenameManagerEvents::OnUpdate(_In_ ISmartRenameItem* pItem)
 {
     m_itemUpdated = pItem;
     return S_OK;
 }
 
+IFACEMETHODIMP CMockSmartRenameManagerEvents::OnItemsUpdated(_In_ UINT firstIndex, _In_ UINT count)
+{
+    m_itemsUpdatedCalls++;
+    m_itemsUpdatedFirst = firstIndex;
+    m_itemsUpdatedCount = count;
+    return S_OK;
+}
+
 IFACEMETHODIMP CMockSmartRenameManagerEvents::OnError(_In_ ISmartRenameItem* pItem)
 {
     m_itemError = pItem;
     return S_OK;
 }
 
-IFACEMETHODIMP CMockSmartRenameManagerEvents::OnRegExStarted(_In_ DWORD threadId)
+IFACEMETHODIMP CMockSmartRenameManagerEvents::OnRegExStarted(_In_ DWORD passId)
 {
     m_regExStarted = true;
     return S_OK;
 }
 
-IFACEMETHODIMP CMockSmartRenameManagerEvents::OnRegExCanceled(_In_ DWORD threadId)
+IFACEMETHODIMP CMockSmartRenameManagerEvents::OnRegExCanceled(_In_ DWORD passId)
 {
     m_regExCanceled = true;
     return S_OK;
 }
 
-IFACEMETHODIMP CMockSmartRenameManagerEvents::OnRegExCompleted(_In_ DWORD threadId)
+IFACEMETHODIMP CMockSmartRenameManagerEvents::OnRegExCompleted(_In_ DWORD passId)
 {
     m_regExCompleted = true;
     return S_OK;
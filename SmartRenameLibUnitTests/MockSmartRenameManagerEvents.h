@@ -17,11 +17,13 @@ public:
     
     // ISmartRenameManagerEvents
     IFACEMETHODIMP OnItemAdded(_In_ ISmartRenameItem* renameItem);
+    IFACEMETHODIMP OnItemsAdded(_In_ UINT firstIndex, _In_ UINT count);
     IFACEMETHODIMP OnUpdate(_In_ ISmartRenameItem* renameItem);
+    IFACEMETHODIMP OnItemsUpdated(_In_ UINT firstIndex, _In_ UINT count);
     IFACEMETHODIMP OnError(_In_ ISmartRenameItem* renameItem);
-    IFACEMETHODIMP OnRegExStarted(_In_ DWORD threadId);
-    IFACEMETHODIMP OnRegExCanceled(_In_ DWORD threadId);
-    IFACEMETHODIMP OnRegExCompleted(_In_ DWORD threadId);
+    IFACEMETHODIMP OnRegExStarted(_In_ DWORD passId);
+    IFACEMETHODIMP OnRegExCanceled(_In_ DWORD passId);
+    IFACEMETHODIMP OnRegExCompleted(_In_ DWORD passId);
     IFACEMETHODIMP OnRenameStarted();
     IFACEMETHODIMP OnRenameCompleted();
 
@@ -34,6 +36,12 @@ public:
     CComPtr<ISmartRenameItem> m_itemAdded;
     CComPtr<ISmartRenameItem> m_itemUpdated;
     CComPtr<ISmartRenameItem> m_itemError;
+    UINT m_itemsAddedCalls = 0;
+    UINT m_itemsAddedFirst = 0;
+    UINT m_itemsAddedCount = 0;
+    UINT m_itemsUpdatedCalls = 0;
+    UINT m_itemsUpdatedFirst = 0;
+    UINT m_itemsUpdatedCount = 0;
     bool m_regExStarted = false;
     bool m_regExCanceled = false;
     bool m_regExCompleted = false;
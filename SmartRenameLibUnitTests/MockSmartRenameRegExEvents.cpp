@@ -54,6 +54,18 @@ IFACEMETHODIMP CMockSmartRenameRegExEvents::OnFlagsChanged(_In_ DWORD flags)
     return S_OK;
 }
 
+IFACEMETHODIMP CMockSmartRenameRegExEvents::OnPatternError(_In_ HRESULT hr)
+{
+    m_patternError = hr;
+    return S_OK;
+}
+
+IFACEMETHODIMP CMockSmartRenameRegExEvents::OnRulesChanged()
+{
+    m_rulesChangedCount++;
+    return S_OK;
+}
+
 HRESULT CMockSmartRenameRegExEvents::s_CreateInstance(_Outptr_ ISmartRenameRegExEvents** ppsrree)
 {
     *ppsrree = nullptr;
@@ -15,6 +15,8 @@ public:
     IFACEMETHODIMP OnSearchTermChanged(_In_ PCWSTR searchTerm);
     IFACEMETHODIMP OnReplaceTermChanged(_In_ PCWSTR replaceTerm);
     IFACEMETHODIMP OnFlagsChanged(_In_ DWORD flags);
+    IFACEMETHODIMP OnPatternError(_In_ HRESULT hr);
+    IFACEMETHODIMP OnRulesChanged();
 
     static HRESULT s_CreateInstance(_Outptr_ ISmartRenameRegExEvents** ppsrree);
 
@@ -32,5 +34,7 @@ public:
     PWSTR m_searchTerm = nullptr;
     PWSTR m_replaceTerm = nullptr;
     DWORD m_flags = 0;
+    HRESULT m_patternError = S_OK;
+    UINT m_rulesChangedCount = 0;
     long m_refCount;
 };
@@ -3,9 +3,16 @@
 #include <SmartRenameInterfaces.h>
 #include <SmartRenameManager.h>
 #include <SmartRenameItem.h>
+#include <SmartRenameItemStore.h>
 #include "MockSmartRenameItem.h"
 #include "MockSmartRenameManagerEvents.h"
 #include "TestFileHelper.h"
+#include <Helpers.h>
+#include <PathItem.h>
+#include <chrono>
+#include <climits>
+#include <strsafe.h>
+#include <thread>
 
 #define DEFAULT_FLAGS MatchAllOccurences
 
@@ -125,6 +132,766 @@ namespace SmartRenameManagerTests
             Assert::IsTrue(mgr->Shutdown() == S_OK);
         }
 
+        TEST_METHOD(VerifyItemLookup)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            CComPtr<ISmartRenameItem> items[3];
+            int ids[3] = {};
+            for (int i = 0; i < ARRAYSIZE(items); i++)
+            {
+                Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo", 0, false, &items[i]) == S_OK);
+                items[i]->get_id(&ids[i]);
+            }
+
+            // Added out of order, items are still indexed in id order
+            Assert::IsTrue(mgr->AddItem(items[2]) == S_OK);
+            Assert::IsTrue(mgr->AddItem(items[0]) == S_OK);
+            Assert::IsTrue(mgr->AddItem(items[1]) == S_OK);
+            Assert::IsTrue(mgr->AddItem(items[1]) == E_FAIL);
+
+            UINT count = 0;
+            Assert::IsTrue(mgr->GetItemCount(&count) == S_OK);
+            Assert::IsTrue(count == ARRAYSIZE(items));
+
+            for (UINT u = 0; u < count; u++)
+            {
+                CComPtr<ISmartRenameItem> byIndex;
+                Assert::IsTrue(mgr->GetItemByIndex(u, &byIndex) == S_OK);
+                Assert::IsTrue(byIndex == items[u]);
+
+                CComPtr<ISmartRenameItem> byId;
+                Assert::IsTrue(mgr->GetItemById(ids[u], &byId) == S_OK);
+                Assert::IsTrue(byId == items[u]);
+            }
+
+            CComPtr<ISmartRenameItem> missing;
+            Assert::IsTrue(mgr->GetItemByIndex(count, &missing) == E_FAIL);
+            Assert::IsTrue(mgr->GetItemById(ids[2] + 1, &missing) == E_FAIL);
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyItemFacades)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            int id = 0;
+            {
+                CComPtr<ISmartRenameItem> item;
+                Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.txt", 1, false, &item) == S_OK);
+                item->get_id(&id);
+                Assert::IsTrue(mgr->AddItem(item) == S_OK);
+            }
+
+            // The item was released after it was added.  Its state stays with the
+            // manager and comes back on a new object.
+            {
+                CComPtr<ISmartRenameItem> item;
+                Assert::IsTrue(mgr->GetItemByIndex(0, &item) == S_OK);
+                PWSTR originalName = nullptr;
+                Assert::IsTrue(item->get_originalName(&originalName) == S_OK);
+                Assert::IsTrue(wcscmp(originalName, L"foo.txt") == 0);
+                CoTaskMemFree(originalName);
+                item->put_newName(L"bar.txt");
+                item->put_selected(false);
+            }
+
+            CComPtr<ISmartRenameItem> item;
+            Assert::IsTrue(mgr->GetItemById(id, &item) == S_OK);
+            PWSTR newName = nullptr;
+            Assert::IsTrue(item->get_newName(&newName) == S_OK);
+            Assert::IsTrue(wcscmp(newName, L"bar.txt") == 0);
+            CoTaskMemFree(newName);
+            bool selected = true;
+            UINT depth = 0;
+            Assert::IsTrue(item->get_selected(&selected) == S_OK && !selected);
+            Assert::IsTrue(item->get_depth(&depth) == S_OK && depth == 1);
+
+            // While it is referenced the same object is handed out
+            CComPtr<ISmartRenameItem> again;
+            Assert::IsTrue(mgr->GetItemByIndex(0, &again) == S_OK);
+            Assert::IsTrue(again == item);
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyItemStringViews)
+        {
+            CComPtr<ISmartRenameItem> item;
+            Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.txt", 0, false, &item) == S_OK);
+
+            // Views can only be taken while the item is pinned
+            SMARTRENAME_STRING_VIEW originalName = {};
+            Assert::IsTrue(item->get_originalNameView(&originalName) == E_UNEXPECTED);
+            Assert::IsTrue(item->Pin() == S_OK);
+            Assert::IsTrue(item->get_originalNameView(&originalName) == S_OK);
+            Assert::IsTrue(originalName.length == 7 && wcscmp(originalName.text, L"foo.txt") == 0);
+            SMARTRENAME_STRING_VIEW newName = {};
+            Assert::IsTrue(item->get_newNameView(&newName) == E_FAIL);
+            Assert::IsTrue(item->Unpin() == S_OK);
+
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+            Assert::IsTrue(mgr->AddItem(item) == S_OK);
+
+            Assert::IsTrue(item->Pin() == S_OK);
+            item->put_newName(L"bar.txt");
+            Assert::IsTrue(item->get_newNameView(&newName) == S_OK);
+            Assert::IsTrue(newName.length == 7 && wcscmp(newName.text, L"bar.txt") == 0);
+
+            // A replaced name stays readable until the item is unpinned, even after
+            // enough renames that the text would otherwise be compacted
+            for (int i = 0; i < 100000; i++)
+            {
+                item->put_newName((i % 2) ? L"baz.txt" : L"qux.txt");
+            }
+            Assert::IsTrue(wcscmp(newName.text, L"bar.txt") == 0);
+            SMARTRENAME_STRING_VIEW latest = {};
+            Assert::IsTrue(item->get_newNameView(&latest) == S_OK);
+            Assert::IsTrue(latest.generation != newName.generation && wcscmp(latest.text, L"baz.txt") == 0);
+            Assert::IsTrue(item->Unpin() == S_OK);
+            Assert::IsTrue(item->Unpin() == E_UNEXPECTED);
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyItemDisplay)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            int id = 0;
+            {
+                CComPtr<ISmartRenameItem> item;
+                Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.txt", 2, true, &item) == S_OK);
+                item->get_id(&id);
+                Assert::IsTrue(mgr->AddItem(item) == S_OK);
+            }
+
+            // Read without an item, and the new name only shows once it would be used
+            wchar_t text[MAX_PATH] = {};
+            SMARTRENAME_ITEM_DISPLAY display = {};
+            Assert::IsTrue(mgr->GetItemDisplay(0, false, &display, text, ARRAYSIZE(text)) == S_OK);
+            Assert::IsTrue(display.id == id && display.depth == 2 && display.selected && !display.shouldRename);
+            Assert::IsTrue(wcscmp(text, L"foo.txt") == 0);
+            Assert::IsTrue(mgr->GetItemDisplay(0, true, &display, text, ARRAYSIZE(text)) == S_OK);
+            Assert::IsTrue(text[0] == L'\0');
+
+            {
+                CComPtr<ISmartRenameItem> item;
+                Assert::IsTrue(mgr->GetItemById(id, &item) == S_OK);
+                item->put_newName(L"bar.txt");
+            }
+            Assert::IsTrue(mgr->GetItemDisplay(0, true, &display, text, ARRAYSIZE(text)) == S_OK);
+            Assert::IsTrue(display.shouldRename && wcscmp(text, L"bar.txt") == 0);
+
+            // Names that don't fit are cut short, and the text is optional
+            wchar_t shortText[4] = {};
+            Assert::IsTrue(mgr->GetItemDisplay(0, false, &display, shortText, ARRAYSIZE(shortText)) == S_OK);
+            Assert::IsTrue(wcscmp(shortText, L"foo") == 0);
+            Assert::IsTrue(mgr->GetItemDisplay(0, false, &display, nullptr, 0) == S_OK);
+
+            // The flags apply like they do to ShouldRenameItem
+            Assert::IsTrue(mgr->put_flags(SmartRenameFlags::ExcludeFolders) == S_OK);
+            Assert::IsTrue(mgr->GetItemDisplay(0, true, &display, text, ARRAYSIZE(text)) == S_OK);
+            Assert::IsTrue(!display.shouldRename && text[0] == L'\0');
+
+            Assert::IsTrue(mgr->GetItemDisplay(1, false, &display, text, ARRAYSIZE(text)) == E_FAIL);
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyItemStoreChunks)
+        {
+            std::shared_ptr<CSmartRenameItemStore> store = std::make_shared<CSmartRenameItemStore>();
+            PCWSTR names[] = { L"foo.txt", L"bar", L".profile" };
+            for (PCWSTR name : names)
+            {
+                CComPtr<ISmartRenameItem> item;
+                Assert::IsTrue(CMockSmartRenameItem::CreateInstance(name, name, 0, false, &item) == S_OK);
+                Assert::IsTrue(store->Add(item) == S_OK);
+            }
+
+            // Items the store doesn't have are left out of the names
+            UINT indexes[] = { 2, 7, 0 };
+            UINT nameOffsets[ARRAYSIZE(indexes)] = {};
+            UINT extensionOffsets[ARRAYSIZE(indexes)] = {};
+            std::wstring chunkNames;
+            Assert::IsTrue(store->GetNamesAt(indexes, ARRAYSIZE(indexes), &chunkNames, nameOffsets, extensionOffsets) == S_FALSE);
+            Assert::IsTrue(wcscmp(&chunkNames[nameOffsets[0]], L".profile") == 0 && extensionOffsets[0] == 8);
+            Assert::IsTrue(nameOffsets[1] == CSmartRenameItemStore::c_noName);
+            Assert::IsTrue(wcscmp(&chunkNames[nameOffsets[2]], L"foo.txt") == 0 && extensionOffsets[2] == 3);
+
+            // Only the items whose new name changed are listed
+            UINT putIndexes[] = { 0, 1, 2 };
+            PCWSTR newNames[] = { L"baz.txt", nullptr, L"qux" };
+            std::vector<UINT> changed;
+            Assert::IsTrue(store->PutNewNamesAt(putIndexes, newNames, ARRAYSIZE(putIndexes), &changed) == S_OK);
+            Assert::IsTrue(changed.size() == 2 && changed[0] == 0 && changed[1] == 2);
+            Assert::IsTrue(store->GetRenameCount(0) == 2);
+
+            newNames[0] = nullptr;
+            Assert::IsTrue(store->PutNewNamesAt(putIndexes, newNames, ARRAYSIZE(putIndexes), &changed) == S_OK);
+            Assert::IsTrue(changed.size() == 1 && changed[0] == 0);
+            Assert::IsTrue(store->GetRenameCount(0) == 1);
+        }
+
+        TEST_METHOD(VerifyItemsFromPath)
+        {
+            CComPtr<ISmartRenameItemPathFactory> factory;
+            Assert::IsTrue(CSmartRenameItem::s_CreateInstance(nullptr, IID_PPV_ARGS(&factory)) == S_OK);
+
+            // The name is the one the listing found, the shell is not asked
+            PATH_ITEM pathItem = MakePathItem(L"c:\\foo\\bar/baz.txt");
+            CComPtr<ISmartRenameItem> item;
+            Assert::IsTrue(factory->CreateFromPath(pathItem.path.c_str(), pathItem.GetName(), false, 2, &item) == S_OK);
+            PWSTR originalName = nullptr;
+            Assert::IsTrue(item->get_originalName(&originalName) == S_OK);
+            Assert::IsTrue(wcscmp(originalName, L"baz.txt") == 0);
+            CoTaskMemFree(originalName);
+            bool isFolder = true;
+            UINT depth = 0;
+            Assert::IsTrue(item->get_isFolder(&isFolder) == S_OK && !isFolder);
+            Assert::IsTrue(item->get_depth(&depth) == S_OK && depth == 2);
+
+            // Items from paths are renamed like any other
+            CTestFileHelper testFileHelper;
+            Assert::IsTrue(testFileHelper.AddFolder(L"foo"));
+            Assert::IsTrue(testFileHelper.AddFile(L"foo\\foo.txt"));
+
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+            CComPtr<ISmartRenameItem> folder;
+            CComPtr<ISmartRenameItem> file;
+            PATH_ITEM folderPath = MakePathItem(testFileHelper.GetFullPath(L"foo").c_str());
+            PATH_ITEM filePath = MakeChildPathItem(folderPath, L"foo.txt", 7);
+            Assert::IsTrue(factory->CreateFromPath(folderPath.path.c_str(), folderPath.GetName(), true, 0, &folder) == S_OK);
+            Assert::IsTrue(factory->CreateFromPath(filePath.path.c_str(), filePath.GetName(), false, 1, &file) == S_OK);
+            Assert::IsTrue(mgr->AddItem(folder) == S_OK);
+            Assert::IsTrue(mgr->AddItem(file) == S_OK);
+
+            CComPtr<ISmartRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_renameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_flags(DEFAULT_FLAGS);
+            renRegEx->put_searchTerm(L"foo");
+            renRegEx->put_replaceTerm(L"bar");
+
+            Sleep(1000);
+            Assert::IsTrue(mgr->Rename(0) == S_OK);
+            Sleep(1000);
+
+            Assert::IsTrue(testFileHelper.PathExists(L"bar\\bar.txt"));
+            Assert::IsTrue(!testFileHelper.PathExists(L"foo"));
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyEnumeratedPreviewOrder)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            // Enough items to be split across several preview workers
+            const UINT itemCount = 5000;
+            std::vector<CComPtr<ISmartRenameItem>> items(itemCount);
+            for (UINT u = 0; u < itemCount; u++)
+            {
+                // Every third item is left alone so numbering has gaps to get wrong
+                Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", (u % 3) ? L"foo.txt" : L"other.txt", 0, false, &items[u]) == S_OK);
+                Assert::IsTrue(mgr->AddItem(items[u]) == S_OK);
+            }
+
+            CComPtr<ISmartRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_renameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_flags(DEFAULT_FLAGS | EnumerateItems);
+            renRegEx->put_searchTerm(L"foo");
+            renRegEx->put_replaceTerm(L"bar");
+
+            Sleep(1000);
+
+            // Renamed items are numbered in item order no matter which worker handled them
+            unsigned long enumIndex = 1;
+            for (UINT u = 0; u < itemCount; u++)
+            {
+                PWSTR newName = nullptr;
+                HRESULT hr = items[u]->get_newName(&newName);
+                if (u % 3)
+                {
+                    wchar_t expected[MAX_PATH] = { 0 };
+                    unsigned long countUsed = 0;
+                    Assert::IsTrue(GetEnumeratedFileName(expected, ARRAYSIZE(expected), L"bar.txt", nullptr, enumIndex++, &countUsed) != FALSE);
+                    Assert::IsTrue(hr == S_OK && wcscmp(newName, expected) == 0);
+                }
+                else
+                {
+                    Assert::IsTrue(FAILED(hr));
+                }
+                CoTaskMemFree(newName);
+            }
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyExcludedItemsPreview)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            // Files, folders and subfolder content interleaved, and enough of them for
+            // several preview workers
+            const UINT itemCount = 3000;
+            std::vector<CComPtr<ISmartRenameItem>> items(itemCount);
+            for (UINT u = 0; u < itemCount; u++)
+            {
+                Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", (u % 2) ? L"foo" : L"foo.txt", (u % 3) ? 0 : 1, (u % 2) != 0, &items[u]) == S_OK);
+                Assert::IsTrue(mgr->AddItem(items[u]) == S_OK);
+            }
+
+            CComPtr<ISmartRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_renameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_searchTerm(L"foo");
+            renRegEx->put_replaceTerm(L"bar");
+
+            // Excluded items get no new name and aren't counted when numbering the rest
+            const DWORD excludes[] = { ExcludeFolders, ExcludeSubfolders, ExcludeFiles | ExcludeSubfolders, 0 };
+            for (DWORD exclude : excludes)
+            {
+                mgr->put_flags(DEFAULT_FLAGS | EnumerateItems | exclude);
+                Sleep(1000);
+
+                unsigned long enumIndex = 1;
+                for (UINT u = 0; u < itemCount; u++)
+                {
+                    bool isFolder = (u % 2) != 0;
+                    bool excluded = ((exclude & ExcludeFolders) && isFolder) ||
+                        ((exclude & ExcludeFiles) && !isFolder) ||
+                        ((exclude & ExcludeSubfolders) && (u % 3) == 0);
+
+                    PWSTR newName = nullptr;
+                    HRESULT hr = items[u]->get_newName(&newName);
+                    if (excluded)
+                    {
+                        Assert::IsTrue(FAILED(hr));
+                    }
+                    else
+                    {
+                        wchar_t expected[MAX_PATH] = { 0 };
+                        unsigned long countUsed = 0;
+                        Assert::IsTrue(GetEnumeratedFileName(expected, ARRAYSIZE(expected), isFolder ? L"bar" : L"bar.txt", nullptr, enumIndex++, &countUsed) != FALSE);
+                        Assert::IsTrue(hr == S_OK && wcscmp(newName, expected) == 0);
+                    }
+                    CoTaskMemFree(newName);
+                }
+            }
+
+            // Reset removes the items but keeps the terms
+            Assert::IsTrue(mgr->Reset() == S_OK);
+            UINT count = 0;
+            Assert::IsTrue(mgr->GetItemCount(&count) == S_OK && count == 0);
+            Assert::IsTrue(mgr->GetRenameItemCount(&count) == S_OK && count == 0);
+
+            CComPtr<ISmartRenameItem> item;
+            Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.txt", 0, false, &item) == S_OK);
+            Assert::IsTrue(mgr->AddItem(item) == S_OK);
+            Assert::IsTrue(mgr->RefreshPreview() == S_OK);
+            Sleep(500);
+            Assert::IsTrue(mgr->GetRenameItemCount(&count) == S_OK && count == 1);
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        // Handles the messages the manager posts to itself for a while
+        void PumpMessages(_In_ DWORD milliseconds)
+        {
+            ULONGLONG end = GetTickCount64() + milliseconds;
+            while (GetTickCount64() < end)
+            {
+                MSG msg;
+                while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+                {
+                    TranslateMessage(&msg);
+                    DispatchMessage(&msg);
+                }
+                Sleep(10);
+            }
+        }
+
+        TEST_METHOD(VerifyPatternErrorClearsNames)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            const UINT itemCount = 3000;
+            std::vector<CComPtr<ISmartRenameItem>> items(itemCount);
+            for (UINT u = 0; u < itemCount; u++)
+            {
+                Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.txt", 0, false, &items[u]) == S_OK);
+                Assert::IsTrue(mgr->AddItem(items[u]) == S_OK);
+            }
+
+            CComPtr<ISmartRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_renameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_flags(DEFAULT_FLAGS | UseRegularExpressions);
+            renRegEx->put_replaceTerm(L"bar");
+            renRegEx->put_searchTerm(L"fo+");
+            PumpMessages(1000);
+            UINT renameCount = 0;
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == itemCount);
+
+            // The error doesn't wait for a pass in flight.  The names are cleared
+            // once it stops, unless a valid term came along in the meantime.
+            renRegEx->put_searchTerm(L"o+");
+            renRegEx->put_searchTerm(L"(fo+");
+            PumpMessages(1000);
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == 0);
+
+            renRegEx->put_searchTerm(L"(fo+");
+            renRegEx->put_searchTerm(L"fo+");
+            PumpMessages(1000);
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == itemCount);
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyPriorityRangePreview)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            const UINT itemCount = 5000;
+            std::vector<CComPtr<ISmartRenameItem>> items(itemCount);
+            for (UINT u = 0; u < itemCount; u++)
+            {
+                Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.txt", 0, false, &items[u]) == S_OK);
+                Assert::IsTrue(mgr->AddItem(items[u]) == S_OK);
+            }
+
+            // Rows in the middle of the list, like a scrolled list view
+            UINT first = 0;
+            UINT count = 0;
+            Assert::IsTrue(mgr->SetPriorityRange(3000, 40) == S_OK);
+            Assert::IsTrue(mgr->GetPriorityRange(&first, &count) == S_OK);
+            Assert::IsTrue(first == 3000 && count == 40);
+
+            CComPtr<ISmartRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_renameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_searchTerm(L"foo");
+            renRegEx->put_replaceTerm(L"bar");
+
+            // Scrolling while the pass runs, including past the end of the list
+            Assert::IsTrue(mgr->SetPriorityRange(100, 40) == S_OK);
+            Assert::IsTrue(mgr->SetPriorityRange(4990, 100) == S_OK);
+
+            Sleep(1000);
+
+            // Every item is evaluated exactly once whatever order the workers took them in
+            for (UINT u = 0; u < itemCount; u++)
+            {
+                PWSTR newName = nullptr;
+                Assert::IsTrue(items[u]->get_newName(&newName) == S_OK);
+                Assert::IsTrue(wcscmp(newName, L"bar.txt") == 0);
+                CoTaskMemFree(newName);
+            }
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyPreviewSupersededByNewTerm)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            const UINT itemCount = 2000;
+            std::vector<CComPtr<ISmartRenameItem>> items(itemCount);
+            for (UINT u = 0; u < itemCount; u++)
+            {
+                Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.txt", 0, false, &items[u]) == S_OK);
+                Assert::IsTrue(mgr->AddItem(items[u]) == S_OK);
+            }
+
+            CComPtr<ISmartRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_renameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_searchTerm(L"foo");
+
+            // Like typing: each change queues a pass that replaces the one in flight
+            wchar_t replaceTerm[MAX_PATH] = { 0 };
+            for (int i = 0; i < 20; i++)
+            {
+                StringCchPrintf(replaceTerm, ARRAYSIZE(replaceTerm), L"bar%d", i);
+                renRegEx->put_replaceTerm(replaceTerm);
+            }
+
+            Sleep(1000);
+
+            // Every item shows the result of the last term
+            for (UINT u = 0; u < itemCount; u++)
+            {
+                PWSTR newName = nullptr;
+                Assert::IsTrue(items[u]->get_newName(&newName) == S_OK);
+                Assert::IsTrue(wcscmp(newName, L"bar19.txt") == 0);
+                CoTaskMemFree(newName);
+            }
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyPreviewFromAnotherThread)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            CComPtr<ISmartRenameItem> item;
+            Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.txt", 0, false, &item) == S_OK);
+            Assert::IsTrue(mgr->AddItem(item) == S_OK);
+
+            CComPtr<ISmartRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_renameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_searchTerm(L"foo");
+            renRegEx->put_replaceTerm(L"bar");
+
+            // An edit made off the thread that made the first ones is still evaluated
+            std::thread editor([&renRegEx]()
+            {
+                renRegEx->put_replaceTerm(L"baz");
+            });
+            editor.join();
+
+            Sleep(1000);
+
+            PWSTR newName = nullptr;
+            Assert::IsTrue(item->get_newName(&newName) == S_OK);
+            Assert::IsTrue(wcscmp(newName, L"baz.txt") == 0);
+            CoTaskMemFree(newName);
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyFirstPreviewFromManyThreads)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            CComPtr<ISmartRenameItem> item;
+            Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.txt", 0, false, &item) == S_OK);
+            Assert::IsTrue(mgr->AddItem(item) == S_OK);
+
+            CComPtr<ISmartRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_renameRegEx(&renRegEx) == S_OK);
+
+            // The first jobs race to start the worker thread; only one may win
+            std::vector<std::thread> editors;
+            for (int i = 0; i < 8; i++)
+            {
+                editors.emplace_back([&renRegEx]()
+                {
+                    renRegEx->put_searchTerm(L"foo");
+                    renRegEx->put_replaceTerm(L"bar");
+                });
+            }
+            for (std::thread& editor : editors)
+            {
+                editor.join();
+            }
+
+            Sleep(1000);
+
+            PWSTR newName = nullptr;
+            Assert::IsTrue(item->get_newName(&newName) == S_OK);
+            Assert::IsTrue(wcscmp(newName, L"bar.txt") == 0);
+            CoTaskMemFree(newName);
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyRefreshPreviewAfterItemsAdded)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            CComPtr<ISmartRenameItem> first;
+            Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.txt", 0, false, &first) == S_OK);
+            Assert::IsTrue(mgr->AddItem(first) == S_OK);
+
+            CComPtr<ISmartRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_renameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_searchTerm(L"foo");
+            renRegEx->put_replaceTerm(L"bar");
+
+            Sleep(1000);
+
+            // Items added after the pass, like the rest of a folder still being
+            // enumerated, are previewed by the next one
+            CComPtr<ISmartRenameItem> second;
+            Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo2", L"foo2.txt", 0, false, &second) == S_OK);
+            Assert::IsTrue(mgr->AddItem(second) == S_OK);
+
+            PWSTR newName = nullptr;
+            Assert::IsTrue(second->get_newName(&newName) != S_OK || newName == nullptr);
+            CoTaskMemFree(newName);
+
+            Assert::IsTrue(mgr->RefreshPreview() == S_OK);
+
+            Sleep(1000);
+
+            for (ISmartRenameItem* item : { first.p, second.p })
+            {
+                newName = nullptr;
+                Assert::IsTrue(item->get_newName(&newName) == S_OK);
+                Assert::IsTrue(wcsncmp(newName, L"bar", 3) == 0);
+                CoTaskMemFree(newName);
+            }
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+        }
+
+        TEST_METHOD(VerifyItemUpdateRing)
+        {
+            std::unique_ptr<CItemUpdateRing> ring(new CItemUpdateRing());
+            UINT first = UINT_MAX;
+            UINT last = 0;
+            Assert::IsTrue(ring->Drain(first, last) == 0);
+
+            Assert::IsTrue(ring->Push(7));
+            Assert::IsTrue(ring->Push(3));
+            Assert::IsTrue(ring->Push(12));
+            Assert::IsTrue(ring->Drain(first, last) == 3);
+            Assert::IsTrue(first == 3 && last == 12);
+
+            // A full ring refuses more until it is drained
+            for (size_t i = 0; i < CItemUpdateRing::c_capacity; i++)
+            {
+                Assert::IsTrue(ring->Push(static_cast<UINT>(i)));
+            }
+            Assert::IsFalse(ring->Push(0));
+            Assert::IsTrue(ring->Drain(first, last) == CItemUpdateRing::c_capacity);
+            Assert::IsTrue(ring->Push(0));
+        }
+
+        TEST_METHOD(VerifyItemUpdateRingAcrossThreads)
+        {
+            std::unique_ptr<CItemUpdateRing> ring(new CItemUpdateRing());
+            const UINT pushCount = 1000000;
+            std::thread producer([&ring, pushCount]()
+            {
+                for (UINT u = 0; u < pushCount; u++)
+                {
+                    while (!ring->Push(u))
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+
+            size_t drained = 0;
+            UINT first = UINT_MAX;
+            UINT last = 0;
+            while (drained < pushCount)
+            {
+                drained += ring->Drain(first, last);
+            }
+            producer.join();
+
+            Assert::IsTrue(drained == pushCount);
+            Assert::IsTrue(first == 0 && last == pushCount - 1);
+        }
+
+        TEST_METHOD(BenchmarkItemLookup)
+        {
+            // Time per item should stay flat as the item count grows
+            UINT counts[] = { 10000, 100000, 1000000 };
+            for (int i = 0; i < ARRAYSIZE(counts); i++)
+            {
+                CComPtr<ISmartRenameManager> mgr;
+                Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+                for (UINT u = 0; u < counts[i]; u++)
+                {
+                    CComPtr<ISmartRenameItem> item;
+                    Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo", 0, false, &item) == S_OK);
+                    mgr->AddItem(item);
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                for (UINT u = 0; u < counts[i]; u++)
+                {
+                    CComPtr<ISmartRenameItem> item;
+                    Assert::IsTrue(mgr->GetItemByIndex(u, &item) == S_OK);
+                    int id = 0;
+                    item->get_id(&id);
+                    CComPtr<ISmartRenameItem> byId;
+                    Assert::IsTrue(mgr->GetItemById(id, &byId) == S_OK);
+                }
+                auto done = std::chrono::steady_clock::now();
+
+                long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(done - start).count();
+                wchar_t message[MAX_PATH];
+                StringCchPrintf(message, ARRAYSIZE(message), L"%u items: %lld ms, %lld ns per item\n", counts[i], ns / 1000000, ns / counts[i]);
+                Logger::WriteMessage(message);
+
+                Assert::IsTrue(mgr->Shutdown() == S_OK);
+            }
+        }
+
+        TEST_METHOD(VerifyItemCounts)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+
+            CComPtr<ISmartRenameItem> file;
+            CComPtr<ISmartRenameItem> folder;
+            CComPtr<ISmartRenameItem> subFolderFile;
+            Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.txt", 0, false, &file) == S_OK);
+            Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo", 0, true, &folder) == S_OK);
+            Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.doc", 1, false, &subFolderFile) == S_OK);
+            Assert::IsTrue(mgr->AddItem(file) == S_OK);
+            Assert::IsTrue(mgr->AddItem(folder) == S_OK);
+            Assert::IsTrue(mgr->AddItem(subFolderFile) == S_OK);
+
+            UINT selectedCount = 0;
+            UINT renameCount = 0;
+            Assert::IsTrue(mgr->GetSelectedItemCount(&selectedCount) == S_OK && selectedCount == 3);
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == 0);
+
+            // A new name the same as the original is not a rename
+            file->put_newName(L"bar.txt");
+            folder->put_newName(L"bar");
+            subFolderFile->put_newName(L"foo.doc");
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == 2);
+            subFolderFile->put_newName(L"bar.doc");
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == 3);
+
+            folder->put_selected(false);
+            Assert::IsTrue(mgr->GetSelectedItemCount(&selectedCount) == S_OK && selectedCount == 2);
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == 2);
+
+            // Flag changes run a preview pass, which gives the same names as above
+            folder->put_selected(true);
+            CComPtr<ISmartRenameRegEx> renRegEx;
+            Assert::IsTrue(mgr->get_renameRegEx(&renRegEx) == S_OK);
+            renRegEx->put_searchTerm(L"foo");
+            renRegEx->put_replaceTerm(L"bar");
+            Sleep(500);
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == 3);
+            mgr->put_flags(DEFAULT_FLAGS | ExcludeFolders);
+            Sleep(500);
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == 2);
+            mgr->put_flags(DEFAULT_FLAGS | ExcludeSubfolders);
+            Sleep(500);
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == 2);
+            mgr->put_flags(DEFAULT_FLAGS | ExcludeFiles);
+            Sleep(500);
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == 1);
+            mgr->put_flags(DEFAULT_FLAGS);
+            Sleep(500);
+
+            file->Reset();
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == 2);
+
+            // Items no longer report to the manager once it has shut down
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+            Assert::IsTrue(mgr->GetSelectedItemCount(&selectedCount) == S_OK && selectedCount == 0);
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == 0);
+            file->put_newName(L"bar.txt");
+            Assert::IsTrue(mgr->GetRenameItemCount(&renameCount) == S_OK && renameCount == 0);
+        }
+
         TEST_METHOD(VerifySmartManagerEvents)
         {
             CComPtr<ISmartRenameManager> mgr;
@@ -150,6 +917,56 @@ namespace SmartRenameManagerTests
             mockMgrEvents->Release();
         }
 
+        TEST_METHOD(VerifyAddItems)
+        {
+            CComPtr<ISmartRenameManager> mgr;
+            Assert::IsTrue(CSmartRenameManager::s_CreateInstance(&mgr) == S_OK);
+            CMockSmartRenameManagerEvents* mockMgrEvents = new CMockSmartRenameManagerEvents();
+            CComPtr<ISmartRenameManagerEvents> mgrEvents;
+            Assert::IsTrue(mockMgrEvents->QueryInterface(IID_PPV_ARGS(&mgrEvents)) == S_OK);
+            DWORD cookie = 0;
+            Assert::IsTrue(mgr->Advise(mgrEvents, &cookie) == S_OK);
+
+            const UINT itemCount = 1000;
+            std::vector<CComPtr<ISmartRenameItem>> items(itemCount);
+            std::vector<ISmartRenameItem*> batch(itemCount);
+            for (UINT u = 0; u < itemCount; u++)
+            {
+                Assert::IsTrue(CMockSmartRenameItem::CreateInstance(L"foo", L"foo.txt", 0, (u % 2) == 0, &items[u]) == S_OK);
+                batch[u] = items[u];
+            }
+
+            // One event for the whole batch and none per item
+            Assert::IsTrue(mgr->AddItems(batch.data(), 600) == S_OK);
+            Assert::IsTrue(mockMgrEvents->m_itemsAddedCalls == 1);
+            Assert::IsTrue(mockMgrEvents->m_itemsAddedFirst == 0 && mockMgrEvents->m_itemsAddedCount == 600);
+            Assert::IsTrue(mockMgrEvents->m_itemAdded == nullptr);
+
+            // Items already added are skipped
+            Assert::IsTrue(mgr->AddItems(batch.data() + 500, itemCount - 500) == S_FALSE);
+            Assert::IsTrue(mockMgrEvents->m_itemsAddedCalls == 2);
+            Assert::IsTrue(mockMgrEvents->m_itemsAddedFirst == 600 && mockMgrEvents->m_itemsAddedCount == itemCount - 600);
+
+            UINT count = 0;
+            Assert::IsTrue(mgr->GetItemCount(&count) == S_OK && count == itemCount);
+            Assert::IsTrue(mgr->GetSelectedItemCount(&count) == S_OK && count == itemCount);
+            for (UINT u = 0; u < itemCount; u++)
+            {
+                CComPtr<ISmartRenameItem> item;
+                Assert::IsTrue(mgr->GetItemByIndex(u, &item) == S_OK);
+                bool isFolder = false;
+                Assert::IsTrue(item->get_isFolder(&isFolder) == S_OK && isFolder == ((u % 2) == 0));
+            }
+
+            // No event when nothing was added
+            Assert::IsTrue(mgr->AddItems(batch.data(), 10) == S_FALSE);
+            Assert::IsTrue(mockMgrEvents->m_itemsAddedCalls == 2);
+
+            Assert::IsTrue(mgr->Shutdown() == S_OK);
+
+            mockMgrEvents->Release();
+        }
+
         TEST_METHOD(VerifySingleRename)
         {
             // Create a single item and verify rename works as expected
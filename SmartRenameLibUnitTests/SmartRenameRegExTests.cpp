@@ -2,7 +2,12 @@
 #include "CppUnitTest.h"
 #include <SmartRenameInterfaces.h>
 #include <SmartRenameRegEx.h>
+#include <SmartRenameLinearRegEx.h>
+#include <LinearRegEx.h>
 #include "MockSmartRenameRegExEvents.h"
+#include <chrono>
+#include <regex>
+#include <thread>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -186,6 +191,174 @@ namespace SmartRenameRegExTests
                 CoTaskMemFree(result);
             }
         }
+
+        TEST_METHOD(VerifyReplaceBatch)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"foo") == S_OK);
+            Assert::IsTrue(renameRegEx->put_replaceTerm(L"big") == S_OK);
+
+            PCWSTR sources[] = { L"foobar", L"", L"barfoofoo", L"nomatch" };
+            wchar_t arena[64] = { 0 };
+            UINT offsets[ARRAYSIZE(sources)] = { 0 };
+            HRESULT results[ARRAYSIZE(sources)] = { 0 };
+            UINT processed = 0;
+            Assert::IsTrue(renameRegEx->ReplaceBatch(ARRAYSIZE(sources), sources, nullptr, arena, ARRAYSIZE(arena), offsets, results, &processed) == S_OK);
+            Assert::IsTrue(processed == ARRAYSIZE(sources));
+            Assert::IsTrue(results[0] == S_OK && wcscmp(arena + offsets[0], L"bigbar") == 0);
+            Assert::IsTrue(FAILED(results[1]));
+            Assert::IsTrue(results[2] == S_OK && wcscmp(arena + offsets[2], L"barbigbig") == 0);
+            Assert::IsTrue(results[3] == S_OK && wcscmp(arena + offsets[3], L"nomatch") == 0);
+
+            // Only the first result fits
+            processed = 0;
+            Assert::IsTrue(renameRegEx->ReplaceBatch(ARRAYSIZE(sources), sources, nullptr, arena, 8, offsets, results, &processed) == HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
+            Assert::IsTrue(processed == 2);
+            Assert::IsTrue(wcscmp(arena + offsets[0], L"bigbar") == 0);
+        }
+
+        TEST_METHOD(VerifyReplaceBatchCanceled)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(UseRegularExpressions | MatchAllOccurences) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"o+") == S_OK);
+            Assert::IsTrue(renameRegEx->put_replaceTerm(L"0") == S_OK);
+
+            PCWSTR sources[] = { L"foo", L"boo" };
+            wchar_t arena[64] = { 0 };
+            UINT offsets[ARRAYSIZE(sources)] = { 0 };
+            HRESULT results[ARRAYSIZE(sources)] = { 0 };
+            UINT processed = 0;
+
+            HANDLE cancelEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+            Assert::IsTrue(renameRegEx->ReplaceBatch(ARRAYSIZE(sources), sources, cancelEvent, arena, ARRAYSIZE(arena), offsets, results, &processed) == S_OK);
+            Assert::IsTrue(processed == ARRAYSIZE(sources));
+            Assert::IsTrue(wcscmp(arena + offsets[1], L"b0") == 0);
+
+            SetEvent(cancelEvent);
+            processed = 0;
+            Assert::IsTrue(renameRegEx->ReplaceBatch(ARRAYSIZE(sources), sources, cancelEvent, arena, ARRAYSIZE(arena), offsets, results, &processed) == HRESULT_FROM_WIN32(ERROR_CANCELLED));
+            Assert::IsTrue(processed == 0);
+            CloseHandle(cancelEvent);
+        }
+
+        TEST_METHOD(VerifyTimeLimit)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+
+            DWORD timeLimit = 1;
+            Assert::IsTrue(renameRegEx->get_timeLimit(&timeLimit) == S_OK);
+            Assert::IsTrue(timeLimit == 0);
+            Assert::IsTrue(renameRegEx->put_timeLimit(500) == S_OK);
+            Assert::IsTrue(renameRegEx->get_timeLimit(&timeLimit) == S_OK);
+            Assert::IsTrue(timeLimit == 500);
+
+            // Names well inside the limit are unaffected
+            Assert::IsTrue(renameRegEx->put_flags(UseRegularExpressions) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(\\w+)\\.txt") == S_OK);
+            Assert::IsTrue(renameRegEx->put_replaceTerm(L"$1.md") == S_OK);
+
+            PWSTR result = nullptr;
+            Assert::IsTrue(renameRegEx->Replace(L"notes.txt", &result) == S_OK);
+            Assert::IsTrue(wcscmp(result, L"notes.md") == 0);
+            CoTaskMemFree(result);
+        }
+
+        TEST_METHOD(VerifyLimitsUseLinearRegEx)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_timeLimit(2000) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(UseRegularExpressions) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(a+)+$") == S_OK);
+            Assert::IsTrue(renameRegEx->put_replaceTerm(L"X") == S_OK);
+
+            // Backtracks for far longer than the limit with std::wregex.  With a time
+            // limit the linear engine matches it instead.
+            std::wstring name(50000, L'a');
+            name += L"!a";
+            PWSTR result = nullptr;
+            auto start = std::chrono::steady_clock::now();
+            Assert::IsTrue(renameRegEx->Replace(name.c_str(), &result) == S_OK);
+            Assert::IsTrue(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(2000));
+            Assert::IsTrue(wcscmp(result + 50000, L"!X") == 0);
+            CoTaskMemFree(result);
+
+            // A signaled cancel event stops it part way through the name
+            PCWSTR sources[] = { name.c_str() };
+            std::vector<wchar_t> arena(name.length() * 2);
+            UINT offsets[ARRAYSIZE(sources)] = { 0 };
+            HRESULT results[ARRAYSIZE(sources)] = { 0 };
+            UINT processed = 0;
+            HANDLE cancelEvent = CreateEvent(nullptr, TRUE, TRUE, nullptr);
+            Assert::IsTrue(renameRegEx->ReplaceBatch(ARRAYSIZE(sources), sources, cancelEvent, arena.data(), static_cast<UINT>(arena.size()), offsets, results, &processed) == HRESULT_FROM_WIN32(ERROR_CANCELLED));
+            Assert::IsTrue(results[0] == HRESULT_FROM_WIN32(ERROR_CANCELLED));
+            Assert::IsTrue(processed == 0);
+            CloseHandle(cancelEvent);
+
+            // Backreferences still need std::wregex
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(o)\\1") == S_OK);
+            Assert::IsTrue(renameRegEx->Replace(L"foo.txt", &result) == S_OK);
+            Assert::IsTrue(wcscmp(result, L"fX.txt") == 0);
+            CoTaskMemFree(result);
+        }
+
+        TEST_METHOD(VerifyReplaceWhileTermsChange)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_flags(MatchAllOccurences) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"a") == S_OK);
+            Assert::IsTrue(renameRegEx->put_replaceTerm(L"x") == S_OK);
+
+            // Every Replace must see one whole search term, never a mix of old and new
+            std::thread writer([&renameRegEx]()
+            {
+                for (int i = 0; i < 2000; i++)
+                {
+                    renameRegEx->put_searchTerm((i % 2) ? L"a" : L"bb");
+                }
+            });
+
+            for (int i = 0; i < 2000; i++)
+            {
+                PWSTR result = nullptr;
+                Assert::IsTrue(renameRegEx->Replace(L"abba", &result) == S_OK);
+                Assert::IsTrue(wcscmp(result, L"xbbx") == 0 || wcscmp(result, L"axa") == 0);
+                CoTaskMemFree(result);
+            }
+
+            writer.join();
+        }
+
+        TEST_METHOD(VerifyReplaceAllLongName)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            DWORD flags = MatchAllOccurences;
+            Assert::IsTrue(renameRegEx->put_flags(flags) == S_OK);
+
+            // Long enough that matches straddle the vectorized blocks and the scalar tail
+            SearchReplaceExpected sreTable[] =
+            {
+                { L"ab", L"X", L"AbaBabABxxxxxxxxxxxxxxxxxabxxxxxxxxxxxxxxxxxxxxxxxxAB", L"XXXXxxxxxxxxxxxxxxxxxXxxxxxxxxxxxxxxxxxxxxxxxxX" },
+                { L"aab", L"-", L"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab", L"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa-" },
+                { L"xyzzy", L"q", L"0123456789ABCDEFXYZZY0123456789ABCDEFxyzzy", L"0123456789ABCDEFq0123456789ABCDEFq" },
+            };
+
+            for (int i = 0; i < ARRAYSIZE(sreTable); i++)
+            {
+                PWSTR result = nullptr;
+                Assert::IsTrue(renameRegEx->put_searchTerm(sreTable[i].search) == S_OK);
+                Assert::IsTrue(renameRegEx->put_replaceTerm(sreTable[i].replace) == S_OK);
+                Assert::IsTrue(renameRegEx->Replace(sreTable[i].test, &result) == S_OK);
+                Assert::IsTrue(wcscmp(result, sreTable[i].expected) == 0);
+                CoTaskMemFree(result);
+            }
+        }
     };
 
     TEST_CLASS(RegExEventsTests)
@@ -210,6 +383,41 @@ namespace SmartRenameRegExTests
             Assert::IsTrue(renameRegEx->UnAdvise(cookie) == S_OK);
             mockEvents->Release();
         }
+
+        TEST_METHOD(VerifyInvalidPatternFiresError)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            CMockSmartRenameRegExEvents* mockEvents = new CMockSmartRenameRegExEvents();
+            CComPtr<ISmartRenameRegExEvents> regExEvents;
+            Assert::IsTrue(mockEvents->QueryInterface(IID_PPV_ARGS(&regExEvents)) == S_OK);
+            DWORD cookie = 0;
+            Assert::IsTrue(renameRegEx->Advise(regExEvents, &cookie) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(foo") == S_OK);
+            Assert::IsTrue(mockEvents->m_patternError == S_OK);
+
+            // Turning on regular expressions makes the current search term invalid
+            DWORD flags = MatchAllOccurences | UseRegularExpressions;
+            Assert::IsTrue(renameRegEx->put_flags(flags) == S_OK);
+            Assert::IsTrue(mockEvents->m_patternError == SR_E_INVALIDPATTERN);
+            Assert::IsTrue(mockEvents->m_flags != flags);
+
+            PWSTR result = nullptr;
+            Assert::IsTrue(renameRegEx->Replace(L"foobar", &result) == SR_E_INVALIDPATTERN);
+            Assert::IsTrue(result == nullptr);
+
+            // Fixing the search term raises the regular change event again
+            mockEvents->m_patternError = S_OK;
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"(foo)") == S_OK);
+            Assert::IsTrue(mockEvents->m_patternError == S_OK);
+            Assert::IsTrue(lstrcmpi(L"(foo)", mockEvents->m_searchTerm) == 0);
+            Assert::IsTrue(renameRegEx->Replace(L"foobar", &result) == S_OK);
+            Assert::IsTrue(wcscmp(result, L"bar") == 0);
+            CoTaskMemFree(result);
+
+            Assert::IsTrue(renameRegEx->UnAdvise(cookie) == S_OK);
+            mockEvents->Release();
+        }
     };
 
     TEST_CLASS(RegExTests)
@@ -385,5 +593,184 @@ namespace SmartRenameRegExTests
                 CoTaskMemFree(result);
             }
         }
+
+        TEST_METHOD(VerifyRequiredLiteralUseRegEx)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            DWORD flags = UseRegularExpressions;
+            Assert::IsTrue(renameRegEx->put_flags(flags) == S_OK);
+
+            // Names without the required literal must come back unchanged, including
+            // for patterns the prefilter can't analyze such as backreferences
+            SearchReplaceExpected sreTable[] =
+            {
+                { L"IMG_(\\d+)", L"Photo $1", L"IMG_0042.jpg", L"Photo 0042.jpg" },
+                { L"IMG_(\\d+)", L"Photo $1", L"DSC_0042.jpg", L"DSC_0042.jpg" },
+                { L"img_(\\d+)", L"Photo $1", L"IMG_0042.jpg", L"Photo 0042.jpg" },
+                { L"\\.jpeg$", L".jpg", L"a.jpeg.bak", L"a.jpeg.bak" },
+                { L"\\.jpeg$", L".jpg", L"a.jpeg", L"a.jpg" },
+                { L"(o)\\1", L"0", L"foo", L"f0" },
+            };
+
+            for (int i = 0; i < ARRAYSIZE(sreTable); i++)
+            {
+                PWSTR result = nullptr;
+                Assert::IsTrue(renameRegEx->put_searchTerm(sreTable[i].search) == S_OK);
+                Assert::IsTrue(renameRegEx->put_replaceTerm(sreTable[i].replace) == S_OK);
+                Assert::IsTrue(renameRegEx->Replace(sreTable[i].test, &result) == S_OK);
+                Assert::IsTrue(wcscmp(result, sreTable[i].expected) == 0);
+                CoTaskMemFree(result);
+            }
+        }
+
+        TEST_METHOD(VerifyCaseConversionUseRegEx)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            DWORD flags = UseRegularExpressions | MatchAllOccurences;
+            Assert::IsTrue(renameRegEx->put_flags(flags) == S_OK);
+
+            SearchReplaceExpected sreTable[] =
+            {
+                { L"(\\w+)-(\\w+)", L"\\U$1\\E-$2", L"foo-bar.txt", L"FOO-bar.txt" },
+                { L"^(\\w)(\\w*)", L"\\U$1\\L$2", L"hELLO wORLD", L"Hello wORLD" },
+                { L"o", L"\\U$&", L"foo", L"fOO" },
+                { L"o", L"\\X$$", L"foo", L"f\\X$\\X$" },
+            };
+
+            for (int i = 0; i < ARRAYSIZE(sreTable); i++)
+            {
+                PWSTR result = nullptr;
+                Assert::IsTrue(renameRegEx->put_searchTerm(sreTable[i].search) == S_OK);
+                Assert::IsTrue(renameRegEx->put_replaceTerm(sreTable[i].replace) == S_OK);
+                Assert::IsTrue(renameRegEx->Replace(sreTable[i].test, &result) == S_OK);
+                Assert::IsTrue(wcscmp(result, sreTable[i].expected) == 0);
+                CoTaskMemFree(result);
+            }
+        }
+    };
+
+    TEST_CLASS(RuleTests)
+    {
+    public:
+        TEST_METHOD(VerifyLiteralRules)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            CMockSmartRenameRegExEvents* mockEvents = new CMockSmartRenameRegExEvents();
+            CComPtr<ISmartRenameRegExEvents> regExEvents;
+            Assert::IsTrue(mockEvents->QueryInterface(IID_PPV_ARGS(&regExEvents)) == S_OK);
+            DWORD cookie = 0;
+            Assert::IsTrue(renameRegEx->Advise(regExEvents, &cookie) == S_OK);
+
+            // Rules apply even without a search term
+            Assert::IsTrue(renameRegEx->AddRule(L"teh", L"the", MatchAllOccurences) == S_OK);
+            Assert::IsTrue(renameRegEx->AddRule(L"ACME_", L"", CaseSensitive) == S_OK);
+            Assert::IsTrue(renameRegEx->AddRule(L"_en-US", L"", MatchAllOccurences) == S_OK);
+            Assert::IsTrue(renameRegEx->AddRule(L"", L"x", 0) == E_INVALIDARG);
+            Assert::IsTrue(mockEvents->m_rulesChangedCount == 3);
+
+            UINT count = 0;
+            Assert::IsTrue(renameRegEx->GetRuleCount(&count) == S_OK);
+            Assert::IsTrue(count == 3);
+
+            SearchReplaceExpected sreTable[] =
+            {
+                { L"", L"", L"ACME_teh_report_en-US.docx", L"the_report.docx" },
+                { L"", L"", L"acme_TEH_teh.txt", L"acme_the_the.txt" },
+                { L"", L"", L"ACME_ACME_x.txt", L"ACME_x.txt" },
+            };
+
+            for (int i = 0; i < ARRAYSIZE(sreTable); i++)
+            {
+                PWSTR result = nullptr;
+                Assert::IsTrue(renameRegEx->Replace(sreTable[i].test, &result) == S_OK);
+                Assert::IsTrue(wcscmp(result, sreTable[i].expected) == 0);
+                CoTaskMemFree(result);
+            }
+
+            Assert::IsTrue(renameRegEx->ClearRules() == S_OK);
+            Assert::IsTrue(mockEvents->m_rulesChangedCount == 4);
+            PWSTR result = nullptr;
+            Assert::IsTrue(renameRegEx->Replace(L"teh.txt", &result) == E_INVALIDARG);
+
+            Assert::IsTrue(renameRegEx->UnAdvise(cookie) == S_OK);
+            mockEvents->Release();
+        }
+
+        TEST_METHOD(VerifyRulesChainAfterSearchTerm)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            Assert::IsTrue(renameRegEx->put_searchTerm(L"foo") == S_OK);
+            Assert::IsTrue(renameRegEx->put_replaceTerm(L"bar") == S_OK);
+
+            // Literal rules all run in one pass, then regular expression rules in order
+            Assert::IsTrue(renameRegEx->AddRule(L"bar", L"baz", MatchAllOccurences) == S_OK);
+            Assert::IsTrue(renameRegEx->AddRule(L"(\\d+)", L"#$1", MatchAllOccurences | UseRegularExpressions) == S_OK);
+            Assert::IsTrue(renameRegEx->AddRule(L"#0*", L"No", UseRegularExpressions) == S_OK);
+            Assert::IsTrue(renameRegEx->AddRule(L"(foo", L"", UseRegularExpressions) == SR_E_INVALIDPATTERN);
+
+            PWSTR result = nullptr;
+            Assert::IsTrue(renameRegEx->Replace(L"foo_007_12.txt", &result) == S_OK);
+            Assert::IsTrue(wcscmp(result, L"baz_No7_#12.txt") == 0);
+            CoTaskMemFree(result);
+        }
+
+        TEST_METHOD(VerifyEmptyMatchesUseLinearRegEx)
+        {
+            CComPtr<ISmartRenameRegEx> renameRegEx;
+            Assert::IsTrue(CSmartRenameLinearRegEx::s_CreateInstance(&renameRegEx) == S_OK);
+            DWORD flags = MatchAllOccurences | UseRegularExpressions;
+            Assert::IsTrue(renameRegEx->put_flags(flags) == S_OK);
+
+            // Like std::regex_iterator an empty match may follow a longer one where it
+            // ended, but not another empty one
+            SearchReplaceExpected sreTable[] =
+            {
+                { L"a*", L"X", L"aaa", L"XX" },
+                { L"a*", L"X", L"ab", L"XXbX" },
+                { L".*", L"Foo", L"AAAAAA", L"FooFoo" },
+                { L"(a*)*", L"[$1]", L"aab", L"[][]b[]" },
+                { L"(a|)+", L"[$1]", L"aab", L"[][]b[]" },
+                { L"(|a)+", L"[$&]", L"aab", L"[][a][][a][]b[]" },
+            };
+
+            for (int i = 0; i < ARRAYSIZE(sreTable); i++)
+            {
+                PWSTR result = nullptr;
+                Assert::IsTrue(renameRegEx->put_searchTerm(sreTable[i].search) == S_OK);
+                Assert::IsTrue(renameRegEx->put_replaceTerm(sreTable[i].replace) == S_OK);
+                Assert::IsTrue(renameRegEx->Replace(sreTable[i].test, &result) == S_OK);
+                Assert::IsTrue(wcscmp(result, sreTable[i].expected) == 0);
+                CoTaskMemFree(result);
+            }
+
+            // A loop pass that matches nothing ends the loop but its groups are kept,
+            // the same as std::wregex
+            PCWSTR patterns[] = { L"(a*)*", L"(a|)+" };
+            PCWSTR texts[] = { L"", L"b", L"aaa", L"aab" };
+            for (PCWSTR pattern : patterns)
+            {
+                CLinearRegEx linear;
+                Assert::IsTrue(linear.Compile(pattern, wcslen(pattern), true) == CLinearRegEx::CompileOk);
+                std::wregex standard(pattern);
+                for (PCWSTR text : texts)
+                {
+                    std::vector<size_t> captures;
+                    std::wcmatch match;
+                    Assert::IsTrue(linear.Search(text, wcslen(text), 0, captures));
+                    Assert::IsTrue(std::regex_search(text, match, standard));
+                    Assert::IsTrue(captures.size() == match.size() * 2);
+                    for (size_t group = 0; group < match.size(); group++)
+                    {
+                        size_t begin = match[group].matched ? static_cast<size_t>(match.position(group)) : CLinearRegEx::npos;
+                        size_t end = match[group].matched ? begin + match.length(group) : CLinearRegEx::npos;
+                        Assert::IsTrue(captures[group * 2] == begin && captures[group * 2 + 1] == end);
+                    }
+                }
+            }
+        }
     };
 }
\ No newline at end of file
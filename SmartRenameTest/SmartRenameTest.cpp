@@ -7,6 +7,8 @@
 #include <SmartRenameItem.h>
 #include <SmartRenameUI.h>
 #include <SmartRenameManager.h>
+#include <SmartRenameLinearRegEx.h>
+#include <Settings.h>
 #include <Shobjidl.h>
 
 #pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
@@ -35,6 +37,23 @@ int APIENTRY wWinMain(
         CComPtr<ISmartRenameManager> spsrm;
         if (SUCCEEDED(CSmartRenameManager::s_CreateInstance(&spsrm)))
         {
+            // Use the linear time regular expression engine if it has been turned on
+            if (CSettings::GetUseLinearRegEx())
+            {
+                CComPtr<ISmartRenameRegEx> spsrre;
+                if (SUCCEEDED(CSmartRenameLinearRegEx::s_CreateInstance(&spsrre)))
+                {
+                    spsrm->put_renameRegEx(spsrre);
+                }
+            }
+
+            // Keep one slow name from holding up the preview
+            CComPtr<ISmartRenameRegEx> spsrre;
+            if (SUCCEEDED(spsrm->get_renameRegEx(&spsrre)))
+            {
+                spsrre->put_timeLimit(CSettings::GetRegExTimeLimit());
+            }
+
             // Create the factory for our items
             CComPtr<ISmartRenameItemFactory> spsrif;
             if (SUCCEEDED(CSmartRenameItem::s_CreateInstance(nullptr, IID_PPV_ARGS(&spsrif))))
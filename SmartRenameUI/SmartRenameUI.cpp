@@ -77,6 +77,25 @@ inline int RECT_HEIGHT(RECT& r) { return r.bottom - r.top; }
 
 #define MAX_INPUT_STRING_LEN 1024
 
+// Custom messages from the enumeration thread
+enum
+{
+    SRUI_ITEMS_ADDED = (WM_APP + 1),    // The manager has items the list view doesn't show yet
+    SRUI_ENUMERATION_COMPLETE           // The enumeration thread with id wParam is done adding items
+};
+
+// The list view grows at most this often while items are being enumerated (ms)
+const ULONGLONG c_itemsAddedInterval = 100;
+
+struct EnumerateThreadData
+{
+    HWND hwnd = nullptr;
+    HANDLE cancelEvent = nullptr;
+    DWORD flags = 0;
+    std::vector<IStream*> dataObjectStreams;    // The data objects marshaled from the dialog thread
+    CComPtr<ISmartRenameManager> spsrm;
+};
+
 // IUnknown
 IFACEMETHODIMP CSmartRenameUI::QueryInterface(__in REFIID riid, __deref_out void** ppv)
 {
@@ -156,6 +175,21 @@ IFACEMETHODIMP CSmartRenameUI::get_showUI(_Out_ bool* showUI)
 // ISmartRenameManagerEvents
 IFACEMETHODIMP CSmartRenameUI::OnItemAdded(_In_ ISmartRenameItem*)
 {
+    return OnItemsAdded(0, 1);
+}
+
+IFACEMETHODIMP CSmartRenameUI::OnItemsAdded(_In_ UINT, _In_ UINT)
+{
+    // Items are added on the enumeration thread.  Post a single message for however
+    // many arrive before the dialog gets to it, and no more than one per interval,
+    // so the list grows in chunks.  The first items are posted right away.
+    ULONGLONG now = GetTickCount64();
+    if (now - m_itemsAddedTick >= c_itemsAddedInterval &&
+        InterlockedCompareExchange(&m_itemsAddedPosted, 1, 0) == 0)
+    {
+        m_itemsAddedTick = now;
+        PostMessage(m_hwnd, SRUI_ITEMS_ADDED, 0, 0);
+    }
     return S_OK;
 }
 
@@ -171,36 +205,46 @@ IFACEMETHODIMP CSmartRenameUI::OnUpdate(_In_ ISmartRenameItem*)
     return S_OK;
 }
 
+IFACEMETHODIMP CSmartRenameUI::OnItemsUpdated(_In_ UINT firstIndex, _In_ UINT count)
+{
+    if (count > 0)
+    {
+        m_listview.RedrawItems(firstIndex, firstIndex + count - 1);
+    }
+    _UpdateCounts();
+    return S_OK;
+}
+
 IFACEMETHODIMP CSmartRenameUI::OnError(_In_ ISmartRenameItem*)
 {
     return S_OK;
 }
 
-IFACEMETHODIMP CSmartRenameUI::OnRegExStarted(_In_ DWORD threadId)
+IFACEMETHODIMP CSmartRenameUI::OnRegExStarted(_In_ DWORD passId)
 {
-    m_disableCountUpdate = true;
-    m_currentRegExId = threadId;
+    m_currentRegExId = passId;
+    m_regExRunning = true;
     _UpdateCounts();
     return S_OK;
 }
 
-IFACEMETHODIMP CSmartRenameUI::OnRegExCanceled(_In_ DWORD threadId)
+IFACEMETHODIMP CSmartRenameUI::OnRegExCanceled(_In_ DWORD passId)
 {
-    if (m_currentRegExId == threadId)
+    if (m_currentRegExId == passId)
     {
-        m_disableCountUpdate = false;
         _UpdateCounts();
     }
 
     return S_OK;
 }
 
-IFACEMETHODIMP CSmartRenameUI::OnRegExCompleted(_In_ DWORD threadId)
+IFACEMETHODIMP CSmartRenameUI::OnRegExCompleted(_In_ DWORD passId)
 {
     // Enable list view
-    if (m_currentRegExId == threadId)
+    if (m_currentRegExId == passId)
     {
-        m_disableCountUpdate = false;
+        m_regExRunning = false;
+        _RefreshPreview();
         _UpdateCounts();
     }
     return S_OK;
@@ -226,6 +270,12 @@ IFACEMETHODIMP CSmartRenameUI::OnRenameCompleted()
 // IDropTarget
 IFACEMETHODIMP CSmartRenameUI::DragEnter(_In_ IDataObject* pdtobj, DWORD /* grfKeyState */, POINTL pt, _Inout_ DWORD* pdwEffect)
 {
+    if (m_enumThreadHandle)
+    {
+        // Only one drop is enumerated at a time
+        *pdwEffect = DROPEFFECT_NONE;
+    }
+
     if (m_spdth)
     {
         POINT ptT = { pt.x, pt.y };
@@ -237,6 +287,11 @@ IFACEMETHODIMP CSmartRenameUI::DragEnter(_In_ IDataObject* pdtobj, DWORD /* grfK
 
 IFACEMETHODIMP CSmartRenameUI::DragOver(DWORD /* grfKeyState */, POINTL pt, _Inout_ DWORD* pdwEffect)
 {
+    if (m_enumThreadHandle)
+    {
+        *pdwEffect = DROPEFFECT_NONE;
+    }
+
     if (m_spdth)
     {
         POINT ptT = { pt.x, pt.y };
@@ -258,18 +313,23 @@ IFACEMETHODIMP CSmartRenameUI::DragLeave()
 
 IFACEMETHODIMP CSmartRenameUI::Drop(_In_ IDataObject* pdtobj, DWORD, POINTL pt, _Inout_ DWORD* pdwEffect)
 {
+    if (m_enumThreadHandle)
+    {
+        *pdwEffect = DROPEFFECT_NONE;
+    }
+
     if (m_spdth)
     {
         POINT ptT = { pt.x, pt.y };
         m_spdth->Drop(pdtobj, &ptT, *pdwEffect);
     }
 
-    EnableWindow(GetDlgItem(m_hwnd, ID_RENAME), TRUE);
-    EnableWindow(m_hwndLV, TRUE);
-
     // Populate the manager from the data object
-    if (m_spsrm)
+    if (m_spsrm && !m_enumThreadHandle)
     {
+        EnableWindow(GetDlgItem(m_hwnd, ID_RENAME), TRUE);
+        EnableWindow(m_hwndLV, TRUE);
+
         _EnumerateItems(pdtobj);
     }
 
@@ -286,7 +346,13 @@ HRESULT CSmartRenameUI::_Initialize(_In_ ISmartRenameManager* psrm, _In_opt_ IDa
 
     m_enableDragDrop = enableDragDrop;
 
-    HRESULT hr = CoCreateInstance(CLSID_DragDropHelper, NULL, CLSCTX_INPROC, IID_PPV_ARGS(&m_spdth));
+    m_cancelEnumEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    HRESULT hr = m_cancelEnumEvent ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+    if (SUCCEEDED(hr))
+    {
+        hr = CoCreateInstance(CLSID_DragDropHelper, NULL, CLSCTX_INPROC, IID_PPV_ARGS(&m_spdth));
+    }
+
     if (SUCCEEDED(hr))
     {
         // Subscribe to smart rename manager events
@@ -343,6 +409,9 @@ HRESULT CSmartRenameUI::_InitAutoComplete()
 
 void CSmartRenameUI::_Cleanup()
 {
+    // Stop adding items before we stop listening for them
+    _CancelEnumeration();
+
     if (m_spsrm && m_cookie != 0)
     {
         m_spsrm->UnAdvise(m_cookie);
@@ -351,6 +420,7 @@ void CSmartRenameUI::_Cleanup()
     }
 
     m_spdo = nullptr;
+    m_dataObjects.clear();
     m_spdth = nullptr;
 
     if (m_enableDragDrop)
@@ -361,18 +431,185 @@ void CSmartRenameUI::_Cleanup()
 
 void CSmartRenameUI::_EnumerateItems(_In_ IDataObject* pdtobj)
 {
-    // Enumerate the data object and popuplate the manager
-    if (m_spsrm)
+    // Enumerate the data object on a background thread and popuplate the manager.
+    // The list view grows as the items arrive.
+    if (m_spsrm && !m_enumThreadHandle)
     {
-        m_disableCountUpdate = true;
-        EnumerateDataObject(pdtobj, m_spsrm);
-        m_disableCountUpdate = false;
+        // Keep the data object in case it has to be enumerated again
+        m_dataObjects.push_back(pdtobj);
+        _StartEnumeration(m_dataObjects.size() - 1);
+    }
+}
 
-        UINT itemCount = 0;
+void CSmartRenameUI::_ReenumerateItems()
+{
+    // The folders weren't listed while subfolders were excluded, so start over with
+    // everything dropped so far now that their contents are wanted
+    if (m_spsrm && m_enumeratedShallow)
+    {
+        _CancelEnumeration();
+        m_spsrm->Reset();
+        m_itemCount = 0;
+        m_listview.SetItemCount(0);
+        _StartEnumeration(0);
+    }
+}
+
+// Enumerates m_dataObjects from first on
+void CSmartRenameUI::_StartEnumeration(_In_ size_t first)
+{
+    EnumerateThreadData* petd = new EnumerateThreadData;
+    HRESULT hr = petd ? S_OK : E_OUTOFMEMORY;
+    if (SUCCEEDED(hr))
+    {
+        petd->hwnd = m_hwnd;
+        petd->cancelEvent = m_cancelEnumEvent;
+        petd->spsrm = m_spsrm;
+        m_spsrm->get_flags(&petd->flags);
+        for (size_t i = first; SUCCEEDED(hr) && i < m_dataObjects.size(); i++)
+        {
+            IStream* pstm = nullptr;
+            hr = CoMarshalInterThreadInterfaceInStream(IID_IDataObject, m_dataObjects[i], &pstm);
+            if (SUCCEEDED(hr))
+            {
+                petd->dataObjectStreams.push_back(pstm);
+            }
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            // Only the items enumerated with subfolders excluded need doing again
+            bool shallow = (petd->flags & ExcludeSubfolders) != 0;
+            m_enumeratedShallow = (first == 0) ? shallow : (m_enumeratedShallow || shallow);
+
+            ResetEvent(m_cancelEnumEvent);
+            m_itemsAddedTick = 0;
+            m_enumThreadHandle = CreateThread(nullptr, 0, s_enumerateThread, petd, 0, &m_enumThreadId);
+            hr = (m_enumThreadHandle) ? S_OK : E_FAIL;
+        }
+
+        if (FAILED(hr))
+        {
+            for (IStream* pstm : petd->dataObjectStreams)
+            {
+                pstm->Release();
+            }
+            delete petd;
+        }
+    }
+
+    // Rename stays disabled until every item has been added
+    _UpdateCounts();
+}
+
+DWORD WINAPI CSmartRenameUI::s_enumerateThread(_In_ void* pv)
+{
+    EnumerateThreadData* petd = reinterpret_cast<EnumerateThreadData*>(pv);
+    size_t unmarshaled = 0;
+    if (SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED)))
+    {
+        HRESULT hr = S_OK;
+        for (; unmarshaled < petd->dataObjectStreams.size(); unmarshaled++)
+        {
+            // Releases the stream whether or not it succeeds
+            CComPtr<IDataObject> spdo;
+            if (SUCCEEDED(CoGetInterfaceAndReleaseStream(petd->dataObjectStreams[unmarshaled], IID_PPV_ARGS(&spdo))) &&
+                hr != HRESULT_FROM_WIN32(ERROR_CANCELLED))
+            {
+                hr = EnumerateDataObject(spdo, petd->spsrm, petd->flags, petd->cancelEvent);
+            }
+        }
+
+        petd->spsrm = nullptr;
+        CoUninitialize();
+    }
+
+    for (; unmarshaled < petd->dataObjectStreams.size(); unmarshaled++)
+    {
+        petd->dataObjectStreams[unmarshaled]->Release();
+    }
+
+    PostMessage(petd->hwnd, SRUI_ENUMERATION_COMPLETE, GetCurrentThreadId(), 0);
+    delete petd;
+    return 0;
+}
+
+void CSmartRenameUI::_CancelEnumeration()
+{
+    if (m_enumThreadHandle)
+    {
+        SetEvent(m_cancelEnumEvent);
+        _WaitForEnumeration();
+    }
+}
+
+void CSmartRenameUI::_WaitForEnumeration()
+{
+    if (m_enumThreadHandle)
+    {
+        // The enumeration thread calls into the data object, which lives on this
+        // thread, so keep handling those calls while waiting for it.  That can
+        // dispatch its completion message, which must not wait again.
+        HANDLE enumThreadHandle = m_enumThreadHandle;
+        m_enumThreadHandle = nullptr;
+
+        DWORD index = 0;
+        CoWaitForMultipleHandles(0, INFINITE, 1, &enumThreadHandle, &index);
+        CloseHandle(enumThreadHandle);
+    }
+}
+
+void CSmartRenameUI::_OnItemsAdded()
+{
+    // Let the enumeration thread post again now that we have caught up
+    InterlockedExchange(&m_itemsAddedPosted, 0);
+
+    UINT itemCount = 0;
+    if (m_spsrm)
+    {
         m_spsrm->GetItemCount(&itemCount);
+    }
+
+    if (itemCount != m_itemCount)
+    {
+        m_itemCount = itemCount;
         m_listview.SetItemCount(itemCount);
 
-        _UpdateCounts();
+        // The new items need a preview pass of their own
+        m_previewPending = true;
+        _RefreshPreview();
+    }
+
+    _UpdateCounts();
+}
+
+void CSmartRenameUI::_OnEnumerationComplete(_In_ DWORD threadId)
+{
+    // A canceled enumeration may finish after the next one has started
+    if (threadId == m_enumThreadId)
+    {
+        _WaitForEnumeration();
+    }
+
+    // Pick up the items added since the last chunk was posted
+    _OnItemsAdded();
+}
+
+void CSmartRenameUI::_RefreshPreview()
+{
+    // Items added since the last preview pass are only previewed by the next one.
+    // Let the pass in flight finish rather than starting over for every chunk,
+    // otherwise a large enumeration would keep the preview from ever completing.
+    if (m_previewPending && !m_regExRunning && m_spsrm)
+    {
+        m_previewPending = false;
+
+        // Nothing is renamed without a search term so there is nothing to preview
+        if (GetWindowTextLength(GetDlgItem(m_hwnd, IDC_EDIT_SEARCHFOR)) > 0)
+        {
+            m_regExRunning = true;
+            m_spsrm->RefreshPreview();
+        }
     }
 }
 
@@ -569,6 +806,14 @@ INT_PTR CSmartRenameUI::_DlgProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
         _OnDestroyDlg();
         break;
 
+    case SRUI_ITEMS_ADDED:
+        _OnItemsAdded();
+        break;
+
+    case SRUI_ENUMERATION_COMPLETE:
+        _OnEnumerationComplete(static_cast<DWORD>(wParam));
+        break;
+
     default:
         bRet = FALSE;
     }
@@ -581,15 +826,16 @@ void CSmartRenameUI::_OnInitDlg()
 
     m_listview.Init(m_hwndLV);
 
+    // Initialize from stored settings.  Read them first since the flags decide how
+    // deep the enumeration goes.
+    _ReadSettings();
+
     if (m_spdo)
     {
         // Populate the manager from the data object
         _EnumerateItems(m_spdo);
     }
 
-    // Initialize from stored settings
-    _ReadSettings();
-
     // Load the main icon
     LoadIconWithScaleDown(g_hInst, MAKEINTRESOURCE(IDI_RENAME), 32, 32, &m_iconMain);
 
@@ -659,7 +905,10 @@ void CSmartRenameUI::_OnCommand(_In_ WPARAM wParam, _In_ LPARAM lParam)
         if (BN_CLICKED == HIWORD(wParam))
         {
             _ValidateFlagCheckbox(LOWORD(wParam));
-            _GetFlagsFromCheckboxes();
+            if (!(_GetFlagsFromCheckboxes() & ExcludeSubfolders))
+            {
+                _ReenumerateItems();
+            }
         }
         break;
     }
@@ -711,6 +960,13 @@ BOOL CSmartRenameUI::_OnNotify(_In_ WPARAM wParam, _In_ LPARAM lParam)
             }
             break;
 
+        case LVN_ODCACHEHINT:
+            if (m_spsrm)
+            {
+                m_listview.OnCacheHint(m_spsrm, (NMLVCACHEHINT*)pnmdr);
+            }
+            break;
+
         case NM_CLICK:
             {
                 if (m_spsrm)
@@ -875,13 +1131,8 @@ void CSmartRenameUI::_ValidateFlagCheckbox(_In_ DWORD checkBoxId)
 
 void CSmartRenameUI::_UpdateCounts()
 {
-    // This method is CPU intensive.  We disable it during certain operations
-    // for performance reasons.
-    if (m_disableCountUpdate)
-    {
-        return;
-    }
-
+    // The manager keeps both counts current so reading them is cheap, even for
+    // every chunk of items while the list is populated
     UINT selectedCount = 0;
     UINT renamingCount = 0;
     if (m_spsrm)
@@ -903,10 +1154,10 @@ void CSmartRenameUI::_UpdateCounts()
         wchar_t countsLabel[100] = { 0 };
         StringCchPrintf(countsLabel, ARRAYSIZE(countsLabel), countsLabelFormat, selectedCount, renamingCount);
         SetDlgItemText(m_hwnd, IDC_STATUS_MESSAGE, countsLabel);
-
-        // Update Rename button state
-        EnableWindow(GetDlgItem(m_hwnd, ID_RENAME), (renamingCount > 0));
     }
+
+    // Update Rename button state.  Wait for the enumeration so every item is renamed.
+    EnableWindow(GetDlgItem(m_hwnd, ID_RENAME), (renamingCount > 0) && !m_enumThreadHandle);
 }
 
 void CSmartRenameListView::Init(_In_ HWND hwndLV)
@@ -1032,29 +1283,37 @@ void CSmartRenameListView::UpdateItemCheckState(_In_ ISmartRenameManager* psrm,
 
 void CSmartRenameListView::GetDisplayInfo(_In_ ISmartRenameManager* psrm, _Inout_ LV_DISPINFO* plvdi)
 {
-    UINT count = 0;
-    psrm->GetItemCount(&count);
-    if (plvdi->item.iItem < 0 || plvdi->item.iItem > static_cast<int>(count))
+    if (plvdi->item.iItem < 0)
     {
         // Invalid index
         return;
     }
 
-    CComPtr<ISmartRenameItem> renameItem;
-    if (SUCCEEDED(psrm->GetItemByIndex((int)plvdi->item.iItem, &renameItem)))
+    // Read the row straight out of the manager rather than through an item, which
+    // would have to be created for every row painted
+    UINT index = static_cast<UINT>(plvdi->item.iItem);
+    bool wantText = (plvdi->item.mask & LVIF_TEXT) != 0;
+    SMARTRENAME_ITEM_DISPLAY display = {};
+    if (SUCCEEDED(psrm->GetItemDisplay(index, (plvdi->item.iSubItem == COL_NEW_NAME), &display, wantText ? plvdi->item.pszText : nullptr, wantText ? static_cast<UINT>(plvdi->item.cchTextMax) : 0)))
     {
         if (plvdi->item.mask & LVIF_IMAGE)
         {
-            renameItem->get_iconIndex(&plvdi->item.iImage);
+            plvdi->item.iImage = display.iconIndex;
+            if (display.iconIndex == -1)
+            {
+                // The icon is looked up the first time the item is asked for it
+                CComPtr<ISmartRenameItem> renameItem;
+                if (SUCCEEDED(psrm->GetItemByIndex(index, &renameItem)))
+                {
+                    renameItem->get_iconIndex(&plvdi->item.iImage);
+                }
+            }
         }
 
         if (plvdi->item.mask & LVIF_STATE)
         {
             plvdi->item.stateMask = LVIS_STATEIMAGEMASK;
-
-            bool isSelected = false;
-            renameItem->get_selected(&isSelected);
-            if (isSelected)
+            if (display.selected)
             {
                 // Turn check box on
                 plvdi->item.state = INDEXTOSTATEIMAGEMASK(2);
@@ -1068,40 +1327,23 @@ void CSmartRenameListView::GetDisplayInfo(_In_ ISmartRenameManager* psrm, _Inout
 
         if (plvdi->item.mask & LVIF_PARAM)
         {
-            int id = 0;
-            renameItem->get_id(&id);
-            plvdi->item.lParam = static_cast<LPARAM>(id);
+            plvdi->item.lParam = static_cast<LPARAM>(display.id);
         }
 
         if (plvdi->item.mask & LVIF_INDENT)
         {
-            UINT depth = 0;
-            renameItem->get_depth(&depth);
-            plvdi->item.iIndent = static_cast<int>(depth);
+            plvdi->item.iIndent = static_cast<int>(display.depth);
         }
+    }
+}
 
-        if (plvdi->item.mask & LVIF_TEXT)
-        {
-            PWSTR subItemText = nullptr;
-            if (plvdi->item.iSubItem == COL_ORIGINAL_NAME)
-            {
-                renameItem->get_originalName(&subItemText);
-            }
-            else if (plvdi->item.iSubItem == COL_NEW_NAME)
-            {
-                DWORD flags = 0;
-                psrm->get_flags(&flags);
-                bool shouldRename = false;
-                if (SUCCEEDED(renameItem->ShouldRenameItem(flags, &shouldRename)) && shouldRename)
-                {
-                    renameItem->get_newName(&subItemText);
-                }
-            }
-
-            StringCchCopy(plvdi->item.pszText, plvdi->item.cchTextMax, subItemText ? subItemText : L"");
-            CoTaskMemFree(subItemText);
-            subItemText = nullptr;
-        }
+void CSmartRenameListView::OnCacheHint(_In_ ISmartRenameManager* psrm, _In_ NMLVCACHEHINT* cacheHint)
+{
+    // The list view is about to ask for these rows so have the preview evaluate
+    // them before the rest of the items
+    if (cacheHint->iFrom >= 0 && cacheHint->iTo >= cacheHint->iFrom)
+    {
+        psrm->SetPriorityRange(static_cast<UINT>(cacheHint->iFrom), static_cast<UINT>(cacheHint->iTo - cacheHint->iFrom + 1));
     }
 }
 
@@ -1120,7 +1362,9 @@ void CSmartRenameListView::RedrawItems(_In_ int first, _In_ int last)
 
 void CSmartRenameListView::SetItemCount(_In_ UINT itemCount)
 {
-    ListView_SetItemCount(m_hwndLV, itemCount);
+    // The list grows while items are enumerated.  Keep the scroll position and
+    // only paint the rows that are new.
+    ListView_SetItemCountEx(m_hwndLV, itemCount, LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL);
 }
 
 void CSmartRenameListView::_UpdateColumns()
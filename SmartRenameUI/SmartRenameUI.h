@@ -1,6 +1,7 @@
 #pragma once
 #include <SmartRenameInterfaces.h>
 #include <shldisp.h>
+#include <vector>
 
 class CSmartRenameListView
 {
@@ -17,6 +18,7 @@ public:
     void OnKeyDown(_In_ ISmartRenameManager* psrm, _In_ LV_KEYDOWN* lvKeyDown);
     void OnClickList(_In_ ISmartRenameManager* psrm, NM_LISTVIEW* pnmListView);
     void GetDisplayInfo(_In_ ISmartRenameManager* psrm, _Inout_ LV_DISPINFO* plvdi);
+    void OnCacheHint(_In_ ISmartRenameManager* psrm, _In_ NMLVCACHEHINT* cacheHint);
     void OnSize();
     HWND GetHWND() { return m_hwndLV; }
 
@@ -54,11 +56,13 @@ public:
 
     // ISmartRenameManagerEvents
     IFACEMETHODIMP OnItemAdded(_In_ ISmartRenameItem* renameItem);
+    IFACEMETHODIMP OnItemsAdded(_In_ UINT firstIndex, _In_ UINT count);
     IFACEMETHODIMP OnUpdate(_In_ ISmartRenameItem* renameItem);
+    IFACEMETHODIMP OnItemsUpdated(_In_ UINT firstIndex, _In_ UINT count);
     IFACEMETHODIMP OnError(_In_ ISmartRenameItem* renameItem);
-    IFACEMETHODIMP OnRegExStarted(_In_ DWORD threadId);
-    IFACEMETHODIMP OnRegExCanceled(_In_ DWORD threadId);
-    IFACEMETHODIMP OnRegExCompleted(_In_ DWORD threadId);
+    IFACEMETHODIMP OnRegExStarted(_In_ DWORD passId);
+    IFACEMETHODIMP OnRegExCanceled(_In_ DWORD passId);
+    IFACEMETHODIMP OnRegExCompleted(_In_ DWORD passId);
     IFACEMETHODIMP OnRenameStarted();
     IFACEMETHODIMP OnRenameCompleted();
 
@@ -74,6 +78,10 @@ private:
     ~CSmartRenameUI()
     {
         DeleteObject(m_iconMain);
+        if (m_cancelEnumEvent)
+        {
+            CloseHandle(m_cancelEnumEvent);
+        }
         OleUninitialize();
     }
 
@@ -117,13 +125,25 @@ private:
     void _ValidateFlagCheckbox(_In_ DWORD checkBoxId);
 
     void _EnumerateItems(_In_ IDataObject* pdtobj);
+    void _ReenumerateItems();
+    void _StartEnumeration(_In_ size_t first);
+    void _CancelEnumeration();
+    void _WaitForEnumeration();
+    void _OnItemsAdded();
+    void _OnEnumerationComplete(_In_ DWORD threadId);
+    void _RefreshPreview();
     void _UpdateCounts();
 
+    // Thread proc that enumerates data objects into the manager
+    static DWORD WINAPI s_enumerateThread(_In_ void* pv);
+
     long m_refCount = 0;
     bool m_initialized = false;
     bool m_enableDragDrop = false;
-    bool m_disableCountUpdate = false;
     bool m_modeless = true;
+    bool m_regExRunning = false;
+    bool m_previewPending = false;      // Items were added since the last preview pass
+    bool m_enumeratedShallow = false;   // Folders were left unlisted because subfolders were excluded
     HWND m_hwnd = nullptr;
     HWND m_hwndLV = nullptr;
     HICON m_iconMain = nullptr;
@@ -131,12 +151,19 @@ private:
     DWORD m_currentRegExId = 0;
     UINT m_selectedCount = 0;
     UINT m_renamingCount = 0;
+    UINT m_itemCount = 0;               // Items the list view shows
     int m_initialWidth = 0;
     int m_initialHeight = 0;
     int m_lastWidth = 0;
     int m_lastHeight = 0;
+    HANDLE m_enumThreadHandle = nullptr;
+    DWORD m_enumThreadId = 0;
+    HANDLE m_cancelEnumEvent = nullptr;
+    volatile LONG m_itemsAddedPosted = 0;
+    ULONGLONG m_itemsAddedTick = 0;     // Only used by the enumeration thread
     CComPtr<ISmartRenameManager> m_spsrm;
     CComPtr<IDataObject> m_spdo;
+    std::vector<CComPtr<IDataObject>> m_dataObjects;   // Everything enumerated so far, in order
     CComPtr<IDropTargetHelper> m_spdth;
     CComPtr<IAutoComplete2> m_spSearchAC;
     CComPtr<IUnknown> m_spSearchACL;